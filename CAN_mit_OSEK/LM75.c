@@ -7,6 +7,24 @@
 
 #include "LM75.h" 
 #include "TWI.h"
+#include "Trace.h"
+
+#define LM75_REG_TEMP	0x00		/* Pointer-Register: Temperatur */
+
+/* Asynchrones Auslesen: Empfangspuffer, Status und zu weckende Task */
+static const uint8_t lm75_pointer = LM75_REG_TEMP;
+static uint8_t lm75_data[2];
+static volatile uint8_t lm75_status = TWI_ERROR;
+static TaskType lm75_task;
+static EventMaskType lm75_mask;
+
+/* 11 Bit Festkommazahl aus MSB und LSB des Temperaturregisters */
+static uint16_t LM75_convert(uint8_t m, uint8_t l)
+{
+	uint16_t temp = m * 256 + l;
+
+	return temp >> 5;
+}
 
 /* Initialisierung des Temperaturmoduls zur Temperaturmessung */
 void LM75_init(void)
@@ -28,10 +46,37 @@ uint16_t  ReadTemp(void)
 		TWI_write(0x00);
 		TWI_start();
 		TWI_write(DEV_LM75 + I2C_READ);
-		m = TWI_readAck();
-		l = TWI_readNak();
-		TWI_stop();
-		temp = m * 256 + l;
-		temp = temp >> 5;
+		m = TWI_readAck();
+		l = TWI_readNak();
+		TWI_stop();
+		temp = LM75_convert(m, l);
 		return temp;
+}
+
+/* Rueckruf aus dem TWI-ISR */
+static void LM75_done(uint8_t status)
+{
+	lm75_status = status;
+	TRACE_TWI_DONE(status);
+	SetEvent(lm75_task, lm75_mask);
+}
+
+uint8_t LM75_start_read(TaskType task, EventMaskType mask)
+{
+	if (TWI_is_busy()) {
+		return TWI_BUSY;
+	}
+	lm75_task = task;
+	lm75_mask = mask;
+	lm75_status = TWI_BUSY;
+	return TWI_transfer_async(DEV_LM75, &lm75_pointer, 1, lm75_data, sizeof(lm75_data), LM75_done);
+}
+
+uint8_t LM75_result(uint16_t *temp)
+{
+	if (lm75_status != TWI_OK) {
+		return 0;
+	}
+	*temp = LM75_convert(lm75_data[0], lm75_data[1]);
+	return 1;
 }
\ No newline at end of file
@@ -9,6 +9,7 @@
 #define LM75_H_
 
 #include <inttypes.h>
+#include "Os.h"
 
 //---------------------------------------------------------------------------------------------
 /* Initialisierung des Temperaturmoduls zur Temperaturmessung */
@@ -17,5 +18,14 @@ void LM75_init(void);
 /* Auslesen der Temperatur als 11 Bit Festkommazahl mit LSB = 2^(?3) */
 uint16_t  ReadTemp(void);
 //---------------------------------------------------------------------------------------------
+/* Temperatur im Hintergrund auslesen (TWI-ISR, siehe TWI_transfer_async()).
+   Am Ende wird SetEvent(task, mask) aufgerufen, danach liefert LM75_result()
+   den Wert. Rueckgabe TWI_OK oder TWI_BUSY. */
+uint8_t LM75_start_read(TaskType task, EventMaskType mask);
+//---------------------------------------------------------------------------------------------
+/* Ergebnis des letzten LM75_start_read() wie ReadTemp(). Rueckgabe 0, wenn die
+   Uebertragung fehlgeschlagen ist (temp bleibt dann unveraendert). */
+uint8_t LM75_result(uint16_t *temp);
+//---------------------------------------------------------------------------------------------
 
 #endif /* LM75_H_ */
\ No newline at end of file
@@ -0,0 +1,62 @@
+/*
+ * OsStack.c
+ *
+ * High-Water-Mark der Task-Stacks, siehe OsStack.h.
+ */
+
+#include "OsStack.h"
+
+/* Stack-Speicher und Konfiguration aus Os_Cfg.c */
+extern unsigned char OsTaskSB[];
+extern TaskControlBlockT OsTaskCB[];
+extern OsConfigT OsCfg;
+
+void OsStack_Paint(void)
+{
+	uint16_t size = (OsCfg.stackSize + 2) * OsCfg.numberOfTasks + 2;
+
+	for (uint16_t i = 0; i < size; i++) {
+		OsTaskSB[i] = OS_STACK_PAINT;
+	}
+}
+
+uint8_t OsStack_Free(TaskType task)
+{
+	const unsigned char *p;
+	uint8_t n = 0;
+
+	if (task >= OsCfg.numberOfTasks) {
+		return 0;
+	}
+	// unterstes Byte ueber den Schutzbytes, nach oben bis zum ersten benutzten
+	p = &OsTaskSB[task * (OsCfg.stackSize + 2) + 2];
+	while (n < OsCfg.stackSize && p[n] == OS_STACK_PAINT) {
+		n++;
+	}
+	return n;
+}
+
+uint8_t OsStack_Check(void)
+{
+	const unsigned char *p = OsTaskSB;
+
+	// Schutzbytes unten in jedem Bereich und hinter dem letzten
+	for (TaskType task = 0; task <= OsCfg.numberOfTasks; task++) {
+		if (p[0] != OS_STACK_GUARD || p[1] != OS_STACK_GUARD) {
+			return 0;
+		}
+		if (task < OsCfg.numberOfTasks && OsTaskCB[task].stack != p) {
+			return 0;
+		}
+		p += OsCfg.stackSize + 2;
+	}
+	return 1;
+}
+
+uint8_t OsStack_HighWater(TaskType task)
+{
+	if (task >= OsCfg.numberOfTasks) {
+		return 0;
+	}
+	return OsCfg.stackSize - OsStack_Free(task);
+}
@@ -0,0 +1,48 @@
+/*
+ * OsStack.h
+ *
+ * Hoechster Stand (High-Water-Mark) der Task-Stacks. OsStack_Paint() fuellt
+ * vor StartOS() den ganzen Stack-Speicher OsTaskSB mit einem Muster; spaeter
+ * zeigt das erste ueberschriebene Byte, wie tief der Stack einer Task schon
+ * war (einschliesslich der ISRs, die auf ihm gelaufen sind).
+ *
+ * Aufteilung von OsTaskSB durch StartOS() (aus dem Listing von libOsekAvr.a):
+ * je Task OS_STACK_SIZE_PER_TASK + 2 Bytes, unten zwei Schutzbytes 0xAA,
+ * darueber der Stack, der vom obersten Byte nach unten waechst; am Ende zwei
+ * weitere Schutzbytes. Die Groesse ist fuer alle Tasks gleich und im OS fest
+ * eingebaut; eine eigene Groesse je Task liesse sich nur mit den Quellen des
+ * OS einstellen. Mit den Messwerten kann aber OS_STACK_SIZE_PER_TASK auf den
+ * groessten Bedarf aller Tasks (plus Reserve) verkleinert werden.
+ *
+ * Die Aufteilung stammt nur aus dem Listing; OsStack_Check() prueft sie nach
+ * StartOS() an den Schutzbytes und an OsTaskCB[].stack. Stimmt sie nicht
+ * (andere Version der Bibliothek), messen OsStack_Free() und
+ * OsStack_HighWater() an der falschen Stelle.
+ */
+
+#ifndef OSSTACK_H_
+#define OSSTACK_H_
+
+#include <inttypes.h>
+#include "Os.h"
+
+/* Muster fuer unbenutzten Stack (verschieden von den Schutzbytes) */
+#define OS_STACK_PAINT 0xc5
+/* Schutzbytes, die StartOS() schreibt und Os_CheckStackCorruption() prueft */
+#define OS_STACK_GUARD 0xaa
+
+//---------------------------------------------------------------------------------------------
+/* Stack-Speicher aller Tasks mit OS_STACK_PAINT fuellen, nur vor StartOS() */
+void OsStack_Paint(void);
+//---------------------------------------------------------------------------------------------
+/* Groesste bisher benutzte Stacktiefe der Task in Bytes */
+uint8_t OsStack_HighWater(TaskType task);
+//---------------------------------------------------------------------------------------------
+/* Bytes, die der Task bisher nie gebraucht hat (0 = Stack war voll) */
+uint8_t OsStack_Free(TaskType task);
+//---------------------------------------------------------------------------------------------
+/* Aufteilung von OsTaskSB pruefen, nach StartOS(): 1 = wie oben beschrieben */
+uint8_t OsStack_Check(void);
+//---------------------------------------------------------------------------------------------
+
+#endif /* OSSTACK_H_ */
@@ -0,0 +1,421 @@
+/*
+ * OsStat.c
+ *
+ * Ausfuehrungs- und Antwortzeiten der Tasks, siehe OsStat.h.
+ */
+
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <avr/pgmspace.h>
+
+#include "OsStat.h"
+
+#if OS_STAT_ENABLE
+
+#include "OsStack.h"
+#include "Trace.h"
+#include "UsartTx.h"
+
+#ifndef F_CPU
+#define F_CPU 3686400
+#endif
+
+/* Konfiguration des OS aus Os_Cfg.c (Os_Cfg.h kann hier nicht eingebunden
+ * werden, es legt die Tabellen des OS an) */
+extern OsConfigT OsCfg;
+
+static OsStatTaskT os_stat[OS_STAT_TASKS];
+
+volatile uint32_t os_stat_idle;
+
+/* Ticks seit OsStat_Reset(), in OsStat_Poll() nachgefuehrt */
+static uint32_t os_stat_elapsed;
+static TickType os_stat_elapsed_tick;
+
+/* Timer 1: Vorteiler, Takte je OS-Tick und Startwert nach dem Ueberlauf */
+static uint16_t os_stat_prescaler;
+static uint16_t os_stat_counts;
+static uint16_t os_stat_reload;
+
+/* Ausgabe: naechste Zeile (0, 1 = Kopf, 2.. = Task 0.., OS_STAT_TASKS + 2 =
+ * Leerlauf), OS_STAT_TASKS + 3 = fertig */
+static uint8_t os_stat_line = OS_STAT_TASKS + 3;
+
+/* Zeilenpuffer fuer OsStat_Poll(): statisch, nicht auf dem Stack der Task
+ * (OS_STACK_SIZE_PER_TASK). Laengste Zeile 62 Zeichen und die 0. */
+static char os_stat_text[64];
+
+static const char os_stat_header[2][64] PROGMEM = {
+	"                 Ausfuehrung [us]          Antwort [us]  Byte\n",
+	"Task Anzahl     min mittel    max     min mittel    max Stack\n"
+};
+static const char os_stat_idle_text[] PROGMEM = "Leerlauf";
+static const char os_stat_idle_unit[] PROGMEM = " Durchlaeufe/s\n";
+
+//---------------------------------------------------------------------------------------------
+void OsStat_Init(void)
+{
+	static const uint16_t prescaler[8] PROGMEM = { 0, 1, 8, 64, 256, 1024, 0, 0 };
+
+	os_stat_prescaler = pgm_read_word(&prescaler[TCCR1B & 0x07]);
+	if (os_stat_prescaler != 0) {
+		os_stat_counts = (uint32_t)(F_CPU / os_stat_prescaler) * OsCfg.tickDuration / 1000;
+	}
+	os_stat_reload = 0 - os_stat_counts;
+	OsStat_Reset();
+}
+
+void OsStat_Reset(void)
+{
+	uint8_t sreg = SREG;
+
+	cli();
+	for (uint8_t i = 0; i < OS_STAT_TASKS; i++) {
+		os_stat[i].count = 0;
+		os_stat[i].execMin = 0xffff;
+		os_stat[i].execMax = 0;
+		os_stat[i].execSum = 0;
+		os_stat[i].respCount = 0;
+		os_stat[i].respMin = 0xffff;
+		os_stat[i].respMax = 0;
+		os_stat[i].respSum = 0;
+	}
+	os_stat_idle = 0;
+	os_stat_elapsed = 0;
+	os_stat_elapsed_tick = Os_GetSytemCounter();
+	SREG = sreg;
+}
+
+//---------------------------------------------------------------------------------------------
+/* Aktueller OS-Tick und Takte von Timer 1 seit diesem Tick. Ist der Ueberlauf
+ * schon da, aber noch nicht vom OS bearbeitet, zaehlt Timer 1 bereits im
+ * naechsten Tick ab 0. */
+static TickType OsStat_Now(uint16_t *sub)
+{
+	uint8_t sreg = SREG;
+	TickType tick;
+	uint16_t tcnt;
+
+	cli();
+	tick = Os_GetSytemCounter();
+	tcnt = TCNT1;
+	if ((TIFR1 & (1 << TOV1)) && tcnt < os_stat_reload) {
+		tick++;
+		*sub = tcnt;
+	}
+	else {
+		*sub = tcnt - os_stat_reload;
+	}
+	SREG = sreg;
+	return tick;
+}
+
+static uint32_t OsStat_Since(TickType tick, uint16_t sub, TickType now, uint16_t now_sub)
+{
+	return (uint32_t)(TickType)(now - tick) * os_stat_counts + now_sub - sub;
+}
+
+static uint16_t OsStat_Saturate(uint32_t counts)
+{
+	return (counts > 0xffff) ? 0xffff : counts;
+}
+
+//---------------------------------------------------------------------------------------------
+void OsStat_Activate(TaskType task)
+{
+	OsStatTaskT *s;
+
+	if (task >= OS_STAT_TASKS) {
+		return;
+	}
+	s = &os_stat[task];
+	if (s->flags & OS_STAT_ACTIVATED) {
+		return;
+	}
+	s->activation = OsStat_Now(&s->activationSub);
+	s->flags |= OS_STAT_ACTIVATED | OS_STAT_BY_ISR;
+}
+
+void OsStat_ActivateAlarm(TaskType task, AlarmType alarm, TickType cycle)
+{
+	OsStatTaskT *s;
+	uint8_t sreg = SREG;
+	TickType now, ticks, fired;
+
+	if (task >= OS_STAT_TASKS) {
+		return;
+	}
+	s = &os_stat[task];
+	/* GetAlarm() gibt die Interrupts frei: wiederholen, falls dabei ein Tick kam */
+	do {
+		cli();
+		now = Os_GetSytemCounter();
+		SREG = sreg;
+		if (GetAlarm(alarm, &ticks) != E_OK) {
+			return;
+		}
+		cli();
+	} while (now != Os_GetSytemCounter());
+
+	/* Der Tick-ISR hat den Alarm zu Beginn dieses Ticks bearbeitet (Timer 1 bei 0) */
+	fired = now + ticks - cycle;
+	if (!(s->flags & OS_STAT_ACTIVATED) || (int16_t)(TickType)(fired - s->activation) <= 0) {
+		s->activation = fired;
+		s->activationSub = 0;
+	}
+	s->flags |= OS_STAT_ACTIVATED | OS_STAT_BY_ISR;
+	SREG = sreg;
+}
+
+void OsStat_TaskBegin(TaskType task)
+{
+	OsStatTaskT *s;
+	uint8_t sreg = SREG;
+
+	if (task >= OS_STAT_TASKS) {
+		return;
+	}
+	s = &os_stat[task];
+	cli();
+	s->startTick = OsStat_Now(&s->startSub);
+	if (s->flags & OS_STAT_ACTIVATED) {
+		s->flags = (s->flags & ~OS_STAT_ACTIVATED) | OS_STAT_RESPONSE;
+	}
+	else if (s->flags & OS_STAT_BY_ISR) {
+		s->flags &= ~OS_STAT_RESPONSE;
+	}
+	else {
+		s->activation = s->startTick;
+		s->activationSub = 0;
+		s->flags |= OS_STAT_RESPONSE;
+	}
+	SREG = sreg;
+	s->execAcc = 0;
+}
+
+void OsStat_WaitBegin(TaskType task)
+{
+	OsStatTaskT *s;
+	TickType now;
+	uint16_t sub;
+
+	if (task >= OS_STAT_TASKS) {
+		return;
+	}
+	s = &os_stat[task];
+	now = OsStat_Now(&sub);
+	s->execAcc += OsStat_Since(s->startTick, s->startSub, now, sub);
+}
+
+void OsStat_WaitEnd(TaskType task)
+{
+	OsStatTaskT *s;
+
+	if (task >= OS_STAT_TASKS) {
+		return;
+	}
+	s = &os_stat[task];
+	s->startTick = OsStat_Now(&s->startSub);
+}
+
+void OsStat_TaskEnd(TaskType task)
+{
+	OsStatTaskT *s;
+	TickType now;
+	uint16_t sub, exec, resp;
+
+	if (task >= OS_STAT_TASKS) {
+		return;
+	}
+	s = &os_stat[task];
+	now = OsStat_Now(&sub);
+	exec = OsStat_Saturate(s->execAcc + OsStat_Since(s->startTick, s->startSub, now, sub));
+	resp = OsStat_Saturate(OsStat_Since(s->activation, s->activationSub, now, sub));
+
+	if (s->count == 0xffff) {
+		return;
+	}
+	s->count++;
+	if (exec < s->execMin) {
+		s->execMin = exec;
+	}
+	if (exec > s->execMax) {
+		s->execMax = exec;
+	}
+	s->execSum += exec;
+	if (!(s->flags & OS_STAT_RESPONSE)) {
+		return;
+	}
+	s->respCount++;
+	if (resp < s->respMin) {
+		s->respMin = resp;
+	}
+	if (resp > s->respMax) {
+		s->respMax = resp;
+	}
+	s->respSum += resp;
+}
+
+const OsStatTaskT* OsStat_Get(TaskType task)
+{
+	return (task < OS_STAT_TASKS) ? &os_stat[task] : 0;
+}
+
+uint32_t OsStat_ToMicroseconds(uint32_t counts)
+{
+	/* Mikrosekunden je Takt * 256; F_CPU / 256 haelt das Produkt in 32 Bit */
+	uint32_t us_q8 = ((uint32_t)os_stat_prescaler * 1000000UL + F_CPU / 512) / (F_CPU / 256);
+
+	return (counts * us_q8 + 128) >> 8;
+}
+
+/* Der Systemzaehler laeuft nach 65536 Ticks ueber (bei 1 ms nach gut einer
+ * Minute), deshalb die vergangenen Ticks bei jedem Aufruf aufsummieren */
+static uint32_t OsStat_Elapsed(void)
+{
+	uint8_t sreg = SREG;
+	TickType now;
+
+	cli();
+	now = Os_GetSytemCounter();
+	os_stat_elapsed += (TickType)(now - os_stat_elapsed_tick);
+	os_stat_elapsed_tick = now;
+	SREG = sreg;
+	return os_stat_elapsed;
+}
+
+uint32_t OsStat_IdlePerSecond(void)
+{
+	uint8_t sreg = SREG;
+	uint32_t idle, ms;
+
+	cli();
+	idle = os_stat_idle;
+	SREG = sreg;
+
+	/* ganze Ticks genuegen */
+	ms = OsStat_Elapsed() * OsCfg.tickDuration;
+	if (ms == 0) {
+		return 0;
+	}
+	/* idle * 1000 / ms ohne Ueberlauf */
+	return idle / ms * 1000 + idle % ms * 1000 / ms;
+}
+
+//---------------------------------------------------------------------------------------------
+static char* OsStat_Number(char *p, uint32_t value, uint8_t width)
+{
+	char digits[10];
+	uint8_t n = 0;
+
+	do {
+		digits[n++] = '0' + value % 10;
+		value /= 10;
+	} while (value);
+	while (width-- > n) {
+		*p++ = ' ';
+	}
+	while (n) {
+		*p++ = digits[--n];
+	}
+	return p;
+}
+
+static char* OsStat_String_P(char *p, const char *text_P)
+{
+	char c;
+
+	while ((c = pgm_read_byte(text_P++)) != '\0') {
+		*p++ = c;
+	}
+	return p;
+}
+
+static char* OsStat_Spaces(char *p, uint8_t n)
+{
+	while (n--) {
+		*p++ = ' ';
+	}
+	return p;
+}
+
+/* Eine Zeile der Tabelle in line schreiben, Zeiten in us, Stack in Byte
+ * (High-Water-Mark aus OsStack.h) */
+static void OsStat_Line(char *line, uint8_t task)
+{
+	const OsStatTaskT *s = &os_stat[task];
+	char *p = line;
+
+	p = OsStat_Number(p, task, 4);
+	p = OsStat_Number(p, s->count, 7);
+	if (s->count) {
+		p = OsStat_Number(p, OsStat_ToMicroseconds(s->execMin), 8);
+		p = OsStat_Number(p, OsStat_ToMicroseconds(s->execSum / s->count), 7);
+		p = OsStat_Number(p, OsStat_ToMicroseconds(s->execMax), 7);
+	}
+	else {
+		p = OsStat_Spaces(p, 8 + 7 + 7);
+	}
+	if (s->respCount) {
+		p = OsStat_Number(p, OsStat_ToMicroseconds(s->respMin), 8);
+		p = OsStat_Number(p, OsStat_ToMicroseconds(s->respSum / s->respCount), 7);
+		p = OsStat_Number(p, OsStat_ToMicroseconds(s->respMax), 7);
+	}
+	else {
+		p = OsStat_Spaces(p, 8 + 7 + 7);
+	}
+	// Stack auch fuer Tasks ohne Messung (IdleTask, StartUpTask)
+	p = OsStat_Number(p, OsStack_HighWater(task), 6);
+	*p++ = '\n';
+	*p = '\0';
+}
+
+void OsStat_Poll(void)
+{
+	char *line = os_stat_text;
+	uint8_t length = 0;
+	unsigned char c;
+
+	OsStat_Elapsed();
+	if (USART_GetChar(&c) == E_OK) {
+		if (c == 's') {
+			os_stat_line = 0;
+		}
+		else if (c == 'r') {
+			OsStat_Reset();
+		}
+	}
+
+	if (os_stat_line > OS_STAT_TASKS + 2) {
+		return;
+	}
+	if (os_stat_line < 2) {
+		OsStat_String_P(line, os_stat_header[os_stat_line])[0] = '\0';
+	}
+	else if (os_stat_line < OS_STAT_TASKS + 2) {
+		OsStat_Line(line, os_stat_line - 2);
+	}
+	else {
+		char *p = OsStat_String_P(line, os_stat_idle_text);
+
+		p = OsStat_Number(p, OsStat_IdlePerSecond(), 11);
+		p = OsStat_String_P(p, os_stat_idle_unit);
+		*p = '\0';
+	}
+	// erst senden, wenn die Zeile (und die 0 dahinter) ganz hineinpasst, damit
+	// nichts als verworfen gezaehlt wird
+	while (line[length]) {
+		length++;
+	}
+	if (USART_TxFree() > length && USART_TryPutString(line) == E_OK) {
+#if TRACE_ENABLE
+		/* Text vom folgenden Trace-Datensatz trennen (tools/trace_decode.py) */
+		static const unsigned char end = 0;
+
+		USART_TryWrite(&end, 1);
+#endif
+		os_stat_line++;
+	}
+}
+
+#endif /* OS_STAT_ENABLE */
@@ -0,0 +1,138 @@
+/*
+ * OsStat.h
+ *
+ * Ausfuehrungs- und Antwortzeiten der Tasks. Das OS der Bibliothek kennt keine
+ * PreTaskHook/PostTaskHook, deshalb stehen OS_STAT_TASK_BEGIN() und
+ * OS_STAT_TASK_END() am Anfang bzw. vor TerminateTask() jeder Task, bei
+ * Extended Tasks zusaetzlich OS_STAT_WAIT_BEGIN()/OS_STAT_WAIT_END() um
+ * WaitEvent(), damit die Wartezeit nicht als Ausfuehrungszeit zaehlt.
+ *
+ * Zeitbasis ist der Systemzaehler des OS (Os_GetSytemCounter()) zusammen mit
+ * dem Stand von Timer/Counter 1 innerhalb des Ticks; einen weiteren Timer
+ * braucht es nicht. Die Aufloesung ist der Vorteiler von Timer 1 / F_CPU.
+ *
+ * - Ausfuehrungszeit: Summe der Zeiten, in denen die Task lief (einschliesslich
+ *   der ISRs, die sie dabei unterbrochen haben), von BEGIN bis END
+ * - Antwortzeit: von der Aktivierung bis END. Meldet ein ISR das Ereignis, auf
+ *   das die Task reagiert, mit OS_STAT_ACTIVATE() (z.B. Task1 beim Empfang im
+ *   INT0-ISR, SwTimer.c beim Ablauf eines Software-Timers), zaehlt die
+ *   Antwortzeit ab dem ersten ACTIVATE vor BEGIN, und Laeufe ohne ACTIVATE
+ *   gehen nur in die Ausfuehrungszeit ein. Aktiviert ein Alarm des OS die Task
+ *   direkt, traegt OS_STAT_ALARM() vor BEGIN den Tick nach, in dem er zuletzt
+ *   ablief. Ohne beides zaehlt sie ab dem Tick von BEGIN.
+ *
+ * Je Task werden Anzahl, Minimum, Mittelwert und Maximum gesammelt. Mit
+ * OS_STAT_IDLE() in der Schleife der IdleTask kommt die Zahl der Durchlaeufe
+ * je Sekunde dazu: ohne Schlafen ein Mass fuer die freie Rechenzeit, mit
+ * OsTick_Idle() (OsTick.h) die Zahl der Aufwachvorgaenge. Mit OS_STAT_POLL() (in
+ * einer zyklischen Task) gibt ein 's' auf der USART die Tabelle (mit dem
+ * Stackbedarf aus OsStack.h) aus, ein 'r' setzt sie zurueck.
+ * Mit OS_STAT_ENABLE 0 verschwinden alle Makros. Das ist die Voreinstellung:
+ * Messwerte und Zeilenpuffer belegen auf dem ATmega88PA rund 210 Byte RAM,
+ * zum Messen mit -DOS_STAT_ENABLE=1 uebersetzen.
+ */
+
+#ifndef OSSTAT_H_
+#define OSSTAT_H_
+
+#include <inttypes.h>
+#include "Os.h"
+
+#ifndef OS_STAT_ENABLE
+#define OS_STAT_ENABLE 0
+#endif
+
+/* Anzahl Task-IDs, fuer die Speicher angelegt wird (mindestens NUMBER_OF_TASKS) */
+#ifndef OS_STAT_TASKS
+#define OS_STAT_TASKS 4
+#endif
+
+#if OS_STAT_ENABLE
+
+/* Messwerte einer Task in Takten von Timer 1 */
+typedef struct
+{
+	uint16_t count;
+	uint16_t execMin, execMax;
+	uint32_t execSum;
+	uint16_t respCount;
+	uint16_t respMin, respMax;
+	uint32_t respSum;
+
+	/* laufende Aktivierung */
+	TickType activation;
+	uint16_t activationSub;
+	TickType startTick;
+	uint16_t startSub;
+	uint32_t execAcc;
+	uint8_t flags;				/* OS_STAT_... */
+} OsStatTaskT;
+
+#define OS_STAT_ACTIVATED	0x01	/* OsStat_Activate() seit BEGIN */
+#define OS_STAT_BY_ISR		0x02	/* Task wird ueber OsStat_Activate() gemessen */
+#define OS_STAT_RESPONSE	0x04	/* laufende Aktivierung hat eine Antwortzeit */
+
+/* Durchlaeufe der IdleTask seit OsStat_Reset() */
+extern volatile uint32_t os_stat_idle;
+
+//---------------------------------------------------------------------------------------------
+/* Vorteiler von Timer 1 ermitteln (nach StartOS(), z.B. in der StartUpTask) */
+void OsStat_Init(void);
+//---------------------------------------------------------------------------------------------
+/* Aktivierung der Task durch einen ISR vermerken (mit gesperrten Interrupts
+   aufrufen) */
+void OsStat_Activate(TaskType task);
+/* Aktivierung durch den zyklischen Alarm alarm (Periode cycle Ticks) nachtragen,
+   in der Task vor OsStat_TaskBegin(). Laeuft die Task erst mehr als eine Periode
+   nach dem Alarm, zaehlt der letzte Ablauf. */
+void OsStat_ActivateAlarm(TaskType task, AlarmType alarm, TickType cycle);
+void OsStat_TaskBegin(TaskType task);
+void OsStat_TaskEnd(TaskType task);
+void OsStat_WaitBegin(TaskType task);
+void OsStat_WaitEnd(TaskType task);
+//---------------------------------------------------------------------------------------------
+/* Alle Messwerte loeschen */
+void OsStat_Reset(void);
+//---------------------------------------------------------------------------------------------
+/* Messwerte einer Task (NULL bei ungueltiger ID) */
+const OsStatTaskT* OsStat_Get(TaskType task);
+//---------------------------------------------------------------------------------------------
+/* Takte von Timer 1 in Mikrosekunden */
+uint32_t OsStat_ToMicroseconds(uint32_t counts);
+//---------------------------------------------------------------------------------------------
+/* Durchlaeufe der IdleTask je Sekunde seit OsStat_Reset() */
+uint32_t OsStat_IdlePerSecond(void);
+//---------------------------------------------------------------------------------------------
+/* Befehle von der USART lesen ('s' = Tabelle ausgeben, 'r' = zuruecksetzen)
+   und eine laufende Ausgabe fortsetzen: je Aufruf hoechstens eine Zeile und
+   nur, wenn sie ganz in den Sendepuffer passt. */
+void OsStat_Poll(void);
+//---------------------------------------------------------------------------------------------
+
+#define OS_STAT_INIT()			OsStat_Init()
+#define OS_STAT_ACTIVATE(task)		OsStat_Activate(task)
+#define OS_STAT_ALARM(task, alarm, cycle)	OsStat_ActivateAlarm(task, alarm, cycle)
+#define OS_STAT_TASK_BEGIN(task)	OsStat_TaskBegin(task)
+#define OS_STAT_TASK_END(task)		OsStat_TaskEnd(task)
+#define OS_STAT_WAIT_BEGIN(task)	OsStat_WaitBegin(task)
+#define OS_STAT_WAIT_END(task)		OsStat_WaitEnd(task)
+#define OS_STAT_POLL()			OsStat_Poll()
+
+/* 32-Bit-Zaehler, die IdleTask kann von jedem Interrupt unterbrochen werden */
+#define OS_STAT_IDLE()			do { cli(); os_stat_idle++; sei(); } while (0)
+
+#else
+
+#define OS_STAT_INIT()
+#define OS_STAT_ACTIVATE(task)
+#define OS_STAT_ALARM(task, alarm, cycle)
+#define OS_STAT_TASK_BEGIN(task)
+#define OS_STAT_TASK_END(task)
+#define OS_STAT_WAIT_BEGIN(task)
+#define OS_STAT_WAIT_END(task)
+#define OS_STAT_POLL()
+#define OS_STAT_IDLE()
+
+#endif /* OS_STAT_ENABLE */
+
+#endif /* OSSTAT_H_ */
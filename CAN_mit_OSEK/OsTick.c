@@ -0,0 +1,22 @@
+/*
+ * OsTick.c
+ *
+ * Schlafen in der IdleTask, siehe OsTick.h.
+ */
+
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <avr/sleep.h>
+
+#include "OsTick.h"
+
+//---------------------------------------------------------------------------------------------
+void OsTick_Idle(void)
+{
+	set_sleep_mode(SLEEP_MODE_IDLE);
+	cli();
+	sleep_enable();
+	sei();
+	sleep_cpu();								/* der Befehl nach sei() laeuft noch vor dem ersten Interrupt */
+	sleep_disable();
+}
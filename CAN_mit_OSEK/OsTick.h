@@ -0,0 +1,25 @@
+/*
+ * OsTick.h
+ *
+ * Schlafen in der IdleTask. OsTick_Idle() legt die CPU mit SLEEP_MODE_IDLE
+ * schlafen, bis ein Interrupt kommt; Timer/Counter 1 (OS-Tick), SPI, TWI und
+ * USART laufen in diesem Modus weiter. Bei 1 ms Tick wacht die CPU im Leerlauf
+ * also 1000 Mal je Sekunde fuer den Tick-ISR auf.
+ *
+ * Kein Tickless Idle: dafuer muessten Systemzaehler und Nachladewert von
+ * Timer 1 (OsSystemCounter, OsTimerStartValue) vor dem Schlafen vorgestellt
+ * und beim Aufwachen zurueckgestellt werden. Beide sind in libOsekAvr.a lokal
+ * zu Os.o, von aussen ist nur Os_GetSytemCounter() zum Lesen sichtbar. Das
+ * geht erst mit einer neu gebauten Bibliothek, die dafuer eine Schnittstelle
+ * exportiert.
+ */
+
+#ifndef OSTICK_H_
+#define OSTICK_H_
+
+//---------------------------------------------------------------------------------------------
+/* In der Schleife der IdleTask: schlafen bis zum naechsten Interrupt */
+void OsTick_Idle(void);
+//---------------------------------------------------------------------------------------------
+
+#endif /* OSTICK_H_ */
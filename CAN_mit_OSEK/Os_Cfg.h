@@ -7,10 +7,26 @@
 /* DEFINES                                                                                        */
 /*------------------------------------------------------------------------------------------------*/
 
-/* Duration of a tick of the system counter (Timer/Counter 1) in milliseconds. */
-#define OSTICKDURATION 10
-
-/* Stack size per task in bytes. */
+/* Duration of a tick of the system counter (Timer/Counter 1) in milliseconds. StartOS() chooses the
+   prescaler of Timer 1, whole milliseconds only. The IdleTask sleeps until the next interrupt
+   (OsTick.h), so an idle tick costs only the tick ISR. */
+#define OSTICKDURATION 1
+
+/* Time in ms as OS ticks (rounded up), for SetRelAlarm() and SetAbsAlarm(). */
+#define OS_MS_TO_TICKS(ms) (((ms) + OSTICKDURATION - 1) / OSTICKDURATION)
+
+/* CAN reception in Task1: 0 = Task1 is an EXTENDED_TASK waiting for EV_CAN_RX, which the INT0 ISR
+   sets (can_set_rx_notify()); Alarm1 only wakes it every CAN_RX_HOUSEKEEPING_MS for
+   OS_STAT_POLL(). 1 = as before: Alarm1 activates Task1 every 10 ms to poll the ring buffer.
+   To compare both variants, print the response time of Task1 and the idle share with 's' (OsStat.h). */
+#ifndef CAN_RX_POLLING
+#define CAN_RX_POLLING 0
+#endif
+#define CAN_RX_HOUSEKEEPING_MS 100
+
+/* Stack size per task in bytes. The same for all tasks: StartOS() in the OS library splits OsTaskSB
+   into equal slots (OsStack.h), so OS_TASK_INFO_BLOCK cannot carry a size per task. Measure the
+   actual need with OsStack_HighWater() ('s' on the USART, see OsStat.h) before reducing it. */
 #define OS_STACK_SIZE_PER_TASK 80
 
 /* If TRUE then stack corruption ist checked during OS execution upon leaving and calling a task. */
@@ -34,10 +50,28 @@
 #define Task1       2
 #define Task2       3
 
-/* Definition of alarm IDs. */
+/* Definition of alarm IDs. Alarm2 carries all software timers (SwTimer.h), e.g. Task 2 every 100 ms;
+   add further cyclic jobs as SwTimerT rather than as alarms, since every alarm lengthens every tick.
+   Cyclic CAN messages need no timer of their own: see can_sched.h, period taken from the DBC. */
 #define Alarm1 0
 #define Alarm2 1
 
+/* Definition of event masks. */
+#define EV_TEMP_READY   0x01   /* Task 2: LM75 read (TWI ISR). */
+#define EV_CAN_RX       0x01   /* Task 1: frame in the receive ring buffer (INT0 ISR). */
+#define EV_HOUSEKEEPING 0x02   /* Task 1: Alarm1, USART commands for OsStat. */
+#define EV_CAN_TX       0x04   /* Task 1: cyclic message due (can_sched_run()). */
+
+#if CAN_RX_POLLING
+#define TASK1_TYPE    BASIC_TASK
+#define ALARM1_ACTION ACTIVATETASK
+#define ALARM1_EVENT  0
+#else
+#define TASK1_TYPE    EXTENDED_TASK
+#define ALARM1_ACTION SETEVENT
+#define ALARM1_EVENT  EV_HOUSEKEEPING
+#endif
+
 /* Task info block. */
 #define OS_TASK_INFO_BLOCK \
 { \
@@ -59,7 +93,7 @@
 	}, \
 	{ /* Task 1 */ \
 		FALSE,                /* TRUE = Task activated on StartOS(), FALSE = Task not activated on StartOS(). */ \
-		BASIC_TASK,           /* BASIC_TASK or EXTENDED_TASK. */  \
+		TASK1_TYPE,           /* EXTENDED_TASK: waits for CAN messages with WaitEvent() (CAN_RX_POLLING). */  \
 		5,                    /* Task priority 0 = lowest priority, 255 = highest priority. */ \
 		NON_PREEMPTIVE,       /* Task schedule type: NON_PREEMPTIVE or PREEMPTIVE. */ \
 		1,                    /* Maximum number of multiple task activations. */ \
@@ -67,7 +101,7 @@
 	}, \
 	{ /* Task 2 */ \
 		FALSE,                /* TRUE = Task activated on StartOS(), FALSE = Task not activated on StartOS(). */ \
-		BASIC_TASK,           /* BASIC_TASK or EXTENDED_TASK. */  \
+		EXTENDED_TASK,        /* EXTENDED_TASK: waits for the LM75 with WaitEvent(). */  \
 		10,                   /* Task priority 0 = lowest priority, 255 = highest priority. */ \
 		NON_PREEMPTIVE,       /* Task schedule type: NON_PREEMPTIVE or PREEMPTIVE. */ \
 		1,                    /* Maximum number of multiple task activations. */ \
@@ -79,16 +113,16 @@
 #define OS_ALARM_INFO_BLOCK \
 { \
 	{ /* Alarm1 */ \
-		ACTIVATETASK,         /* Alarm action: ACTIVATETASK, SETEVENT or CALLBACK. */  \
+		ALARM1_ACTION,        /* Alarm action: ACTIVATETASK, SETEVENT or CALLBACK. */  \
 		Task1,                /* Task ID for alarm action ACTIVATETASK and SETEVENT. */  \
-		0,                    /* Event mask for alarm action SETEVENT. */ \
+		ALARM1_EVENT,         /* Event mask for alarm action SETEVENT. */ \
 		0                     /* Void-void-Callback function for alarm action CALLBACK. */ \
 	}, \
 	{ /* Alarm2 */ \
-		ACTIVATETASK,         /* Alarm action: ACTIVATETASK, SETEVENT or CALLBACK. */  \
-		Task2,                /* Task ID for alarm action ACTIVATETASK and SETEVENT. */  \
+		CALLBACK,             /* Alarm action: ACTIVATETASK, SETEVENT or CALLBACK. */  \
+		INVALID_TASK,         /* Task ID for alarm action ACTIVATETASK and SETEVENT. */  \
 		0,                    /* Event mask for alarm action SETEVENT. */ \
-		0                     /* Void-void-Callback function for alarm action CALLBACK. */ \
+		SwTimer_AlarmCallback /* Void-void-Callback function for alarm action CALLBACK. */ \
 	} \
 }
 
@@ -102,6 +136,9 @@ extern void FuncStartUpTask();
 extern void FuncTask1();
 extern void FuncTask2();
 
+/* Alarm callbacks. */
+extern void SwTimer_AlarmCallback();
+
 /*------------------------------------------------------------------------------------------------*/
 /* CONFIGURATION-SPECIFIC OS IMPLEMENTATION                                                       */
 /*------------------------------------------------------------------------------------------------*/
@@ -0,0 +1,179 @@
+/*
+ * SwTimer.c
+ *
+ * Software-Timer in einer Delta-Liste an einem OS-Alarm, siehe SwTimer.h.
+ */
+
+#include <avr/io.h>
+#include <avr/interrupt.h>
+
+#include "SwTimer.h"
+#include "OsStat.h"
+
+/* Daten des OS aus Os_Cfg.c, nur gelesen */
+extern TaskControlBlockT OsTaskCB[];
+extern const TaskInfoBlockT OsTaskIB[];
+
+static TaskType sw_timer_idle = INVALID_TASK;
+static SwTimerT *sw_timer_head;			/* naechster Ablauf zuerst */
+static TickType sw_timer_base;			/* Stand des Systemzaehlers, ab dem sw_timer_head->delta zaehlt */
+static volatile uint8_t sw_timer_due;	/* faellige Timer fuer SwTimer_Idle() */
+
+//---------------------------------------------------------------------------------------------
+/* Einsortieren, ticks ab sw_timer_base; bei gleichem Ablauf hinter die vorhandenen */
+static void SwTimer_Insert(SwTimerT *timer, TickType ticks)
+{
+	SwTimerT **link = &sw_timer_head;
+
+	while (*link && (*link)->delta <= ticks) {
+		ticks -= (*link)->delta;
+		link = &(*link)->next;
+	}
+	timer->delta = ticks;
+	timer->next = *link;
+	if (*link) {
+		(*link)->delta -= ticks;
+	}
+	*link = timer;
+}
+
+static void SwTimer_Remove(SwTimerT *timer)
+{
+	SwTimerT **link = &sw_timer_head;
+
+	while (*link && *link != timer) {
+		link = &(*link)->next;
+	}
+	if (*link) {
+		*link = timer->next;
+		if (timer->next) {
+			timer->next->delta += timer->delta;
+		}
+	}
+}
+
+/* Liste auf den Stand now des Systemzaehlers beziehen: faellige Eintraege vorn mit delta 0 */
+static void SwTimer_Rebase(TickType now)
+{
+	TickType elapsed = (TickType)(now - sw_timer_base);
+	SwTimerT *timer = sw_timer_head;
+
+	while (timer && timer->delta <= elapsed) {
+		elapsed -= timer->delta;
+		timer->delta = 0;
+		timer = timer->next;
+	}
+	if (timer) {
+		timer->delta -= elapsed;
+	}
+	sw_timer_base = now;
+}
+
+/* Aktion wie im Tick-ISR des OS fuer einen Alarm, ueber die Dienste des OS. Eine
+   Aktivierung einer noch laufenden Task geht ohne Os_ErrorHook() verloren. */
+static void SwTimer_Action(SwTimerT *timer)
+{
+	TaskControlBlockT *tcb = &OsTaskCB[timer->task];
+
+	switch (timer->action) {
+	case ACTIVATETASK:
+		if (tcb->state == SUSPENDED) {
+			OS_STAT_ACTIVATE(timer->task);		/* Antwortzeit ab dem Ablauf (OsStat.h) */
+			ActivateTask(timer->task);
+		}
+		break;
+	case SETEVENT:
+		if (OsTaskIB[timer->task].taskType == EXTENDED_TASK && tcb->state != SUSPENDED) {
+			OS_STAT_ACTIVATE(timer->task);
+			SetEvent(timer->task, timer->mask);
+		}
+		break;
+	case CALLBACK:
+		timer->callback();
+		break;
+	}
+}
+
+/* Alle faelligen Timer ausfuehren, zyklische neu einsortieren. ActivateTask() und
+   SetEvent() geben die Interrupts frei, deshalb vor jedem Eintrag sperren und die
+   Liste neu auf den Systemzaehler beziehen; Aktionen duerfen Timer starten und
+   anhalten. Kehrt mit gesperrten Interrupts zurueck. */
+static void SwTimer_Expire(void)
+{
+	SwTimerT *timer;
+
+	for (;;) {
+		cli();
+		SwTimer_Rebase(Os_GetSytemCounter());
+		timer = sw_timer_head;
+		if (!timer || timer->delta) {
+			break;
+		}
+		sw_timer_head = timer->next;
+		if (timer->cycle) {
+			SwTimer_Insert(timer, timer->cycle);
+		} else {
+			timer->active = 0;
+		}
+		SwTimer_Action(timer);
+	}
+}
+
+//---------------------------------------------------------------------------------------------
+void SwTimer_Init(AlarmType alarm, TaskType idle)
+{
+	sw_timer_idle = idle;
+	SetRelAlarm(alarm, 1, 1);
+}
+
+void SwTimer_Start(SwTimerT *timer, TickType delay, TickType cycle)
+{
+	uint8_t sreg = SREG;
+
+	cli();
+	if (timer->active) {
+		SwTimer_Remove(timer);
+	}
+	SwTimer_Rebase(Os_GetSytemCounter());
+	timer->cycle = cycle;
+	timer->active = 1;
+	SwTimer_Insert(timer, delay ? delay : 1);
+	SREG = sreg;
+}
+
+void SwTimer_Stop(SwTimerT *timer)
+{
+	uint8_t sreg = SREG;
+
+	cli();
+	if (timer->active) {
+		SwTimer_Remove(timer);
+		timer->active = 0;
+	}
+	SREG = sreg;
+}
+
+void SwTimer_Idle(void)
+{
+	if (sw_timer_due) {
+		sw_timer_due = 0;
+		SwTimer_Expire();
+		sei();
+	}
+}
+
+void SwTimer_AlarmCallback(void)
+{
+	SwTimerT *timer = sw_timer_head;
+
+	if (!timer || (TickType)(Os_GetSytemCounter() - sw_timer_base) < timer->delta) {
+		return;
+	}
+	/* Aus der IdleTask wechselten ActivateTask() und SetEvent() mitten im Tick-ISR
+	   zur Task (SwTimer.h): dort gleich nach dem Tick ausfuehren */
+	if (sw_timer_idle != INVALID_TASK && OsTaskCB[sw_timer_idle].state == RUNNING) {
+		sw_timer_due = 1;
+		return;
+	}
+	SwTimer_Expire();
+}
@@ -0,0 +1,79 @@
+/*
+ * SwTimer.h
+ *
+ * Software-Timer in einer sortierten Delta-Liste an einem einzigen OS-Alarm.
+ * Der Tick-ISR von libOsekAvr.a vergleicht in jedem Tick alle Alarme mit dem
+ * Systemzaehler (etwa 27 Takte je Alarm, Listing __vector_13); mit einem Alarm
+ * je zyklischer Nachricht waechst jeder Tick mit ihrer Zahl. Die Software-Timer
+ * liegen stattdessen nach Ablauf sortiert in einer Liste, jeder Eintrag haelt
+ * nur den Abstand in Ticks zu seinem Vorgaenger.
+ *
+ * Der Alarm (Aktion CALLBACK, SwTimer_AlarmCallback()) laeuft zyklisch in jedem
+ * Tick; SwTimer_Init() stellt ihn einmal mit SetRelAlarm(), danach fasst ihn
+ * niemand mehr an. Der Rueckruf vergleicht nur den ersten Eintrag mit dem
+ * Systemzaehler: ein Tick ohne faelligen Timer kostet unabhaengig von der Zahl
+ * der Timer einen Alarm im Tick-ISR und diesen einen Vergleich.
+ *
+ * Beim Ablauf fuehrt der Rueckruf die Aktion wie fuer einen Alarm aus, ueber
+ * ActivateTask() und SetEvent() oder als Funktionsaufruf. Aus einer Task mit
+ * NON_PREEMPTIVE wechseln diese Dienste nicht, der Rueckruf laeuft zu Ende.
+ * Laeuft die IdleTask (PREEMPTIVE), wechselten sie noch im Tick-ISR zur Task
+ * und setzten den Rest des Tick-ISR erst fort, wenn die IdleTask wieder an der
+ * Reihe ist. Der Rueckruf laesst die faelligen Timer dann stehen, die IdleTask
+ * fuehrt sie gleich nach dem Tick in SwTimer_Idle() aus. Die IdleTask muss
+ * deshalb die einzige Task mit PREEMPTIVE sein und SwTimer_Idle() in ihrer
+ * Schleife rufen. Wechselt das OS am Ende des Tick-ISR ohnehin zu einer Task,
+ * oder schlaeft die IdleTask schon wieder, fuehrt der Rueckruf die Aktion im
+ * naechsten Tick aus. Eine Aktivierung, waehrend die Task noch nicht wieder
+ * SUSPENDED ist, geht ohne Meldung verloren.
+ *
+ * Starten und Neuladen zyklischer Timer sortiert in die Liste ein und kostet
+ * O(n) in der Zahl der laufenden Timer. Messung Tick-Kosten gegen Zahl der Alarme:
+ * host/alarm_bench.c.
+ */
+
+#ifndef SWTIMER_H_
+#define SWTIMER_H_
+
+#include <inttypes.h>
+
+#include "Os.h"
+
+typedef struct SwTimer
+{
+	struct SwTimer *next;			/* naechster Timer in der Delta-Liste */
+	TickType delta;					/* Ticks nach dem Vorgaenger */
+	TickType cycle;					/* 0 = einmalig */
+	uint8_t action;					/* ACTIVATETASK, SETEVENT oder CALLBACK wie beim Alarm */
+	TaskType task;					/* Task fuer ACTIVATETASK und SETEVENT */
+	EventMaskType mask;				/* Event fuer SETEVENT */
+	void (*callback)(void);			/* Funktion fuer CALLBACK (im Tick-ISR oder in der IdleTask) */
+	uint8_t active;
+} SwTimerT;
+
+#define SW_TIMER_TASK(task)			{ 0, 0, 0, ACTIVATETASK, (task), 0, 0, 0 }
+#define SW_TIMER_EVENT(task, mask)	{ 0, 0, 0, SETEVENT, (task), (mask), 0, 0 }
+#define SW_TIMER_CALLBACK(func)		{ 0, 0, 0, CALLBACK, INVALID_TASK, 0, (func), 0 }
+
+//---------------------------------------------------------------------------------------------
+/* Alarm (Aktion CALLBACK mit SwTimer_AlarmCallback) fuer alle Software-Timer
+   zyklisch in jedem Tick starten, aus einer Task vor dem ersten SwTimer_Start().
+   idle: die IdleTask, die SwTimer_Idle() ruft (INVALID_TASK: keine) */
+void SwTimer_Init(AlarmType alarm, TaskType idle);
+//---------------------------------------------------------------------------------------------
+/* Timer nach delay Ticks ablaufen lassen, danach alle cycle Ticks (0 = einmalig).
+   delay 0 wie SetRelAlarm(): im naechsten Tick. Ein laufender Timer startet neu. */
+void SwTimer_Start(SwTimerT *timer, TickType delay, TickType cycle);
+//---------------------------------------------------------------------------------------------
+/* Timer anhalten */
+void SwTimer_Stop(SwTimerT *timer);
+//---------------------------------------------------------------------------------------------
+/* In der Schleife der IdleTask: Timer ausfuehren, die im Tick-ISR der IdleTask
+   faellig wurden */
+void SwTimer_Idle(void);
+//---------------------------------------------------------------------------------------------
+/* Rueckruf des Alarms, laeuft im Tick-ISR (OS_ALARM_INFO_BLOCK in Os_Cfg.h) */
+void SwTimer_AlarmCallback(void);
+//---------------------------------------------------------------------------------------------
+
+#endif /* SWTIMER_H_ */
@@ -6,6 +6,23 @@
  */ 
 #include "TWI.h"
 
+#include <avr/interrupt.h>
+#include <compat/twi.h>
+
+/* TWCR fuer den naechsten Schritt einer asynchronen Uebertragung (mit TWIE) */
+#define TWI_CONTINUE	((1 << TWINT) | (1 << TWEN) | (1 << TWIE))
+
+/* Laufende asynchrone Uebertragung, Zugriff nur aus dem ISR solange twi_busy */
+static uint8_t twi_address;
+static const uint8_t *twi_tx;
+static uint8_t twi_tx_len;
+static uint8_t twi_tx_pos;
+static uint8_t *twi_rx;
+static uint8_t twi_rx_len;
+static uint8_t twi_rx_pos;
+static TWI_callback twi_done;
+static volatile uint8_t twi_busy;
+
 void TWI_init(void)
 {
 	/* initialize TWI clock: 100 kHz clock, TWPS = 0 => prescaler = 1 */
@@ -51,4 +68,93 @@ char TWI_readNak()
 	TWCR = (1<<TWINT) | (1<<TWEN);
 	while(!(TWCR & (1<<TWINT)));
 	return TWDR;
+}
+
+/*========================== TWI ASYNCHRON ================================*/
+uint8_t TWI_transfer_async(uint8_t address, const uint8_t *tx, uint8_t tx_len, uint8_t *rx, uint8_t rx_len,
+	TWI_callback done)
+{
+	if (twi_busy) {
+		return TWI_BUSY;
+	}
+	twi_address = address;
+	twi_tx = tx;
+	twi_tx_len = tx_len;
+	twi_tx_pos = 0;
+	twi_rx = rx;
+	twi_rx_len = rx_len;
+	twi_rx_pos = 0;
+	twi_done = done;
+	twi_busy = 1;
+
+	/* STOP der vorigen Uebertragung abwarten (hoechstens ein SCL-Takt) */
+	while ((TWCR & (1 << TWSTO)) != 0);
+	TWCR = TWI_CONTINUE | (1 << TWSTA);
+	return TWI_OK;
+}
+
+uint8_t TWI_is_busy(void)
+{
+	return twi_busy;
+}
+
+/* Uebertragung mit STOP beenden und melden. Der Rueckruf kommt zuletzt, damit
+ * ein Taskwechsel durch SetEvent() keinen halb bearbeiteten ISR hinterlaesst. */
+static void TWI_finish(uint8_t status)
+{
+	TWCR = (1 << TWINT) | (1 << TWSTO) | (1 << TWEN);
+	twi_busy = 0;
+	if (twi_done) {
+		twi_done(status);
+	}
+}
+
+/*========================== TWI ISR ================================*/
+/* Zustandsautomat nach dem Statusregister: SLA+W, tx_len Bytes schreiben,
+ * Repeated START, SLA+R, rx_len Bytes lesen (alle ausser dem letzten mit ACK). */
+ISR(TWI_vect)
+{
+	switch (TW_STATUS) {
+		case TW_START:
+		case TW_REP_START:
+			TWDR = twi_address + ((twi_tx_pos < twi_tx_len) ? I2C_WRITE : I2C_READ);
+			TWCR = TWI_CONTINUE;
+			break;
+
+		case TW_MT_SLA_ACK:
+		case TW_MT_DATA_ACK:
+			if (twi_tx_pos < twi_tx_len) {
+				TWDR = twi_tx[twi_tx_pos++];
+				TWCR = TWI_CONTINUE;
+			}
+			else if (twi_rx_len != 0) {
+				TWCR = TWI_CONTINUE | (1 << TWSTA);
+			}
+			else {
+				TWI_finish(TWI_OK);
+			}
+			break;
+
+		case TW_MR_DATA_ACK:
+			twi_rx[twi_rx_pos++] = TWDR;
+			/* weiter wie nach SLA+R */
+		case TW_MR_SLA_ACK:
+			if (twi_rx_pos + 1 < twi_rx_len) {
+				TWCR = TWI_CONTINUE | (1 << TWEA);
+			}
+			else {
+				TWCR = TWI_CONTINUE;
+			}
+			break;
+
+		case TW_MR_DATA_NACK:
+			twi_rx[twi_rx_pos++] = TWDR;
+			TWI_finish(TWI_OK);
+			break;
+
+		default:
+			/* NACK auf Adresse oder Daten, Arbitrierung verloren, Busfehler */
+			TWI_finish(TWI_ERROR);
+			break;
+	}
 }
\ No newline at end of file
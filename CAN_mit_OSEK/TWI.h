@@ -15,6 +15,7 @@
 #endif
 
 #include <avr/io.h>
+#include <inttypes.h>
 
 #define SCL_CLOCK 100000L		/* TWI clock in Hz */
 #define DEV_LM75  0x90			/* device address:  1001 000 + R/W */
@@ -39,5 +40,23 @@ char TWI_readAck(void);
 /* Daten empfangen und mit Acknowledgement quittieren.(Ohne Ackn.-Bit) */
 char TWI_readNak(void);
 //---------------------------------------------------------------------------------------------
+/* Status einer asynchronen Uebertragung */
+#define TWI_OK		0
+#define TWI_BUSY	1			/* es laeuft noch eine Uebertragung */
+#define TWI_ERROR	2			/* NACK, Arbitrierung verloren oder Busfehler */
+
+/* Rueckruf am Ende einer asynchronen Uebertragung, wird im TWI-ISR aufgerufen */
+typedef void (*TWI_callback)(uint8_t status);
+//---------------------------------------------------------------------------------------------
+/* Asynchrone Uebertragung im TWI-ISR: an address (ohne R/W-Bit) tx_len Bytes
+   schreiben, dann mit Repeated START rx_len Bytes lesen, STOP und done() aufrufen.
+   tx und rx muessen bis zum Rueckruf gueltig bleiben. Die blockierenden
+   Funktionen oben duerfen waehrenddessen nicht benutzt werden. */
+uint8_t TWI_transfer_async(uint8_t address, const uint8_t *tx, uint8_t tx_len, uint8_t *rx, uint8_t rx_len,
+	TWI_callback done);
+//---------------------------------------------------------------------------------------------
+/* 1 solange eine asynchrone Uebertragung laeuft */
+uint8_t TWI_is_busy(void);
+//---------------------------------------------------------------------------------------------
 
 #endif /* TWI_H_ */
\ No newline at end of file
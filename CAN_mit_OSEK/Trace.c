@@ -0,0 +1,144 @@
+/*
+ * Trace.c
+ *
+ * Binaerer Trace mit COBS-Rahmen ueber die USART, siehe Trace.h.
+ */
+
+#include <avr/io.h>
+#include <avr/interrupt.h>
+
+#include "Trace.h"
+
+#if TRACE_ENABLE
+
+#include "UsartTx.h"
+
+#define TRACE_MAX_PAYLOAD	5
+#define TRACE_MAX_RECORD	(3 + TRACE_MAX_PAYLOAD)
+
+/* Oberes Byte des Zeitstempels, zaehlt die Ueberlaeufe von Timer/Counter 0 */
+static volatile uint8_t trace_time_high;
+
+/* Verworfene Datensaetze seit dem letzten gesendeten */
+static uint16_t trace_lost;
+
+//---------------------------------------------------------------------------------------------
+void Trace_Init(void)
+{
+	static const unsigned char sync = 0;
+
+	TCCR0A = 0;
+	TCCR0B = (1 << CS02);							/* Vorteiler 256 */
+	TIMSK0 = (1 << TOIE0);
+	trace_time_high = 0;
+	trace_lost = 0;
+	USART_TryWrite(&sync, 1);
+}
+
+ISR(TIMER0_OVF_vect)
+{
+	trace_time_high++;
+}
+
+/* Zeitstempel mit gesperrten Interrupts lesen; ein noch nicht bearbeiteter
+ * Ueberlauf wird mitgezaehlt */
+static uint16_t Trace_Time(void)
+{
+	uint8_t low = TCNT0;
+	uint8_t high = trace_time_high;
+
+	if ((TIFR0 & (1 << TOV0)) && low < 0x80) {
+		high++;
+	}
+	return ((uint16_t)high << 8) | low;
+}
+
+//---------------------------------------------------------------------------------------------
+/* COBS: jede 0 wird durch den Abstand zur naechsten 0 ersetzt, vorne steht der
+ * Abstand zur ersten. Ein Datensatz ist kuerzer als 254 Byte, es gibt also
+ * nur einen Block. Rueckgabe: Laenge mit abschliessender 0. */
+static uint8_t Trace_Cobs(const uint8_t *in, uint8_t length, uint8_t *out)
+{
+	uint8_t code = 1;
+	uint8_t code_pos = 0;
+	uint8_t n = 1;
+
+	for (uint8_t i = 0; i < length; i++) {
+		if (in[i] == 0) {
+			out[code_pos] = code;
+			code_pos = n++;
+			code = 1;
+		}
+		else {
+			out[n++] = in[i];
+			code++;
+		}
+	}
+	out[code_pos] = code;
+	out[n++] = 0;
+	return n;
+}
+
+static uint8_t Trace_Put(uint8_t type, uint16_t time, const uint8_t *payload, uint8_t length)
+{
+	uint8_t record[TRACE_MAX_RECORD];
+	uint8_t frame[TRACE_MAX_RECORD + 2];
+
+	record[0] = type;
+	record[1] = time & 0xff;
+	record[2] = time >> 8;
+	for (uint8_t i = 0; i < length; i++) {
+		record[3 + i] = payload[i];
+	}
+	return USART_TryWrite(frame, Trace_Cobs(record, 3 + length, frame)) == E_OK;
+}
+
+void Trace_Record(uint8_t type, const uint8_t *payload, uint8_t length)
+{
+	uint8_t sreg = SREG;
+	uint16_t time;
+
+	if (length > TRACE_MAX_PAYLOAD) {
+		length = TRACE_MAX_PAYLOAD;
+	}
+
+	// Zeitstempel und Reihenfolge im Puffer muessen zusammenpassen, auch wenn
+	// ein ISR dazwischen aufzeichnet
+	cli();
+	time = Trace_Time();
+	if (trace_lost != 0) {
+		uint8_t lost[2] = { trace_lost & 0xff, trace_lost >> 8 };
+
+		if (!Trace_Put(TRACE_EV_LOST, time, lost, sizeof(lost))) {
+			trace_lost += (trace_lost != 0xffff);
+			SREG = sreg;
+			return;
+		}
+		trace_lost = 0;
+	}
+	if (!Trace_Put(type, time, payload, length)) {
+		trace_lost += (trace_lost != 0xffff);
+	}
+	SREG = sreg;
+}
+
+void Trace_Record8(uint8_t type, uint8_t value)
+{
+	Trace_Record(type, &value, 1);
+}
+
+void Trace_Record24(uint8_t type, uint8_t value, uint16_t value16)
+{
+	uint8_t payload[3] = { value, value16 & 0xff, value16 >> 8 };
+
+	Trace_Record(type, payload, sizeof(payload));
+}
+
+void Trace_RecordCan(uint8_t type, uint32_t id, uint8_t value)
+{
+	uint8_t payload[5] = { id & 0xff, (id >> 8) & 0xff, (id >> 16) & 0xff, id >> 24, value };
+
+	Trace_Record(type, payload, sizeof(payload));
+}
+
+#endif /* TRACE_ENABLE */
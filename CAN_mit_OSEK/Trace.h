@@ -0,0 +1,94 @@
+/*
+ * Trace.h
+ *
+ * Binaerer Trace ueber die USART statt Textausgaben. Jedes Ereignis ist ein
+ * kurzer Datensatz
+ *
+ *   Typ (1 Byte) | Zeitstempel (2 Byte, little-endian) | Nutzdaten (0..5 Byte)
+ *
+ * der COBS-codiert und mit 0x00 abgeschlossen in den Sendepuffer der USART
+ * (UsartTx.h) gestellt wird. Ein Datensatz ist hoechstens 10 Byte lang statt
+ * 30..40 Zeichen Text; passt er nicht mehr in den Puffer, wird er verworfen
+ * und die Anzahl mit dem naechsten Datensatz als TRACE_EV_LOST gemeldet.
+ *
+ * Der Zeitstempel zaehlt mit Timer/Counter 0 (Vorteiler 256) in Schritten von
+ * 256 / F_CPU (69,4 us bei 3,6864 MHz) und laeuft nach 4,55 s ueber.
+ * tools/trace_decode.py setzt daraus eine Zeitleiste zusammen.
+ *
+ * Mit TRACE_ENABLE 0 verschwinden alle TRACE_...()-Aufrufe; auf dem Host
+ * (host/) ist das die Voreinstellung.
+ */
+
+#ifndef TRACE_H_
+#define TRACE_H_
+
+#include <inttypes.h>
+
+#ifndef TRACE_ENABLE
+#ifdef __AVR__
+#define TRACE_ENABLE 1
+#else
+#define TRACE_ENABLE 0
+#endif
+#endif
+
+/* Ereignistypen, Nutzdaten in Klammern */
+#define TRACE_EV_LOST			0x01	/* verworfene Datensaetze (2) */
+#define TRACE_EV_TASK_START		0x02	/* Task-ID laut Os_Cfg.h (1) */
+#define TRACE_EV_TASK_END		0x03	/* Task-ID (1) */
+#define TRACE_EV_ALARM_SET		0x04	/* Alarm-ID (1), Zyklus in Ticks (2) */
+#define TRACE_EV_ALARM_CANCEL	0x05	/* Alarm-ID (1) */
+#define TRACE_EV_CAN_RX			0x06	/* ID mit CAN_ID_EXT (4), DLC (1) */
+#define TRACE_EV_CAN_TX_QUEUE	0x07	/* ID (4), DLC (1): mcp2515_send_message() */
+#define TRACE_EV_CAN_TX_DONE	0x08	/* ID (4), Sendepuffer (1): TXnIF */
+#define TRACE_EV_TWI_DONE		0x09	/* Status TWI_OK/TWI_ERROR (1) */
+#define TRACE_EV_VALUE			0x0a	/* Kennung (1), Wert (2) */
+#define TRACE_EV_CAN_ERROR		0x0b	/* Fehlerzustand (1), TEC (1), REC (1): EFLG */
+
+/* Kennungen fuer TRACE_VALUE */
+#define TRACE_VALUE_TEMPERATUR	1	/* Rohwert LM75, 0,125 Grad je Bit */
+
+#if TRACE_ENABLE
+
+//---------------------------------------------------------------------------------------------
+/* Timer/Counter 0 fuer die Zeitstempel starten und den Empfaenger mit einem
+   0x00 synchronisieren (nach USART_Init()). */
+void Trace_Init(void);
+//---------------------------------------------------------------------------------------------
+/* Datensatz mit length Byte Nutzdaten aufzeichnen (Task oder ISR) */
+void Trace_Record(uint8_t type, const uint8_t *payload, uint8_t length);
+void Trace_Record8(uint8_t type, uint8_t value);
+void Trace_Record24(uint8_t type, uint8_t value, uint16_t value16);
+void Trace_RecordCan(uint8_t type, uint32_t id, uint8_t value);
+//---------------------------------------------------------------------------------------------
+
+#define TRACE_INIT()					Trace_Init()
+#define TRACE_TASK_START(task)			Trace_Record8(TRACE_EV_TASK_START, (task))
+#define TRACE_TASK_END(task)			Trace_Record8(TRACE_EV_TASK_END, (task))
+#define TRACE_ALARM_SET(alarm, cycle)	Trace_Record24(TRACE_EV_ALARM_SET, (alarm), (cycle))
+#define TRACE_ALARM_CANCEL(alarm)		Trace_Record8(TRACE_EV_ALARM_CANCEL, (alarm))
+#define TRACE_CAN_RX(id, dlc)			Trace_RecordCan(TRACE_EV_CAN_RX, (id), (dlc))
+#define TRACE_CAN_TX_QUEUE(id, dlc)		Trace_RecordCan(TRACE_EV_CAN_TX_QUEUE, (id), (dlc))
+#define TRACE_CAN_TX_DONE(id, buffer)	Trace_RecordCan(TRACE_EV_CAN_TX_DONE, (id), (buffer))
+#define TRACE_TWI_DONE(status)			Trace_Record8(TRACE_EV_TWI_DONE, (status))
+#define TRACE_VALUE(key, value)			Trace_Record24(TRACE_EV_VALUE, (key), (value))
+#define TRACE_CAN_ERROR(state, tec, rec) \
+	Trace_Record24(TRACE_EV_CAN_ERROR, (state), (tec) | ((uint16_t)(rec) << 8))
+
+#else
+
+#define TRACE_INIT()
+#define TRACE_TASK_START(task)
+#define TRACE_TASK_END(task)
+#define TRACE_ALARM_SET(alarm, cycle)
+#define TRACE_ALARM_CANCEL(alarm)
+#define TRACE_CAN_RX(id, dlc)
+#define TRACE_CAN_TX_QUEUE(id, dlc)
+#define TRACE_CAN_TX_DONE(id, buffer)
+#define TRACE_TWI_DONE(status)
+#define TRACE_VALUE(key, value)
+#define TRACE_CAN_ERROR(state, tec, rec)
+
+#endif /* TRACE_ENABLE */
+
+#endif /* TRACE_H_ */
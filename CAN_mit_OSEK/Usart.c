@@ -0,0 +1,250 @@
+/*
+ * Usart.c
+ *
+ * USART-Schnittstelle aus lib/Usart.h mit Sendepuffer und UDRE-Interrupt,
+ * siehe UsartTx.h.
+ *
+ * Ersetzt das Modul Usart.o aus libOsekAvr.a vollstaendig, ohne Meldung des
+ * Linkers: er nimmt ein Modul aus der Bibliothek nur fuer noch offene Symbole
+ * dazu, und hier sind alle sieben Funktionen von Usart.o definiert. Damit
+ * laufen auch die Meldungen des OS hierueber: Os.o ruft USART_Init(),
+ * USART_IsInitialized(), USART_PutChar(), USART_PutString() und
+ * USART_PutUint16AsDecimalAscii() fuer Os_ErrorHook() und die
+ * Stack-Pruefung, meist mit gesperrten Interrupts (dann direkt auf den
+ * Baustein, siehe USART_PutChar()). Fehlt hier eine der sieben Funktionen
+ * und wird sie benutzt, zieht der Linker Usart.o wieder hinzu und meldet
+ * doppelte Definitionen.
+ */
+
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <stdarg.h>
+#include <stdio.h>
+
+#include "UsartTx.h"
+
+#ifndef F_CPU
+#define F_CPU 3686400
+#endif
+
+#define USART_TX_MASK (USART_TX_BUFFER_SIZE - 1)
+
+#if (USART_TX_BUFFER_SIZE & USART_TX_MASK) != 0 || USART_TX_BUFFER_SIZE > 128
+#error USART_TX_BUFFER_SIZE muss eine Zweierpotenz bis 128 sein
+#endif
+
+/* Sendepuffer: Schreiber sind Tasks und ISRs (mit gesperrten Interrupts),
+ * Leser nur der UDRE-ISR. */
+static char tx_buffer[USART_TX_BUFFER_SIZE];
+static volatile uint8_t tx_head;
+static volatile uint8_t tx_tail;
+static volatile uint16_t tx_dropped;
+static uint8_t USART_initialized;
+
+//---------------------------------------------------------------------------------------------
+void USART_Init(unsigned long baud)
+{
+	uint16_t ubrr = (F_CPU + 8 * baud) / (16 * baud) - 1;	/* gerundet, 115200 Baud: UBRR = 1 */
+
+	UCSR0B = 0;
+	UBRR0H = ubrr >> 8;
+	UBRR0L = ubrr & 0xff;
+	UCSR0A = 0;
+	UCSR0C = (1 << UCSZ01) | (1 << UCSZ00);					/* 8N1 */
+	UCSR0B = (1 << RXEN0) | (1 << TXEN0);
+
+	tx_head = 0;
+	tx_tail = 0;
+	tx_dropped = 0;
+	USART_initialized = 1;
+}
+
+unsigned char USART_IsInitialized()
+{
+	return USART_initialized;
+}
+
+//---------------------------------------------------------------------------------------------
+/* Ohne Interrupts kann der Puffer nicht leer laufen: Puffer direkt ausgeben
+ * (nur aus ISRs oder nach cli(), z.B. Fehlermeldungen des OS). */
+static void USART_Drain(void)
+{
+	while (tx_tail != tx_head) {
+		while (!(UCSR0A & (1 << UDRE0)));
+		UDR0 = tx_buffer[tx_tail];
+		tx_tail = (tx_tail + 1) & USART_TX_MASK;
+	}
+}
+
+static void USART_PutCharPolled(unsigned char z)
+{
+	USART_Drain();
+	while (!(UCSR0A & (1 << UDRE0)));
+	UDR0 = z;
+}
+
+static void USART_CountDropped(uint8_t n)
+{
+	tx_dropped = (tx_dropped > 0xffff - n) ? 0xffff : tx_dropped + n;
+}
+
+/* Ein Zeichen anhaengen, Aufruf mit gesperrten Interrupts */
+static void USART_Enqueue(unsigned char z)
+{
+	uint8_t next = (tx_head + 1) & USART_TX_MASK;
+
+	if (next == tx_tail) {
+		USART_CountDropped(1);
+		return;
+	}
+	tx_buffer[tx_head] = z;
+	tx_head = next;
+	UCSR0B |= (1 << UDRIE0);
+}
+
+void USART_PutChar(unsigned char z)
+{
+	uint8_t sreg = SREG;
+
+	if (!(sreg & (1 << SREG_I))) {
+		USART_PutCharPolled(z);
+		return;
+	}
+	cli();
+	USART_Enqueue(z);
+	SREG = sreg;
+}
+
+void USART_PutString(const char text[])
+{
+	while (*text) {
+		USART_PutChar(*text++);
+	}
+}
+
+unsigned char USART_TryWrite(const unsigned char data[], unsigned char length)
+{
+	uint8_t sreg = SREG;
+
+	cli();
+	if (length > ((tx_tail - tx_head - 1) & USART_TX_MASK)) {
+		USART_CountDropped(length);
+		SREG = sreg;
+		return E_USART_TX_FULL;
+	}
+	while (length--) {
+		USART_Enqueue(*data++);
+	}
+	SREG = sreg;
+	return E_OK;
+}
+
+unsigned char USART_TryPutString(const char text[])
+{
+	uint8_t length = 0;
+
+	while (text[length] && length < USART_TX_BUFFER_SIZE) {
+		length++;
+	}
+	return USART_TryWrite((const unsigned char *)text, length);
+}
+
+void USART_PutUint16AsDecimalAscii(unsigned int v)
+{
+	char text[6];
+	uint8_t i = sizeof(text) - 1;
+
+	text[i] = '\0';
+	do {
+		text[--i] = '0' + v % 10;
+		v /= 10;
+	} while (v);
+	USART_PutString(&text[i]);
+}
+
+#ifdef __AVR__
+/* Printf schreibt ueber einen Stream Zeichen fuer Zeichen in den Sendepuffer,
+ * ohne den Zwischenpuffer von USART_PRINTF_BUFFER_SIZE Bytes aus Usart.o;
+ * E_USART_PRINTF_BUFFER_OVERFLOW gibt es deshalb nicht mehr. Was nicht in den
+ * Sendepuffer passt, wird wie bei USART_PutString() verworfen und gezaehlt. */
+static int USART_StreamPut(char z, FILE *stream)
+{
+	(void)stream;
+	USART_PutChar(z);
+	return 0;
+}
+
+static FILE usart_stream = FDEV_SETUP_STREAM(USART_StreamPut, NULL, _FDEV_SETUP_WRITE);
+
+unsigned char USART_Printf(const char text[], ...)
+{
+	va_list args;
+
+	va_start(args, text);
+	vfprintf(&usart_stream, text, args);
+	va_end(args);
+	return E_OK;
+}
+#else
+/* Host (host/os_run.c): ohne Streams der avr-libc, Puffer auf dem Stack */
+unsigned char USART_Printf(const char text[], ...)
+{
+	char buffer[USART_PRINTF_BUFFER_SIZE];
+	va_list args;
+	int length;
+
+	va_start(args, text);
+	length = vsnprintf(buffer, sizeof(buffer), text, args);
+	va_end(args);
+
+	USART_PutString(buffer);
+	return (length >= (int)sizeof(buffer)) ? E_USART_PRINTF_BUFFER_OVERFLOW : E_OK;
+}
+#endif
+
+unsigned char USART_GetChar(unsigned char* z)
+{
+	if (!(UCSR0A & (1 << RXC0))) {
+		return E_USART_NO_CHAR;
+	}
+	*z = UDR0;
+	return E_OK;
+}
+
+//---------------------------------------------------------------------------------------------
+unsigned char USART_TxFree(void)
+{
+	return (tx_tail - tx_head - 1) & USART_TX_MASK;
+}
+
+unsigned int USART_TxDropped(void)
+{
+	uint8_t sreg = SREG;
+	uint16_t dropped;
+
+	cli();
+	dropped = tx_dropped;
+	SREG = sreg;
+	return dropped;
+}
+
+void USART_Flush(void)
+{
+	if (!(SREG & (1 << SREG_I))) {
+		USART_Drain();
+		return;
+	}
+	while (tx_tail != tx_head);
+}
+
+//---------------------------------------------------------------------------------------------
+/* Naechstes Zeichen an den Baustein, bei leerem Puffer Interrupt abschalten */
+ISR(USART_UDRE_vect)
+{
+	if (tx_tail == tx_head) {
+		UCSR0B &= ~(1 << UDRIE0);
+		return;
+	}
+	UDR0 = tx_buffer[tx_tail];
+	tx_tail = (tx_tail + 1) & USART_TX_MASK;
+}
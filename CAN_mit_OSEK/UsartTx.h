@@ -0,0 +1,46 @@
+/*
+ * UsartTx.h
+ *
+ * Erweiterungen der USART-Schnittstelle aus lib/Usart.h. Usart.c ersetzt das
+ * Usart.o der Bibliothek: Ausgaben landen in einem Sendepuffer, den der
+ * UDRE-Interrupt leert. USART_PutChar(), USART_PutString(), USART_Printf() usw.
+ * warten nicht mehr; was nicht in den Puffer passt, wird verworfen und gezaehlt.
+ * Bei gesperrten Interrupts (z.B. Fehlermeldung des OS vor dem Anhalten)
+ * schreiben diese Funktionen direkt auf den Baustein, damit die Meldung nicht
+ * verloren geht. USART_TryWrite() und USART_TryPutString() warten nie, auch
+ * nicht in ISRs.
+ */
+
+#ifndef USARTTX_H_
+#define USARTTX_H_
+
+#include "Usart.h"
+
+/* Groesse des Sendepuffers in Bytes (Zweierpotenz, hoechstens 128) */
+#ifndef USART_TX_BUFFER_SIZE
+#define USART_TX_BUFFER_SIZE 64
+#endif
+
+/* Zusaetzlicher Fehlercode: Zeichenkette passt nicht in den Sendepuffer */
+#define E_USART_TX_FULL 3
+
+//---------------------------------------------------------------------------------------------
+/* length Bytes (auch 0x00) nur dann in den Sendepuffer stellen, wenn alle
+   hineinpassen. Rueckgabe E_OK oder E_USART_TX_FULL. */
+unsigned char USART_TryWrite(const unsigned char data[], unsigned char length);
+//---------------------------------------------------------------------------------------------
+/* Zeichenkette nur dann in den Sendepuffer stellen, wenn sie ganz hineinpasst
+   (keine abgeschnittenen Zeilen). Rueckgabe E_OK oder E_USART_TX_FULL. */
+unsigned char USART_TryPutString(const char text[]);
+//---------------------------------------------------------------------------------------------
+/* Freie Bytes im Sendepuffer */
+unsigned char USART_TxFree(void);
+//---------------------------------------------------------------------------------------------
+/* Anzahl verworfener Bytes seit USART_Init() (bleibt bei 0xffff stehen) */
+unsigned int USART_TxDropped(void);
+//---------------------------------------------------------------------------------------------
+/* Warten, bis der Sendepuffer leer ist (blockiert!) */
+void USART_Flush(void);
+//---------------------------------------------------------------------------------------------
+
+#endif /* USARTTX_H_ */
@@ -0,0 +1,110 @@
+/*
+ * can.c
+ *
+ * CAN-Schnittstelle der Anwendung: leitet jeden Aufruf an die Funktionstabelle
+ * des in can_init() gewaehlten Treibers weiter, siehe can.h.
+ */
+
+#include <stddef.h>
+#include <avr/pgmspace.h>
+
+#include "can.h"
+
+/* Funktionstabelle im Flash (PROGMEM): jeder Eintrag wird vor dem Aufruf
+ * gelesen, die Tabelle belegt kein RAM */
+static const tCANOps *can_ops;
+
+#define CAN_OP(name)	((__typeof__(can_ops->name))pgm_read_ptr(&can_ops->name))
+
+//---------------------------------------------------------------------------------------------
+uint8_t can_init(const tCANOps *ops, uint32_t bitrate)
+{
+	can_ops = ops;
+	return CAN_OP(init)(bitrate);
+}
+
+//---------------------------------------------------------------------------------------------
+uint8_t can_set_filters(const uint32_t *ids, uint8_t count)
+{
+	return CAN_OP(set_filters)(ids, count);
+}
+
+//---------------------------------------------------------------------------------------------
+uint8_t can_send(const tCANFrame *frame)
+{
+	return CAN_OP(send)(frame);
+}
+
+//---------------------------------------------------------------------------------------------
+uint8_t can_receive(tCANFrame *frame)
+{
+	return CAN_OP(receive)(frame);
+}
+
+//---------------------------------------------------------------------------------------------
+const tCANFrame *can_rx_peek(void)
+{
+	return CAN_OP(rx_peek)();
+}
+
+//---------------------------------------------------------------------------------------------
+void can_rx_release(void)
+{
+	CAN_OP(rx_release)();
+}
+
+//---------------------------------------------------------------------------------------------
+tCANFrame *can_tx_alloc(uint32_t id, uint8_t flags, uint8_t length)
+{
+	return CAN_OP(tx_alloc)(id, flags, length);
+}
+
+//---------------------------------------------------------------------------------------------
+tCANFrame *can_tx_alloc_P(const tCANFrame *template_P)
+{
+	uint8_t length = pgm_read_byte(&template_P->length);
+	tCANFrame *frame = CAN_OP(tx_alloc)(pgm_read_dword(&template_P->id),
+		pgm_read_byte(&template_P->flags), length);
+
+	if (frame) {
+		// Kopf und nur die benutzten Datenbytes (length <= CAN_MAX_DLEN)
+		memcpy_P(frame, template_P, offsetof(tCANFrame, data) + length);
+	}
+	return frame;
+}
+
+//---------------------------------------------------------------------------------------------
+uint8_t can_tx_commit(tCANFrame *frame)
+{
+	return CAN_OP(tx_commit)(frame);
+}
+
+//---------------------------------------------------------------------------------------------
+void can_set_rx_notify(void (*notify)(void))
+{
+	CAN_OP(set_rx_notify)(notify);
+}
+
+//---------------------------------------------------------------------------------------------
+void can_get_error_status(tCANErrorStatus *status)
+{
+	CAN_OP(get_error_status)(status);
+}
+
+//---------------------------------------------------------------------------------------------
+void can_set_error_notify(void (*notify)(uint8_t old_state, uint8_t new_state))
+{
+	CAN_OP(set_error_notify)(notify);
+}
+
+//---------------------------------------------------------------------------------------------
+void can_error_poll(uint16_t elapsed_ms)
+{
+	CAN_OP(error_poll)(elapsed_ms);
+}
+
+//---------------------------------------------------------------------------------------------
+uint8_t can_max_length(void)
+{
+	return pgm_read_byte(&can_ops->max_length);
+}
@@ -0,0 +1,211 @@
+/*
+ * can.h
+ *
+ * CAN-Schnittstelle der Anwendung, unabhaengig vom Controller. Die Tasks senden
+ * und empfangen tCANFrame ueber can_send() und can_receive(); welcher Treiber
+ * dahinter steht, legt allein die Funktionstabelle tCANOps in can_init() fest:
+ * mcp2515_can_ops (mcp2515.h) auf der Platine, can_loop_ops (host/can_loop.h)
+ * als Loopback auf dem Host. Ein Knoten mit einem schnelleren Controller
+ * braucht nur eine weitere Tabelle, die Tasks bleiben unveraendert.
+ *
+ * tCANFrame traegt die Laenge in Byte statt des 4-Bit-DLC und bis zu
+ * CAN_MAX_DLEN Datenbytes: 8 fuer klassisches CAN, 64 mit CAN_FD_ENABLE. Auf
+ * dem ATmega88PA (1 KByte RAM, 80 Byte Stack je Task) bleibt CAN FD aus, jede
+ * Nachricht auf dem Stack kostet dann 14 statt 70 Byte. Treiber, die kein CAN
+ * FD koennen (max_length 8), lehnen FD-Nachrichten in send() ab.
+ *
+ * Ohne Kopie: can_rx_peek() leiht die aelteste empfangene Nachricht direkt aus
+ * dem Ringpuffer des Treibers, bis can_rx_release() den Platz freigibt.
+ * can_tx_alloc() leiht einen Platz der Sendewarteschlange, den die Task fuellt
+ * und mit can_tx_commit() einreiht; can_tx_alloc_P() fuellt ihn vorher aus
+ * einer Vorlage im Flash (PROGMEM), sodass nur noch die Signale in data
+ * eingetragen werden. Keine Nachricht liegt dann mehr auf dem Task-Stack.
+ * can_send() und can_receive() kopieren wie bisher.
+ *
+ * Zuordnung DLC -> Laenge bei CAN FD (ISO 11898-1):
+ *
+ *   DLC     0..8   9   10   11   12   13   14   15
+ *   Byte    0..8  12   16   20   24   32   48   64
+ */
+
+#ifndef CAN_H_
+#define CAN_H_
+
+#include <inttypes.h>
+
+#ifndef CAN_FD_ENABLE
+#define CAN_FD_ENABLE		0
+#endif
+
+#if CAN_FD_ENABLE
+#define CAN_MAX_DLEN		64
+#else
+#define CAN_MAX_DLEN		8
+#endif
+
+// ----------------------------------------------------------------------------
+// Extended (29 Bit) IDs werden wie in der DBC-Datei mit gesetztem Bit 31 markiert
+#define CAN_ID_EXT			0x80000000UL
+#define CAN_ID_EXT_MASK		0x1fffffffUL
+
+// ----------------------------------------------------------------------------
+// tCANFrame.flags
+#define CAN_FRAME_RTR		0x01		// Remote-Frame (nur klassisches CAN)
+#define CAN_FRAME_FDF		0x02		// CAN-FD-Format, Laenge bis 64 Byte
+#define CAN_FRAME_BRS		0x04		// CAN FD: Datenphase mit hoeherer Bitrate
+
+// ----------------------------------------------------------------------------
+// Fehlerzustaende nach ISO 11898-1 (Fault Confinement)
+#define CAN_ERROR_ACTIVE	0			// TEC und REC < 96
+#define CAN_ERROR_WARNING	1			// TEC oder REC >= 96
+#define CAN_ERROR_PASSIVE	2			// TEC oder REC >= 128
+#define CAN_BUS_OFF			3			// TEC > 255
+
+typedef struct
+{
+	uint32_t id;				// 11 bit id or 29 bit id | CAN_ID_EXT
+	uint8_t flags;				// CAN_FRAME_...
+	uint8_t length;				// bytes in data, with CAN_FRAME_FDF one of the DLC lengths
+	uint8_t data[CAN_MAX_DLEN];
+} tCANFrame;
+
+typedef struct
+{
+	uint8_t state;				// CAN_ERROR_ACTIVE .. CAN_BUS_OFF
+	uint8_t eflg;				// error flags of the controller, TEC and REC at the last update
+	uint8_t tec;
+	uint8_t rec;
+	uint8_t tec_max;			// highest counters since init
+	uint8_t rec_max;
+	uint16_t transitions[4];	// changes into each state
+	uint16_t error_periods;		// calls of error_poll() that found error frames
+	uint16_t rx_hw_overflow;	// messages lost inside the controller
+	uint16_t tx_aborted;		// messages aborted in the controller at bus-off
+	uint16_t recoveries;		// transmission resumed after bus-off
+} tCANErrorStatus;
+
+// ----------------------------------------------------------------------------
+// Funktionstabelle eines Treibers, Bedeutung wie bei den gleichnamigen can_...().
+// Sie liegt im Flash (PROGMEM), can.c liest die Eintraege mit pgm_read_ptr().
+typedef struct
+{
+	uint8_t (*init)(uint32_t bitrate);
+	uint8_t (*set_filters)(const uint32_t *ids, uint8_t count);
+	uint8_t (*send)(const tCANFrame *frame);
+	uint8_t (*receive)(tCANFrame *frame);
+	const tCANFrame *(*rx_peek)(void);
+	void (*rx_release)(void);
+	tCANFrame *(*tx_alloc)(uint32_t id, uint8_t flags, uint8_t length);
+	uint8_t (*tx_commit)(tCANFrame *frame);
+	void (*set_rx_notify)(void (*notify)(void));
+	void (*get_error_status)(tCANErrorStatus *status);
+	void (*set_error_notify)(void (*notify)(uint8_t old_state, uint8_t new_state));
+	void (*error_poll)(uint16_t elapsed_ms);
+	uint8_t max_length;			// 8: nur klassisches CAN, 64: CAN FD
+} tCANOps;
+
+// ----------------------------------------------------------------------------
+// Laenge in Byte zu einem DLC 0..15 (DLC > 15 wie 15)
+static inline uint8_t can_dlc_to_length(uint8_t dlc)
+{
+	if (dlc <= 8) {
+		return dlc;
+	}
+	if (dlc <= 12) {
+		return 8 + 4 * (dlc - 8);
+	}
+	if (dlc == 13) {
+		return 32;
+	}
+	return (dlc == 14) ? 48 : 64;
+}
+
+// ----------------------------------------------------------------------------
+// kleinster DLC, dessen Laenge mindestens length Byte fasst (length > 64 wie 64)
+static inline uint8_t can_length_to_dlc(uint8_t length)
+{
+	if (length <= 8) {
+		return length;
+	}
+	if (length <= 24) {
+		return 8 + (length - 5) / 4;
+	}
+	if (length <= 32) {
+		return 13;
+	}
+	return (length <= 48) ? 14 : 15;
+}
+
+// ----------------------------------------------------------------------------
+// Treiber ops (Tabelle im Flash) waehlen und fuer bitrate in bit/s initialisieren, vor allen
+// anderen can_...(). Rueckgabe 0, wenn der Controller nicht bereit ist.
+uint8_t can_init(const tCANOps *ops, uint32_t bitrate);
+
+// ----------------------------------------------------------------------------
+// nur Nachrichten mit diesen IDs empfangen (Extended IDs mit CAN_ID_EXT),
+// count == 0: alle Nachrichten
+uint8_t can_set_filters(const uint32_t *ids, uint8_t count);
+
+// ----------------------------------------------------------------------------
+// Nachricht senden bzw. in die Sendewarteschlange des Treibers stellen.
+// Rueckgabe 0, wenn sie verworfen wurde (Warteschlange voll, CAN FD oder
+// Laenge, die der Treiber nicht kann).
+uint8_t can_send(const tCANFrame *frame);
+
+// ----------------------------------------------------------------------------
+// aelteste empfangene Nachricht abholen (blockiert nicht), Rueckgabe 0, wenn
+// keine vorliegt
+uint8_t can_receive(tCANFrame *frame);
+
+// ----------------------------------------------------------------------------
+// aelteste empfangene Nachricht im Ringpuffer des Treibers, NULL wenn keine
+// vorliegt. Sie bleibt bis can_rx_release() gueltig und belegt.
+const tCANFrame *can_rx_peek(void);
+
+// ----------------------------------------------------------------------------
+// Nachricht von can_rx_peek() freigeben
+void can_rx_release(void);
+
+// ----------------------------------------------------------------------------
+// Platz fuer eine Nachricht mit dieser ID, flags und length in der
+// Sendewarteschlange leihen, die drei sind darin schon eingetragen. NULL, wenn
+// sie verworfen wurde (wie can_send(): bei voller Warteschlange faellt die
+// Nachricht mit der niedrigsten Prioritaet) oder der Treiber Format und Laenge
+// nicht senden kann; dann wird auch keine andere Nachricht verdraengt. Jeder
+// Platz muss mit can_tx_commit() zurueckgegeben werden.
+tCANFrame *can_tx_alloc(uint32_t id, uint8_t flags, uint8_t length);
+
+// ----------------------------------------------------------------------------
+// wie can_tx_alloc() mit ID, flags und length aus der Vorlage im Flash
+// (PROGMEM); auch die ersten length Datenbytes werden uebernommen
+tCANFrame *can_tx_alloc_P(const tCANFrame *template_P);
+
+// ----------------------------------------------------------------------------
+// gefuellte Nachricht von can_tx_alloc() einreihen, Rueckgabe 0 wie bei
+// can_send(), der Platz ist danach in jedem Fall zurueckgegeben
+uint8_t can_tx_commit(tCANFrame *frame);
+
+// ----------------------------------------------------------------------------
+// Funktion, die der Treiber im Interrupt nach dem Empfang aufruft (z.B.
+// SetEvent() fuer die empfangende Task), NULL schaltet sie ab
+void can_set_rx_notify(void (*notify)(void));
+
+// ----------------------------------------------------------------------------
+// Fehlerzaehler, Fehlerzustand und Statistik des Controllers
+void can_get_error_status(tCANErrorStatus *status);
+
+// ----------------------------------------------------------------------------
+// Funktion, die bei jedem Wechsel des Fehlerzustands aufgerufen wird, NULL
+// schaltet sie ab
+void can_set_error_notify(void (*notify)(uint8_t old_state, uint8_t new_state));
+
+// ----------------------------------------------------------------------------
+// periodisch aus einer Task aufrufen, elapsed_ms seit dem letzten Aufruf:
+// Fehlerzaehler lesen, nach Bus-Off wieder senden
+void can_error_poll(uint16_t elapsed_ms);
+
+// ----------------------------------------------------------------------------
+// groesste Laenge einer Nachricht, die der gewaehlte Treiber sendet
+uint8_t can_max_length(void);
+
+#endif /* CAN_H_ */
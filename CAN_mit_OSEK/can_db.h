@@ -0,0 +1,110 @@
+/*
+ * can_db.h
+ *
+ * Automatisch erzeugt aus Temperaturmessung.dbc mit tools/dbc2c.py - nicht von Hand aendern!
+ */
+
+#ifndef CAN_DB_H
+#define CAN_DB_H
+
+#include <stdint.h>
+
+/* Botschaft status_led, gesendet von Temperaturknoten */
+#define CAN_DB_STATUS_LED_ID 0x100UL
+#define CAN_DB_STATUS_LED_DLC 1
+#define CAN_DB_STATUS_LED_INIT { CAN_DB_STATUS_LED_ID, 0, CAN_DB_STATUS_LED_DLC, { 0 } }
+
+/* status_led.status_led_signal: Startbit 0, 8 Bit, Intel, unsigned, Faktor 1, Offset 0 */
+#define CAN_DB_STATUS_LED_SIGNAL_FACTOR 1.0
+#define CAN_DB_STATUS_LED_SIGNAL_OFFSET 0.0
+#define CAN_DB_STATUS_LED_SIGNAL_AN 1
+#define CAN_DB_STATUS_LED_SIGNAL_AUS 0
+
+static inline void can_db_pack_status_led_signal(uint8_t *data, uint8_t value)
+{
+	uint8_t raw = value;
+
+	data[0] = (uint8_t)raw;
+}
+
+static inline uint8_t can_db_unpack_status_led_signal(const uint8_t *data)
+{
+	uint8_t raw = data[0];
+
+	return raw;
+}
+
+/* Botschaft taster, gesendet von Bedienpanel */
+#define CAN_DB_TASTER_ID 0x080UL
+#define CAN_DB_TASTER_DLC 8
+#define CAN_DB_TASTER_INIT { CAN_DB_TASTER_ID, 0, CAN_DB_TASTER_DLC, { 0 } }
+
+/* taster.taster_signal: Startbit 0, 8 Bit, Intel, unsigned, Faktor 1, Offset 0 */
+#define CAN_DB_TASTER_SIGNAL_FACTOR 1.0
+#define CAN_DB_TASTER_SIGNAL_OFFSET 0.0
+#define CAN_DB_TASTER_SIGNAL_MESSUNG_STARTEN 1
+#define CAN_DB_TASTER_SIGNAL_MESSUNG_STOPPEN 0
+
+static inline void can_db_pack_taster_signal(uint8_t *data, uint8_t value)
+{
+	uint8_t raw = value;
+
+	data[0] = (uint8_t)raw;
+}
+
+static inline uint8_t can_db_unpack_taster_signal(const uint8_t *data)
+{
+	uint8_t raw = data[0];
+
+	return raw;
+}
+
+/* Botschaft temperatur, gesendet von Temperaturknoten */
+#define CAN_DB_TEMPERATUR_ID 0x090UL
+#define CAN_DB_TEMPERATUR_DLC 2
+#define CAN_DB_TEMPERATUR_INIT { CAN_DB_TEMPERATUR_ID, 0, CAN_DB_TEMPERATUR_DLC, { 0 } }
+
+/* temperatur.temperatur_signal: Startbit 0, 16 Bit, Intel, unsigned, Faktor 0.125, Offset 0 */
+#define CAN_DB_TEMPERATUR_SIGNAL_FACTOR 0.125
+#define CAN_DB_TEMPERATUR_SIGNAL_OFFSET 0.0
+
+static inline void can_db_pack_temperatur_signal(uint8_t *data, uint16_t value)
+{
+	uint16_t raw = value;
+
+	data[0] = (uint8_t)raw;
+	data[1] = (uint8_t)(raw >> 8);
+}
+
+static inline uint16_t can_db_unpack_temperatur_signal(const uint8_t *data)
+{
+	uint16_t raw = (uint16_t)data[0]
+		| ((uint16_t)data[1] << 8);
+
+	return raw;
+}
+
+/* Alle Signale: Name, ID, Startbit, Laenge, Intel, signed, Faktor, Offset */
+#define CAN_DB_SIGNAL_COUNT 3
+#define CAN_DB_SIGNAL_TABLE { \
+	{ "status_led_signal", CAN_DB_STATUS_LED_ID, 0, 8, 1, 0, 1.0, 0.0 }, \
+	{ "taster_signal", CAN_DB_TASTER_ID, 0, 8, 1, 0, 1.0, 0.0 }, \
+	{ "temperatur_signal", CAN_DB_TEMPERATUR_ID, 0, 16, 1, 0, 0.125, 0.0 }, \
+}
+
+/* Nachrichten, die der Knoten Temperaturknoten empfaengt (Tabelle fuer can_set_filters()). */
+#define CAN_DB_RX_FILTER_COUNT 1
+#define CAN_DB_RX_FILTER_IDS { 0x080UL /* taster */ }
+
+/* Zyklische Nachrichten des Knotens Temperaturknoten (GenMsgCycleTime) fuer can_sched.h: Vorlage
+   can_tx_<botschaft>, Funktion can_fill_<botschaft>(), Periode und Versatz in Ticks.
+   Hoechstens CAN_DB_SCHED_BURST Nachrichten sind im selben Tick faellig. */
+#define CAN_DB_SCHED_TICK_MS 10
+#define CAN_DB_SCHED_COUNT 1
+#define CAN_DB_SCHED_BURST 1
+#define CAN_DB_SCHED_TEMPERATUR 0
+#define CAN_DB_SCHED_TABLE { \
+	{ &can_tx_temperatur, can_fill_temperatur, 10, 0 }, /* 100 ms, Versatz 0 ms */ \
+}
+
+#endif /* CAN_DB_H */
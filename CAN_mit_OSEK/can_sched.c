@@ -0,0 +1,141 @@
+/*
+ * can_sched.c
+ *
+ * Zeitplan fuer zyklische CAN-Nachrichten, siehe can_sched.h.
+ */
+
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <avr/pgmspace.h>
+
+#include "can_sched.h"
+
+static const tCANSchedEntry *can_sched_table_P;
+static uint8_t can_sched_count;
+static TickType can_sched_tick;
+static TickType can_sched_next;				/* Zeitpunkt des naechsten Ticks */
+static uint16_t can_sched_countdown[CAN_SCHED_MAX];	/* Ticks bis zum naechsten Versand */
+static uint8_t can_sched_active;
+static tCANSchedStats can_sched_stats;
+
+//---------------------------------------------------------------------------------------------
+/* Os_GetSytemCounter() liest die beiden Bytes des Zaehlers ohne Sperre */
+static TickType can_sched_now(void)
+{
+	uint8_t sreg = SREG;
+	TickType now;
+
+	cli();
+	now = Os_GetSytemCounter();
+	SREG = sreg;
+	return now;
+}
+
+//---------------------------------------------------------------------------------------------
+/* Nachricht aus der Vorlage direkt in der Sendewarteschlange anlegen */
+static void can_sched_send(uint8_t index)
+{
+	tCANSchedEntry entry;
+	tCANFrame *frame;
+
+	memcpy_P(&entry, &can_sched_table_P[index], sizeof(entry));
+	frame = can_tx_alloc_P(entry.template_P);
+	if (!frame) {
+		can_sched_stats.dropped++;
+		return;
+	}
+	if (entry.fill) {
+		entry.fill(frame->data);
+	}
+	if (can_tx_commit(frame)) {
+		can_sched_stats.sent++;
+	}
+	else {
+		can_sched_stats.dropped++;
+	}
+}
+
+//---------------------------------------------------------------------------------------------
+void can_sched_init(const tCANSchedEntry *table_P, uint8_t count, TickType tick)
+{
+	uint8_t i;
+
+	if (count > CAN_SCHED_MAX) {
+		count = CAN_SCHED_MAX;
+	}
+	can_sched_table_P = table_P;
+	can_sched_count = count;
+	can_sched_tick = tick ? tick : 1;
+	can_sched_active = 0;
+	for (i = 0; i < count; i++) {
+		can_sched_countdown[i] = pgm_read_word(&table_P[i].offset);
+	}
+	can_sched_next = can_sched_now();
+}
+
+//---------------------------------------------------------------------------------------------
+void can_sched_enable(uint8_t index, uint8_t on)
+{
+	if (index >= can_sched_count) {
+		return;
+	}
+	if (on) {
+		can_sched_active |= 1 << index;
+	}
+	else {
+		can_sched_active &= ~(1 << index);
+	}
+}
+
+//---------------------------------------------------------------------------------------------
+TickType can_sched_run(void)
+{
+	TickType now = can_sched_now();
+	uint16_t wait = UINT16_MAX;
+	uint8_t due = 0;
+	uint8_t i, bit;
+
+	if (can_sched_count == 0) {
+		return 0;
+	}
+
+	/* alle Ticks bis jetzt nachholen; Differenz mit Vorzeichen wegen des
+	   Ueberlaufs des Systemzaehlers */
+	while ((int16_t)(now - can_sched_next) >= 0) {
+		for (i = 0, bit = 1; i < can_sched_count; i++, bit <<= 1) {
+			if (can_sched_countdown[i]) {
+				can_sched_countdown[i]--;
+				continue;
+			}
+			can_sched_countdown[i] = pgm_read_word(&can_sched_table_P[i].period) - 1;
+			if (can_sched_active & bit) {
+				if (due & bit) {
+					can_sched_stats.late++;
+				}
+				due |= bit;
+			}
+		}
+		can_sched_next += can_sched_tick;
+	}
+
+	for (i = 0, bit = 1; due; i++, bit <<= 1) {
+		if (due & bit) {
+			due &= ~bit;
+			can_sched_send(i);
+		}
+	}
+
+	/* naechster Tick, in dem eine Nachricht faellig ist, auch abgeschaltete */
+	for (i = 0; i < can_sched_count; i++) {
+		if (can_sched_countdown[i] < wait) {
+			wait = can_sched_countdown[i];
+		}
+	}
+	return (TickType)(can_sched_next + wait * can_sched_tick - now);
+}
+
+//---------------------------------------------------------------------------------------------
+void can_sched_get_stats(tCANSchedStats *stats)
+{
+	*stats = can_sched_stats;
+}
@@ -0,0 +1,75 @@
+/*
+ * can_sched.h
+ *
+ * Zeitplan fuer zyklische CAN-Nachrichten aus einer Tabelle im Flash. Jede
+ * Nachricht hat Periode und Versatz in Ticks des Zeitplans (CAN_DB_SCHED_TICK_MS),
+ * beides erzeugt tools/dbc2c.py aus den DBC-Attributen GenMsgCycleTime und
+ * GenMsgStartDelayTime in CAN_DB_SCHED_TABLE. Ohne GenMsgStartDelayTime waehlt
+ * dbc2c.py die Versaetze so, dass moeglichst wenige Nachrichten im selben Tick
+ * faellig werden: der MCP2515 hat nur drei Sendepuffer, der Rest wartet in der
+ * Warteschlange von mcp2515.c. Eine weitere zyklische Nachricht braucht damit
+ * nur das Attribut in der DBC, ihre Vorlage und eine Funktion, die die Signale
+ * eintraegt, aber keine eigene Task und keinen eigenen Alarm.
+ *
+ * can_sched_run() laeuft in einer Task (main.c: Task1 auf EV_CAN_TX) und holt
+ * alle seit dem letzten Aufruf vergangenen Ticks nach, eine verspaetete Task
+ * verliert also keine Nachricht. Der Rueckgabewert ist der Abstand zum
+ * naechsten Tick, in dem eine Nachricht faellig ist; ein einmaliger SwTimer
+ * (SwTimer.h) weckt die Task genau dann und nicht in jedem Tick des Zeitplans.
+ *
+ * Die Zaehler aller Nachrichten laufen auch, solange sie abgeschaltet sind
+ * (can_sched_enable()): eine wieder eingeschaltete Nachricht behaelt ihren
+ * Versatz zu den anderen.
+ */
+
+#ifndef CAN_SCHED_H_
+#define CAN_SCHED_H_
+
+#include <inttypes.h>
+
+#include "Os.h"
+#include "can.h"
+
+/* Anzahl Nachrichten im Zeitplan (RAM: 2 Byte je Nachricht), hoechstens 8 */
+#ifndef CAN_SCHED_MAX
+#define CAN_SCHED_MAX		4
+#endif
+
+#if CAN_SCHED_MAX > 8
+#error CAN_SCHED_MAX: hoechstens 8 Nachrichten (Bitmaske uint8_t)
+#endif
+
+typedef struct
+{
+	const tCANFrame *template_P;	// Vorlage im Flash (PROGMEM) fuer can_tx_alloc_P()
+	void (*fill)(uint8_t *data);	// Signale eintragen, NULL: Vorlage unveraendert senden
+	uint16_t period;				// in Ticks des Zeitplans
+	uint16_t offset;				// erster Versand nach offset Ticks, < period
+} tCANSchedEntry;
+
+typedef struct
+{
+	uint16_t sent;					// an can_tx_commit() uebergeben
+	uint16_t dropped;				// Sendewarteschlange voll
+	uint16_t late;					// erneut faellig, bevor can_sched_run() sie gesendet hat
+} tCANSchedStats;
+
+// ----------------------------------------------------------------------------
+// Tabelle im Flash (PROGMEM) mit count <= CAN_SCHED_MAX Nachrichten, tick in
+// OS-Ticks je Tick des Zeitplans. Der erste Tick ist jetzt, alle Nachrichten
+// sind abgeschaltet.
+void can_sched_init(const tCANSchedEntry *table_P, uint8_t count, TickType tick);
+
+// ----------------------------------------------------------------------------
+// Nachricht index der Tabelle senden (on != 0) oder nicht mehr senden
+void can_sched_enable(uint8_t index, uint8_t on);
+
+// ----------------------------------------------------------------------------
+// faellige Nachrichten senden (Task-Kontext). Rueckgabe: OS-Ticks bis zum
+// naechsten Aufruf, 0 bei leerer Tabelle.
+TickType can_sched_run(void);
+
+// ----------------------------------------------------------------------------
+void can_sched_get_stats(tCANSchedStats *stats);
+
+#endif /* CAN_SCHED_H_ */
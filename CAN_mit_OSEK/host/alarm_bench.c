@@ -0,0 +1,290 @@
+/*
+ * alarm_bench.c
+ *
+ * Kosten des OS-Ticks gegen die Zahl zyklischer Aufgaben: einmal jede Aufgabe
+ * als eigener OS-Alarm, einmal als Software-Timer (SwTimer.c) an einem Alarm.
+ * Der Tick-ISR von libOsekAvr.a ist hier nachgebildet (Systemzaehler + 1, alle
+ * Alarme mit inUse und nextOccurrence == Systemzaehler ausloesen, danach cycle
+ * addieren oder freigeben, Listing __vector_13). Beide Varianten bekommen
+ * dieselben Zyklen (10 ms bis 1 s) und Phasen; Zahl und Zeitpunkte der
+ * Ablaeufe muessen gleich sein.
+ *
+ * Ausgegeben werden die Vergleiche im Tick-ISR je Tick (auf dem ATmega88PA etwa
+ * 27 Takte je Alarm, 0xf66-0xf8c im Listing) und die Zeit je Tick auf dem Host
+ * einschliesslich Einsortieren der Software-Timer. Die zweite Tabelle misst
+ * dieselben Aufgaben, wenn im ganzen Lauf keine faellig wird: das sind die
+ * allermeisten Ticks, hier kosten die Alarme O(n), die Software-Timer O(1).
+ * Mit mehreren Ablaeufen je Tick (ab etwa 64 Aufgaben) holt das Einsortieren
+ * zyklischer Timer, eine Zeigerkette durch die Liste, die Vergleiche ein; die
+ * Zeiten auf dem Host schwanken dort stark.
+ *
+ * Uebersetzen und starten (aus CAN_mit_OSEK):
+ *
+ *   gcc -std=gnu99 -O2 -Wall -funsigned-char -Ihost -I. -Ilib \
+ *       -o alarm_bench host/alarm_bench.c SwTimer.c
+ *   ./alarm_bench [-t ticks] [-n max_aufgaben] [-s seed]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <avr/io.h>
+
+#include "Os.h"
+#include "SwTimer.h"
+
+#define MAX_JOBS	256
+
+/* Ersatz fuer sim_avr.c: nur SREG wird gebraucht */
+static uint8_t io[256];
+
+volatile uint8_t *sim_io(uint8_t adress)
+{
+	return &io[adress];
+}
+
+volatile uint16_t *sim_io16(uint8_t adress)
+{
+	return (volatile uint16_t *)&io[adress];
+}
+
+void sim_sei(void)
+{
+	io[SIM_SREG] |= 0x80;
+}
+
+void sim_cli(void)
+{
+	io[SIM_SREG] &= ~0x80;
+}
+
+/* Daten aus Os_Cfg.c und Dienste des OS, die SwTimer.c benutzt */
+AlarmControlBlockT OsAlarmCB[MAX_JOBS];
+TaskControlBlockT OsTaskCB[MAX_JOBS];
+const TaskInfoBlockT OsTaskIB[MAX_JOBS];
+static TickType OsSystemCounter;
+
+static uint32_t fired[MAX_JOBS];
+static uint64_t checksum;
+static uint64_t compares;
+
+static void task_fired(TaskType task)
+{
+	/* bleibt SUSPENDED, jede Aktivierung zaehlt */
+	fired[task]++;
+	checksum += (uint64_t)OsSystemCounter * (task + 1);
+}
+
+StatusType ActivateTask(TaskType taskId)
+{
+	task_fired(taskId);
+	return E_OK;
+}
+
+StatusType SetEvent(TaskType taskId, EventMaskType mask)
+{
+	(void)taskId;
+	(void)mask;
+	return E_OK;
+}
+
+StatusType SetRelAlarm(AlarmType alarmId, TickType increment, TickType cycle)
+{
+	OsAlarmCB[alarmId].nextOccurrence = OsSystemCounter + (increment ? increment : 1);
+	OsAlarmCB[alarmId].cycle = cycle;
+	OsAlarmCB[alarmId].inUse = TRUE;
+	return E_OK;
+}
+
+TickType Os_GetSytemCounter()
+{
+	return OsSystemCounter;
+}
+
+static void (*alarm_callback[MAX_JOBS])(void);
+static uint8_t alarm_count;
+
+// ----------------------------------------------------------------------------
+/* Tick-ISR wie in libOsekAvr.a; Aktion ACTIVATETASK = Alarm-Index als Task */
+static void os_tick(void)
+{
+	OsSystemCounter++;
+	for (uint8_t i = 0; i < alarm_count; i++) {
+		AlarmControlBlockT *cb = &OsAlarmCB[i];
+
+		compares++;
+		if (cb->inUse == TRUE && cb->nextOccurrence == OsSystemCounter) {
+			if (alarm_callback[i]) {
+				alarm_callback[i]();
+			} else {
+				task_fired(i);
+			}
+			if (cb->cycle == 0) {
+				cb->inUse = FALSE;
+			} else {
+				cb->nextOccurrence += cb->cycle;
+			}
+		}
+	}
+}
+
+// ----------------------------------------------------------------------------
+static uint64_t seed = 1;
+
+static uint64_t random64(void)
+{
+	// xorshift64
+	seed ^= seed << 13;
+	seed ^= seed >> 7;
+	seed ^= seed << 17;
+	return seed;
+}
+
+static double seconds(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+typedef struct
+{
+	double compares;			/* Vergleiche im Tick-ISR je Tick */
+	double ns;					/* Host-Zeit je Tick */
+	uint64_t expiries;
+	uint64_t checksum;
+	uint32_t fired[MAX_JOBS];
+} result;
+
+static void reset(void)
+{
+	memset(OsAlarmCB, 0, sizeof(OsAlarmCB));
+	memset(OsTaskCB, 0, sizeof(OsTaskCB));
+	memset(alarm_callback, 0, sizeof(alarm_callback));
+	memset(fired, 0, sizeof(fired));
+	for (int i = 0; i < MAX_JOBS; i++) {
+		OsTaskCB[i].state = SUSPENDED;
+	}
+	OsSystemCounter = 0;
+	checksum = 0;
+	compares = 0;
+}
+
+static void finish(result *r, unsigned jobs, uint32_t ticks, double t)
+{
+	r->compares = (double)compares / ticks;
+	r->ns = t * 1e9 / ticks;
+	r->checksum = checksum;
+	r->expiries = 0;
+	for (unsigned i = 0; i < jobs; i++) {
+		r->fired[i] = fired[i];
+		r->expiries += fired[i];
+	}
+}
+
+/* jede Aufgabe als eigener Alarm */
+static void run_alarms(result *r, unsigned jobs, const TickType *cycle, const TickType *phase, uint32_t ticks)
+{
+	double t;
+
+	reset();
+	alarm_count = jobs;
+	for (unsigned i = 0; i < jobs; i++) {
+		OsAlarmCB[i].nextOccurrence = phase[i];
+		OsAlarmCB[i].cycle = cycle[i];
+		OsAlarmCB[i].inUse = TRUE;
+	}
+	t = seconds();
+	for (uint32_t n = 0; n < ticks; n++) {
+		os_tick();
+	}
+	finish(r, jobs, ticks, seconds() - t);
+}
+
+/* alle Aufgaben als SwTimer an Alarm 1, Alarm 0 steht fuer Alarm1 der Anwendung */
+static void run_swtimer(result *r, unsigned jobs, const TickType *cycle, const TickType *phase, uint32_t ticks)
+{
+	static SwTimerT timer[MAX_JOBS];
+	double t;
+
+	reset();
+	alarm_count = 2;
+	alarm_callback[1] = SwTimer_AlarmCallback;
+	SwTimer_Init(1, INVALID_TASK);
+	for (unsigned i = 0; i < jobs; i++) {
+		SwTimerT init = SW_TIMER_TASK(i);
+
+		timer[i] = init;
+		SwTimer_Start(&timer[i], phase[i], cycle[i]);
+	}
+	t = seconds();
+	for (uint32_t n = 0; n < ticks; n++) {
+		os_tick();
+	}
+	finish(r, jobs, ticks, seconds() - t);
+	for (unsigned i = 0; i < jobs; i++) {
+		SwTimer_Stop(&timer[i]);
+	}
+}
+
+// ----------------------------------------------------------------------------
+int main(int argc, char **argv)
+{
+	static const TickType cycles[] = { 10, 20, 50, 100, 200, 500, 1000 };
+	static TickType cycle[MAX_JOBS], phase[MAX_JOBS];
+	static result a, b;
+	uint32_t ticks = 1000000;
+	unsigned max_jobs = 128;
+	int opt, errors = 0;
+
+	while ((opt = getopt(argc, argv, "t:n:s:")) != -1) {
+		switch (opt) {
+		case 't': ticks = strtoul(optarg, 0, 0); break;
+		case 'n': max_jobs = strtoul(optarg, 0, 0); break;
+		case 's': seed = strtoull(optarg, 0, 0); break;
+		default:
+			fprintf(stderr, "Aufruf: %s [-t ticks] [-n max_aufgaben] [-s seed]\n", argv[0]);
+			return 2;
+		}
+	}
+	if (max_jobs < 1 || max_jobs > 255) {
+		fprintf(stderr, "max_aufgaben 1..255\n");
+		return 2;
+	}
+	for (unsigned i = 0; i < max_jobs; i++) {
+		cycle[i] = cycles[random64() % (sizeof(cycles) / sizeof(cycles[0]))];
+		phase[i] = 1 + random64() % cycle[i];
+	}
+
+	printf("%u Ticks, Zyklen 10..1000 Ticks\n\n", ticks);
+	printf("Aufgaben  Ablaeufe/Tick | je ein Alarm: Vergl./Tick  ns/Tick | SwTimer: Vergl./Tick  ns/Tick\n");
+	for (unsigned jobs = 1; jobs <= max_jobs; jobs *= 2) {
+		run_alarms(&a, jobs, cycle, phase, ticks);
+		run_swtimer(&b, jobs, cycle, phase, ticks);
+		if (a.checksum != b.checksum || memcmp(a.fired, b.fired, jobs * sizeof(a.fired[0]))) {
+			printf("FEHLER: Ablaeufe verschieden bei %u Aufgaben\n", jobs);
+			errors++;
+		}
+		printf("%8u  %13.3f | %25.2f %8.1f | %20.2f %8.1f\n", jobs, (double)a.expiries / ticks,
+			a.compares, a.ns, b.compares, b.ns);
+	}
+	printf("\nohne faellige Aufgabe im Lauf:\n");
+	printf("Aufgaben                | je ein Alarm: Vergl./Tick  ns/Tick | SwTimer: Vergl./Tick  ns/Tick\n");
+	for (unsigned i = 0; i < max_jobs; i++) {
+		phase[i] = ticks + 1 + i;
+	}
+	for (unsigned jobs = 1; jobs <= max_jobs; jobs *= 2) {
+		run_alarms(&a, jobs, cycle, phase, ticks);
+		run_swtimer(&b, jobs, cycle, phase, ticks);
+		if (a.expiries || b.expiries) {
+			printf("FEHLER: Ablauf bei %u Aufgaben\n", jobs);
+			errors++;
+		}
+		printf("%8u                | %25.2f %8.1f | %20.2f %8.1f\n", jobs, a.compares, a.ns, b.compares, b.ns);
+	}
+	printf("\n%d Fehler\n", errors);
+	return errors != 0;
+}
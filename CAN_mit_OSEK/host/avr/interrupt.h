@@ -0,0 +1,18 @@
+/*
+ * avr/interrupt.h (Host-Build)
+ *
+ * ISR(vector) wird zu einer normalen Funktion, die sim_avr.c aufruft, sobald der
+ * Interrupt anliegt, freigegeben ist und das I-Bit in SREG gesetzt ist.
+ */
+
+#ifndef SIM_AVR_INTERRUPT_H
+#define SIM_AVR_INTERRUPT_H
+
+#include <avr/io.h>
+
+#define ISR(vector, ...)	void vector(void); void vector(void)
+
+#define sei()				sim_sei()
+#define cli()				sim_cli()
+
+#endif /* SIM_AVR_INTERRUPT_H */
@@ -0,0 +1,172 @@
+/*
+ * avr/io.h (Host-Build)
+ *
+ * Ersatz fuer <avr/io.h> der avr-libc: die I/O-Register des ATmega88PA werden
+ * ueber sim_io() auf den simulierten Datenspeicher abgebildet, siehe sim_avr.h.
+ * Es sind nur die Register und Bits enthalten, die die Firmware benutzt.
+ */
+
+#ifndef SIM_AVR_IO_H
+#define SIM_AVR_IO_H
+
+#include <stdint.h>
+
+#include "sim_avr.h"
+#include <avr/sfr_defs.h>
+
+#define PINB	(*sim_io(SIM_PINB))
+#define DDRB	(*sim_io(SIM_DDRB))
+#define PORTB	(*sim_io(SIM_PORTB))
+#define PINC	(*sim_io(SIM_PINC))
+#define DDRC	(*sim_io(SIM_DDRC))
+#define PORTC	(*sim_io(SIM_PORTC))
+#define PIND	(*sim_io(SIM_PIND))
+#define DDRD	(*sim_io(SIM_DDRD))
+#define PORTD	(*sim_io(SIM_PORTD))
+#define TIFR0	(*sim_io(SIM_TIFR0))
+#define TIFR1	(*sim_io(SIM_TIFR1))
+#define TIFR2	(*sim_io(SIM_TIFR2))
+#define EIFR	(*sim_io(SIM_EIFR))
+#define EIMSK	(*sim_io(SIM_EIMSK))
+#define TCCR0A	(*sim_io(SIM_TCCR0A))
+#define TCCR0B	(*sim_io(SIM_TCCR0B))
+#define TCNT0	(*sim_io(SIM_TCNT0))
+#define SPCR	(*sim_io(SIM_SPCR))
+#define SPSR	(*sim_io(SIM_SPSR))
+#define SPDR	(*sim_io(SIM_SPDR))
+#define SMCR	(*sim_io(SIM_SMCR))
+#define SREG	(*sim_io(SIM_SREG))
+#define EICRA	(*sim_io(SIM_EICRA))
+#define TIMSK0	(*sim_io(SIM_TIMSK0))
+#define TIMSK1	(*sim_io(SIM_TIMSK1))
+#define TIMSK2	(*sim_io(SIM_TIMSK2))
+#define TCCR1A	(*sim_io(SIM_TCCR1A))
+#define TCCR1B	(*sim_io(SIM_TCCR1B))
+#define TCNT1	(*sim_io16(SIM_TCNT1))
+#define TCCR2A	(*sim_io(SIM_TCCR2A))
+#define TCCR2B	(*sim_io(SIM_TCCR2B))
+#define TCNT2	(*sim_io(SIM_TCNT2))
+#define TWBR	(*sim_io(SIM_TWBR))
+#define TWSR	(*sim_io(SIM_TWSR))
+#define TWAR	(*sim_io(SIM_TWAR))
+#define TWDR	(*sim_io(SIM_TWDR))
+#define TWCR	(*sim_io(SIM_TWCR))
+#define UCSR0A	(*sim_io(SIM_UCSR0A))
+#define UCSR0B	(*sim_io(SIM_UCSR0B))
+#define UCSR0C	(*sim_io(SIM_UCSR0C))
+#define UBRR0L	(*sim_io(SIM_UBRR0L))
+#define UBRR0H	(*sim_io(SIM_UBRR0H))
+#define UDR0	(*sim_io(SIM_UDR0))
+
+/* Portbits */
+#define PB0		0
+#define PB1		1
+#define PB2		2
+#define PB3		3
+#define PB4		4
+#define PB5		5
+#define PB6		6
+#define PB7		7
+#define PC0		0
+#define PC1		1
+#define PC2		2
+#define PC3		3
+#define PC4		4
+#define PC5		5
+#define PD0		0
+#define PD1		1
+#define PD2		2
+#define PD3		3
+#define PD4		4
+#define PD5		5
+#define PD6		6
+#define PD7		7
+
+/* SPCR, SPSR */
+#define SPIE	7
+#define SPE		6
+#define DORD	5
+#define MSTR	4
+#define CPOL	3
+#define CPHA	2
+#define SPR1	1
+#define SPR0	0
+#define SPIF	7
+#define WCOL	6
+#define SPI2X	0
+
+/* EICRA, EIMSK, EIFR */
+#define ISC11	3
+#define ISC10	2
+#define ISC01	1
+#define ISC00	0
+#define INT1	1
+#define INT0	0
+#define INTF1	1
+#define INTF0	0
+
+/* Timer 0 */
+#define WGM01	1
+#define WGM00	0
+#define CS02	2
+#define CS01	1
+#define CS00	0
+#define TOIE0	0
+#define OCIE0A	1
+#define TOV0	0
+
+/* Timer 1 */
+#define CS12	2
+#define CS11	1
+#define CS10	0
+#define TOIE1	0
+#define TOV1	0
+
+/* Timer 2 */
+#define CS22	2
+#define CS21	1
+#define CS20	0
+#define TOIE2	0
+#define TOV2	0
+
+/* SREG */
+#define SREG_I	7
+
+/* SMCR */
+#define SM2		3
+#define SM1		2
+#define SM0		1
+#define SE		0
+
+/* TWI */
+#define TWINT	7
+#define TWEA	6
+#define TWSTA	5
+#define TWSTO	4
+#define TWWC	3
+#define TWEN	2
+#define TWIE	0
+#define TWPS1	1
+#define TWPS0	0
+
+/* USART0 */
+#define RXC0	7
+#define TXC0	6
+#define UDRE0	5
+#define U2X0	1
+#define RXCIE0	7
+#define TXCIE0	6
+#define UDRIE0	5
+#define RXEN0	4
+#define TXEN0	3
+#define UCSZ01	2
+#define UCSZ00	1
+
+/* Interruptvektoren als Funktionsnamen, siehe <avr/interrupt.h> */
+#define INT0_vect			sim_vector_INT0
+#define TIMER1_OVF_vect		sim_vector_TIMER1_OVF
+#define TIMER0_OVF_vect		sim_vector_TIMER0_OVF
+#define USART_UDRE_vect		sim_vector_USART_UDRE
+#define TWI_vect			sim_vector_TWI
+
+#endif /* SIM_AVR_IO_H */
@@ -0,0 +1,22 @@
+/*
+ * avr/pgmspace.h (Host-Build)
+ *
+ * Der Host hat nur einen Adressraum: PROGMEM-Daten liegen im normalen
+ * Speicher, die Lesefunktionen sind gewoehnliche Zugriffe.
+ */
+
+#ifndef SIM_AVR_PGMSPACE_H
+#define SIM_AVR_PGMSPACE_H
+
+#include <stdint.h>
+#include <string.h>
+
+#define PROGMEM
+
+#define pgm_read_byte(addr)		(*(const uint8_t *)(addr))
+#define pgm_read_word(addr)		(*(const uint16_t *)(addr))
+#define pgm_read_dword(addr)	(*(const uint32_t *)(addr))
+#define pgm_read_ptr(addr)		(*(void * const *)(addr))
+#define memcpy_P(dest, src, n)	memcpy((dest), (src), (n))
+
+#endif /* SIM_AVR_PGMSPACE_H */
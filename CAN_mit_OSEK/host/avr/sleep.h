@@ -0,0 +1,23 @@
+/*
+ * avr/sleep.h (Host-Build)
+ *
+ * sleep_cpu() rueckt die simulierte Zeit bis zum naechsten Interrupt vor, siehe
+ * sim_sleep(). Die Schlafart wird nur in SMCR eingetragen.
+ */
+
+#ifndef SIM_AVR_SLEEP_H
+#define SIM_AVR_SLEEP_H
+
+#include <avr/io.h>
+
+#define SLEEP_MODE_IDLE			0
+#define SLEEP_MODE_ADC			(1 << SM0)
+#define SLEEP_MODE_PWR_DOWN		(1 << SM1)
+#define SLEEP_MODE_PWR_SAVE		((1 << SM0) | (1 << SM1))
+
+#define set_sleep_mode(mode)	(SMCR = (SMCR & ~((1 << SM0) | (1 << SM1) | (1 << SM2))) | (mode))
+#define sleep_enable()			(SMCR |= (1 << SE))
+#define sleep_disable()			(SMCR &= ~(1 << SE))
+#define sleep_cpu()				sim_sleep()
+
+#endif /* SIM_AVR_SLEEP_H */
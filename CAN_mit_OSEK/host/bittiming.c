@@ -0,0 +1,147 @@
+/*
+ * bittiming.c
+ *
+ * Tabelle der Bit-Timings, die mcp2515_init() mit mcp2515_bit_timing()
+ * (mcp2515_timing.c) fuer einen Oszillator und verschiedene Bitraten
+ * einstellt: BRP, Quanten je Bit, PropSeg, PS1, PS2, SJW, Abtastpunkt,
+ * Abweichung der Bitrate und die Registerwerte CNF1..CNF3.
+ *
+ * Jede Zeile wird gegen eine vollstaendige Suche ueber alle BRP, N, PropSeg,
+ * PS1 und PS2 des Datenblatts geprueft: die Abweichung der Bitrate und danach
+ * die des Abtastpunkts duerfen nicht schlechter sein als das Optimum.
+ *
+ * Uebersetzen und starten (aus CAN_mit_OSEK):
+ *
+ *   gcc -std=gnu99 -O2 -Wall -funsigned-char -Ihost -I. \
+ *       -o bittiming host/bittiming.c mcp2515_timing.c
+ *   ./bittiming [-o osc_hz] [-p abtastpunkt_promille] [bitrate ...]
+ *
+ * Ohne Bitraten: 10, 20, 33,3, 50, 83,3, 100, 125, 250, 500, 800, 1000 kbit/s.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "mcp2515_timing.h"
+#include "mcp2515_defs.h"
+
+static uint32_t osc = MCP2515_OSC;
+static uint16_t sample_point = MCP2515_SAMPLE_POINT;
+
+// ----------------------------------------------------------------------------
+static uint32_t difference(uint32_t a, uint32_t b)
+{
+	return a > b ? a - b : b - a;
+}
+
+/* Bestes Ergebnis der vollstaendigen Suche: Abweichung der Bitrate in bit/s
+ * und des Abtastpunkts in Promille (gerundet wie in mcp2515_timing.c) */
+static int search(uint32_t bitrate, uint32_t *rate_error, uint16_t *sp_error)
+{
+	int found = 0;
+
+	for (uint32_t brp = 1; brp <= 64; brp++) {
+		for (uint32_t n = 8; n <= 25; n++) {
+			uint32_t error = difference(osc / (2 * brp * n), bitrate);
+
+			for (uint32_t ps2 = 2; ps2 <= 8; ps2++) {
+				uint32_t tseg1 = n - 1 - ps2;
+				uint16_t sp_err;
+
+				// PropSeg 1..8 und PS1 1..8, PropSeg + PS1 >= PS2
+				if (tseg1 < 2 || tseg1 > 16 || tseg1 < ps2) {
+					continue;
+				}
+				sp_err = difference(1000 * (n - ps2) / n, sample_point);
+				if (!found || error < *rate_error || (error == *rate_error && sp_err < *sp_error)) {
+					*rate_error = error;
+					*sp_error = sp_err;
+					found = 1;
+				}
+			}
+		}
+	}
+	return found;
+}
+
+// ----------------------------------------------------------------------------
+static int print_timing(uint32_t bitrate)
+{
+	uint8_t cnf[3];
+	uint32_t brp, prop, ps1, ps2, sjw, n, rate, best_rate_error;
+	uint16_t sp, best_sp_error;
+
+	if (!mcp2515_bit_timing(osc, bitrate, sample_point, cnf)) {
+		if (search(bitrate, &best_rate_error, &best_sp_error)
+			&& best_rate_error * 1000 <= bitrate * MCP2515_BITRATE_TOLERANCE) {
+			printf("%8lu  FEHLER: nicht gefunden, erreichbar mit %lu bit/s Abweichung\n",
+				(unsigned long)bitrate, (unsigned long)best_rate_error);
+			return 1;
+		}
+		printf("%8lu  nicht erreichbar\n", (unsigned long)bitrate);
+		return 0;
+	}
+
+	// Register zurueck in Quanten wie der MCP2515 (BTLMODE gesetzt)
+	brp = (cnf[2] & 0x3f) + 1;
+	sjw = (cnf[2] >> 6) + 1;
+	prop = (cnf[1] & 0x07) + 1;
+	ps1 = ((cnf[1] >> 3) & 0x07) + 1;
+	ps2 = (cnf[0] & 0x07) + 1;
+	n = 1 + prop + ps1 + ps2;
+	rate = osc / (2 * brp * n);
+	sp = 1000 * (n - ps2) / n;
+
+	printf("%8lu  %3lu %3lu %4lu %3lu %3lu %3lu  %3u.%u %% %+8.3f %%   0x%02x 0x%02x 0x%02x\n",
+		(unsigned long)bitrate, (unsigned long)brp, (unsigned long)n, (unsigned long)prop,
+		(unsigned long)ps1, (unsigned long)ps2, (unsigned long)sjw, sp / 10, sp % 10,
+		100.0 * ((double)rate - bitrate) / bitrate, cnf[2], cnf[1], cnf[0]);
+
+	if (!(cnf[1] & (1<<BTLMODE)) || prop + ps1 < ps2 || ps2 < 2 || sjw > ps2 || sjw > ps1) {
+		printf("          FEHLER: Regeln des Datenblatts verletzt\n");
+		return 1;
+	}
+	search(bitrate, &best_rate_error, &best_sp_error);
+	if (difference(rate, bitrate) > best_rate_error
+		|| (difference(rate, bitrate) == best_rate_error && difference(sp, sample_point) > best_sp_error)) {
+		printf("          FEHLER: besser moeglich (Abweichung %lu bit/s, Abtastpunkt %u Promille daneben)\n",
+			(unsigned long)best_rate_error, best_sp_error);
+		return 1;
+	}
+	return 0;
+}
+
+int main(int argc, char **argv)
+{
+	static const uint32_t defaults[] = {
+		10000, 20000, 33333, 50000, 83333, 100000, 125000, 250000, 500000, 800000, 1000000
+	};
+	int opt, errors = 0;
+
+	while ((opt = getopt(argc, argv, "o:p:")) != -1) {
+		switch (opt) {
+		case 'o': osc = strtoul(optarg, 0, 0); break;
+		case 'p': sample_point = strtoul(optarg, 0, 0); break;
+		default:
+			fprintf(stderr, "Aufruf: %s [-o osc_hz] [-p abtastpunkt_promille] [bitrate ...]\n", argv[0]);
+			return 2;
+		}
+	}
+
+	printf("Oszillator %lu Hz, Abtastpunkt %u.%u %%\n\n", (unsigned long)osc, sample_point / 10,
+		sample_point % 10);
+	printf("  bit/s   BRP   N Prop PS1 PS2 SJW  Abtastp.  Abweichung   CNF1 CNF2 CNF3\n");
+	if (optind < argc) {
+		for (int i = optind; i < argc; i++) {
+			errors += print_timing(strtoul(argv[i], 0, 0));
+		}
+	}
+	else {
+		for (unsigned i = 0; i < sizeof(defaults) / sizeof(defaults[0]); i++) {
+			errors += print_timing(defaults[i]);
+		}
+	}
+	printf("\n%d Fehler\n", errors);
+	return errors != 0;
+}
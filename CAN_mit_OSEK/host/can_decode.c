@@ -0,0 +1,337 @@
+/*
+ * can_decode.c
+ *
+ * Spaltenweises Dekodieren von CAN-Signalen, siehe can_decode.h.
+ */
+
+#include <math.h>
+#include <string.h>
+
+#include "can_decode.h"
+
+/* Nachrichten je Vektor: vier mit AVX2, sonst zwei (SSE2) */
+#ifdef __AVX2__
+#define LANES		4
+#else
+#define LANES		2
+#endif
+
+/* Nachrichten je Kachel: alle Signale einer Kachel werden nacheinander
+ * dekodiert, solange ihre Spalten noch im L1-Cache liegen */
+#define TILE		1024
+
+typedef uint64_t u64v __attribute__((vector_size(8 * LANES)));
+typedef int64_t i64v __attribute__((vector_size(8 * LANES)));
+typedef double f64v __attribute__((vector_size(8 * LANES)));
+typedef uint8_t u8v __attribute__((vector_size(8 * LANES)));
+typedef uint32_t u32v __attribute__((vector_size(4 * LANES)));
+typedef int32_t i32v __attribute__((vector_size(4 * LANES)));
+typedef uint8_t dlcv __attribute__((vector_size(LANES)));
+
+/* Aus der Signalbeschreibung vorberechnete Konstanten */
+typedef struct
+{
+	uint8_t swap;				/* Motorola: Bytes vor dem Schieben tauschen */
+	uint8_t shift;				/* Lage des LSB im (ggf. getauschten) Datenwort */
+	uint64_t sign;				/* Vorzeichenbit fuer signed, sonst 0 */
+	uint8_t fast_convert;		/* Rohwert passt in 52 Bit (siehe to_double()) */
+	uint64_t mask;
+	uint8_t bytes;
+} kernel;
+
+// ----------------------------------------------------------------------------
+static void kernel_init(kernel *k, const can_decode_signal *signal)
+{
+	memset(k, 0, sizeof(*k));
+	k->swap = !signal->little_endian;
+	if (signal->little_endian) {
+		k->shift = signal->start;
+	}
+	else {
+		// nach dem Tauschen liegt Byte b bei Bit (7 - b) * 8; das MSB steht im
+		// Startbit, das Signal liegt darunter zusammenhaengend
+		k->shift = (7 - signal->start / 8) * 8 + signal->start % 8 - (signal->length - 1);
+	}
+	k->mask = (signal->length < 64) ? (1ULL << signal->length) - 1 : ~0ULL;
+	k->sign = signal->is_signed ? 1ULL << (signal->length - 1) : 0;
+	k->fast_convert = signal->is_signed ? signal->length <= 52 : signal->length <= 51;
+	k->bytes = can_decode_bytes(signal);
+}
+
+// ----------------------------------------------------------------------------
+uint8_t can_decode_bytes(const can_decode_signal *signal)
+{
+	uint8_t lsb;
+
+	if (signal->little_endian) {
+		return (signal->start + signal->length - 1) / 8 + 1;
+	}
+	// Motorola: das LSB liegt im letzten benutzten Byte
+	lsb = (7 - signal->start / 8) * 8 + signal->start % 8 - (signal->length - 1);
+	return 8 - lsb / 8;
+}
+
+// ----------------------------------------------------------------------------
+int64_t can_decode_raw_scalar(const can_decode_signal *signal, uint64_t data)
+{
+	uint64_t raw = 0;
+	uint8_t pos = signal->start;
+
+	if (signal->little_endian) {
+		for (uint8_t i = 0; i < signal->length; i++) {
+			raw |= ((data >> (signal->start + i)) & 1) << i;
+		}
+	}
+	else {
+		// vom MSB an, nach Bit 0 eines Bytes weiter bei Bit 7 des naechsten
+		for (uint8_t i = 0; i < signal->length; i++) {
+			raw = (raw << 1) | ((data >> pos) & 1);
+			pos = (pos % 8 == 0) ? pos + 15 : pos - 1;
+		}
+	}
+	if (signal->is_signed && signal->length < 64 && (raw >> (signal->length - 1)) & 1) {
+		raw |= ~0ULL << signal->length;
+	}
+	return (int64_t)raw;
+}
+
+// ----------------------------------------------------------------------------
+static inline __attribute__((always_inline)) u64v bswap(u64v data)
+{
+#ifdef __SSSE3__
+	const u8v order = {
+		7, 6, 5, 4, 3, 2, 1, 0, 15, 14, 13, 12, 11, 10, 9, 8,
+#if LANES == 4
+		23, 22, 21, 20, 19, 18, 17, 16, 31, 30, 29, 28, 27, 26, 25, 24
+#endif
+	};
+
+	return (u64v)__builtin_shuffle((u8v)data, order);
+#else
+	// ohne pshufb wuerde __builtin_shuffle Byte fuer Byte zerlegt: Bytes, dann
+	// 16-Bit- und 32-Bit-Haelften mit Schieben und Maskieren tauschen
+	data = ((data >> 8) & 0x00FF00FF00FF00FFULL) | ((data & 0x00FF00FF00FF00FFULL) << 8);
+	data = ((data >> 16) & 0x0000FFFF0000FFFFULL) | ((data & 0x0000FFFF0000FFFFULL) << 16);
+	return (data >> 32) | (data << 32);
+#endif
+}
+
+// ----------------------------------------------------------------------------
+/* Rohwerte eines Vektors von Nachrichten: schieben, maskieren, Vorzeichen
+ * erweitern. Das Vorzeichen wird mit (r ^ s) - s erweitert, weil es einen
+ * arithmetischen 64-Bit-Schiebebefehl erst mit AVX-512 gibt. */
+static inline __attribute__((always_inline)) i64v extract(u64v data, const kernel *k, int swap)
+{
+	if (swap) {
+		data = bswap(data);
+	}
+	data = (data >> k->shift) & k->mask;
+	return (i64v)((data ^ k->sign) - k->sign);
+}
+
+// ----------------------------------------------------------------------------
+/* int64 -> double ohne Konvertierungsbefehl (den es vor AVX-512 fuer 64 Bit
+ * nicht gibt): Wert + 2^51 als Mantisse unter den Exponenten von 2^52 legen
+ * und 2^52 + 2^51 abziehen. Gilt fuer -2^51 <= v < 2^51. */
+static inline __attribute__((always_inline)) f64v to_double(i64v v, int fast)
+{
+	if (!fast) {
+		return __builtin_convertvector(v, f64v);
+	}
+
+	u64v bits = (u64v)(v + (1LL << 51)) | 0x4330000000000000ULL;
+
+	return (f64v)bits - (0x1p52 + 0x1p51);
+}
+
+// ----------------------------------------------------------------------------
+/* Gueltige Nachrichten (ID passt und DLC reicht) als Maske je Lane */
+static inline __attribute__((always_inline)) i64v valid_mask(const uint32_t *id, const uint8_t *dlc,
+	const can_decode_signal *signal, const kernel *k)
+{
+	u32v ids;
+	dlcv dlcs;
+
+	memcpy(&ids, id, sizeof(ids));
+	memcpy(&dlcs, dlc, sizeof(dlcs));
+	// in 32 Bit vergleichen (SSE2 kennt keinen 64-Bit-Vergleich), dann verbreitern
+	return __builtin_convertvector((ids == signal->id)
+		& (__builtin_convertvector(dlcs, i32v) >= k->bytes), i64v);
+}
+
+// ----------------------------------------------------------------------------
+static inline __attribute__((always_inline)) void column_block(const uint32_t *id, const uint8_t *dlc,
+	const uint64_t *data, const can_decode_signal *signal, const kernel *k, int swap, int fast, double *value)
+{
+	const u64v nan = (u64v)((f64v){ 0 } + NAN);
+	u64v words;
+	f64v phys;
+	i64v valid;
+
+	memcpy(&words, data, sizeof(words));
+	valid = valid_mask(id, dlc, signal, k);
+	phys = to_double(extract(words, k, swap), fast) * signal->factor + signal->offset;
+	phys = (f64v)(((u64v)phys & (u64v)valid) | (nan & ~(u64v)valid));
+	memcpy(value, &phys, sizeof(phys));
+}
+
+/* Signal, Konstanten und Spalten werden in lokale Kopien geholt: die
+ * Ergebnisse werden mit memcpy() geschrieben und koennten sonst fuer den
+ * Compiler jeden Zeiger ueberschreiben, der in jeder Runde neu geladen wird. */
+static inline __attribute__((always_inline)) void column_loop(const can_decode_batch *batch,
+	const can_decode_signal *signal, const kernel *k, int swap, int fast, double *value)
+{
+	const can_decode_signal sig = *signal;
+	const kernel ker = *k;
+	const uint32_t *ids = batch->id;
+	const uint8_t *dlcs = batch->dlc;
+	const uint64_t *words = batch->data;
+	const size_t count = batch->count;
+	size_t i;
+
+	for (i = 0; i + LANES <= count; i += LANES) {
+		column_block(&ids[i], &dlcs[i], &words[i], &sig, &ker, swap, fast, &value[i]);
+	}
+
+	// Rest im aufgefuellten Block
+	if (i < count) {
+		uint32_t id[LANES] = { 0 };
+		uint8_t dlc[LANES] = { 0 };
+		uint64_t data[LANES] = { 0 };
+		double rest[LANES];
+		size_t n = count - i;
+
+		memcpy(id, &ids[i], n * sizeof(id[0]));
+		memcpy(dlc, &dlcs[i], n * sizeof(dlc[0]));
+		memcpy(data, &words[i], n * sizeof(data[0]));
+		column_block(id, dlc, data, &sig, &ker, swap, fast, rest);
+		memcpy(&value[i], rest, n * sizeof(rest[0]));
+	}
+}
+
+/* Je eine Schleife fuer Intel/Motorola und schnelle/normale Umrechnung */
+static void column(const can_decode_batch *batch, const can_decode_signal *signal, const kernel *k, double *value)
+{
+	if (k->swap) {
+		if (k->fast_convert) {
+			column_loop(batch, signal, k, 1, 1, value);
+		}
+		else {
+			column_loop(batch, signal, k, 1, 0, value);
+		}
+	}
+	else {
+		if (k->fast_convert) {
+			column_loop(batch, signal, k, 0, 1, value);
+		}
+		else {
+			column_loop(batch, signal, k, 0, 0, value);
+		}
+	}
+}
+
+void can_decode_column(const can_decode_batch *batch, const can_decode_signal *signal, double *value)
+{
+	kernel k;
+
+	kernel_init(&k, signal);
+	column(batch, signal, &k, value);
+}
+
+// ----------------------------------------------------------------------------
+void can_decode_columns(const can_decode_batch *batch, const can_decode_signal *signal, uint16_t count,
+	double **value)
+{
+	kernel k[count];
+
+	for (uint16_t s = 0; s < count; s++) {
+		kernel_init(&k[s], &signal[s]);
+	}
+
+	for (size_t first = 0; first < batch->count; first += TILE) {
+		can_decode_batch tile = {
+			(batch->count - first < TILE) ? batch->count - first : TILE,
+			NULL, &batch->id[first], &batch->dlc[first], &batch->data[first]
+		};
+
+		for (uint16_t s = 0; s < count; s++) {
+			column(&tile, &signal[s], &k[s], &value[s][first]);
+		}
+	}
+}
+
+// ----------------------------------------------------------------------------
+static inline __attribute__((always_inline)) i64v raw_block(const uint32_t *id, const uint8_t *dlc,
+	const uint64_t *data, const can_decode_signal *signal, const kernel *k, int swap, int64_t *raw)
+{
+	u64v words;
+	i64v valid;
+	i64v v;
+
+	memcpy(&words, data, sizeof(words));
+	valid = valid_mask(id, dlc, signal, k);
+	v = extract(words, k, swap) & valid;
+	memcpy(raw, &v, sizeof(v));
+	return valid;
+}
+
+static inline __attribute__((always_inline)) size_t raw_loop(const can_decode_batch *batch,
+	const can_decode_signal *signal, const kernel *k, int swap, int64_t *raw)
+{
+	const can_decode_signal sig = *signal;
+	const kernel ker = *k;
+	const uint32_t *ids = batch->id;
+	const uint8_t *dlcs = batch->dlc;
+	const uint64_t *words = batch->data;
+	const size_t count = batch->count;
+	i64v matches = { 0 };
+	size_t i;
+
+	for (i = 0; i + LANES <= count; i += LANES) {
+		// gueltige Lanes sind -1
+		matches -= raw_block(&ids[i], &dlcs[i], &words[i], &sig, &ker, swap, &raw[i]);
+	}
+	if (i < count) {
+		uint32_t id[LANES] = { 0 };
+		uint8_t dlc[LANES] = { 0 };
+		uint64_t data[LANES] = { 0 };
+		int64_t rest[LANES];
+		size_t n = count - i;
+
+		// aufgefuellte Lanes haben DLC 0 und zaehlen nicht
+		memcpy(id, &ids[i], n * sizeof(id[0]));
+		memcpy(dlc, &dlcs[i], n * sizeof(dlc[0]));
+		memcpy(data, &words[i], n * sizeof(data[0]));
+		matches -= raw_block(id, dlc, data, &sig, &ker, swap, rest);
+		memcpy(&raw[i], rest, n * sizeof(rest[0]));
+	}
+	size_t sum = 0;
+
+	for (uint8_t lane = 0; lane < LANES; lane++) {
+		sum += matches[lane];
+	}
+	return sum;
+}
+
+size_t can_decode_raw(const can_decode_batch *batch, const can_decode_signal *signal, int64_t *raw)
+{
+	kernel k;
+
+	kernel_init(&k, signal);
+	return k.swap ? raw_loop(batch, signal, &k, 1, raw) : raw_loop(batch, signal, &k, 0, raw);
+}
+
+// ----------------------------------------------------------------------------
+size_t can_decode_compact(const can_decode_batch *batch, const double *value, double *out, uint64_t *time)
+{
+	size_t n = 0;
+
+	for (size_t i = 0; i < batch->count; i++) {
+		out[n] = value[i];
+		if (time) {
+			time[n] = batch->time[i];
+		}
+		n += !isnan(value[i]);
+	}
+	return n;
+}
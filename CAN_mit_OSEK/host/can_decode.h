@@ -0,0 +1,82 @@
+/*
+ * can_decode.h
+ *
+ * Dekodieren von CAN-Signalen fuer die Auswertung aufgezeichneter Nachrichten
+ * auf dem Host. Die Nachrichten liegen spaltenweise vor (je eine Spalte fuer
+ * Zeit, ID, DLC und Daten); ein Signal wird fuer einen ganzen Block auf einmal
+ * dekodiert: Bits herausschieben, Vorzeichen erweitern, mit Faktor und Offset
+ * umrechnen. Die Schleifen arbeiten mit GCC-Vektortypen auf vier Nachrichten
+ * gleichzeitig (AVX2) bzw. zwei (SSE2), je nach -march, und ohne Verzweigungen.
+ *
+ * Die Signalbeschreibungen erzeugt tools/dbc2c.py aus der DBC
+ * (CAN_DB_SIGNAL_TABLE in can_db.h).
+ */
+
+#ifndef CAN_DECODE_H
+#define CAN_DECODE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Signal laut DBC, Reihenfolge wie CAN_DB_SIGNAL_TABLE */
+typedef struct
+{
+	const char *name;
+	uint32_t id;
+	uint8_t start;
+	uint8_t length;
+	uint8_t little_endian;		/* 1 = Intel (@1), 0 = Motorola (@0) */
+	uint8_t is_signed;
+	double factor;
+	double offset;
+} can_decode_signal;
+
+/* Block von Nachrichten in Spalten. data enthaelt die Datenbytes einer
+ * Nachricht als little-endian uint64_t (Byte 0 in Bit 0..7). */
+typedef struct
+{
+	size_t count;
+	uint64_t *time;
+	uint32_t *id;
+	uint8_t *dlc;
+	uint64_t *data;
+} can_decode_batch;
+
+/* Datenbytes einer Nachricht als Eintrag fuer can_decode_batch.data */
+static inline uint64_t can_decode_data(const uint8_t *bytes)
+{
+	uint64_t data = 0;
+
+	for (uint8_t i = 0; i < 8; i++) {
+		data |= (uint64_t)bytes[i] << (8 * i);
+	}
+	return data;
+}
+
+/* Anzahl Datenbytes, die eine Nachricht mindestens haben muss, damit das
+ * Signal vollstaendig enthalten ist. */
+uint8_t can_decode_bytes(const can_decode_signal *signal);
+
+/* Physikalische Werte eines Signals fuer alle Nachrichten des Blocks. Fuer
+ * Nachrichten mit anderer ID oder zu kleinem DLC wird NaN eingetragen, damit
+ * value[i] zu Nachricht i gehoert. */
+void can_decode_column(const can_decode_batch *batch, const can_decode_signal *signal, double *value);
+
+/* Wie can_decode_column() fuer count Signale auf einmal (value[s] fuer
+ * signal[s]). Der Block wird in Kacheln bearbeitet, damit ID, DLC und Daten
+ * nur einmal aus dem Speicher gelesen werden. */
+void can_decode_columns(const can_decode_batch *batch, const can_decode_signal *signal, uint16_t count,
+	double **value);
+
+/* Rohwerte (mit Vorzeichen erweitert) wie can_decode_column(), fuer fremde
+ * Nachrichten 0. Rueckgabe: Anzahl der Nachrichten mit dem Signal. */
+size_t can_decode_raw(const can_decode_batch *batch, const can_decode_signal *signal, int64_t *raw);
+
+/* Werte ohne NaN zusammenschieben, Rueckgabe: Anzahl. Die Zeitstempel werden
+ * mit kopiert, wenn time nicht NULL ist. */
+size_t can_decode_compact(const can_decode_batch *batch, const double *value, double *out, uint64_t *time);
+
+/* Referenz: ein Signal aus einer einzelnen Nachricht Bit fuer Bit dekodieren. */
+int64_t can_decode_raw_scalar(const can_decode_signal *signal, uint64_t data);
+
+#endif /* CAN_DECODE_H */
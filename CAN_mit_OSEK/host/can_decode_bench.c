@@ -0,0 +1,302 @@
+/*
+ * can_decode_bench.c
+ *
+ * Benchmark und Selbsttest fuer can_decode.c. Erzeugt einen Mitschnitt mit den
+ * Nachrichten aus Temperaturmessung.dbc (temperatur, taster, status_led) und
+ * fremden Nachrichten und dekodiert alle Signale aus CAN_DB_SIGNAL_TABLE
+ * einmal Nachricht fuer Nachricht mit den erzeugten can_db_unpack_...()
+ * Funktionen und spaltenweise mit can_decode_column() bzw. can_decode_columns().
+ * Die Ergebnisse muessen gleich sein; ausgegeben werden Nachrichten pro Sekunde auf einem Kern.
+ * Zusaetzlich werden die Vektor-Kerne mit zufaelligen Intel-/Motorola- und
+ * signed-Signalen gegen can_decode_raw_scalar() geprueft.
+ *
+ * Uebersetzen und starten (aus CAN_mit_OSEK):
+ *
+ *   gcc -std=gnu99 -O3 -march=native -Wall -funsigned-char -Ihost -I. \
+ *       -o can_decode_bench host/can_decode_bench.c host/can_decode.c -lm
+ *   ./can_decode_bench [-n frames] [-r repeat] [-s seed]
+ *
+ * Ohne -march (nur SSE2, zwei Lanes, DLC und Maske muessen skalar verbreitert
+ * werden) sind die Spalten langsamer als Nachricht fuer Nachricht; ab SSE4.1
+ * (-march=x86-64-v2) schneller, mit AVX2 etwa um den Faktor 1,5.
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "can_db.h"
+#include "can_decode.h"
+
+static const can_decode_signal signals[CAN_DB_SIGNAL_COUNT] = CAN_DB_SIGNAL_TABLE;
+
+static uint64_t seed = 1;
+
+// ----------------------------------------------------------------------------
+static uint64_t random64(void)
+{
+	// xorshift64
+	seed ^= seed << 13;
+	seed ^= seed >> 7;
+	seed ^= seed << 17;
+	return seed;
+}
+
+// ----------------------------------------------------------------------------
+static double seconds(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+// ----------------------------------------------------------------------------
+/* Mitschnitt: 60 % temperatur, je 5 % taster und status_led, Rest fremde IDs */
+static void make_log(can_decode_batch *batch, size_t count)
+{
+	batch->count = count;
+	batch->time = malloc(count * sizeof(*batch->time));
+	batch->id = malloc(count * sizeof(*batch->id));
+	batch->dlc = malloc(count * sizeof(*batch->dlc));
+	batch->data = malloc(count * sizeof(*batch->data));
+
+	for (size_t i = 0; i < count; i++) {
+		uint8_t bytes[8] = { 0 };
+		uint32_t kind = random64() % 100;
+
+		batch->time[i] = i * 500;
+		if (kind < 60) {
+			batch->id[i] = CAN_DB_TEMPERATUR_ID;
+			batch->dlc[i] = CAN_DB_TEMPERATUR_DLC;
+			can_db_pack_temperatur_signal(bytes, 160 + random64() % 80);
+		}
+		else if (kind < 65) {
+			batch->id[i] = CAN_DB_TASTER_ID;
+			batch->dlc[i] = CAN_DB_TASTER_DLC;
+			can_db_pack_taster_signal(bytes, random64() & 1);
+		}
+		else if (kind < 70) {
+			batch->id[i] = CAN_DB_STATUS_LED_ID;
+			batch->dlc[i] = CAN_DB_STATUS_LED_DLC;
+			can_db_pack_status_led_signal(bytes, random64() & 1);
+		}
+		else {
+			uint64_t word = random64();
+
+			batch->id[i] = 0x200 + random64() % 0x600;
+			batch->dlc[i] = random64() % 9;
+			memcpy(bytes, &word, sizeof(bytes));
+		}
+		// gelegentlich zu kurze Nachrichten mit bekannter ID
+		if (kind >= 60 && kind < 62) {
+			batch->dlc[i] = 1;
+		}
+		batch->data[i] = can_decode_data(bytes);
+	}
+}
+
+// ----------------------------------------------------------------------------
+/* Nachricht fuer Nachricht mit den erzeugten Funktionen aus can_db.h */
+static void decode_frames(const can_decode_batch *batch, double *value[CAN_DB_SIGNAL_COUNT])
+{
+	for (size_t i = 0; i < batch->count; i++) {
+		uint8_t bytes[8];
+
+		for (uint8_t s = 0; s < CAN_DB_SIGNAL_COUNT; s++) {
+			value[s][i] = NAN;
+		}
+		memcpy(bytes, &batch->data[i], sizeof(bytes));
+		switch (batch->id[i]) {
+			case CAN_DB_STATUS_LED_ID:
+				if (batch->dlc[i] >= 1) {
+					value[0][i] = can_db_unpack_status_led_signal(bytes) * CAN_DB_STATUS_LED_SIGNAL_FACTOR
+						+ CAN_DB_STATUS_LED_SIGNAL_OFFSET;
+				}
+				break;
+			case CAN_DB_TASTER_ID:
+				if (batch->dlc[i] >= 1) {
+					value[1][i] = can_db_unpack_taster_signal(bytes) * CAN_DB_TASTER_SIGNAL_FACTOR
+						+ CAN_DB_TASTER_SIGNAL_OFFSET;
+				}
+				break;
+			case CAN_DB_TEMPERATUR_ID:
+				if (batch->dlc[i] >= 2) {
+					value[2][i] = can_db_unpack_temperatur_signal(bytes) * CAN_DB_TEMPERATUR_SIGNAL_FACTOR
+						+ CAN_DB_TEMPERATUR_SIGNAL_OFFSET;
+				}
+				break;
+		}
+	}
+}
+
+// ----------------------------------------------------------------------------
+/* Spaltenweise, ein Signal nach dem anderen ueber den ganzen Block */
+static void decode_columns(const can_decode_batch *batch, double *value[CAN_DB_SIGNAL_COUNT])
+{
+	for (uint8_t s = 0; s < CAN_DB_SIGNAL_COUNT; s++) {
+		can_decode_column(batch, &signals[s], value[s]);
+	}
+}
+
+// ----------------------------------------------------------------------------
+/* Zufaellige Signale gegen die bitweise Referenz pruefen */
+static int self_test(void)
+{
+	can_decode_batch batch;
+	int64_t *raw;
+	int errors = 0;
+
+	make_log(&batch, 1003);
+	raw = malloc(batch.count * sizeof(*raw));
+
+	for (int t = 0; t < 2000 && errors < 10; t++) {
+		can_decode_signal signal = { "test", 0, 0, 0, 0, 0, 1.0, 0.0 };
+		size_t matches = 0;
+		size_t found;
+
+		signal.length = 1 + random64() % 64;
+		signal.little_endian = random64() & 1;
+		signal.is_signed = random64() & 1;
+		if (signal.little_endian) {
+			signal.start = random64() % (65 - signal.length);
+		}
+		else {
+			// MSB so waehlen, dass das Signal in 8 Bytes passt
+			uint8_t lsb = random64() % (65 - signal.length);
+			uint8_t msb = lsb + signal.length - 1;
+
+			signal.start = (7 - msb / 8) * 8 + msb % 8;
+		}
+		signal.id = batch.id[random64() % batch.count];
+
+		found = can_decode_raw(&batch, &signal, raw);
+		for (size_t i = 0; i < batch.count; i++) {
+			int valid = batch.id[i] == signal.id && batch.dlc[i] >= can_decode_bytes(&signal);
+			int64_t expected = valid ? can_decode_raw_scalar(&signal, batch.data[i]) : 0;
+
+			matches += valid;
+			if (raw[i] != expected) {
+				printf("Selbsttest: %s Startbit %u Laenge %u %s, Nachricht %zu: %lld statt %lld\n",
+					signal.little_endian ? "Intel" : "Motorola", signal.start, signal.length,
+					signal.is_signed ? "signed" : "unsigned", i, (long long)raw[i], (long long)expected);
+				errors++;
+				break;
+			}
+		}
+		if (found != matches) {
+			printf("Selbsttest: %zu statt %zu Nachrichten mit dem Signal\n", found, matches);
+			errors++;
+		}
+
+		// Umrechnung mit Faktor und Offset
+		double *value = malloc(batch.count * sizeof(*value));
+
+		signal.factor = 0.125;
+		signal.offset = -40.0;
+		can_decode_column(&batch, &signal, value);
+		for (size_t i = 0; i < batch.count; i++) {
+			double expected = raw[i] * 0.125 - 40.0;
+
+			if (batch.id[i] == signal.id && batch.dlc[i] >= can_decode_bytes(&signal)
+				? value[i] != expected && fabs(value[i] - expected) > fabs(expected) * 1e-15
+				: !isnan(value[i])) {
+				printf("Selbsttest: physikalischer Wert von Nachricht %zu: %g statt %g\n", i, value[i], expected);
+				errors++;
+				break;
+			}
+		}
+		free(value);
+	}
+
+	free(raw);
+	free(batch.time);
+	free(batch.id);
+	free(batch.dlc);
+	free(batch.data);
+	return errors;
+}
+
+// ----------------------------------------------------------------------------
+int main(int argc, char **argv)
+{
+	size_t frames = 4000000;
+	uint32_t repeat = 5;
+	can_decode_batch batch;
+	double *frame_value[CAN_DB_SIGNAL_COUNT];
+	double *column_value[CAN_DB_SIGNAL_COUNT];
+	double *tiled_value[CAN_DB_SIGNAL_COUNT];
+	double best_frames = 1e30, best_columns = 1e30, best_tiled = 1e30;
+	int errors;
+
+	for (int i = 1; i + 1 < argc; i += 2) {
+		unsigned long value = strtoul(argv[i + 1], NULL, 0);
+
+		switch (argv[i][1]) {
+			case 'n':	frames = value;					break;
+			case 'r':	repeat = value ? value : 1;		break;
+			case 's':	seed = value ? value : 1;		break;
+		}
+	}
+
+	errors = self_test();
+	printf("Selbsttest Vektor-Kerne gegen bitweise Referenz: %s\n", errors ? "FEHLER" : "ok");
+
+	make_log(&batch, frames);
+	for (uint8_t s = 0; s < CAN_DB_SIGNAL_COUNT; s++) {
+		frame_value[s] = malloc(frames * sizeof(double));
+		column_value[s] = malloc(frames * sizeof(double));
+		tiled_value[s] = malloc(frames * sizeof(double));
+	}
+
+	for (uint32_t r = 0; r < repeat; r++) {
+		double t0 = seconds();
+
+		decode_frames(&batch, frame_value);
+		double t1 = seconds();
+
+		decode_columns(&batch, column_value);
+		double t2 = seconds();
+
+		can_decode_columns(&batch, signals, CAN_DB_SIGNAL_COUNT, tiled_value);
+		double t3 = seconds();
+
+		if (t1 - t0 < best_frames) {
+			best_frames = t1 - t0;
+		}
+		if (t2 - t1 < best_columns) {
+			best_columns = t2 - t1;
+		}
+		if (t3 - t2 < best_tiled) {
+			best_tiled = t3 - t2;
+		}
+	}
+
+	// gleiche Ergebnisse, NaN an denselben Stellen
+	for (uint8_t s = 0; s < CAN_DB_SIGNAL_COUNT; s++) {
+		size_t count = 0;
+
+		if (memcmp(frame_value[s], column_value[s], frames * sizeof(double)) != 0
+			|| memcmp(frame_value[s], tiled_value[s], frames * sizeof(double)) != 0) {
+			printf("%s: spaltenweise anders als Nachricht fuer Nachricht\n", signals[s].name);
+			errors++;
+		}
+		for (size_t i = 0; i < frames; i++) {
+			count += !isnan(column_value[s][i]);
+		}
+		printf("%-20s ID 0x%03X  %9zu Werte\n", signals[s].name, signals[s].id, count);
+	}
+
+	printf("%zu Nachrichten, %u Signale, bester von %u Durchlaeufen, ein Kern:\n",
+		frames, CAN_DB_SIGNAL_COUNT, repeat);
+	printf("  Nachricht fuer Nachricht (can_db_unpack_...)  %8.1f Mio. Nachrichten/s\n",
+		frames / best_frames / 1e6);
+	printf("  spaltenweise (can_decode_column)               %8.1f Mio. Nachrichten/s (x%.1f)\n",
+		frames / best_columns / 1e6, best_frames / best_columns);
+	printf("  spaltenweise in Kacheln (can_decode_columns)   %8.1f Mio. Nachrichten/s (x%.1f)\n",
+		frames / best_tiled / 1e6, best_frames / best_tiled);
+
+	return errors ? 1 : 0;
+}
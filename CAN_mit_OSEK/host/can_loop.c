@@ -0,0 +1,205 @@
+/*
+ * can_loop.c
+ *
+ * Loopback-Treiber fuer can.h auf dem Host, siehe can_loop.h.
+ */
+
+#include <string.h>
+#include <avr/pgmspace.h>
+
+#include "can_loop.h"
+
+static tCANFrame rx[CAN_LOOP_RX_SIZE];
+static uint8_t rx_head;
+static uint8_t rx_count;
+
+static uint32_t filter_ids[CAN_LOOP_FILTERS];
+static uint8_t filter_count;
+
+static void (*rx_notify)(void);
+static can_loop_stats stats;
+
+/* Platz fuer can_tx_alloc(), der Loopback sendet sofort beim Einreihen */
+static tCANFrame tx_slot;
+
+// ----------------------------------------------------------------------------
+static uint8_t loop_init(uint32_t bitrate)
+{
+	(void)bitrate;
+
+	rx_head = 0;
+	rx_count = 0;
+	filter_count = 0;
+	rx_notify = 0;
+	memset(&stats, 0, sizeof(stats));
+	return 1;
+}
+
+// ----------------------------------------------------------------------------
+static uint8_t loop_set_filters(const uint32_t *ids, uint8_t count)
+{
+	if (count > CAN_LOOP_FILTERS) {
+		return 0;
+	}
+	memcpy(filter_ids, ids, count * sizeof(ids[0]));
+	filter_count = count;
+	return 1;
+}
+
+// ----------------------------------------------------------------------------
+static int loop_accept(uint32_t id)
+{
+	uint8_t i;
+
+	if (filter_count == 0) {
+		return 1;
+	}
+	for (i = 0; i < filter_count; i++) {
+		if (filter_ids[i] == id) {
+			return 1;
+		}
+	}
+	return 0;
+}
+
+// ----------------------------------------------------------------------------
+/* Laenge und Format wie auf dem Bus moeglich */
+static int loop_valid(const tCANFrame *frame)
+{
+	if (frame->length > CAN_MAX_DLEN) {
+		return 0;
+	}
+	if (frame->flags & CAN_FRAME_FDF) {
+		return !(frame->flags & CAN_FRAME_RTR)
+			&& can_dlc_to_length(can_length_to_dlc(frame->length)) == frame->length;
+	}
+	return frame->length <= 8 && !(frame->flags & CAN_FRAME_BRS);
+}
+
+// ----------------------------------------------------------------------------
+int can_loop_inject(const tCANFrame *frame)
+{
+	if (!loop_accept(frame->id)) {
+		stats.filtered++;
+		return 0;
+	}
+	if (rx_count == CAN_LOOP_RX_SIZE) {
+		stats.rx_overflow++;
+		return 0;
+	}
+	rx[(rx_head + rx_count) % CAN_LOOP_RX_SIZE] = *frame;
+	rx_count++;
+	stats.received++;
+	if (rx_notify) {
+		rx_notify();
+	}
+	return 1;
+}
+
+// ----------------------------------------------------------------------------
+static uint8_t loop_send(const tCANFrame *frame)
+{
+	if (!loop_valid(frame)) {
+		stats.rejected++;
+		return 0;
+	}
+	stats.sent++;
+	can_loop_inject(frame);
+	return 1;
+}
+
+// ----------------------------------------------------------------------------
+static uint8_t loop_receive(tCANFrame *frame)
+{
+	if (rx_count == 0) {
+		return 0;
+	}
+	*frame = rx[rx_head];
+	rx_head = (rx_head + 1) % CAN_LOOP_RX_SIZE;
+	rx_count--;
+	return 1;
+}
+
+// ----------------------------------------------------------------------------
+static const tCANFrame *loop_rx_peek(void)
+{
+	return rx_count ? &rx[rx_head] : 0;
+}
+
+// ----------------------------------------------------------------------------
+static void loop_rx_release(void)
+{
+	if (rx_count) {
+		rx_head = (rx_head + 1) % CAN_LOOP_RX_SIZE;
+		rx_count--;
+	}
+}
+
+// ----------------------------------------------------------------------------
+static tCANFrame *loop_tx_alloc(uint32_t id, uint8_t flags, uint8_t length)
+{
+	tx_slot.id = id;
+	tx_slot.flags = flags;
+	tx_slot.length = length;
+	if (!loop_valid(&tx_slot)) {
+		stats.rejected++;
+		return 0;
+	}
+	return &tx_slot;
+}
+
+// ----------------------------------------------------------------------------
+static uint8_t loop_tx_commit(tCANFrame *frame)
+{
+	return loop_send(frame);
+}
+
+// ----------------------------------------------------------------------------
+static void loop_set_rx_notify(void (*notify)(void))
+{
+	rx_notify = notify;
+}
+
+// ----------------------------------------------------------------------------
+static void loop_get_error_status(tCANErrorStatus *status)
+{
+	memset(status, 0, sizeof(*status));
+	status->state = CAN_ERROR_ACTIVE;
+	status->rx_hw_overflow = (stats.rx_overflow > 0xffff) ? 0xffff : stats.rx_overflow;
+}
+
+// ----------------------------------------------------------------------------
+static void loop_set_error_notify(void (*notify)(uint8_t old_state, uint8_t new_state))
+{
+	// der Fehlerzustand aendert sich nie
+	(void)notify;
+}
+
+// ----------------------------------------------------------------------------
+static void loop_error_poll(uint16_t elapsed_ms)
+{
+	(void)elapsed_ms;
+}
+
+// ----------------------------------------------------------------------------
+void can_loop_get_stats(can_loop_stats *copy)
+{
+	*copy = stats;
+}
+
+// ----------------------------------------------------------------------------
+const tCANOps can_loop_ops PROGMEM = {
+	loop_init,
+	loop_set_filters,
+	loop_send,
+	loop_receive,
+	loop_rx_peek,
+	loop_rx_release,
+	loop_tx_alloc,
+	loop_tx_commit,
+	loop_set_rx_notify,
+	loop_get_error_status,
+	loop_set_error_notify,
+	loop_error_poll,
+	CAN_MAX_DLEN
+};
@@ -0,0 +1,49 @@
+/*
+ * can_loop.h
+ *
+ * Zweiter Treiber hinter can.h: Loopback auf dem Host ohne Controller und Bus.
+ * Jede mit can_send() gesendete Nachricht wird sofort wieder empfangen, dazu
+ * kann ein Testprogramm mit can_loop_inject() Nachrichten anderer Knoten
+ * einspeisen. Beide laufen durch dieselbe Filtertabelle wie beim MCP2515
+ * (can_set_filters(), nur die eingetragenen IDs) in einen Ringpuffer, nach
+ * jeder angenommenen Nachricht wird die Funktion aus can_set_rx_notify()
+ * aufgerufen. can_rx_peek() leiht den Platz im Ringpuffer, can_tx_alloc()
+ * einen einzigen Sendeplatz, den can_tx_commit() sofort sendet.
+ *
+ * Mit CAN_FD_ENABLE 1 uebersetzt nimmt der Loopback CAN-FD-Nachrichten bis 64
+ * Byte an; can_send() prueft wie ein FD-Controller, dass die Laenge einem DLC
+ * entspricht und Remote-Frames nur im klassischen Format vorkommen. Der
+ * Fehlerzustand bleibt immer error active.
+ */
+
+#ifndef CAN_LOOP_H
+#define CAN_LOOP_H
+
+#include <stdint.h>
+
+#include "can.h"
+
+/* Nachrichten im Empfangsringpuffer */
+#define CAN_LOOP_RX_SIZE	16
+
+/* Filtertabelle: wie RXF0..RXF5 des MCP2515 */
+#define CAN_LOOP_FILTERS	6
+
+typedef struct
+{
+	uint32_t sent;			/* von can_send() angenommen */
+	uint32_t rejected;		/* von can_send() abgelehnt (Laenge, Format) */
+	uint32_t received;		/* in den Ringpuffer gestellt */
+	uint32_t filtered;		/* von der Filtertabelle verworfen */
+	uint32_t rx_overflow;	/* verloren, weil der Ringpuffer voll war */
+} can_loop_stats;
+
+extern const tCANOps can_loop_ops;
+
+/* Nachricht eines anderen Knotens empfangen (wie vom Bus). Rueckgabe 0, wenn
+ * sie gefiltert wurde oder der Ringpuffer voll war. */
+int can_loop_inject(const tCANFrame *frame);
+
+void can_loop_get_stats(can_loop_stats *stats);
+
+#endif /* CAN_LOOP_H */
@@ -0,0 +1,217 @@
+/*
+ * can_loop_check.c
+ *
+ * Prueft die CAN-Schnittstelle can.h mit dem Loopback-Treiber can_loop.c:
+ * Zuordnung DLC <-> Laenge, CAN-FD-Nachrichten aller Laengen 0..64 Byte hin
+ * und zurueck, Ablehnung ungueltiger Laengen und Formate, Filtertabelle und
+ * Empfangsmeldung. Gibt die DLC-Tabelle aus.
+ *
+ * Uebersetzen und starten (aus CAN_mit_OSEK):
+ *
+ *   gcc -std=gnu99 -O2 -Wall -funsigned-char -DCAN_FD_ENABLE=1 -Ihost -I. \
+ *       -o can_loop_check host/can_loop_check.c host/can_loop.c can.c
+ *   ./can_loop_check
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "can.h"
+#include "can_loop.h"
+
+#if !CAN_FD_ENABLE
+#error "mit -DCAN_FD_ENABLE=1 uebersetzen"
+#endif
+
+static int errors;
+static unsigned notified;
+
+// ----------------------------------------------------------------------------
+static void fail(const char *text, unsigned value)
+{
+	printf("FEHLER: %s (%u)\n", text, value);
+	errors++;
+}
+
+static void count_notify(void)
+{
+	notified++;
+}
+
+// ----------------------------------------------------------------------------
+/* DLC -> Laenge und kleinster DLC je Laenge */
+static void check_dlc(void)
+{
+	printf("DLC   ");
+	for (uint8_t dlc = 0; dlc <= 15; dlc++) {
+		printf("%3u", dlc);
+	}
+	printf("\nByte  ");
+	for (uint8_t dlc = 0; dlc <= 15; dlc++) {
+		printf("%3u", can_dlc_to_length(dlc));
+		if (can_length_to_dlc(can_dlc_to_length(dlc)) != dlc) {
+			fail("can_length_to_dlc(can_dlc_to_length(dlc)) != dlc", dlc);
+		}
+		if (dlc > 0 && can_dlc_to_length(dlc) <= can_dlc_to_length(dlc - 1)) {
+			fail("Laenge steigt nicht mit dem DLC", dlc);
+		}
+	}
+	printf("\n\n");
+
+	for (uint8_t length = 0; length <= 64; length++) {
+		uint8_t dlc = can_length_to_dlc(length);
+
+		if (can_dlc_to_length(dlc) < length || (dlc > 0 && can_dlc_to_length(dlc - 1) >= length)) {
+			fail("can_length_to_dlc() nicht der kleinste DLC", length);
+		}
+	}
+}
+
+// ----------------------------------------------------------------------------
+/* jede Laenge 0..64 als CAN FD senden: DLC-Laengen kommen unveraendert zurueck,
+ * alle anderen lehnt can_send() ab */
+static void check_fd_lengths(void)
+{
+	tCANFrame tx, rx;
+	unsigned accepted = 0;
+
+	for (uint8_t length = 0; length <= 64; length++) {
+		int valid = can_dlc_to_length(can_length_to_dlc(length)) == length;
+
+		memset(&tx, 0, sizeof(tx));
+		tx.id = 0x123 | ((length & 1) ? CAN_ID_EXT : 0);
+		tx.flags = CAN_FRAME_FDF | CAN_FRAME_BRS;
+		tx.length = length;
+		for (uint8_t i = 0; i < length; i++) {
+			tx.data[i] = (uint8_t)(length * 7 + i);
+		}
+
+		if (can_send(&tx) != valid) {
+			fail(valid ? "gueltige FD-Laenge abgelehnt" : "ungueltige FD-Laenge angenommen", length);
+			continue;
+		}
+		if (!valid) {
+			continue;
+		}
+		accepted++;
+		if (!can_receive(&rx)) {
+			fail("FD-Nachricht nicht empfangen", length);
+			continue;
+		}
+		if (rx.id != tx.id || rx.flags != tx.flags || rx.length != length
+			|| memcmp(rx.data, tx.data, length) != 0) {
+			fail("FD-Nachricht veraendert", length);
+		}
+	}
+	if (accepted != 16) {
+		fail("Anzahl gueltiger FD-Laengen", accepted);
+	}
+	printf("CAN FD: %u von 65 Laengen angenommen und unveraendert empfangen\n", accepted);
+}
+
+// ----------------------------------------------------------------------------
+/* Formate, die es auf dem Bus nicht gibt */
+static void check_invalid(void)
+{
+	tCANFrame frame;
+
+	memset(&frame, 0, sizeof(frame));
+	frame.id = 0x100;
+
+	frame.length = 9;
+	if (can_send(&frame)) {
+		fail("klassische Nachricht mit 9 Byte angenommen", 9);
+	}
+	frame.length = 8;
+	frame.flags = CAN_FRAME_BRS;
+	if (can_send(&frame)) {
+		fail("BRS ohne FDF angenommen", 8);
+	}
+	frame.flags = CAN_FRAME_FDF | CAN_FRAME_RTR;
+	if (can_send(&frame)) {
+		fail("Remote-Frame im FD-Format angenommen", 8);
+	}
+	frame.flags = CAN_FRAME_RTR;
+	frame.length = 4;
+	if (!can_send(&frame) || !can_receive(&frame) || frame.flags != CAN_FRAME_RTR || frame.length != 4) {
+		fail("klassischer Remote-Frame", 4);
+	}
+	if (can_tx_alloc(0x100, 0, 9)) {
+		fail("can_tx_alloc() mit 9 Byte klassisch", 9);
+	}
+	if (can_tx_alloc(0x100, CAN_FRAME_FDF, 13)) {
+		fail("can_tx_alloc() mit FD-Laenge ohne DLC", 13);
+	}
+}
+
+// ----------------------------------------------------------------------------
+/* Filtertabelle, Empfangsmeldung und Ringpuffer */
+static void check_filters(void)
+{
+	static const uint32_t ids[] = { 0x080, 0x18ff0001UL | CAN_ID_EXT };
+	tCANFrame frame;
+	can_loop_stats stats;
+	unsigned received = 0;
+
+	can_set_filters(ids, 2);
+	can_set_rx_notify(count_notify);
+	notified = 0;
+
+	memset(&frame, 0, sizeof(frame));
+	for (uint32_t id = 0x07e; id <= 0x082; id++) {
+		frame.id = id;
+		can_send(&frame);
+	}
+	frame.id = 0x18ff0001UL;
+	can_loop_inject(&frame);
+	frame.id = 0x18ff0001UL | CAN_ID_EXT;
+	can_loop_inject(&frame);
+
+	while (can_receive(&frame)) {
+		if (frame.id != ids[0] && frame.id != ids[1]) {
+			fail("ID trotz Filter empfangen", (unsigned)frame.id);
+		}
+		received++;
+	}
+	if (received != 2 || notified != 2) {
+		fail("Anzahl nach Filter", received);
+	}
+
+	can_set_filters(ids, 0);
+	for (unsigned i = 0; i < CAN_LOOP_RX_SIZE + 3; i++) {
+		can_send(&frame);
+	}
+	can_loop_get_stats(&stats);
+	if (stats.rx_overflow != 3) {
+		fail("Ueberlauf des Ringpuffers", stats.rx_overflow);
+	}
+	while (can_receive(&frame)) {
+	}
+	printf("Filter: %u von 7 Nachrichten empfangen, %lu gefiltert, %lu Ueberlauf\n",
+		received, (unsigned long)stats.filtered, (unsigned long)stats.rx_overflow);
+}
+
+int main(void)
+{
+	tCANErrorStatus status;
+
+	if (!can_init(&can_loop_ops, 500000UL)) {
+		fail("can_init()", 0);
+	}
+	if (can_max_length() != 64) {
+		fail("can_max_length()", can_max_length());
+	}
+
+	check_dlc();
+	check_fd_lengths();
+	check_invalid();
+	check_filters();
+
+	can_get_error_status(&status);
+	if (status.state != CAN_ERROR_ACTIVE) {
+		fail("Fehlerzustand", status.state);
+	}
+
+	printf("\n%d Fehler\n", errors);
+	return errors != 0;
+}
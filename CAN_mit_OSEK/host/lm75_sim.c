@@ -0,0 +1,97 @@
+/*
+ * lm75_sim.c
+ *
+ * Modell des LM75 fuer die Host-Simulation, siehe lm75_sim.h.
+ */
+
+#include <math.h>
+
+#include "lm75_sim.h"
+
+#define LM75_TEMP		0
+#define LM75_CONF		1
+
+void lm75_sim_init(lm75_sim *chip, uint8_t address)
+{
+	chip->address = address;
+	chip->pointer = LM75_TEMP;
+	chip->first = 0;
+	chip->index = 0;
+	chip->config = 0;
+	chip->reg[LM75_TEMP] = 0;
+	chip->reg[2] = 75 << 8;
+	chip->reg[3] = 80 << 8;
+	chip->reads = 0;
+	chip->writes = 0;
+}
+
+void lm75_sim_set(lm75_sim *chip, double celsius)
+{
+	int16_t eighths = (int16_t)lround(celsius * 8);
+
+	chip->reg[LM75_TEMP] = (uint16_t)(eighths << 5);
+}
+
+// ----------------------------------------------------------------------------
+static void lm75_start(void *context, int read)
+{
+	lm75_sim *chip = context;
+
+	chip->first = !read;
+	chip->index = 0;
+}
+
+static int lm75_write(void *context, uint8_t data)
+{
+	lm75_sim *chip = context;
+
+	if (chip->first) {
+		chip->pointer = data & 0x03;
+		chip->first = 0;
+		return 1;
+	}
+	chip->writes++;
+	if (chip->pointer == LM75_CONF) {
+		chip->config = data;
+	}
+	else if (chip->pointer != LM75_TEMP && chip->index < 2) {
+		uint8_t shift = chip->index ? 0 : 8;
+
+		chip->reg[chip->pointer] = (chip->reg[chip->pointer] & ~(0xff << shift)) | (data << shift);
+	}
+	chip->index++;
+	return 1;
+}
+
+static uint8_t lm75_read(void *context, int ack)
+{
+	lm75_sim *chip = context;
+	uint8_t data;
+
+	(void)ack;
+	if (chip->pointer == LM75_CONF) {
+		data = chip->config;
+	}
+	else {
+		data = (chip->index & 1) ? chip->reg[chip->pointer] & 0xff : chip->reg[chip->pointer] >> 8;
+		if (chip->pointer == LM75_TEMP && (chip->index & 1)) {
+			chip->reads++;
+		}
+	}
+	chip->index++;
+	return data;
+}
+
+static void lm75_stop(void *context)
+{
+	lm75_sim *chip = context;
+
+	chip->first = 0;
+}
+
+void lm75_sim_attach(lm75_sim *chip)
+{
+	sim_twi_slave slave = { chip, chip->address, lm75_start, lm75_write, lm75_read, lm75_stop };
+
+	sim_attach_twi(&slave);
+}
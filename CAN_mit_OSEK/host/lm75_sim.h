@@ -0,0 +1,40 @@
+/*
+ * lm75_sim.h
+ *
+ * Modell des Temperatursensors LM75(B) am simulierten TWI (sim_attach_twi()):
+ * Zeigerregister, Temperatur (11 Bit, 0,125 Grad je Bit, linksbuendig),
+ * Konfiguration, THYST und TOS. Das erste Byte nach SLA+W setzt den Zeiger,
+ * weitere Bytes beschreiben das Register; gelesen wird ab dem Zeiger.
+ */
+
+#ifndef LM75_SIM_H
+#define LM75_SIM_H
+
+#include <stdint.h>
+
+#include "sim_avr.h"
+
+typedef struct
+{
+	uint8_t address;
+	uint8_t pointer;
+	uint8_t first;			/* naechstes geschriebenes Byte ist der Zeiger */
+	uint8_t index;			/* Byte im Register beim Lesen und Schreiben */
+	uint8_t config;
+	uint16_t reg[4];		/* Temperatur, -, THYST, TOS wie auf dem Bus (MSB zuerst) */
+
+	/* Statistik */
+	uint32_t reads;			/* gelesene Temperaturregister */
+	uint32_t writes;
+} lm75_sim;
+
+/* Baustein nach Power-On, address wie in der Firmware (DEV_LM75). */
+void lm75_sim_init(lm75_sim *chip, uint8_t address);
+
+/* An den simulierten TWI haengen. */
+void lm75_sim_attach(lm75_sim *chip);
+
+/* Temperatur in Grad Celsius (auf 0,125 Grad gerundet). */
+void lm75_sim_set(lm75_sim *chip, double celsius);
+
+#endif /* LM75_SIM_H */
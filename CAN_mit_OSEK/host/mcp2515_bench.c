@@ -0,0 +1,944 @@
+/*
+ * mcp2515_bench.c
+ *
+ * Durchsatz-, Latenz- und Fuzz-Tests fuer den Treiber mcp2515.c auf dem Host.
+ * Der Treiber laeuft unveraendert gegen das Registermodell mcp2515_sim.c; eine
+ * Gegenstelle am simulierten Bus sendet und empfaengt die Nachrichten.
+ *
+ * Uebersetzen und starten (aus CAN_mit_OSEK):
+ *
+ *   gcc -std=gnu99 -O2 -Wall -funsigned-char -DF_CPU=3686400UL -Ihost -I. \
+ *       -o mcp2515_bench host/mcp2515_bench.c host/mcp2515_sim.c host/sim_avr.c \
+ *       host/sim_bus.c host/sim_can.c mcp2515.c mcp2515_timing.c
+ *   ./mcp2515_bench [rx|tx|fuzz|spi|all] [-b kbps] [-n frames] [-d length] [-l latency_us] [-p poll_us] [-s seed] [-z]
+ *
+ * rx:   die Gegenstelle sendet mit 100 % Buslast. Die Applikation holt die
+ *       Nachrichten wie Task1 mit CAN_RX_POLLING 0 ab: der ISR meldet den
+ *       Empfang (EV_CAN_RX), latency_us spaeter leert sie den Ringpuffer,
+ *       ohne Meldung spaetestens nach CAN_RX_HOUSEKEEPING_MS. Mit -p holt sie
+ *       die Nachrichten wie mit CAN_RX_POLLING 1 nur alle poll_us ab. Die
+ *       Nachrichten haben length Datenbytes (-d, sonst 8).
+ *       Rueckgabewert != 0, wenn innerhalb der Auslegung aus mcp2515.h
+ *       (MCP2515_RX_MAX_KBPS, MCP2515_RX_MAX_LATENCY_US) eine Nachricht
+ *       verloren geht (Ringpuffer oder RXnOVR); ausserhalb werden Verluste
+ *       nur gemeldet. Ohne -b, -d und -p laufen die Eckpunkte der Auslegung:
+ *       125 kbit/s und MCP2515_RX_MAX_KBPS mit 0 und 8 Datenbytes, dazu
+ *       zyklisches Abholen bei 125 kbit/s.
+ * tx:   die Applikation sendet, sobald in der Warteschlange Platz ist
+ * fuzz: zufaellige Nachrichten in beide Richtungen mit zufaelliger Filtertabelle,
+ *       Rueckgabewert != 0, wenn eine Nachricht ungezaehlt fehlt, doppelt oder
+ *       falsch ankommt. Die Applikation wechselt zufaellig zwischen Kopie
+ *       (mcp2515_send_message(), mcp2515_get_message()) und geliehenen Plaetzen
+ *       (mcp2515_tx_alloc(), mcp2515_rx_peek())
+ * spi:  SPI-Bytes, Befehle und Takte je Nachricht beim Laden eines Sendepuffers
+ *       und beim Abholen eines Empfangspuffers: der fruehere Treiber Byte fuer
+ *       Byte (SPI-Takt F_CPU/16 wie damals und F_CPU/2) gegen die
+ *       Block-Transfers von mcp2515.c. Takte zaehlen nur Registerzugriffe
+ *       (SIM_CYCLES_PER_IO) und die Zeit der SPI-Bytes, nicht die Befehle
+ *       dazwischen.
+ *
+ * -z:   rx und tx mit geliehenen Plaetzen statt Kopie
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <util/delay.h>
+
+#include "mcp2515.h"
+#include "mcp2515_timing.h"
+#include "mcp2515_sim.h"
+#include "sim_bus.h"
+#include "defaults.h"
+
+#define APP_HOUSEKEEPING_MS		100			/* CAN_RX_HOUSEKEEPING_MS in Os_Cfg.h */
+
+// ----------------------------------------------------------------------------
+/* Gegenstelle am Bus: sendet eine Liste von Nachrichten ab ihrem Startzeitpunkt
+ * und zeichnet alle empfangenen Nachrichten auf */
+typedef struct
+{
+	sim_can_frame *tx;
+	uint64_t *tx_release;		/* fruehester Sendezeitpunkt in Takten */
+	uint32_t tx_count;
+	uint32_t tx_next;
+
+	sim_can_frame *rx;
+	uint64_t *rx_time;
+	uint32_t rx_count;
+	uint32_t rx_size;
+} peer_node;
+
+static mcp2515_sim chip;
+static sim_bus bus;
+static peer_node peer;
+
+static uint32_t seed = 1;
+static int zero_copy;
+static volatile uint8_t rx_event;
+
+/* kleinster mittlerer Abstand der Nachrichten der Gegenstelle im Fuzz-Test */
+#define FUZZ_MIN_GAP_US		500
+
+// ----------------------------------------------------------------------------
+static uint32_t random32(void)
+{
+	// xorshift32
+	seed ^= seed << 13;
+	seed ^= seed >> 17;
+	seed ^= seed << 5;
+	return seed;
+}
+
+// ----------------------------------------------------------------------------
+static int peer_tx_next(void *context, sim_can_frame *frame)
+{
+	peer_node *node = context;
+
+	if (node->tx_next >= node->tx_count || node->tx_release[node->tx_next] > sim_cycles) {
+		return 0;
+	}
+	*frame = node->tx[node->tx_next];
+	return 1;
+}
+
+static void peer_tx_done(void *context, int result, uint64_t now)
+{
+	peer_node *node = context;
+
+	(void)now;
+	if (result == SIM_BUS_WON) {
+		node->tx_next++;
+	}
+}
+
+static void peer_rx(void *context, const sim_can_frame *frame, uint64_t now)
+{
+	peer_node *node = context;
+
+	(void)now;
+	if (node->rx_count < node->rx_size) {
+		node->rx[node->rx_count] = *frame;
+		node->rx_time[node->rx_count] = sim_cycles;
+		node->rx_count++;
+	}
+}
+
+// ----------------------------------------------------------------------------
+static void bus_clock(void *context, uint64_t now)
+{
+	sim_bus_advance(context, SIM_CYCLES_TO_NS(now));
+}
+
+
+// ----------------------------------------------------------------------------
+/* Simulation, Modell und Treiber neu aufsetzen */
+static int setup(uint16_t kbps, uint32_t tx_count, uint32_t rx_size)
+{
+	uint32_t bitrate, error;
+
+	sim_reset();
+
+	free(peer.tx);
+	free(peer.tx_release);
+	free(peer.rx);
+	free(peer.rx_time);
+	memset(&peer, 0, sizeof(peer));
+	peer.tx = calloc(tx_count + 1, sizeof(*peer.tx));
+	peer.tx_release = calloc(tx_count + 1, sizeof(*peer.tx_release));
+	peer.rx = calloc(rx_size + 1, sizeof(*peer.rx));
+	peer.rx_time = calloc(rx_size + 1, sizeof(*peer.rx_time));
+	peer.rx_size = rx_size;
+
+	memset(&chip, 0, sizeof(chip));
+	mcp2515_sim_init(&chip);
+	mcp2515_sim_attach_spi(&chip);
+
+	sim_bus_init(&bus, kbps * 1000UL);
+	mcp2515_sim_attach_bus(&chip, &bus);
+	sim_bus_attach(&bus, &(sim_bus_port){ &peer, peer_tx_next, peer_tx_done, peer_rx, 0 });
+	sim_attach_clock(bus_clock, &bus);
+
+	sei();
+	if (!mcp2515_init(kbps * 1000UL)) {
+		printf("mcp2515_init() fehlgeschlagen\n");
+		return 0;
+	}
+	bitrate = mcp2515_sim_bitrate(&chip);
+	error = (bitrate > kbps * 1000UL) ? bitrate - kbps * 1000UL : kbps * 1000UL - bitrate;
+	if (error > kbps * MCP2515_BITRATE_TOLERANCE) {
+		printf("CNF1..3 ergeben %lu bit/s statt %u kbit/s\n", (unsigned long)bitrate, kbps);
+		return 0;
+	}
+	// der Bus laeuft mit der Bitrate, die CNF1..3 tatsaechlich ergeben
+	bus.bit_ns = 1000000000UL / bitrate;
+	return 1;
+}
+
+// ----------------------------------------------------------------------------
+static void random_frame(sim_can_frame *frame, uint8_t ext_allowed)
+{
+	memset(frame, 0, sizeof(*frame));
+	if (ext_allowed && (random32() & 3) == 0) {
+		frame->id = CAN_ID_EXT | (random32() & CAN_ID_EXT_MASK);
+	}
+	else {
+		frame->id = random32() & 0x7ff;
+	}
+	frame->rtr = (random32() & 7) == 0;
+	frame->length = random32() % 9;
+	for (uint8_t i = 0; i < 8 && !frame->rtr; i++) {
+		frame->data[i] = (i < frame->length) ? random32() : 0;
+	}
+}
+
+// ----------------------------------------------------------------------------
+static void report_common(const char *name, uint64_t cycles)
+{
+	double seconds = (double)cycles / F_CPU;
+
+	printf("%-5s simulierte Zeit      %10.3f ms\n", name, seconds * 1e3);
+	printf("%-5s Buslast              %10.1f %%\n", name, 100.0 * bus.busy_ns / (seconds * 1e9));
+	printf("%-5s CPU-Last INT0-ISR    %10.1f %% (%u Aufrufe)\n", name,
+		100.0 * sim_isr_cycles / cycles, sim_isr_count[SIM_IRQ_INT0]);
+	printf("%-5s SPI-Bytes            %10u (%u Befehle)\n", name, chip.spi_bytes, chip.spi_commands);
+	if (chip.illegal_writes) {
+		printf("%-5s unzulaessige Schreibzugriffe auf den MCP2515: %u\n", name, chip.illegal_writes);
+	}
+}
+
+// ----------------------------------------------------------------------------
+/* Ringpuffer leeren wie Task1, Rueckgabe: Anzahl der Nachrichten */
+static uint32_t app_receive_all(void)
+{
+	tCANFrame message;
+	uint32_t count = 0;
+
+	if (zero_copy) {
+		while (mcp2515_rx_peek()) {
+			mcp2515_rx_release();
+			count++;
+		}
+	}
+	else {
+		while (mcp2515_get_message(&message)) {
+			count++;
+		}
+	}
+	return count;
+}
+
+// ----------------------------------------------------------------------------
+/* wie can_rx_notify() in main.c: SetEvent(Task1, EV_CAN_RX) im ISR */
+static void app_rx_notify(void)
+{
+	rx_event = 1;
+}
+
+// ----------------------------------------------------------------------------
+/* Task1 warten lassen: auf EV_CAN_RX, bis latency_us danach, hoechstens
+ * APP_HOUSEKEEPING_MS (EV_HOUSEKEEPING). poll_us != 0: nur zyklisch. */
+static void app_wait_rx(uint32_t poll_us, uint32_t latency_us)
+{
+	uint32_t waited;
+
+	if (poll_us) {
+		_delay_us(poll_us);
+		return;
+	}
+	for (waited = 0; !rx_event && waited < APP_HOUSEKEEPING_MS * 1000UL; waited++) {
+		_delay_us(1);
+	}
+	if (rx_event) {
+		_delay_us(latency_us);
+	}
+	rx_event = 0;						// ClearEvent() vor dem Abholen
+}
+
+// ----------------------------------------------------------------------------
+/* Empfang bei 100 % Buslast */
+static int bench_rx(uint16_t kbps, uint32_t frames, uint8_t length, uint32_t poll_us, uint32_t latency_us)
+{
+	uint32_t received = 0;
+	uint32_t lost;
+	uint32_t per_poll;
+	uint16_t min_bits = 0xffff;
+	int inside;
+
+	if (!setup(kbps, frames, 0)) {
+		return 1;
+	}
+	rx_event = 0;
+	mcp2515_set_rx_notify(poll_us ? NULL : app_rx_notify);
+
+	for (uint32_t i = 0; i < frames; i++) {
+		random_frame(&peer.tx[i], 1);
+		peer.tx[i].rtr = 0;
+		peer.tx[i].length = length;
+		if (sim_can_frame_bits(&peer.tx[i]) < min_bits) {
+			min_bits = sim_can_frame_bits(&peer.tx[i]);
+		}
+	}
+
+	// Auslegung aus mcp2515.h; zyklisch: angefangene Nachricht am Periodenende mitzaehlen
+	if (poll_us) {
+		per_poll = (uint32_t)(1000ULL * poll_us / ((uint64_t)min_bits * bus.bit_ns)) + 1;
+		inside = per_poll <= MCP2515_RX_BUFFER_SIZE - 1;
+	}
+	else {
+		per_poll = 0;
+		inside = kbps <= MCP2515_RX_MAX_KBPS && latency_us <= MCP2515_RX_MAX_LATENCY_US;
+	}
+
+	uint64_t start = sim_cycles;
+	peer.tx_count = frames;
+
+	while (peer.tx_next < frames || bus.busy) {
+		app_wait_rx(poll_us, latency_us);
+		received += app_receive_all();
+	}
+	// letzte Nachricht: ISR und Task1 laufen lassen, nicht bis EV_HOUSEKEEPING warten
+	_delay_us(poll_us ? poll_us : latency_us + 1000);
+	received += app_receive_all();
+
+	uint64_t cycles = sim_cycles - start;
+
+	mcp2515_set_rx_notify(NULL);
+	if (poll_us) {
+		printf("rx    %u kbit/s, %u Nachrichten mit %u Datenbytes, Abholen alle %u us, Ringpuffer %u\n",
+			kbps, frames, length, poll_us, MCP2515_RX_BUFFER_SIZE);
+		printf("rx    Auslegung            %10s (bis %u Nachrichten je Periode, hier %u)\n",
+			inside ? "innerhalb" : "ausserhalb", MCP2515_RX_BUFFER_SIZE - 1, per_poll);
+	}
+	else {
+		printf("rx    %u kbit/s, %u Nachrichten mit %u Datenbytes, Abholen %u us nach EV_CAN_RX, Ringpuffer %u\n",
+			kbps, frames, length, latency_us, MCP2515_RX_BUFFER_SIZE);
+		printf("rx    Auslegung            %10s (bis %u kbit/s, %u us)\n",
+			inside ? "innerhalb" : "ausserhalb", MCP2515_RX_MAX_KBPS, MCP2515_RX_MAX_LATENCY_US);
+	}
+	report_common("rx", cycles);
+	printf("rx    empfangen            %10u\n", received);
+	printf("rx    Verlust Ringpuffer   %10u\n", mcp2515_get_rx_overflow_count());
+	printf("rx    Verlust MCP2515      %10u (RXnOVR)\n", chip.rx_overflows);
+	if (chip.rx_latency_count) {
+		printf("rx    RXBn belegt          %10.1f us Mittel, %.1f us max\n",
+			1e6 * chip.rx_latency_sum / chip.rx_latency_count / F_CPU,
+			1e6 * chip.rx_latency_max / F_CPU);
+	}
+	lost = frames - received;
+	if (lost || mcp2515_get_rx_overflow_count() || chip.rx_overflows) {
+		printf(inside ? "rx    FEHLER: %u von %u Nachrichten verloren\n"
+			: "rx    %u von %u Nachrichten verloren (ausserhalb der Auslegung)\n", lost, frames);
+	}
+	printf("\n");
+	return (inside && (lost || mcp2515_get_rx_overflow_count() || chip.rx_overflows)) ? 1 : 0;
+}
+
+// ----------------------------------------------------------------------------
+/* Eckpunkte der Auslegung aus mcp2515.h, alle muessen verlustfrei sein */
+static int bench_rx_limits(uint32_t frames, uint32_t latency_us)
+{
+	static const uint16_t kbps[] = { 125, MCP2515_RX_MAX_KBPS };
+	static const uint8_t length[] = { 0, 8 };
+	int result = 0;
+
+	for (uint8_t k = 0; k < sizeof(kbps) / sizeof(kbps[0]); k++) {
+		for (uint8_t l = 0; l < sizeof(length); l++) {
+			result |= bench_rx(kbps[k], frames, length[l], 0, latency_us);
+		}
+	}
+	// zyklisch: drei Nachrichten mit 8 Datenbytes je Periode
+	result |= bench_rx(125, frames, 8, 2500, latency_us);
+	return result;
+}
+
+// ----------------------------------------------------------------------------
+/* Senden mit voller Warteschlange */
+static int bench_tx(uint16_t kbps, uint32_t frames)
+{
+	tCANFrame message;
+	uint64_t *sent_at = calloc(frames, sizeof(*sent_at));
+	uint64_t send_cycles = 0;
+	uint64_t latency_sum = 0;
+	uint64_t latency_max = 0;
+	uint32_t sent = 0;
+
+	if (!setup(kbps, 0, frames)) {
+		free(sent_at);
+		return 1;
+	}
+
+	uint64_t start = sim_cycles;
+
+	while (sent < frames) {
+		if (!mcp2515_check_free_buffer()) {
+			_delay_us(10);
+			continue;
+		}
+
+		// fortlaufende Nummer in den ersten vier Datenbytes
+		uint64_t before = sim_cycles;
+		if (zero_copy) {
+			tCANFrame *slot = mcp2515_tx_alloc(0x100 + (sent & 0x3f), 0, 8);
+
+			memset(slot->data, 0, 8);
+			memcpy(slot->data, &sent, sizeof(sent));
+			mcp2515_tx_commit(slot);
+		}
+		else {
+			memset(&message, 0, sizeof(message));
+			message.id = 0x100 + (sent & 0x3f);
+			message.length = 8;
+			memcpy(message.data, &sent, sizeof(sent));
+			mcp2515_send_message(&message);
+		}
+		send_cycles += sim_cycles - before;
+		sent_at[sent++] = before;
+	}
+	while (peer.rx_count < frames && sim_cycles - start < 60ULL * F_CPU) {
+		_delay_us(100);
+	}
+
+	uint64_t cycles = sim_cycles - start;
+
+	for (uint32_t i = 0; i < peer.rx_count; i++) {
+		uint32_t number;
+
+		memcpy(&number, peer.rx[i].data, sizeof(number));
+		if (number < frames) {
+			uint64_t latency = peer.rx_time[i] - sent_at[number];
+
+			latency_sum += latency;
+			if (latency > latency_max) {
+				latency_max = latency;
+			}
+		}
+	}
+
+	printf("tx    %u kbit/s, %u Nachrichten\n", kbps, frames);
+	report_common("tx", cycles);
+	printf("tx    gesendet             %10u (%.0f Nachrichten/s)\n", peer.rx_count,
+		peer.rx_count / ((double)cycles / F_CPU));
+	printf("tx    verworfen            %10u\n", mcp2515_get_tx_dropped_count());
+	printf("tx    %-20s %10.1f us Mittel\n", zero_copy ? "mcp2515_tx_commit" : "mcp2515_send_message",
+		1e6 * send_cycles / sent / F_CPU);
+	if (peer.rx_count) {
+		printf("tx    Latenz bis Busende   %10.1f us Mittel, %.1f us max\n",
+			1e6 * latency_sum / peer.rx_count / F_CPU, 1e6 * latency_max / F_CPU);
+	}
+	printf("\n");
+	free(sent_at);
+	return (peer.rx_count == frames) ? 0 : 1;
+}
+
+// ----------------------------------------------------------------------------
+static int id_in_table(uint32_t id, const uint32_t *ids, uint8_t count)
+{
+	for (uint8_t i = 0; i < count; i++) {
+		if (ids[i] == id) {
+			return 1;
+		}
+	}
+	return 0;
+}
+
+// ----------------------------------------------------------------------------
+/* Zufaellige Nachrichten in beide Richtungen. Geprueft wird:
+ * - jede empfangene Nachricht wurde von der Gegenstelle gesendet, unveraendert
+ *   (ID, RTR, DLC, Daten) und hoechstens von einer spaeteren ueberholt
+ * - jede gesendete Nachricht mit einer ID aus der Filtertabelle kommt an oder
+ *   ist als Verlust (Ringpuffer, RXnOVR) gezaehlt
+ * - jede Nachricht der Applikation kommt genau einmal an, gleiche IDs in
+ *   Sendereihenfolge */
+static int bench_fuzz(uint16_t kbps, uint32_t frames)
+{
+	uint32_t ids[9];
+	uint8_t id_count;
+	sim_can_frame *app_tx = calloc(frames, sizeof(*app_tx));
+	sim_can_frame frame;
+	tCANFrame message;
+	uint32_t app_sent = 0;
+	uint32_t matched = 0;
+	uint32_t received = 0;
+	uint8_t *consumed = calloc(frames, 1);
+	uint32_t missing = 0;
+	uint32_t losses;
+	uint32_t j;
+	uint32_t errors = 0;
+	uint64_t frame_cycles;
+	uint32_t start_seed = seed;
+
+	if (!setup(kbps, frames, frames)) {
+		free(consumed);
+		free(app_tx);
+		return 1;
+	}
+
+	// Filtertabelle mit 0..9 IDs, davon ein Teil als Extended IDs
+	id_count = random32() % 10;
+	for (uint8_t i = 0; i < id_count; i++) {
+		random_frame(&frame, 1);
+		ids[i] = frame.id;
+	}
+	mcp2515_set_filters(ids, id_count);
+
+	// Gegenstelle: Nachrichten mit IDs aus der Tabelle und zufaelligen IDs, mit
+	// Abstaenden so gewaehlt, dass der Treiber ohne Verluste hinterherkommt
+	// (mindestens eine Nachrichtenlaenge, bei hohen Bitraten begrenzt die ISR)
+	frame_cycles = SIM_NS_TO_CYCLES(130ULL * bus.bit_ns);
+	if (frame_cycles < FUZZ_MIN_GAP_US * (F_CPU / 1000000UL)) {
+		frame_cycles = FUZZ_MIN_GAP_US * (F_CPU / 1000000UL);
+	}
+	for (uint32_t i = 0; i < frames; i++) {
+		random_frame(&peer.tx[i], 1);
+		if (id_count && (random32() & 1)) {
+			peer.tx[i].id = ids[random32() % id_count];
+		}
+		peer.tx_release[i] = sim_cycles + i * frame_cycles * 2 + (random32() % frame_cycles);
+	}
+	peer.tx_count = frames;
+
+	// Applikation: eine ID darf auf dem Bus nur einen Sender haben, sonst enden
+	// gleichzeitige Sendungen mit unterschiedlichen Daten in Error-Frames
+	for (uint32_t i = 0; i < frames; i++) {
+		do {
+			random_frame(&app_tx[i], 1);
+			for (j = 0; j < frames && peer.tx[j].id != app_tx[i].id; j++) {
+			}
+		} while (j < frames);
+	}
+
+	uint64_t deadline = sim_cycles + (frames * 4 + 1000) * frame_cycles;
+
+	while ((peer.tx_next < frames || app_sent < frames || bus.busy) && sim_cycles < deadline) {
+		if (app_sent < frames && mcp2515_check_free_buffer() && (random32() & 1)) {
+			if (random32() & 1) {
+				sim_can_to_tcanframe(&message, &app_tx[app_sent++]);
+				mcp2515_send_message(&message);
+			}
+			else {
+				const sim_can_frame *tx = &app_tx[app_sent++];
+				tCANFrame *slot = mcp2515_tx_alloc(tx->id, tx->rtr ? CAN_FRAME_RTR : 0, tx->length);
+
+				if (slot) {
+					sim_can_to_tcanframe(slot, tx);
+					mcp2515_tx_commit(slot);
+				}
+			}
+		}
+		_delay_us(20);
+
+		for (;;) {
+			const tCANFrame *lent = (random32() & 1) ? mcp2515_rx_peek() : NULL;
+
+			if (lent) {
+				sim_can_from_tcanframe(&frame, lent);
+				mcp2515_rx_release();
+			}
+			else if (mcp2515_get_message(&message)) {
+				sim_can_from_tcanframe(&frame, &message);
+			}
+			else {
+				break;
+			}
+			received++;
+
+			// in der Sendeliste der Gegenstelle suchen. Reihenfolge: hoechstens
+			// eine spaeter gesendete Nachricht darf schon da sein, weil der MCP2515
+			// nach einem Ueberlauf von RXB0 nach RXB1 (BUKT) nicht anzeigt, welcher
+			// Puffer die aeltere Nachricht enthaelt. Gleiche Nachrichten (z.B.
+			// Remote-Frames) koennen mehrfach in der Liste stehen; ist eine davon
+			// verloren gegangen, gehoert die empfangene zu einer spaeteren.
+			uint32_t first = peer.tx_next;
+			uint32_t overtaken = 0;
+
+			for (j = matched; j < peer.tx_next; j++) {
+				if (!consumed[j] && sim_can_frame_compare(&peer.tx[j], &frame) == 0) {
+					overtaken = 0;
+					for (uint32_t k = j + 1; k < peer.tx_next; k++) {
+						overtaken += consumed[k];
+					}
+					if (first == peer.tx_next) {
+						first = j;
+					}
+					if (overtaken <= 1) {
+						break;
+					}
+				}
+			}
+			if (first == peer.tx_next) {
+				printf("fuzz  unerwartete Nachricht ID 0x%08X DLC %u\n", frame.id, frame.length);
+				errors++;
+				continue;
+			}
+			if (j == peer.tx_next) {
+				j = first;
+				overtaken = 0;
+				for (uint32_t k = j + 1; k < peer.tx_next; k++) {
+					overtaken += consumed[k];
+				}
+			}
+			consumed[j] = 1;
+
+			if (overtaken > 1) {
+				printf("fuzz  Nachricht %u (ID 0x%08X) von %u spaeteren ueberholt\n", j, frame.id, overtaken);
+				errors++;
+			}
+			while (matched < peer.tx_next && consumed[matched]) {
+				matched++;
+			}
+		}
+	}
+	for (j = 0; j < peer.tx_next; j++) {
+		if (!consumed[j] && (id_in_table(peer.tx[j].id, ids, id_count) || id_count == 0)) {
+			missing++;
+		}
+	}
+	free(consumed);
+
+	// fehlende Nachrichten muessen als Verlust gezaehlt sein (z.B. RXnOVR, wenn
+	// die Applikation mit ihren Sendungen die ISR zu lange beschaeftigt)
+	losses = mcp2515_get_rx_overflow_count() + chip.rx_overflows;
+	if (missing > losses) {
+		printf("fuzz  %u Nachrichten fehlen, aber nur %u Verluste gezaehlt\n", missing, losses);
+		errors++;
+	}
+
+	// Senderichtung: jede Nachricht genau einmal, je ID in Reihenfolge
+	if (peer.rx_count != app_sent) {
+		printf("fuzz  %u von %u Nachrichten der Applikation gesendet\n", peer.rx_count, app_sent);
+		errors++;
+	}
+	uint8_t *seen = calloc(frames, 1);
+	for (uint32_t i = 0; i < peer.rx_count; i++) {
+		for (j = 0; j < app_sent; j++) {
+			if (!seen[j] && sim_can_frame_compare(&app_tx[j], &peer.rx[i]) == 0) {
+				break;
+			}
+			if (!seen[j] && app_tx[j].id == peer.rx[i].id) {
+				// aeltere Nachricht mit derselben ID steht noch aus
+				j = app_sent;
+				break;
+			}
+		}
+		if (j == app_sent) {
+			printf("fuzz  Nachricht ID 0x%08X in falscher Reihenfolge oder unbekannt\n", peer.rx[i].id);
+			errors++;
+		}
+		else {
+			seen[j] = 1;
+		}
+	}
+	free(seen);
+
+	if (mcp2515_get_tx_dropped_count()) {
+		printf("fuzz  %u Nachrichten der Applikation verworfen\n", mcp2515_get_tx_dropped_count());
+		errors++;
+	}
+	if (chip.illegal_writes) {
+		printf("fuzz  unzulaessige Schreibzugriffe auf den MCP2515: %u\n", chip.illegal_writes);
+		errors++;
+	}
+
+	printf("fuzz  %u kbit/s, Seed %u, %u Filter-IDs: %u empfangen (%u verloren), %u gesendet, %u Fehler\n\n",
+		kbps, start_seed, id_count, received, missing, peer.rx_count, errors);
+	free(app_tx);
+	return errors ? 1 : 0;
+}
+
+// ----------------------------------------------------------------------------
+/* Frueherer Treiber zum Vergleich (spi): jedes Byte einzeln ueber spi_putc(),
+ * nach dem Laden eines Sendepuffers _delay_us(1) und ein eigenes RTS, beim
+ * Empfang SPI_RX_STATUS, READ RX BUFFER und ein BIT MODIFY auf CANINTF. Wie
+ * damals nur Standard-IDs. */
+static uint8_t old_send_message(const tCANFrame *message)
+{
+	uint8_t status = mcp2515_read_status(SPI_READ_STATUS);
+	uint8_t address;
+	uint8_t length;
+	uint8_t t;
+
+	if (bit_is_clear(status, 2)) {
+		address = 0x00;
+	}
+	else if (bit_is_clear(status, 4)) {
+		address = 0x02;
+	}
+	else if (bit_is_clear(status, 6)) {
+		address = 0x04;
+	}
+	else {
+		return 0;
+	}
+
+	RESET(MCP2515_CS);
+	spi_putc(SPI_WRITE_TX | address);
+	spi_putc(message->id >> 3);
+	spi_putc(message->id << 5);
+	spi_putc(0);
+	spi_putc(0);
+	length = message->length & 0x0f;
+	if (message->flags & CAN_FRAME_RTR) {
+		spi_putc((1<<RTR) | length);
+	}
+	else {
+		spi_putc(length);
+		for (t = 0; t < length; t++) {
+			spi_putc(message->data[t]);
+		}
+	}
+	SET(MCP2515_CS);
+
+	_delay_us(1);
+
+	RESET(MCP2515_CS);
+	address = (address == 0) ? 1 : address;
+	spi_putc(SPI_RTS | address);
+	SET(MCP2515_CS);
+	return 1;
+}
+
+static uint8_t old_get_message(tCANFrame *message)
+{
+	uint8_t status = mcp2515_read_status(SPI_RX_STATUS);
+	uint8_t addr;
+	uint8_t length;
+	uint8_t t;
+
+	if (bit_is_set(status, 6)) {
+		addr = SPI_READ_RX;
+	}
+	else if (bit_is_set(status, 7)) {
+		addr = SPI_READ_RX | 0x04;
+	}
+	else {
+		return 0;
+	}
+
+	RESET(MCP2515_CS);
+	spi_putc(addr);
+	message->id  = (uint16_t)spi_putc(0xff) << 3;
+	message->id |=           spi_putc(0xff) >> 5;
+	spi_putc(0xff);
+	spi_putc(0xff);
+	length = spi_putc(0xff) & 0x0f;
+	message->length = length;
+	message->flags = bit_is_set(status, 3) ? CAN_FRAME_RTR : 0;
+	for (t = 0; t < length; t++) {
+		message->data[t] = spi_putc(0xff);
+	}
+	SET(MCP2515_CS);
+
+	if (bit_is_set(status, 6)) {
+		mcp2515_bit_modify(CANINTF, (1<<RX0IF), 0);
+	}
+	else {
+		mcp2515_bit_modify(CANINTF, (1<<RX1IF), 0);
+	}
+	return 1;
+}
+
+typedef struct
+{
+	uint32_t bytes;
+	uint32_t commands;
+	uint64_t cycles;
+} spi_cost;
+
+static void spi_cost_print(const char *name, const spi_cost *cost, uint32_t count)
+{
+	printf("spi   %-30s %6.1f %7.1f %8.0f %8.1f\n", name,
+		(double)cost->bytes / count, (double)cost->commands / count,
+		(double)cost->cycles / count, 1e6 * cost->cycles / count / F_CPU);
+}
+
+// ----------------------------------------------------------------------------
+/* SPI-Aufwand je Nachricht (8 Datenbytes, Standard-ID): Laden eines
+ * Sendepuffers bis zum Sendeauftrag und Abholen eines Empfangspuffers, einmal
+ * mit dem frueheren Treiber Byte fuer Byte (mit seinem SPI-Takt F_CPU/16 und
+ * mit F_CPU/2), einmal mit mcp2515.c. Gemessen wird der Aufruf bzw. beim
+ * Empfang mit mcp2515.c der INT0-ISR samt Eintritt; den ISR nach dem Senden
+ * (TXnIF) zeigt tx. Rueckgabewert != 0, wenn eine Nachricht falsch ankommt. */
+static int bench_spi(uint16_t kbps, uint32_t frames)
+{
+	static const char *name[3][2] = {
+		{ "Senden  Byte fuer Byte, /16", "Empfang Byte fuer Byte, /16" },
+		{ "Senden  Byte fuer Byte, /2", "Empfang Byte fuer Byte, /2" },
+		{ "Senden  Block (mcp2515.c), /2", "Empfang Block (mcp2515.c), /2" },
+	};
+	spi_cost cost[3][2];
+	int errors = 0;
+
+	if (frames > 100) {
+		frames = 100;
+	}
+	memset(cost, 0, sizeof(cost));
+
+	for (uint8_t variant = 0; variant < 3; variant++) {
+		if (!setup(kbps, 0, frames)) {
+			return 1;
+		}
+		if (variant == 0) {
+			// SPI-Takt des frueheren Treibers
+			SPCR = (1<<SPE)|(1<<MSTR)|(0<<SPR1)|(1<<SPR0);
+			SPSR = 0;
+		}
+
+		for (uint32_t i = 0; i < frames; i++) {
+			tCANFrame message, received;
+			sim_can_frame frame;
+			uint64_t start;
+
+			memset(&message, 0, sizeof(message));
+			message.id = random32() & 0x7ff;
+			message.length = 8;
+			for (uint8_t b = 0; b < 8; b++) {
+				message.data[b] = random32();
+			}
+
+			// Senden: INT0 gesperrt, damit nur der Aufruf selbst zaehlt
+			EIMSK &= ~(1<<INT0);
+			start = sim_cycles;
+			cost[variant][0].bytes -= chip.spi_bytes;
+			cost[variant][0].commands -= chip.spi_commands;
+			if (!(variant < 2 ? old_send_message(&message) : mcp2515_send_message(&message))) {
+				errors++;
+			}
+			cost[variant][0].cycles += sim_cycles - start;
+			cost[variant][0].bytes += chip.spi_bytes;
+			cost[variant][0].commands += chip.spi_commands;
+			EIMSK |= (1<<INT0);
+			while (bus.busy || chip.tx_frames <= i) {
+				_delay_us(10);
+			}
+			_delay_us(1000);
+			if (peer.rx_count != i + 1 || peer.rx[i].id != message.id
+				|| memcmp(peer.rx[i].data, message.data, 8) != 0) {
+				errors++;
+			}
+
+			// Empfang: frueherer Treiber aus der Task mit gesperrtem INT0,
+			// mcp2515.c im INT0-ISR
+			memset(&frame, 0, sizeof(frame));
+			frame.id = message.id;
+			frame.length = 8;
+			memcpy(frame.data, message.data, 8);
+			memset(&received, 0, sizeof(received));
+			cost[variant][1].bytes -= chip.spi_bytes;
+			cost[variant][1].commands -= chip.spi_commands;
+			if (variant < 2) {
+				EIMSK &= ~(1<<INT0);
+				mcp2515_sim_receive(&chip, &frame);
+				start = sim_cycles;
+				if (!old_get_message(&received)) {
+					errors++;
+				}
+				cost[variant][1].cycles += sim_cycles - start;
+				EIMSK |= (1<<INT0);
+			}
+			else {
+				start = sim_isr_cycles;
+				mcp2515_sim_receive(&chip, &frame);
+				_delay_us(1000);
+				cost[variant][1].cycles += sim_isr_cycles - start;
+				if (!mcp2515_get_message(&received)) {
+					errors++;
+				}
+			}
+			cost[variant][1].bytes += chip.spi_bytes;
+			cost[variant][1].commands += chip.spi_commands;
+			if (received.id != message.id || received.length != 8
+				|| memcmp(received.data, message.data, 8) != 0) {
+				errors++;
+			}
+		}
+	}
+
+	printf("spi   %u kbit/s, je Nachricht (8 Datenbytes, Standard-ID), Mittel ueber %u\n", kbps, frames);
+	printf("spi   %-30s %6s %7s %8s %8s\n", "", "Bytes", "Befehle", "Takte", "us");
+	for (uint8_t direction = 0; direction < 2; direction++) {
+		for (uint8_t variant = 0; variant < 3; variant++) {
+			spi_cost_print(name[variant][direction], &cost[variant][direction], frames);
+		}
+	}
+	if (errors) {
+		printf("spi   FEHLER: %u Nachrichten falsch gesendet oder empfangen\n", errors);
+	}
+	printf("\n");
+	return errors ? 1 : 0;
+}
+
+// ----------------------------------------------------------------------------
+int main(int argc, char **argv)
+{
+	const char *mode = "all";
+	uint16_t kbps = 125;
+	uint32_t frames = 1000;
+	uint32_t poll_us = 0;
+	uint32_t latency_us = MCP2515_RX_MAX_LATENCY_US;
+	uint8_t length = 8;
+	int rx_limits = 1;
+	int result = 0;
+
+	for (int i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "-b") == 0 && i + 1 < argc) {
+			kbps = atoi(argv[++i]);
+			rx_limits = 0;
+		}
+		else if (strcmp(argv[i], "-d") == 0 && i + 1 < argc) {
+			length = atoi(argv[++i]);
+			rx_limits = 0;
+			if (length > 8) {
+				length = 8;
+			}
+		}
+		else if (strcmp(argv[i], "-n") == 0 && i + 1 < argc) {
+			frames = atoi(argv[++i]);
+		}
+		else if (strcmp(argv[i], "-l") == 0 && i + 1 < argc) {
+			latency_us = atoi(argv[++i]);
+		}
+		else if (strcmp(argv[i], "-p") == 0 && i + 1 < argc) {
+			poll_us = atoi(argv[++i]);
+			rx_limits = 0;
+		}
+		else if (strcmp(argv[i], "-s") == 0 && i + 1 < argc) {
+			seed = strtoul(argv[++i], NULL, 0);
+		}
+		else if (strcmp(argv[i], "-z") == 0) {
+			zero_copy = 1;
+		}
+		else if (argv[i][0] != '-') {
+			mode = argv[i];
+		}
+		else {
+			fprintf(stderr, "Aufruf: %s [rx|tx|fuzz|spi|all] [-b kbps] [-n frames] [-d length] [-l latency_us] [-p poll_us] [-s seed] [-z]\n", argv[0]);
+			return 2;
+		}
+	}
+	if (seed == 0) {
+		seed = 1;
+	}
+
+	if (strcmp(mode, "rx") == 0 || strcmp(mode, "all") == 0) {
+		if (rx_limits) {
+			result |= bench_rx_limits(frames, latency_us);
+		}
+		else {
+			result |= bench_rx(kbps, frames, length, poll_us, latency_us);
+		}
+	}
+	if (strcmp(mode, "tx") == 0 || strcmp(mode, "all") == 0) {
+		result |= bench_tx(kbps, frames);
+	}
+	if (strcmp(mode, "fuzz") == 0 || strcmp(mode, "all") == 0) {
+		result |= bench_fuzz(kbps, frames);
+	}
+	if (strcmp(mode, "spi") == 0 || strcmp(mode, "all") == 0) {
+		result |= bench_spi(kbps, frames);
+	}
+	return result;
+}
@@ -0,0 +1,754 @@
+/*
+ * mcp2515_sim.c
+ *
+ * Registermodell des MCP2515, siehe mcp2515_sim.h. Registeradressen und Bits
+ * stammen aus mcp2515_defs.h, das Verhalten aus dem Datenblatt (DS20001801).
+ */
+
+#include <string.h>
+
+#include "mcp2515_defs.h"
+#include "mcp2515_sim.h"
+
+#define TXBCTRL(n)		(0x30 + ((n) << 4))
+#define RXBCTRL(n)		(0x60 + ((n) << 4))
+
+#define MODE_NORMAL		0
+#define MODE_SLEEP		1
+#define MODE_LOOPBACK	2
+#define MODE_LISTEN		3
+#define MODE_CONFIG		4
+
+static const uint8_t filter_adress[6] = { 0x00, 0x04, 0x08, 0x10, 0x14, 0x18 };
+
+// ----------------------------------------------------------------------------
+void mcp2515_sim_init(mcp2515_sim *chip)
+{
+	memset(chip->reg, 0, sizeof(chip->reg));
+	chip->reg[CANSTAT] = MODE_CONFIG << 5;
+	chip->reg[CANCTRL] = 0x87;
+	chip->read_rx = 0;
+	chip->tx_offered = -1;
+}
+
+// ----------------------------------------------------------------------------
+uint8_t mcp2515_sim_mode(const mcp2515_sim *chip)
+{
+	return chip->reg[CANSTAT] >> 5;
+}
+
+// ----------------------------------------------------------------------------
+int mcp2515_sim_int_pin(const mcp2515_sim *chip)
+{
+	return (chip->reg[CANINTF] & chip->reg[CANINTE]) ? 0 : 1;
+}
+
+// ----------------------------------------------------------------------------
+uint32_t mcp2515_sim_bitrate(const mcp2515_sim *chip)
+{
+	uint8_t brp = chip->reg[CNF1] & 0x3f;
+	uint8_t prseg = (chip->reg[CNF2] & 0x07) + 1;
+	uint8_t phseg1 = ((chip->reg[CNF2] >> 3) & 0x07) + 1;
+	uint8_t phseg2 = (chip->reg[CNF3] & 0x07) + 1;
+
+	if (!(chip->reg[CNF2] & (1<<BTLMODE))) {
+		// PS2 = max(PS1, IPT)
+		phseg2 = (phseg1 > 2) ? phseg1 : 2;
+	}
+	return MCP2515_SIM_OSC / (2UL * (brp + 1) * (1 + prseg + phseg1 + phseg2));
+}
+
+// ----------------------------------------------------------------------------
+/* Gespiegelte Adressen von CANSTAT und CANCTRL (xE, xF) abbilden */
+static uint8_t reg_index(uint8_t adress)
+{
+	adress &= 0x7f;
+	if ((adress & 0x0e) == 0x0e) {
+		return adress & 0x0f;
+	}
+	return adress;
+}
+
+// ----------------------------------------------------------------------------
+static uint8_t read_reg(const mcp2515_sim *chip, uint8_t adress)
+{
+	adress = reg_index(adress);
+
+	if (adress == CANSTAT) {
+		// ICOD: Interrupt mit der hoechsten Prioritaet
+		static const uint8_t icod[8] = { 6, 7, 3, 4, 5, 1, 2, 0 };
+		uint8_t pending = chip->reg[CANINTF] & chip->reg[CANINTE];
+		uint8_t code = 0;
+
+		for (uint8_t bit = 0; bit < 8; bit++) {
+			if ((pending & (1 << bit)) && icod[bit] != 0 && (code == 0 || icod[bit] < code)) {
+				code = icod[bit];
+			}
+		}
+		return (chip->reg[CANSTAT] & 0xe0) | (code << 1);
+	}
+	return chip->reg[adress];
+}
+
+// ----------------------------------------------------------------------------
+static void tx_frame(const mcp2515_sim *chip, uint8_t n, sim_can_frame *frame)
+{
+	const uint8_t *r = &chip->reg[TXBCTRL(n) + 1];
+
+	memset(frame, 0, sizeof(*frame));
+	if (r[1] & (1<<EXIDE)) {
+		frame->id = CAN_ID_EXT
+			| ((uint32_t)r[0] << 21)
+			| ((uint32_t)(r[1] & 0xe0) << 13)
+			| ((uint32_t)(r[1] & 0x03) << 16)
+			| ((uint32_t)r[2] << 8)
+			| r[3];
+	}
+	else {
+		frame->id = ((uint32_t)r[0] << 3) | (r[1] >> 5);
+	}
+	frame->rtr = (r[4] >> RTR) & 1;
+	frame->length = r[4] & 0x0f;
+	if (!frame->rtr) {
+		memcpy(frame->data, &r[5], 8);
+	}
+}
+
+// ----------------------------------------------------------------------------
+/* Fehlereingrenzung nach ISO 11898: TEC und REC um tec bzw. rec aendern und
+ * EFLG nachfuehren; jedes neu gesetzte Bit in EFLG setzt ERRIF. Ueber 255
+ * geht der Baustein ins Bus-Off, now ist dann der Zeitpunkt in ns. */
+static void error_count(mcp2515_sim *chip, int tec, int rec, uint64_t now)
+{
+	uint8_t old = chip->reg[EFLG];
+	uint8_t eflg = old & ((1<<RX1OVR)|(1<<RX0OVR));
+
+	if (old & (1<<TXBO)) {
+		return;
+	}
+	tec += chip->reg[TEC];
+	rec += chip->reg[REC];
+	if (tec < 0) {
+		tec = 0;
+	}
+	if (rec < 0) {
+		rec = 0;
+	}
+	else if (rec > 255) {
+		rec = 255;
+	}
+	else if (rec > 127 && chip->reg[REC] > 127 && rec < chip->reg[REC]) {
+		// erfolgreicher Empfang im Zustand Error-Passive
+		rec = 127;
+	}
+
+	if (tec > 255) {
+		tec = 255;
+		eflg |= (1<<TXBO)|(1<<TXEP)|(1<<TXWAR)|(1<<EWARN);
+		chip->bus_off_at = now;
+		chip->bus_off++;
+	}
+	else {
+		if (tec >= 96) {
+			eflg |= (1<<TXWAR)|(1<<EWARN);
+		}
+		if (rec >= 96) {
+			eflg |= (1<<RXWAR)|(1<<EWARN);
+		}
+		if (tec >= 128) {
+			eflg |= (1<<TXEP);
+		}
+		if (rec >= 128) {
+			eflg |= (1<<RXEP);
+		}
+	}
+	if (eflg & ~old) {
+		chip->reg[CANINTF] |= (1<<ERRIF);
+	}
+	chip->reg[EFLG] = eflg;
+	chip->reg[TEC] = tec;
+	chip->reg[REC] = rec;
+}
+
+// ----------------------------------------------------------------------------
+/* Bus-Off endet nach 128 x 11 rezessiven Bits; gezaehlt wird hier einfach die
+ * Zeit seit dem Bus-Off, Nachrichten anderer Teilnehmer in dieser Zeit
+ * verlaengern sie nicht. */
+static void bus_off_recovery(mcp2515_sim *chip, uint64_t now)
+{
+	uint32_t bitrate;
+
+	if (!(chip->reg[EFLG] & (1<<TXBO))) {
+		return;
+	}
+	bitrate = mcp2515_sim_bitrate(chip);
+	if (now - chip->bus_off_at >= 128ULL * 11 * 1000000000ULL / bitrate) {
+		chip->reg[EFLG] &= (1<<RX1OVR)|(1<<RX0OVR);
+		chip->reg[TEC] = 0;
+		chip->reg[REC] = 0;
+	}
+}
+
+// ----------------------------------------------------------------------------
+static void tx_complete(mcp2515_sim *chip, uint8_t n)
+{
+	chip->reg[TXBCTRL(n)] &= ~((1<<TXREQ)|(1<<MLOA)|(1<<TXERR));
+	chip->reg[CANINTF] |= (1<<TX0IF) << n;
+	chip->tx_frames++;
+}
+
+// ----------------------------------------------------------------------------
+/* Im Loopback-Modus gehen angeforderte Nachrichten nicht auf den Bus, sondern
+ * direkt in die eigenen Empfangspuffer */
+static void loopback(mcp2515_sim *chip)
+{
+	sim_can_frame frame;
+
+	if (mcp2515_sim_mode(chip) != MODE_LOOPBACK) {
+		return;
+	}
+	for (int8_t n = 2; n >= 0; n--) {
+		if (chip->reg[TXBCTRL(n)] & (1<<TXREQ)) {
+			tx_frame(chip, n, &frame);
+			tx_complete(chip, n);
+			if (chip->on_tx) {
+				chip->on_tx(chip->on_tx_context, &frame);
+			}
+			mcp2515_sim_receive(chip, &frame);
+		}
+	}
+}
+
+// ----------------------------------------------------------------------------
+static void set_mode(mcp2515_sim *chip, uint8_t canctrl)
+{
+	uint8_t mode = canctrl >> 5;
+
+	if (canctrl & (1<<ABAT)) {
+		// alle ausstehenden Sendeanforderungen abbrechen
+		for (uint8_t n = 0; n < 3; n++) {
+			if ((chip->reg[TXBCTRL(n)] & (1<<TXREQ)) && chip->tx_offered != n) {
+				chip->reg[TXBCTRL(n)] = (chip->reg[TXBCTRL(n)] & ~(1<<TXREQ)) | (1<<ABTF);
+			}
+		}
+	}
+	if (mode <= MODE_CONFIG) {
+		chip->reg[CANSTAT] = mode << 5;
+	}
+	chip->reg[CANCTRL] = canctrl;
+}
+
+// ----------------------------------------------------------------------------
+/* Register schreiben, mask != 0xff nur fuer BIT MODIFY */
+static void write_reg(mcp2515_sim *chip, uint8_t adress, uint8_t mask, uint8_t value)
+{
+	uint8_t writable;
+
+	adress = reg_index(adress);
+
+	switch (adress) {
+		case BFPCTRL:	writable = 0x3f; break;
+		case TXRTSCTRL:	writable = 0x07; break;
+		case CANCTRL:	writable = 0xff; break;
+		case CANINTE:	writable = 0xff; break;
+		case CANINTF:	writable = 0xff; break;
+		case EFLG:		writable = (1<<RX1OVR)|(1<<RX0OVR); break;
+		case 0x60:		writable = (1<<RXM1)|(1<<RXM0)|(1<<BUKT); break;
+		case 0x70:		writable = (1<<RXM1)|(1<<RXM0); break;
+		case CANSTAT:
+		case TEC:
+		case REC:
+			return;
+		default:
+			if (adress < 0x2b && (adress & 0x0c) != 0x0c) {
+				// Filter, Masken und CNF1..3 nur im Konfigurationsmodus
+				if (mcp2515_sim_mode(chip) != MODE_CONFIG) {
+					chip->illegal_writes++;
+					return;
+				}
+				writable = 0xff;
+			}
+			else if (adress >= 0x30 && adress < 0x60) {
+				uint8_t n = (adress - 0x30) >> 4;
+
+				if ((adress & 0x0f) == 0) {
+					// TXBnCTRL: TXREQ und TXP1..0, eine laufende Nachricht wird nicht abgebrochen
+					writable = (1<<TXREQ)|(1<<TXP1)|(1<<TXP0);
+					if (chip->tx_offered == n) {
+						writable &= ~(1<<TXREQ);
+					}
+				}
+				else if (chip->reg[TXBCTRL(n)] & (1<<TXREQ)) {
+					// Puffer mit TXREQ darf nicht veraendert werden
+					chip->illegal_writes++;
+					return;
+				}
+				else {
+					writable = 0xff;
+				}
+			}
+			else {
+				// Empfangspuffer und nicht belegte Adressen
+				chip->illegal_writes++;
+				return;
+			}
+			break;
+	}
+
+	mask &= writable;
+	value = (chip->reg[adress] & ~mask) | (value & mask);
+
+	if (adress == CANCTRL) {
+		set_mode(chip, value);
+	}
+	else {
+		chip->reg[adress] = value;
+	}
+	loopback(chip);
+}
+
+// ----------------------------------------------------------------------------
+/* Nur diese Register koennen mit BIT MODIFY bitweise veraendert werden, bei allen
+ * anderen wirkt die Maske wie 0xff */
+static uint8_t bit_modify_allowed(uint8_t adress)
+{
+	adress = reg_index(adress);
+
+	switch (adress) {
+		case BFPCTRL:
+		case TXRTSCTRL:
+		case CANCTRL:
+		case CNF3:
+		case CNF2:
+		case CNF1:
+		case CANINTE:
+		case CANINTF:
+		case EFLG:
+		case 0x30:
+		case 0x40:
+		case 0x50:
+		case 0x60:
+		case 0x70:
+			return 1;
+	}
+	return 0;
+}
+
+// ----------------------------------------------------------------------------
+static uint8_t read_status(const mcp2515_sim *chip)
+{
+	uint8_t intf = chip->reg[CANINTF];
+	uint8_t status = intf & ((1<<RX1IF)|(1<<RX0IF));
+
+	for (uint8_t n = 0; n < 3; n++) {
+		if (chip->reg[TXBCTRL(n)] & (1<<TXREQ)) {
+			status |= 1 << (2 + 2*n);
+		}
+		if (intf & ((1<<TX0IF) << n)) {
+			status |= 1 << (3 + 2*n);
+		}
+	}
+	return status;
+}
+
+// ----------------------------------------------------------------------------
+static uint8_t rx_status(const mcp2515_sim *chip)
+{
+	uint8_t intf = chip->reg[CANINTF];
+	uint8_t status = 0;
+	uint8_t n;
+
+	if (intf & (1<<RX0IF)) {
+		status |= 0x40;
+	}
+	if (intf & (1<<RX1IF)) {
+		status |= 0x80;
+	}
+	if (status == 0) {
+		return 0;
+	}
+
+	n = (intf & (1<<RX0IF)) ? 0 : 1;
+	const uint8_t *r = &chip->reg[RXBCTRL(n)];
+
+	// Nachrichtentyp: Bit 4 = Extended, Bit 3 = Remote
+	if (r[2] & (1<<IDE)) {
+		status |= 0x10;
+	}
+	if (r[0] & (1<<RXRTR)) {
+		status |= 0x08;
+	}
+
+	// Filtertreffer, 6 bzw. 7 = RXF0 bzw. RXF1 mit Ueberlauf nach RXB1
+	if (n == 0) {
+		status |= r[0] & 0x01;
+	}
+	else if (r[0] & 0x06) {
+		status |= r[0] & 0x07;
+	}
+	else {
+		status |= 6 | (r[0] & 0x01);
+	}
+	return status;
+}
+
+// ----------------------------------------------------------------------------
+/* Registerabbild SIDH, SIDL, EID8, EID0 einer empfangenen Nachricht. Bei
+ * Standard-Nachrichten vergleichen die Filter EID8/EID0 mit den ersten beiden
+ * Datenbytes. */
+static void rx_image(const sim_can_frame *frame, uint8_t *image, uint8_t for_filter)
+{
+	if (frame->id & CAN_ID_EXT) {
+		uint32_t id = frame->id & CAN_ID_EXT_MASK;
+
+		image[0] = id >> 21;
+		image[1] = ((id >> 13) & 0xe0) | (1<<IDE) | ((id >> 16) & 0x03);
+		image[2] = id >> 8;
+		image[3] = id;
+	}
+	else {
+		image[0] = frame->id >> 3;
+		image[1] = (frame->id << 5) | (frame->rtr ? (1<<SRR) : 0);
+		image[2] = for_filter ? frame->data[0] : 0;
+		image[3] = for_filter ? frame->data[1] : 0;
+	}
+}
+
+// ----------------------------------------------------------------------------
+static uint8_t filter_match(const mcp2515_sim *chip, uint8_t filter, const sim_can_frame *frame)
+{
+	const uint8_t *f = &chip->reg[filter_adress[filter]];
+	const uint8_t *m = &chip->reg[(filter < 2) ? RXM0SIDH : RXM1SIDH];
+	uint8_t image[4];
+	uint8_t ext = (frame->id & CAN_ID_EXT) ? 1 : 0;
+
+	if (ext != ((f[1] >> EXIDE) & 1)) {
+		return 0;
+	}
+	rx_image(frame, image, 1);
+
+	return ((image[0] ^ f[0]) & m[0]) == 0
+		&& ((image[1] ^ f[1]) & m[1] & (ext ? 0xe3 : 0xe0)) == 0
+		&& ((image[2] ^ f[2]) & m[2]) == 0
+		&& ((image[3] ^ f[3]) & m[3]) == 0;
+}
+
+// ----------------------------------------------------------------------------
+/* Akzeptanz durch RXBn pruefen, Rueckgabe Filternummer oder -1 */
+static int8_t rx_accept(const mcp2515_sim *chip, uint8_t n, const sim_can_frame *frame)
+{
+	uint8_t rxm = (chip->reg[RXBCTRL(n)] >> RXM0) & 0x03;
+	uint8_t ext = (frame->id & CAN_ID_EXT) ? 1 : 0;
+
+	if (rxm == 3) {
+		return (n == 0) ? 0 : 2;
+	}
+	if ((rxm == 1 && ext) || (rxm == 2 && !ext)) {
+		return -1;
+	}
+	for (uint8_t f = (n == 0) ? 0 : 2; f < ((n == 0) ? 2 : 6); f++) {
+		if (filter_match(chip, f, frame)) {
+			return f;
+		}
+	}
+	return -1;
+}
+
+// ----------------------------------------------------------------------------
+static void rx_store(mcp2515_sim *chip, uint8_t n, uint8_t filhit, const sim_can_frame *frame)
+{
+	uint8_t *r = &chip->reg[RXBCTRL(n)];
+	uint8_t length = frame->length & 0x0f;
+
+	rx_image(frame, &r[1], 0);
+	r[5] = ((frame->rtr && (frame->id & CAN_ID_EXT)) ? (1<<RTR) : 0) | length;
+	if (!frame->rtr) {
+		memcpy(&r[6], frame->data, (length > 8) ? 8 : length);
+	}
+
+	if (n == 0) {
+		r[0] = (r[0] & ((1<<RXM1)|(1<<RXM0)|(1<<BUKT)))
+			| ((r[0] & (1<<BUKT)) ? (1<<BUKT1) : 0)
+			| (frame->rtr ? (1<<RXRTR) : 0)
+			| filhit;
+	}
+	else {
+		r[0] = (r[0] & ((1<<RXM1)|(1<<RXM0)))
+			| (frame->rtr ? (1<<RXRTR) : 0)
+			| filhit;
+	}
+	chip->reg[CANINTF] |= (1<<RX0IF) << n;
+	chip->rx_stored_at[n] = sim_cycles;
+	chip->rx_frames++;
+}
+
+// ----------------------------------------------------------------------------
+static void rx_overflow(mcp2515_sim *chip, uint8_t n)
+{
+	chip->reg[EFLG] |= (n == 0) ? (1<<RX0OVR) : (1<<RX1OVR);
+	chip->reg[CANINTF] |= (1<<ERRIF);
+	chip->rx_overflows++;
+}
+
+// ----------------------------------------------------------------------------
+void mcp2515_sim_receive(mcp2515_sim *chip, const sim_can_frame *frame)
+{
+	int8_t filter;
+
+	filter = rx_accept(chip, 0, frame);
+	if (filter >= 0) {
+		if (!(chip->reg[CANINTF] & (1<<RX0IF))) {
+			rx_store(chip, 0, filter, frame);
+		}
+		else if (!(chip->reg[RXBCTRL(0)] & (1<<BUKT))) {
+			rx_overflow(chip, 0);
+		}
+		else if (!(chip->reg[CANINTF] & (1<<RX1IF))) {
+			rx_store(chip, 1, filter, frame);
+		}
+		else {
+			rx_overflow(chip, 1);
+		}
+		return;
+	}
+
+	filter = rx_accept(chip, 1, frame);
+	if (filter >= 0) {
+		if (!(chip->reg[CANINTF] & (1<<RX1IF))) {
+			rx_store(chip, 1, filter, frame);
+		}
+		else {
+			rx_overflow(chip, 1);
+		}
+		return;
+	}
+
+	chip->rx_filtered++;
+}
+
+// ----------------------------------------------------------------------------
+static void spi_select(void *context, int active)
+{
+	mcp2515_sim *chip = context;
+
+	if (active) {
+		bus_off_recovery(chip, SIM_CYCLES_TO_NS(sim_cycles));
+	}
+	if (!active && chip->selected) {
+		// READ RX loescht RXnIF, sobald CS wieder HIGH ist
+		for (uint8_t n = 0; n < 2; n++) {
+			if (chip->read_rx & chip->reg[CANINTF] & ((1<<RX0IF) << n)) {
+				uint64_t latency = sim_cycles - chip->rx_stored_at[n];
+
+				chip->rx_latency_sum += latency;
+				chip->rx_latency_count++;
+				if (latency > chip->rx_latency_max) {
+					chip->rx_latency_max = latency;
+				}
+			}
+		}
+		chip->reg[CANINTF] &= ~chip->read_rx;
+	}
+	chip->selected = active;
+	chip->bytes = 0;
+	chip->read_rx = 0;
+}
+
+// ----------------------------------------------------------------------------
+static uint8_t spi_command(mcp2515_sim *chip, uint8_t command)
+{
+	chip->command = command;
+	chip->spi_commands++;
+
+	if (command == SPI_RESET) {
+		mcp2515_sim_init(chip);
+	}
+	else if ((command & 0xf8) == SPI_RTS) {
+		for (uint8_t n = 0; n < 3; n++) {
+			if (command & (1 << n)) {
+				write_reg(chip, TXBCTRL(n), (1<<TXREQ), (1<<TXREQ));
+			}
+		}
+	}
+	else if ((command & 0xf9) == SPI_READ_RX) {
+		uint8_t n = (command >> 2) & 1;
+
+		chip->adress = RXBCTRL(n) + ((command & 0x02) ? 6 : 1);
+		chip->read_rx = (1<<RX0IF) << n;
+	}
+	else if ((command & 0xf8) == SPI_WRITE_TX && (command & 0x07) <= 5) {
+		chip->adress = TXBCTRL(command >> 1 & 0x03) + ((command & 0x01) ? 6 : 1);
+	}
+	return 0xff;
+}
+
+// ----------------------------------------------------------------------------
+static uint8_t spi_exchange(void *context, uint8_t mosi)
+{
+	mcp2515_sim *chip = context;
+	uint8_t byte;
+
+	if (!chip->selected) {
+		// SO ist hochohmig
+		return 0xff;
+	}
+
+	chip->spi_bytes++;
+	byte = chip->bytes++;
+	if (byte == 0) {
+		return spi_command(chip, mosi);
+	}
+
+	switch (chip->command) {
+		case SPI_READ:
+			if (byte == 1) {
+				chip->adress = mosi;
+				return 0xff;
+			}
+			return read_reg(chip, chip->adress++);
+
+		case SPI_WRITE:
+			if (byte == 1) {
+				chip->adress = mosi;
+			}
+			else {
+				write_reg(chip, chip->adress++, 0xff, mosi);
+			}
+			return 0xff;
+
+		case SPI_READ_STATUS:
+			return read_status(chip);
+
+		case SPI_RX_STATUS:
+			return rx_status(chip);
+
+		case SPI_BIT_MODIFY:
+			if (byte == 1) {
+				chip->adress = mosi;
+			}
+			else if (byte == 2) {
+				chip->mask = bit_modify_allowed(chip->adress) ? mosi : 0xff;
+			}
+			else if (byte == 3) {
+				write_reg(chip, chip->adress, chip->mask, mosi);
+			}
+			return 0xff;
+	}
+
+	if ((chip->command & 0xf9) == SPI_READ_RX) {
+		return chip->reg[chip->adress++ & 0x7f];
+	}
+	if ((chip->command & 0xf8) == SPI_WRITE_TX && (chip->command & 0x07) <= 5) {
+		write_reg(chip, chip->adress++, 0xff, mosi);
+	}
+	return 0xff;
+}
+
+// ----------------------------------------------------------------------------
+static int spi_int_pin(void *context)
+{
+	return mcp2515_sim_int_pin(context);
+}
+
+// ----------------------------------------------------------------------------
+void mcp2515_sim_attach_spi(mcp2515_sim *chip)
+{
+	sim_spi_slave slave = { chip, spi_select, spi_exchange, spi_int_pin };
+
+	sim_attach_spi(&slave);
+}
+
+// ----------------------------------------------------------------------------
+static int bus_tx_next(void *context, sim_can_frame *frame)
+{
+	mcp2515_sim *chip = context;
+	int8_t best = -1;
+
+	bus_off_recovery(chip, SIM_CYCLES_TO_NS(sim_cycles));
+	if (mcp2515_sim_mode(chip) != MODE_NORMAL || (chip->reg[EFLG] & (1<<TXBO))) {
+		return 0;
+	}
+
+	// hoechste TXP gewinnt, bei gleicher TXP der Puffer mit der hoeheren Nummer
+	for (uint8_t n = 0; n < 3; n++) {
+		uint8_t ctrl = chip->reg[TXBCTRL(n)];
+
+		if ((ctrl & (1<<TXREQ))
+			&& (best < 0 || (ctrl & 0x03) >= (chip->reg[TXBCTRL(best)] & 0x03))) {
+			best = n;
+		}
+	}
+	if (best < 0) {
+		return 0;
+	}
+
+	tx_frame(chip, best, frame);
+	chip->tx_offered = best;
+	return 1;
+}
+
+// ----------------------------------------------------------------------------
+static void bus_tx_done(void *context, int result, uint64_t now)
+{
+	mcp2515_sim *chip = context;
+	uint8_t n = chip->tx_offered;
+
+	chip->tx_offered = -1;
+	if (result == SIM_BUS_WON) {
+		sim_can_frame frame;
+
+		tx_frame(chip, n, &frame);
+		tx_complete(chip, n);
+		error_count(chip, -1, 0, now);
+		if (chip->on_tx) {
+			chip->on_tx(chip->on_tx_context, &frame);
+		}
+	}
+	else if (result == SIM_BUS_ERROR) {
+		// TXREQ bleibt gesetzt, der Baustein wiederholt die Nachricht
+		chip->reg[TXBCTRL(n)] |= (1<<TXERR);
+		chip->reg[CANINTF] |= (1<<MERRF);
+		chip->tx_errors++;
+		error_count(chip, 8, 0, now);
+	}
+	else {
+		chip->reg[TXBCTRL(n)] |= (1<<MLOA);
+		chip->tx_arbitration_lost++;
+	}
+}
+
+// ----------------------------------------------------------------------------
+static void bus_rx(void *context, const sim_can_frame *frame, uint64_t now)
+{
+	mcp2515_sim *chip = context;
+	uint8_t mode = mcp2515_sim_mode(chip);
+
+	bus_off_recovery(chip, now);
+	if ((mode == MODE_NORMAL && !(chip->reg[EFLG] & (1<<TXBO))) || mode == MODE_LISTEN) {
+		if (mode == MODE_NORMAL) {
+			error_count(chip, 0, -1, now);
+		}
+		mcp2515_sim_receive(chip, frame);
+	}
+}
+
+// ----------------------------------------------------------------------------
+/* Error-Frame waehrend einer Nachricht eines anderen Teilnehmers */
+static void bus_rx_error(void *context, uint64_t now)
+{
+	mcp2515_sim *chip = context;
+
+	bus_off_recovery(chip, now);
+	if (mcp2515_sim_mode(chip) == MODE_NORMAL && !(chip->reg[EFLG] & (1<<TXBO))) {
+		chip->reg[CANINTF] |= (1<<MERRF);
+		error_count(chip, 0, 1, now);
+	}
+}
+
+// ----------------------------------------------------------------------------
+uint8_t mcp2515_sim_attach_bus(mcp2515_sim *chip, sim_bus *bus)
+{
+	sim_bus_port port = { chip, bus_tx_next, bus_tx_done, bus_rx, bus_rx_error };
+
+	return sim_bus_attach(bus, &port);
+}
@@ -0,0 +1,91 @@
+/*
+ * mcp2515_sim.h
+ *
+ * Registermodell des MCP2515 fuer die Host-Simulation. Nachgebildet werden der
+ * SPI-Befehlssatz aus mcp2515_defs.h (RESET, READ, WRITE, READ RX, LOAD TX,
+ * RTS, READ STATUS, RX STATUS, BIT MODIFY), die Sende- und Empfangspuffer mit
+ * TXP-Prioritaet, Akzeptanzfiltern, Masken und BUKT-Ueberlauf, CANINTF/CANINTE
+ * mit der INT-Leitung, EFLG-Ueberlaufbits sowie die Betriebsarten (Konfiguration,
+ * Normal, Listen-Only, Loopback, Sleep). Fehlerzaehler TEC/REC mit Warnung,
+ * Error-Passive und Bus-Off in EFLG folgen den Error-Frames auf dem Bus; im
+ * Bus-Off sendet und empfaengt der Baustein nicht, bis 128 x 11 Bitzeiten
+ * vergangen sind.
+ *
+ * Das Modell haengt als SPI-Baustein am simulierten ATmega (sim_attach_spi())
+ * und als Port am simulierten CAN-Bus (sim_bus_attach()). Zugriffe, die beim
+ * echten Baustein keine Wirkung haetten (z.B. Filter ausserhalb des
+ * Konfigurationsmodus schreiben), werden ignoriert und in illegal_writes gezaehlt.
+ */
+
+#ifndef MCP2515_SIM_H
+#define MCP2515_SIM_H
+
+#include <stdint.h>
+
+#include "sim_avr.h"
+#include "sim_bus.h"
+
+/* Oszillator des MCP2515 auf der Platine. */
+#define MCP2515_SIM_OSC		16000000UL
+
+typedef struct
+{
+	uint8_t reg[128];
+
+	/* SPI-Befehl im laufenden Chip-Select-Fenster */
+	uint8_t selected;
+	uint8_t command;
+	uint8_t bytes;
+	uint8_t adress;
+	uint8_t mask;
+	uint8_t read_rx;		/* RXnIF, das beim Ende des READ RX geloescht wird */
+
+	/* Sendepuffer, der gerade auf dem Bus angeboten wird */
+	int8_t tx_offered;
+
+	/* Statistik */
+	uint32_t spi_bytes;
+	uint32_t spi_commands;
+	uint32_t illegal_writes;
+	uint32_t rx_frames;
+	uint32_t rx_filtered;
+	uint32_t rx_overflows;
+	uint32_t tx_frames;
+	uint32_t tx_arbitration_lost;
+	uint32_t tx_errors;
+	uint32_t bus_off;
+
+	/* Beginn des Bus-Off in ns (Zeit des Busses) */
+	uint64_t bus_off_at;
+
+	/* Zeit (CPU-Takte) vom Ablegen einer Nachricht in RXBn bis zum Abholen */
+	uint64_t rx_stored_at[2];
+	uint64_t rx_latency_sum;
+	uint64_t rx_latency_max;
+	uint32_t rx_latency_count;
+
+	/* Optional: wird fuer jede gesendete Nachricht aufgerufen */
+	void (*on_tx)(void *context, const sim_can_frame *frame);
+	void *on_tx_context;
+} mcp2515_sim;
+
+/* Baustein nach Power-On (entspricht SPI_RESET). */
+void mcp2515_sim_init(mcp2515_sim *chip);
+
+/* Modell an den simulierten ATmega (CS an B,2, INT an D,2) bzw. an den Bus haengen. */
+void mcp2515_sim_attach_spi(mcp2515_sim *chip);
+uint8_t mcp2515_sim_attach_bus(mcp2515_sim *chip, sim_bus *bus);
+
+/* Nachricht vom Bus empfangen (ohne Bus direkt aufrufbar). */
+void mcp2515_sim_receive(mcp2515_sim *chip, const sim_can_frame *frame);
+
+/* Bitrate aus CNF1..CNF3 und dem Oszillator. */
+uint32_t mcp2515_sim_bitrate(const mcp2515_sim *chip);
+
+/* Betriebsart (CANSTAT.OPMOD, 0 = Normal, 4 = Konfiguration). */
+uint8_t mcp2515_sim_mode(const mcp2515_sim *chip);
+
+/* Pegel der INT-Leitung (0 = Interrupt anstehend). */
+int mcp2515_sim_int_pin(const mcp2515_sim *chip);
+
+#endif /* MCP2515_SIM_H */
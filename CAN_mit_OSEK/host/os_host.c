@@ -0,0 +1,722 @@
+/*
+ * os_host.c
+ *
+ * Host-Port des OSEK, siehe os_host.h.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ucontext.h>
+
+#include <avr/io.h>
+#include <avr/interrupt.h>
+
+#include "Os.h"
+#include "os_host.h"
+#include "os_ready.h"
+
+/* Konfiguration aus Os_Cfg.c (ueber Os_Cfg.h in main.c) */
+extern const TaskInfoBlockT OsTaskIB[];
+extern TaskControlBlockT OsTaskCB[];
+extern unsigned char OsTaskSB[];
+extern const AlarmInfoBlockT OsAlarmIB[];
+extern AlarmControlBlockT OsAlarmCB[];
+extern OsConfigT OsCfg;
+
+/* Daten wie in libOsekAvr.a, dort lokal zu Os.o: die Firmware liest den Zaehler
+   nur ueber Os_GetSytemCounter() */
+static volatile TickType OsSystemCounter;
+static volatile uint16_t OsTimerStartValue;
+
+os_host_stats os_host_stat;
+
+/* Interne Funktionen wie in libOsekAvr.a, ebenfalls lokal */
+static void Os_SwitchTaskToReady(TaskType task);
+static void Os_EnqueueTaskInReadyQueue(TaskType task);
+
+static os_ready_queue ready;
+static TaskType running = INVALID_TASK;
+static TaskType resource_owner = INVALID_TASK;
+static uint8_t started[256];			/* Task hat einen laufenden Kontext */
+static uint8_t task_sreg[256];
+static ucontext_t task_context[256];
+static uint8_t *task_stack[256];
+static ucontext_t scheduler;
+static uint8_t dispatch_pending;
+static uint8_t shutdown;
+static uint8_t stop_pending;
+static uint8_t error_pending;
+static uint64_t stop_at;
+
+/* Zeitpunkt des letzten Zustandswechsels, der Aktivierung und des letzten
+ * Bereitwerdens je Task */
+static uint64_t state_since[256];
+static uint64_t job_start[256];
+static uint64_t segment_start[256];
+static FILE *trace;
+
+static const char *const state_names[] = { "RUNNING", "WAITING", "READY", "SUSPENDED" };
+
+static const char *const error_names[] =
+{
+	"E_OK", "E_OS_ACCESS", "E_OS_CALLEVEL", "E_OS_ID", "E_OS_LIMIT",
+	"E_OS_NOFUNC", "E_OS_RESOURCE", "E_OS_STATE", "E_OS_VALUE"
+};
+
+// ----------------------------------------------------------------------------
+void os_host_stop_at(uint64_t cycles)
+{
+	stop_at = cycles;
+}
+
+// ----------------------------------------------------------------------------
+/* Zeit in us fuer das Trace-Event-Format */
+static double os_trace_us(uint64_t cycles)
+{
+	return cycles * 1e6 / F_CPU;
+}
+
+void os_host_trace_open(FILE *file)
+{
+	trace = file;
+	fprintf(trace, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n");
+	fprintf(trace, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"args\":{\"name\":\"OSEK\"}}");
+	for (TaskType i = 0; i < OsCfg.numberOfTasks; i++) {
+		fprintf(trace, ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,"
+			"\"args\":{\"name\":\"Task %u (Prio %u, %s)\"}}", i, i, OsTaskIB[i].priority,
+			OsTaskIB[i].scheduling == PREEMPTIVE ? "preemptiv" : "nicht preemptiv");
+		fprintf(trace, ",\n{\"name\":\"thread_sort_index\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,"
+			"\"args\":{\"sort_index\":%u}}", i, 255 - OsTaskIB[i].priority);
+	}
+}
+
+/* Zustand einer Task von since bis jetzt als Balken in ihrer Spur */
+static void os_trace_state(TaskType task, TaskStateType state, uint64_t since)
+{
+	if (!trace || sim_cycles == since) {
+		return;
+	}
+	fprintf(trace, ",\n{\"name\":\"%s\",\"cat\":\"task\",\"ph\":\"X\",\"pid\":1,\"tid\":%u,"
+		"\"ts\":%.3f,\"dur\":%.3f}", state_names[state], task, os_trace_us(since),
+		os_trace_us(sim_cycles) - os_trace_us(since));
+}
+
+void os_host_trace_close(void)
+{
+	if (!trace) {
+		return;
+	}
+	for (TaskType i = 0; i < OsCfg.numberOfTasks; i++) {
+		os_trace_state(i, OsTaskCB[i].state, state_since[i]);
+		state_since[i] = sim_cycles;
+	}
+	fprintf(trace, "\n]}\n");
+	trace = 0;
+}
+
+/* Zustandswechsel mit Statistik und Zeitleiste */
+static void os_state(TaskType task, TaskStateType state)
+{
+	TaskStateType old = OsTaskCB[task].state;
+	os_host_task_stats *stat = &os_host_stat.task[task];
+	uint64_t now = sim_cycles;
+
+	if (old == RUNNING) {
+		stat->run_cycles += now - state_since[task];
+		if ((state == SUSPENDED || state == WAITING) && now - segment_start[task] > stat->segment_max) {
+			stat->segment_max = now - segment_start[task];
+		}
+		if (state == SUSPENDED) {
+			stat->jobs++;
+			stat->response_sum += now - job_start[task];
+			if (now - job_start[task] > stat->response_max) {
+				stat->response_max = now - job_start[task];
+			}
+		}
+	}
+	else if (old == READY && state == RUNNING && now - state_since[task] > stat->ready_max) {
+		stat->ready_max = now - state_since[task];
+	}
+	if (state == READY && old == SUSPENDED) {
+		job_start[task] = now;
+	}
+	if (state == READY && (old == SUSPENDED || old == WAITING)) {
+		segment_start[task] = now;
+	}
+	os_trace_state(task, old, state_since[task]);
+	OsTaskCB[task].state = state;
+	state_since[task] = now;
+}
+
+/* Fehler eines Dienstes melden wie mit OS_MESSAGE_ON_API_SERVICE_ERROR, mit
+ * OS_STOP_ON_API_SERVICE_ERROR anhalten (im ISR erst an dessen Ende) */
+static StatusType os_error(const char *service, StatusType error)
+{
+	os_host_stat.errors++;
+	os_host_stat.last_error = error;
+	if (trace) {
+		fprintf(trace, ",\n{\"name\":\"%s: %s\",\"cat\":\"error\",\"ph\":\"i\",\"s\":\"g\",\"pid\":1,"
+			"\"ts\":%.3f}", service, error_names[error], os_trace_us(sim_cycles));
+	}
+	if (OsCfg.messageOnApiServiceError) {
+		fprintf(stderr, "OS: %s -> %s (Task %u, Tick %u)\n", service,
+			error_names[error], running, OsSystemCounter);
+	}
+	if (OsCfg.stopOnApiServiceError) {
+		if (sim_in_isr() || running == INVALID_TASK) {
+			error_pending = error;
+		}
+		else {
+			ShutdownOS(error);
+		}
+	}
+	return error;
+}
+
+// ----------------------------------------------------------------------------
+/* Laufende Task abgeben und zum Scheduler-Kontext wechseln; kehrt zurueck,
+ * sobald die Task wieder ausgewaehlt ist */
+static void os_yield(void)
+{
+	TaskType task = running;
+
+	task_sreg[task] = sim_get_sreg();
+	running = INVALID_TASK;
+	swapcontext(&task_context[task], &scheduler);
+	sim_set_sreg(task_sreg[task]);
+}
+
+/* Laufende Task verdraengen, wenn eine hoehere Prioritaet bereit ist.
+ * explicit: Schedule(), gibt auch eine NON_PREEMPTIVE-Task ab */
+static void os_dispatch(uint8_t explicit)
+{
+	int top = os_ready_top(&ready);
+
+	dispatch_pending = 0;
+	if (running == INVALID_TASK || top < 0 || resource_owner == running) {
+		return;
+	}
+	if (OsTaskIB[running].scheduling != PREEMPTIVE && !explicit) {
+		return;
+	}
+	if (top <= OsTaskIB[running].priority) {
+		return;
+	}
+	os_state(running, READY);
+	os_ready_push_front(&ready, running, OsTaskIB[running].priority);
+	os_host_stat.preemptions++;
+	os_yield();
+}
+
+/* Nach einem Dienst, der eine Task bereit macht: in einer Task sofort
+ * wechseln, im ISR am Ende des ISR */
+static void os_reschedule(void)
+{
+	if (sim_in_isr()) {
+		dispatch_pending = 1;
+	}
+	else {
+		os_dispatch(0);
+	}
+}
+
+/* Am Ende jedes ISR (sim_attach_isr_exit()) */
+static void os_isr_exit(void)
+{
+	if (shutdown || stop_pending || error_pending) {
+		if (running != INVALID_TASK) {
+			ShutdownOS(shutdown ? os_host_stat.shutdown_status : stop_pending ? E_OK : error_pending);
+		}
+		return;
+	}
+	if (dispatch_pending) {
+		os_dispatch(0);
+	}
+}
+
+/* Einstieg jeder Task; kehrt die Task-Funktion zurueck, endet sie wie mit
+ * TerminateTask() */
+static void os_task_entry(void)
+{
+	OsTaskIB[running].taskPtr();
+	TerminateTask();
+}
+
+// ----------------------------------------------------------------------------
+/* Task SUSPENDED -> READY, auch aus Os_SwitchTaskToReady() */
+static void os_activate(TaskType task)
+{
+	os_state(task, READY);
+	OsTaskCB[task].eventMask = 0;
+	OsTaskCB[task].eventMaskWaiting = 0;
+	os_ready_push(&ready, task, OsTaskIB[task].priority);
+	os_host_stat.task[task].activations++;
+}
+
+/* Laufende Task beenden (TerminateTask(), ChainTask()), ohne Wechsel */
+static void os_terminate(void)
+{
+	os_state(running, SUSPENDED);
+	started[running] = 0;
+}
+
+/* Event setzen und eine darauf wartende Task bereit machen */
+static void os_set_event(TaskType task, EventMaskType mask)
+{
+	OsTaskCB[task].eventMask |= mask;
+	if (OsTaskCB[task].state == WAITING && (OsTaskCB[task].eventMask & OsTaskCB[task].eventMaskWaiting)) {
+		Os_EnqueueTaskInReadyQueue(task);
+	}
+}
+
+// ----------------------------------------------------------------------------
+static void Os_SwitchTaskToReady(TaskType task)
+{
+	os_activate(task);
+	dispatch_pending = 1;
+}
+
+static void Os_EnqueueTaskInReadyQueue(TaskType task)
+{
+	os_state(task, READY);
+	OsTaskCB[task].eventMaskWaiting = 0;
+	os_ready_push(&ready, task, OsTaskIB[task].priority);
+	dispatch_pending = 1;
+}
+
+TickType Os_GetSytemCounter()
+{
+	return OsSystemCounter;
+}
+
+// ----------------------------------------------------------------------------
+/* Tick des OS wie __vector_13 in libOsekAvr.a */
+ISR(TIMER1_OVF_vect)
+{
+	TCNT1 = OsTimerStartValue;
+	OsSystemCounter++;
+	os_host_stat.ticks++;
+
+	for (AlarmType i = 0; i < OsCfg.numberOfAlarms; i++) {
+		AlarmControlBlockT *alarm = &OsAlarmCB[i];
+		const AlarmInfoBlockT *info = &OsAlarmIB[i];
+
+		if (alarm->inUse != TRUE || alarm->nextOccurrence != OsSystemCounter) {
+			continue;
+		}
+		switch (info->action) {
+			case ACTIVATETASK:
+				if (OsTaskCB[info->task].state == SUSPENDED) {
+					Os_SwitchTaskToReady(info->task);
+				}
+				else {
+					os_host_stat.task[info->task].lost++;
+					os_error("Alarm ActivateTask", E_OS_LIMIT);
+				}
+				break;
+			case SETEVENT:
+				if (OsTaskIB[info->task].taskType != EXTENDED_TASK) {
+					os_error("Alarm SetEvent", E_OS_ACCESS);
+				}
+				else if (OsTaskCB[info->task].state == SUSPENDED) {
+					os_error("Alarm SetEvent", E_OS_STATE);
+				}
+				else {
+					os_set_event(info->task, info->mask);
+				}
+				break;
+			case CALLBACK:
+				info->callback();
+				break;
+		}
+		/* cycle erst nach der Aktion lesen, der Rueckruf darf ihn aendern */
+		if (alarm->cycle == 0) {
+			alarm->inUse = FALSE;
+		}
+		else {
+			alarm->nextOccurrence += alarm->cycle;
+		}
+	}
+	if (stop_at && sim_cycles >= stop_at) {
+		stop_pending = 1;
+	}
+	dispatch_pending = 1;
+}
+
+// ----------------------------------------------------------------------------
+StatusType ActivateTask(TaskType taskId)
+{
+	if (taskId >= OsCfg.numberOfTasks) {
+		return os_error("ActivateTask", E_OS_ID);
+	}
+	if (OsTaskCB[taskId].state != SUSPENDED) {
+		os_host_stat.task[taskId].lost++;
+		return os_error("ActivateTask", E_OS_LIMIT);
+	}
+	os_activate(taskId);
+	os_reschedule();
+	return E_OK;
+}
+
+StatusType TerminateTask()
+{
+	if (sim_in_isr() || running == INVALID_TASK) {
+		return os_error("TerminateTask", E_OS_CALLEVEL);
+	}
+	if (resource_owner == running) {
+		return os_error("TerminateTask", E_OS_RESOURCE);
+	}
+	os_terminate();
+	running = INVALID_TASK;
+	setcontext(&scheduler);
+	return E_OK;
+}
+
+StatusType ChainTask(TaskType taskId)
+{
+	if (sim_in_isr() || running == INVALID_TASK) {
+		return os_error("ChainTask", E_OS_CALLEVEL);
+	}
+	if (taskId >= OsCfg.numberOfTasks) {
+		return os_error("ChainTask", E_OS_ID);
+	}
+	if (resource_owner == running) {
+		return os_error("ChainTask", E_OS_RESOURCE);
+	}
+	if (taskId != running && OsTaskCB[taskId].state != SUSPENDED) {
+		os_host_stat.task[taskId].lost++;
+		return os_error("ChainTask", E_OS_LIMIT);
+	}
+	os_terminate();
+	os_activate(taskId);
+	running = INVALID_TASK;
+	setcontext(&scheduler);
+	return E_OK;
+}
+
+StatusType Schedule()
+{
+	if (sim_in_isr() || running == INVALID_TASK) {
+		return os_error("Schedule", E_OS_CALLEVEL);
+	}
+	if (resource_owner == running) {
+		return os_error("Schedule", E_OS_RESOURCE);
+	}
+	os_dispatch(1);
+	return E_OK;
+}
+
+StatusType GetTaskID(TaskRefType taskId)
+{
+	*taskId = running;
+	return E_OK;
+}
+
+StatusType GetTaskState(TaskType taskId, TaskStateRefType state)
+{
+	if (taskId >= OsCfg.numberOfTasks) {
+		return os_error("GetTaskState", E_OS_ID);
+	}
+	*state = OsTaskCB[taskId].state;
+	return E_OK;
+}
+
+// ----------------------------------------------------------------------------
+StatusType GetResource(ResourceType resId)
+{
+	if (resId != RES_SCHEDULER) {
+		return os_error("GetResource", E_OS_ID);
+	}
+	if (sim_in_isr() || running == INVALID_TASK) {
+		return os_error("GetResource", E_OS_CALLEVEL);
+	}
+	if (resource_owner != INVALID_TASK) {
+		return os_error("GetResource", E_OS_ACCESS);
+	}
+	resource_owner = running;
+	return E_OK;
+}
+
+StatusType ReleaseResource(ResourceType resId)
+{
+	if (resId != RES_SCHEDULER) {
+		return os_error("ReleaseResource", E_OS_ID);
+	}
+	if (resource_owner == INVALID_TASK || resource_owner != running) {
+		return os_error("ReleaseResource", E_OS_NOFUNC);
+	}
+	resource_owner = INVALID_TASK;
+	os_dispatch(0);
+	return E_OK;
+}
+
+// ----------------------------------------------------------------------------
+StatusType SetEvent(TaskType taskId, EventMaskType mask)
+{
+	if (taskId >= OsCfg.numberOfTasks) {
+		return os_error("SetEvent", E_OS_ID);
+	}
+	if (OsTaskIB[taskId].taskType != EXTENDED_TASK) {
+		return os_error("SetEvent", E_OS_ACCESS);
+	}
+	if (OsTaskCB[taskId].state == SUSPENDED) {
+		return os_error("SetEvent", E_OS_STATE);
+	}
+	os_set_event(taskId, mask);
+	os_reschedule();
+	return E_OK;
+}
+
+StatusType ClearEvent(EventMaskType mask)
+{
+	if (sim_in_isr() || running == INVALID_TASK) {
+		return os_error("ClearEvent", E_OS_CALLEVEL);
+	}
+	if (OsTaskIB[running].taskType != EXTENDED_TASK) {
+		return os_error("ClearEvent", E_OS_ACCESS);
+	}
+	OsTaskCB[running].eventMask &= ~mask;
+	return E_OK;
+}
+
+StatusType GetEvent(TaskType taskId, EventMaskRefType mask)
+{
+	if (taskId >= OsCfg.numberOfTasks) {
+		return os_error("GetEvent", E_OS_ID);
+	}
+	if (OsTaskIB[taskId].taskType != EXTENDED_TASK) {
+		return os_error("GetEvent", E_OS_ACCESS);
+	}
+	if (OsTaskCB[taskId].state == SUSPENDED) {
+		return os_error("GetEvent", E_OS_STATE);
+	}
+	*mask = OsTaskCB[taskId].eventMask;
+	return E_OK;
+}
+
+StatusType WaitEvent(EventMaskType mask)
+{
+	if (sim_in_isr() || running == INVALID_TASK) {
+		return os_error("WaitEvent", E_OS_CALLEVEL);
+	}
+	if (OsTaskIB[running].taskType != EXTENDED_TASK) {
+		return os_error("WaitEvent", E_OS_ACCESS);
+	}
+	if (resource_owner == running) {
+		return os_error("WaitEvent", E_OS_RESOURCE);
+	}
+	if (!(OsTaskCB[running].eventMask & mask)) {
+		os_state(running, WAITING);
+		OsTaskCB[running].eventMaskWaiting = mask;
+		os_yield();
+	}
+	return E_OK;
+}
+
+// ----------------------------------------------------------------------------
+StatusType GetAlarmBase(AlarmType alarmId, AlarmBaseRefType info)
+{
+	if (alarmId >= OsCfg.numberOfAlarms) {
+		return os_error("GetAlarmBase", E_OS_ID);
+	}
+	info->maxallowedvalue = OSMAXALLOWEDVALUE;
+	info->ticksperbase = OSTICKSPERBASE;
+	info->mincycle = OSMINCYCLE;
+	return E_OK;
+}
+
+StatusType GetAlarm(AlarmType alarmId, TickRefType tick)
+{
+	if (alarmId >= OsCfg.numberOfAlarms) {
+		return os_error("GetAlarm", E_OS_ID);
+	}
+	if (OsAlarmCB[alarmId].inUse != TRUE) {
+		return os_error("GetAlarm", E_OS_NOFUNC);
+	}
+	*tick = OsAlarmCB[alarmId].nextOccurrence - OsSystemCounter;
+	return E_OK;
+}
+
+/* Gemeinsame Pruefung von SetRelAlarm() und SetAbsAlarm() */
+static StatusType os_check_alarm(const char *service, AlarmType alarmId, TickType value, TickType cycle)
+{
+	if (alarmId >= OsCfg.numberOfAlarms) {
+		return os_error(service, E_OS_ID);
+	}
+	if (OsAlarmCB[alarmId].inUse == TRUE) {
+		return os_error(service, E_OS_STATE);
+	}
+	if (value > OSMAXALLOWEDVALUE || (cycle != 0 && (cycle < OSMINCYCLE || cycle > OSMAXALLOWEDVALUE))) {
+		return os_error(service, E_OS_VALUE);
+	}
+	return E_OK;
+}
+
+StatusType SetRelAlarm(AlarmType alarmId, TickType increment, TickType cycle)
+{
+	StatusType status = os_check_alarm("SetRelAlarm", alarmId, increment, cycle);
+
+	if (status != E_OK) {
+		return status;
+	}
+	/* increment 0 wie in libOsekAvr.a: im naechsten Tick */
+	OsAlarmCB[alarmId].nextOccurrence = OsSystemCounter + (increment ? increment : 1);
+	OsAlarmCB[alarmId].cycle = cycle;
+	OsAlarmCB[alarmId].inUse = TRUE;
+	return E_OK;
+}
+
+StatusType SetAbsAlarm(AlarmType alarmId, TickType start, TickType cycle)
+{
+	StatusType status = os_check_alarm("SetAbsAlarm", alarmId, start, cycle);
+
+	if (status != E_OK) {
+		return status;
+	}
+	OsAlarmCB[alarmId].nextOccurrence = start;
+	OsAlarmCB[alarmId].cycle = cycle;
+	OsAlarmCB[alarmId].inUse = TRUE;
+	return E_OK;
+}
+
+StatusType CancelAlarm(AlarmType alarmId)
+{
+	if (alarmId >= OsCfg.numberOfAlarms) {
+		return os_error("CancelAlarm", E_OS_ID);
+	}
+	if (OsAlarmCB[alarmId].inUse != TRUE) {
+		return os_error("CancelAlarm", E_OS_NOFUNC);
+	}
+	OsAlarmCB[alarmId].inUse = FALSE;
+	return E_OK;
+}
+
+// ----------------------------------------------------------------------------
+AppModeType GetActiveApplicationMode()
+{
+	return OSDEFAULTAPPMODE;
+}
+
+/* Timer 1 wie StartOS() in libOsekAvr.a: kleinster Vorteiler, bei dem ein Tick
+ * in 16 Bit passt, Ueberlauf nach OSTICKDURATION */
+static void os_start_timer(void)
+{
+	static const uint16_t prescaler[] = { 1, 8, 64, 256, 1024 };
+	uint32_t cycles = (uint32_t)(F_CPU / 1000) * OsCfg.tickDuration;
+	uint8_t cs = 0;
+
+	while (cs < 4 && cycles / prescaler[cs] > 0x10000) {
+		cs++;
+	}
+	OsTimerStartValue = (uint16_t)(0x10000 - cycles / prescaler[cs]);
+	TCCR1A = 0;
+	TCNT1 = OsTimerStartValue;
+	TCCR1B = cs + 1;
+	TIMSK1 = (1<<TOIE1);
+}
+
+void StartOS(AppModeType mode)
+{
+	(void)mode;
+
+	cli();
+	os_ready_init(&ready);
+	running = INVALID_TASK;
+	resource_owner = INVALID_TASK;
+	dispatch_pending = 0;
+	shutdown = 0;
+	stop_pending = 0;
+	error_pending = 0;
+	OsSystemCounter = 0;
+	for (AlarmType i = 0; i < OsCfg.numberOfAlarms; i++) {
+		OsAlarmCB[i].inUse = FALSE;
+	}
+	/* OsTaskSB wie StartOS() in libOsekAvr.a aufteilen (OsStack.h), nur fuer
+	   OsStack_Check(); die Tasks laufen auf den Stacks der ucontexte */
+	for (TaskType i = 0; i <= OsCfg.numberOfTasks; i++) {
+		unsigned char *slot = &OsTaskSB[i * (OsCfg.stackSize + 2)];
+
+		slot[0] = 0xaa;
+		slot[1] = 0xaa;
+		if (i < OsCfg.numberOfTasks) {
+			OsTaskCB[i].stack = slot;
+		}
+	}
+	for (TaskType i = 0; i < OsCfg.numberOfTasks; i++) {
+		OsTaskCB[i].activationOrder = 0;
+		OsTaskCB[i].state = SUSPENDED;
+		state_since[i] = sim_cycles;
+		memset(&os_host_stat.task[i], 0, sizeof(os_host_stat.task[i]));
+		started[i] = 0;
+		if (!task_stack[i]) {
+			task_stack[i] = malloc(OS_HOST_STACK);
+		}
+		memset(task_stack[i], OS_HOST_STACK_PAINT, OS_HOST_STACK);
+		if (OsTaskIB[i].actOnStart) {
+			os_activate(i);
+		}
+	}
+	os_start_timer();
+	sim_attach_isr_exit(os_isr_exit);
+	sei();
+
+	while (!shutdown) {
+		TaskType task;
+
+		if (stop_pending || error_pending) {
+			ShutdownOS(stop_pending ? E_OK : error_pending);
+			break;
+		}
+		task = os_ready_pop(&ready);
+		if (task == INVALID_TASK) {
+			/* die IdleTask hat sich beendet */
+			ShutdownOS(E_OK);
+			break;
+		}
+		running = task;
+		os_state(task, RUNNING);
+		dispatch_pending = 0;
+		os_host_stat.switches++;
+		sim_cycles += OS_HOST_SWITCH_CYCLES;
+		if (!started[task]) {
+			started[task] = 1;
+			task_sreg[task] = sim_get_sreg() | 0x80;
+			getcontext(&task_context[task]);
+			task_context[task].uc_stack.ss_sp = task_stack[task];
+			task_context[task].uc_stack.ss_size = OS_HOST_STACK;
+			task_context[task].uc_link = 0;
+			makecontext(&task_context[task], os_task_entry, 0);
+		}
+		sim_set_sreg(task_sreg[task]);
+		swapcontext(&scheduler, &task_context[task]);
+	}
+	sim_attach_isr_exit(0);
+	TIMSK1 = 0;
+}
+
+uint32_t os_host_stack_used(TaskType task)
+{
+	uint32_t n = 0;
+
+	if (!task_stack[task]) {
+		return 0;
+	}
+	// der Stack waechst von oben nach unten
+	while (n < OS_HOST_STACK && task_stack[task][n] == OS_HOST_STACK_PAINT) {
+		n++;
+	}
+	return OS_HOST_STACK - n;
+}
+
+void ShutdownOS(StatusType error)
+{
+	cli();
+	shutdown = 1;
+	os_host_stat.shutdown_status = error;
+	if (running != INVALID_TASK && !sim_in_isr()) {
+		/* der Kontext der laufenden Task wird verworfen */
+		running = INVALID_TASK;
+		setcontext(&scheduler);
+	}
+}
@@ -0,0 +1,106 @@
+/*
+ * os_host.h
+ *
+ * Host-Port des OSEK aus lib/Os.h (Linux), Ersatz fuer libOsekAvr.a. main.c,
+ * Os_Cfg.h mit lib/Os_Cfg.c und alle Module laufen unveraendert auf dem
+ * simulierten ATmega aus sim_avr.c; die Zeit ist die simulierte (sim_cycles)
+ * und laeuft so schnell, wie der Host rechnet. Ablauf: host/os_run.c.
+ *
+ * Tasks: jede Task hat einen ucontext mit eigenem Stack (OS_HOST_STACK Byte),
+ * StartOS() bleibt als Scheduler-Kontext und waehlt die naechste Task aus der
+ * Ready-Queue (os_ready.h). Wie in libOsekAvr.a: hoechste Prioritaet zuerst,
+ * bei gleicher Prioritaet die aelteste Aktivierung, eine verdraengte Task
+ * kommt an den Anfang ihrer Prioritaet; NON_PREEMPTIVE-Tasks gibt nur
+ * TerminateTask(), ChainTask(), WaitEvent() oder Schedule() ab. Mehrfache
+ * Aktivierung gibt es wie in der Bibliothek nicht (E_OS_LIMIT).
+ *
+ * Tick: StartOS() stellt Timer 1 ein wie libOsekAvr.a (kleinster Vorteiler,
+ * bei dem OSTICKDURATION in 16 Bit passt, TCNT1 = OsTimerStartValue), der
+ * Tick ist ISR(TIMER1_OVF_vect) hier: TCNT1 neu laden, Systemzaehler + 1,
+ * Alarme pruefen in derselben Reihenfolge wie __vector_13. TickType hat auf
+ * dem Host 32 Bit, der Systemzaehler laeuft also erst nach 2^32 Ticks ueber
+ * und nicht wie auf dem ATmega nach OSMAXALLOWEDVALUE.
+ *
+ * Dienste, die im ISR eine Task bereit machen (ActivateTask(), SetEvent(),
+ * Alarme), wechseln erst am Ende des ISR (sim_attach_isr_exit()); libOsekAvr.a
+ * wechselt schon im Dienst, die Firmware ruft sie aber immer zuletzt im ISR.
+ * Jeder Taskwechsel kostet OS_HOST_SWITCH_CYCLES simulierte Takte.
+ *
+ * Je Task zaehlt der Port Aktivierungen, Zeit im Zustand RUNNING (inkl. der
+ * ISRs in dieser Zeit), die Antwortzeit von der Aktivierung bis zum Ende
+ * (TerminateTask(), ChainTask()) und die laengste Zeit vom Bereitwerden
+ * (Aktivierung oder Event) bis zum naechsten WaitEvent() oder Ende; letztere
+ * ist die Antwortzeit von Extended Tasks, die nie enden. Mit
+ * os_host_trace_open() schreibt er jeden Zustandswechsel als Zeitleiste im
+ * Trace-Event-Format (JSON) fuer chrome://tracing oder ui.perfetto.dev: eine
+ * Spur je Task, nach Prioritaet sortiert, Fehler der Dienste als Marke.
+ *
+ * Fehler der Dienste gehen statt auf die USART nach stderr; mit
+ * OS_STOP_ON_API_SERVICE_ERROR endet StartOS() danach ueber ShutdownOS().
+ * Die Stacks in OsTaskSB benutzt der Host nicht, StartOS() schreibt dort nur
+ * die Schutzbytes fuer OsStack_Check(); OsStack_HighWater() meldet deshalb
+ * keinen Verbrauch. Stattdessen fuellt StartOS() die Stacks der
+ * ucontexte mit OS_HOST_STACK_PAINT und os_host_stack_used() zaehlt wie
+ * OsStack.c die ueberschriebenen Bytes: Host-Code (x86-64, inkl. der ISRs
+ * und der simulierten Hardware), also nur zum Vergleich zweier Staende der
+ * Firmware, nicht als Bedarf auf dem ATmega.
+ */
+
+#ifndef OS_HOST_H
+#define OS_HOST_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include "Os.h"
+
+/* Stack je Task in Byte (Host-Code mit printf braucht mehr als der ATmega) */
+#define OS_HOST_STACK			(64 * 1024)
+
+/* Muster fuer unbenutzten Stack wie OS_STACK_PAINT */
+#define OS_HOST_STACK_PAINT		0xc5
+
+/* Angenommene Takte fuer einen Taskwechsel in libOsekAvr.a (32 Register
+ * sichern und laden, Os_Schedule()) */
+#define OS_HOST_SWITCH_CYCLES	150
+
+typedef struct
+{
+	uint32_t activations;				/* SUSPENDED -> READY */
+	uint32_t lost;						/* ActivateTask() und Alarme mit E_OS_LIMIT */
+	uint32_t jobs;						/* beendete Laeufe (Aktivierung bis Ende) */
+	uint64_t run_cycles;				/* Takte im Zustand RUNNING */
+	uint64_t response_sum;				/* Aktivierung bis Ende in Takten */
+	uint64_t response_max;
+	uint64_t segment_max;				/* READY bis WAITING oder SUSPENDED */
+	uint64_t ready_max;					/* laengste Zeit READY bis RUNNING */
+} os_host_task_stats;
+
+typedef struct
+{
+	uint64_t ticks;						/* Tick-ISRs */
+	uint32_t switches;					/* Taskwechsel */
+	uint32_t preemptions;				/* davon verdraengte Tasks */
+	uint32_t errors;					/* Fehler der Dienste */
+	StatusType last_error;
+	StatusType shutdown_status;			/* Argument von ShutdownOS() */
+	os_host_task_stats task[256];
+} os_host_stats;
+
+extern os_host_stats os_host_stat;
+
+/* Simulation im naechsten Tick ab cycles Takten mit ShutdownOS(E_OK)
+   beenden, StartOS() kehrt dann zurueck. 0 = kein Ende. */
+void os_host_stop_at(uint64_t cycles);
+
+/* Groesste bisher benutzte Tiefe des Host-Stacks der Task in Byte */
+uint32_t os_host_stack_used(TaskType task);
+
+/* Zeitleiste der Taskzustaende in file schreiben (vor StartOS()) */
+void os_host_trace_open(FILE *file);
+
+/* Offene Zustaende bis jetzt eintragen und die Zeitleiste abschliessen (nach
+   StartOS()), die Datei schliesst der Aufrufer */
+void os_host_trace_close(void);
+
+#endif /* OS_HOST_H */
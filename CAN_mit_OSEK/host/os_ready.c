@@ -0,0 +1,105 @@
+/*
+ * os_ready.c
+ *
+ * Ready-Queue mit Prioritaets-Bitmap, siehe os_ready.h.
+ */
+
+#include "os_ready.h"
+
+void os_ready_init(os_ready_queue *queue)
+{
+	queue->top = 0;
+	for (int g = 0; g < 8; g++) {
+		queue->bitmap[g] = 0;
+	}
+	for (int p = 0; p < 256; p++) {
+		queue->head[p] = OS_READY_END;
+		queue->tail[p] = OS_READY_END;
+	}
+	for (int i = 0; i < OS_READY_ENTRIES; i++) {
+		queue->next[i] = i + 1 < OS_READY_ENTRIES ? i + 1 : OS_READY_END;
+	}
+	queue->free = 0;
+}
+
+// ----------------------------------------------------------------------------
+static int os_ready_alloc(os_ready_queue *queue, TaskType task, uint8_t priority)
+{
+	uint16_t entry = queue->free;
+
+	if (entry == OS_READY_END) {
+		return -1;
+	}
+	queue->free = queue->next[entry];
+	queue->task[entry] = task;
+	queue->bitmap[priority >> 5] |= (uint32_t)1 << (priority & 31);
+	queue->top |= 1 << (priority >> 5);
+	return entry;
+}
+
+int os_ready_push(os_ready_queue *queue, TaskType task, uint8_t priority)
+{
+	int entry = os_ready_alloc(queue, task, priority);
+
+	if (entry < 0) {
+		return -1;
+	}
+	queue->next[entry] = OS_READY_END;
+	if (queue->tail[priority] == OS_READY_END) {
+		queue->head[priority] = entry;
+	} else {
+		queue->next[queue->tail[priority]] = entry;
+	}
+	queue->tail[priority] = entry;
+	return 0;
+}
+
+int os_ready_push_front(os_ready_queue *queue, TaskType task, uint8_t priority)
+{
+	int entry = os_ready_alloc(queue, task, priority);
+
+	if (entry < 0) {
+		return -1;
+	}
+	queue->next[entry] = queue->head[priority];
+	if (queue->head[priority] == OS_READY_END) {
+		queue->tail[priority] = entry;
+	}
+	queue->head[priority] = entry;
+	return 0;
+}
+
+int os_ready_top(const os_ready_queue *queue)
+{
+	int g;
+
+	if (!queue->top) {
+		return -1;
+	}
+	g = 31 - __builtin_clz(queue->top);
+	return (g << 5) + 31 - __builtin_clz(queue->bitmap[g]);
+}
+
+TaskType os_ready_pop(os_ready_queue *queue)
+{
+	int priority = os_ready_top(queue);
+	uint16_t entry;
+	TaskType task;
+
+	if (priority < 0) {
+		return INVALID_TASK;
+	}
+	entry = queue->head[priority];
+	task = queue->task[entry];
+	queue->head[priority] = queue->next[entry];
+	if (queue->head[priority] == OS_READY_END) {
+		queue->tail[priority] = OS_READY_END;
+		queue->bitmap[priority >> 5] &= ~((uint32_t)1 << (priority & 31));
+		if (!queue->bitmap[priority >> 5]) {
+			queue->top &= ~(1 << (priority >> 5));
+		}
+	}
+	queue->next[entry] = queue->free;
+	queue->free = entry;
+	return task;
+}
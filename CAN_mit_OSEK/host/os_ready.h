@@ -0,0 +1,60 @@
+/*
+ * os_ready.h
+ *
+ * Ready-Queue fuer den Host-Port des OSEK. Os_Schedule() in libOsekAvr.a sucht
+ * bei jedem Aufruf ueber alle Tasks die hoechste Prioritaet im Zustand READY und
+ * bei gleicher Prioritaet die kleinste activationOrder (Listing 0xa3e-0xaa8):
+ * Aufwand linear in der Zahl der Tasks, mit einem 32-Bit-Vergleich je bereiter
+ * Task gleicher Prioritaet.
+ *
+ * Hier steht je Prioritaet eine FIFO der Aktivierungen, dazu eine Bitmap der
+ * belegten Prioritaeten in zwei Stufen (8 x 32 Bit, darueber ein Byte). Die
+ * hoechste belegte Prioritaet ergibt sich aus zwei Bitsuchen; Einreihen und
+ * Entnehmen kosten unabhaengig von der Zahl der Tasks gleich viel. Die
+ * Reihenfolge ist die der Suche in libOsekAvr.a: hoechste Prioritaet zuerst,
+ * bei gleicher Prioritaet die aelteste Aktivierung.
+ *
+ * Eine Task mit maxAct > 1 steht je Aktivierung einmal in der Queue, die
+ * Eintraege kommen aus einem festen Vorrat (OS_READY_ENTRIES). Verdraengte
+ * Tasks kommen mit os_ready_push_front() wieder an den Anfang ihrer Prioritaet.
+ *
+ * Vergleich mit der Suche wie in libOsekAvr.a: host/sched_bench.c.
+ */
+
+#ifndef OS_READY_H
+#define OS_READY_H
+
+#include <stdint.h>
+
+#include "Os.h"
+
+#define OS_READY_ENTRIES	256
+#define OS_READY_END		0xffff
+
+typedef struct
+{
+	uint8_t top;							/* Bit g: bitmap[g] != 0 */
+	uint32_t bitmap[8];						/* Bit p % 32 in bitmap[p / 32]: Prioritaet p belegt */
+	uint16_t head[256];						/* erster Eintrag je Prioritaet oder OS_READY_END */
+	uint16_t tail[256];
+	uint16_t next[OS_READY_ENTRIES];		/* naechster Eintrag derselben Prioritaet bzw. im Vorrat */
+	TaskType task[OS_READY_ENTRIES];
+	uint16_t free;							/* erster freier Eintrag */
+} os_ready_queue;
+
+void os_ready_init(os_ready_queue *queue);
+
+/* Task hinten in die FIFO ihrer Prioritaet (Aktivierung, Ende von WAITING).
+   0 oder -1, wenn der Vorrat erschoepft ist. */
+int os_ready_push(os_ready_queue *queue, TaskType task, uint8_t priority);
+
+/* Task vorn in die FIFO ihrer Prioritaet (verdraengte Task) */
+int os_ready_push_front(os_ready_queue *queue, TaskType task, uint8_t priority);
+
+/* Hoechste belegte Prioritaet oder -1 bei leerer Queue */
+int os_ready_top(const os_ready_queue *queue);
+
+/* Aelteste Task der hoechsten Prioritaet entnehmen, INVALID_TASK bei leerer Queue */
+TaskType os_ready_pop(os_ready_queue *queue);
+
+#endif /* OS_READY_H */
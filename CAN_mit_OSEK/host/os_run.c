@@ -0,0 +1,458 @@
+/*
+ * os_run.c
+ *
+ * Die ganze Firmware auf dem Host: main.c mit allen Modulen unveraendert auf
+ * dem OSEK aus os_host.c und dem simulierten ATmega aus sim_avr.c. Am TWI
+ * haengt das LM75-Modell (lm75_sim.c), am SPI der MCP2515 (mcp2515_sim.c)
+ * an einem CAN-Bus mit 125 kbit/s, an dem eine Gegenstelle die Taster-
+ * Nachricht sendet und Status-LED und Temperatur mitschreibt. Die Zeit ist
+ * simuliert und laeuft so schnell, wie der Host rechnet.
+ *
+ * Ablauf: "Messung starten" nach 500 ms, danach wechselt der Taster alle
+ * -p ms zwischen Stoppen und Starten (0 = erst 500 ms vor dem Ende stoppen).
+ * Die Temperatur steigt linear von -c bis -c + -d Grad. Ausgegeben werden
+ * die Nachrichten, Abstand der Temperatur-Nachrichten, Antwortzeit auf den
+ * Taster, Leerlauf, Taskwechsel und der Faktor gegenueber Echtzeit. Die
+ * Ausgaben der USART gehen nach stdout oder mit -u in eine Datei.
+ *
+ * Virtuelle Zeit: schlaeft die CPU, springt die Simulation direkt zum
+ * naechsten Ereignis (Timer-Ueberlauf, Ende einer Nachricht, Taster);
+ * -n schlaeft wie die anderen Host-Programme in Schritten von SIM_SLEEP_STEP.
+ * Der Ablauf ist in beiden Faellen deterministisch.
+ *
+ * Zeitplanung pruefen: je Task Aktivierungen, verlorene Aktivierungen
+ * (E_OS_LIMIT), CPU-Anteil, Antwortzeit von der Aktivierung bis zum Ende,
+ * laengster Abschnitt vom Bereitwerden bis WaitEvent() oder Ende und
+ * laengste Wartezeit im Zustand READY (os_host.h). Mit -j datei entsteht die Zeitleiste der
+ * Taskzustaende fuer chrome://tracing oder ui.perfetto.dev. So laesst sich
+ * ein geaenderter OS_TASK_INFO_BLOCK in Os_Cfg.h vor dem Flashen pruefen.
+ *
+ * main() der Firmware heisst hier firmware_main() (-Dmain=firmware_main).
+ *
+ * Uebersetzen und starten (aus CAN_mit_OSEK):
+ *
+ *   gcc -std=gnu99 -O2 -Wall -funsigned-char -DF_CPU=3686400UL -Dmain=firmware_main \
+ *       -Ihost -I. -Ilib -o os_run host/os_run.c host/os_host.c host/os_ready.c \
+ *       host/sim_avr.c host/mcp2515_sim.c host/lm75_sim.c host/sim_bus.c host/sim_can.c \
+ *       main.c can.c can_sched.c mcp2515.c mcp2515_timing.c TWI.c LM75.c Usart.c Trace.c OsStat.c \
+ *       OsStack.c OsTick.c SwTimer.c -lm
+ *   ./os_run [-t sekunden] [-p taster_ms] [-c grad] [-d grad] [-e von_ms:bis_ms] [-s ms]
+ *            [-u datei] [-j datei] [-n]
+ *
+ * Busfehler: -e von_ms:bis_ms stoert den Bus in dieser Zeit (sim_bus.h), jede
+ * Nachricht endet mit einem Error-Frame. Nach 32 Fehlversuchen geht der
+ * MCP2515 ins Bus-Off, mcp2515.c bricht die Sendepuffer ab und sendet erst nach
+ * der Sperrzeit wieder. Ausgegeben wird tCANErrorStatus der Firmware; geprueft
+ * wird, dass sie am Ende wieder Error-Active ist und nach der Stoerung wieder
+ * Temperaturen sendet. Status-LED und Temperatur werden in diesem Fall nur
+ * ausserhalb der Stoerung und der Sperrzeit geprueft.
+ *
+ * -s ms: zu diesem Zeitpunkt 's' an die USART senden (Laufzeiten, mit
+ * -DOS_STAT_ENABLE=1 uebersetzt). Mit -DTRACE_ENABLE=1 und -u datei liest
+ * tools/trace_decode.py den Trace aus der Datei.
+ * Rueckgabewert != 0, wenn das OS mit einem Fehler endet, eine Aktivierung
+ * verloren geht, eine Temperatur falsch ankommt oder die Status-LED nicht
+ * dem Taster folgt.
+ */
+
+#undef main
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <avr/io.h>
+
+#include "Os.h"
+#include "os_host.h"
+#include "sim_avr.h"
+#include "sim_bus.h"
+#include "mcp2515_sim.h"
+#include "lm75_sim.h"
+#include "mcp2515.h"
+#include "can_sched.h"
+#include "can_db.h"
+#include "TWI.h"
+
+#define MAX_PRESSES		256
+
+int firmware_main(void);
+
+/* Konfiguration aus Os_Cfg.c (ueber Os_Cfg.h in main.c) */
+extern const TaskInfoBlockT OsTaskIB[];
+extern OsConfigT OsCfg;
+
+// ----------------------------------------------------------------------------
+/* Gegenstelle am Bus: Taster senden, Status-LED und Temperatur mitschreiben */
+typedef struct
+{
+	sim_can_frame press[MAX_PRESSES];
+	uint64_t press_at[MAX_PRESSES];		/* Sendezeitpunkt in Takten */
+	uint64_t press_sent[MAX_PRESSES];	/* Ende der Nachricht auf dem Bus */
+	uint32_t presses;
+	uint32_t press_next;
+
+	uint32_t led_frames;
+	uint64_t led_latency_max;			/* Taster bis Status-LED in Takten */
+	uint64_t led_latency_sum;
+	uint32_t led_errors;
+
+	uint32_t temp_frames;
+	uint32_t temp_zero;					/* leere Nachricht beim Stoppen */
+	uint32_t temp_errors;
+	uint64_t temp_last;
+	uint64_t temp_gap_min;
+	uint64_t temp_gap_max;
+	uint64_t temp_gap_sum;
+	uint32_t temp_gaps;
+	uint32_t temp_fault;				/* waehrend Stoerung und Sperrzeit (-e) */
+	uint32_t temp_after_fault;
+	uint32_t other_frames;
+} peer_node;
+
+static sim_bus bus;
+static mcp2515_sim chip;
+static lm75_sim lm75;
+static peer_node peer;
+
+static double celsius_start = 21.5;
+static double celsius_delta = 2.0;
+static uint64_t end_cycles;
+static uint64_t stat_at;
+static uint64_t fault_from;				/* Stoerung des Busses in Takten (-e) */
+static uint64_t fault_to;
+static uint64_t fault_settled;			/* Ende der Stoerung plus laengste Sperrzeit */
+static FILE *usart_file;
+static uint32_t usart_bytes;
+
+// ----------------------------------------------------------------------------
+static int peer_tx_next(void *context, sim_can_frame *frame)
+{
+	peer_node *node = context;
+
+	if (node->press_next >= node->presses || node->press_at[node->press_next] > sim_cycles) {
+		return 0;
+	}
+	*frame = node->press[node->press_next];
+	return 1;
+}
+
+static void peer_tx_done(void *context, int result, uint64_t now)
+{
+	peer_node *node = context;
+
+	(void)now;
+	if (result == SIM_BUS_WON) {
+		node->press_sent[node->press_next] = sim_cycles;
+		node->press_next++;
+	}
+}
+
+/* Temperatur des Modells zum Zeitpunkt cycles in LM75-Einheiten */
+static uint16_t expected_temperature(uint64_t cycles)
+{
+	double celsius = celsius_start + celsius_delta * cycles / end_cycles;
+
+	return (uint16_t)(int16_t)(celsius * 8 + (celsius < 0 ? -0.5 : 0.5)) & 0x7ff;
+}
+
+/* Zeitpunkt in der Stoerung oder danach, bevor das Senden sicher wieder laeuft */
+static int in_fault(uint64_t cycles)
+{
+	return cycles >= fault_from && cycles < fault_settled;
+}
+
+static void peer_rx(void *context, const sim_can_frame *frame, uint64_t now)
+{
+	peer_node *node = context;
+
+	(void)now;
+	if (frame->id == CAN_DB_STATUS_LED_ID) {
+		if (in_fault(sim_cycles)) {
+			/* kann verloren gehen oder von der naechsten ersetzt werden */
+			return;
+		}
+		uint8_t led = can_db_unpack_status_led_signal(frame->data);
+		uint32_t press = node->press_next - 1;
+		uint8_t expected = press & 1 ? CAN_DB_STATUS_LED_SIGNAL_AUS : CAN_DB_STATUS_LED_SIGNAL_AN;
+
+		node->led_frames++;
+		if (node->press_next == 0 || led != expected) {
+			node->led_errors++;
+		}
+		else {
+			uint64_t latency = sim_cycles - node->press_sent[press];
+
+			node->led_latency_sum += latency;
+			if (latency > node->led_latency_max) {
+				node->led_latency_max = latency;
+			}
+		}
+	}
+	else if (frame->id == CAN_DB_TEMPERATUR_ID) {
+		uint16_t temp = can_db_unpack_temperatur_signal(frame->data);
+
+		node->temp_frames++;
+		if (fault_settled && sim_cycles >= fault_settled) {
+			node->temp_after_fault++;
+		}
+		if (in_fault(sim_cycles) || in_fault(node->temp_last)) {
+			node->temp_fault++;
+			node->temp_last = (node->press_next & 1) ? sim_cycles : 0;
+		}
+		else if (node->press_next & 1) {
+			/* Wert darf hoechstens eine Messung (100 ms) alt sein */
+			uint16_t now_temp = expected_temperature(sim_cycles);
+			uint16_t old_temp = expected_temperature(sim_cycles > F_CPU / 5 ? sim_cycles - F_CPU / 5 : 0);
+
+			if (temp != now_temp && temp != old_temp) {
+				node->temp_errors++;
+			}
+			if (node->temp_last) {
+				uint64_t gap = sim_cycles - node->temp_last;
+
+				if (!node->temp_gaps || gap < node->temp_gap_min) {
+					node->temp_gap_min = gap;
+				}
+				if (gap > node->temp_gap_max) {
+					node->temp_gap_max = gap;
+				}
+				node->temp_gap_sum += gap;
+				node->temp_gaps++;
+			}
+			node->temp_last = sim_cycles;
+		}
+		else if (temp == 0) {
+			/* leere Nachricht nach "Messung stoppen" */
+			node->temp_zero++;
+			node->temp_last = 0;
+		}
+		else {
+			node->temp_errors++;
+		}
+	}
+	else {
+		node->other_frames++;
+	}
+}
+
+/* Taster-Nachricht zum Zeitpunkt ms einplanen, abwechselnd starten und stoppen */
+static void peer_press(peer_node *node, uint64_t ms)
+{
+	sim_can_frame *frame = &node->press[node->presses];
+
+	if (node->presses >= MAX_PRESSES) {
+		return;
+	}
+	frame->id = CAN_DB_TASTER_ID;
+	frame->length = CAN_DB_TASTER_DLC;
+	can_db_pack_taster_signal(frame->data, node->presses & 1 ? CAN_DB_TASTER_SIGNAL_MESSUNG_STOPPEN :
+		CAN_DB_TASTER_SIGNAL_MESSUNG_STARTEN);
+	node->press_at[node->presses] = ms * (F_CPU / 1000);
+	node->presses++;
+}
+
+// ----------------------------------------------------------------------------
+/* Zeitgeber: Bus, Temperatur des LM75, 's' an die USART */
+static void run_clock(void *context, uint64_t now)
+{
+	(void)context;
+	sim_bus_advance(&bus, SIM_CYCLES_TO_NS(now));
+	lm75_sim_set(&lm75, celsius_start + celsius_delta * now / end_cycles);
+	if (stat_at && now >= stat_at) {
+		stat_at = 0;
+		sim_usart_receive('s');
+	}
+}
+
+/* Naechstes Ereignis ausserhalb der CPU fuer die virtuelle Zeit */
+static uint64_t run_next_event(void *context)
+{
+	uint64_t next = sim_bus_next_event(&bus);
+
+	(void)context;
+	if (next != UINT64_MAX) {
+		/* ns aufgerundet in Takte */
+		next = (next * F_CPU + 999999999ULL) / 1000000000ULL;
+	}
+	if (peer.press_next < peer.presses && peer.press_at[peer.press_next] < next) {
+		next = peer.press_at[peer.press_next];
+	}
+	if (stat_at && stat_at < next) {
+		next = stat_at;
+	}
+	return next;
+}
+
+static void usart_out(void *context, uint8_t data)
+{
+	(void)context;
+	usart_bytes++;
+	if (usart_file) {
+		fputc(data, usart_file);
+	}
+}
+
+static double seconds(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+int main(int argc, char **argv)
+{
+	double duration = 10.0, real;
+	uint32_t toggle_ms = 0;
+	const char *usart_name = 0, *trace_name = 0;
+	FILE *trace_file = 0;
+	static const char *const can_state[] = { "Error-Active", "Warnung", "Error-Passive", "Bus-Off" };
+	tCANErrorStatus can_error;
+	tCANSchedStats sched;
+	int opt, errors = 0, stepping = 0;
+	char *end;
+
+	while ((opt = getopt(argc, argv, "t:p:c:d:e:s:u:j:n")) != -1) {
+		switch (opt) {
+		case 't': duration = atof(optarg); break;
+		case 'p': toggle_ms = strtoul(optarg, 0, 0); break;
+		case 'c': celsius_start = atof(optarg); break;
+		case 'd': celsius_delta = atof(optarg); break;
+		case 'e':
+			fault_from = strtoull(optarg, &end, 0) * (F_CPU / 1000);
+			fault_to = (*end == ':') ? strtoull(end + 1, 0, 0) * (F_CPU / 1000) : 0;
+			break;
+		case 's': stat_at = strtoull(optarg, 0, 0) * (F_CPU / 1000); break;
+		case 'u': usart_name = optarg; break;
+		case 'j': trace_name = optarg; break;
+		case 'n': stepping = 1; break;
+		default:
+			fprintf(stderr, "Aufruf: %s [-t sekunden] [-p taster_ms] [-c grad] [-d grad] [-e von_ms:bis_ms]"
+				" [-s ms] [-u datei] [-j datei] [-n]\n", argv[0]);
+			return 2;
+		}
+	}
+	if (duration < 1.0) {
+		duration = 1.0;
+	}
+	end_cycles = (uint64_t)(duration * F_CPU);
+	usart_file = usart_name ? fopen(usart_name, "wb") : stdout;
+	if (!usart_file) {
+		perror(usart_name);
+		return 2;
+	}
+	if (trace_name && !(trace_file = fopen(trace_name, "w"))) {
+		perror(trace_name);
+		return 2;
+	}
+
+	sim_reset();
+	mcp2515_sim_init(&chip);
+	mcp2515_sim_attach_spi(&chip);
+	sim_bus_init(&bus, 125000);
+	mcp2515_sim_attach_bus(&chip, &bus);
+	if (fault_to > fault_from) {
+		sim_bus_set_fault(&bus, SIM_CYCLES_TO_NS(fault_from), SIM_CYCLES_TO_NS(fault_to));
+		fault_settled = fault_to + (MCP2515_BUS_OFF_HOLDOFF_MAX_MS + 500) * (F_CPU / 1000);
+	}
+	sim_bus_attach(&bus, &(sim_bus_port){ &peer, peer_tx_next, peer_tx_done, peer_rx, 0 });
+	lm75_sim_init(&lm75, DEV_LM75);
+	lm75_sim_attach(&lm75);
+	sim_attach_usart(usart_out, 0);
+	sim_attach_clock(run_clock, 0);
+	if (!stepping) {
+		sim_attach_next_event(run_next_event, 0);
+	}
+
+	peer_press(&peer, 500);
+	if (toggle_ms) {
+		for (uint64_t ms = 500 + toggle_ms; ms < duration * 1000; ms += toggle_ms) {
+			peer_press(&peer, ms);
+		}
+	}
+	else {
+		peer_press(&peer, duration * 1000 - 500);
+	}
+	os_host_stop_at(end_cycles);
+	if (trace_file) {
+		os_host_trace_open(trace_file);
+	}
+
+	real = seconds();
+	firmware_main();
+	real = seconds() - real;
+	if (trace_file) {
+		os_host_trace_close();
+		fclose(trace_file);
+	}
+	if (usart_file != stdout) {
+		fclose(usart_file);
+	}
+	else {
+		fflush(stdout);
+	}
+
+	printf("\nsimuliert %.3f s, real %.3f s, Faktor %.1f\n", (double)sim_cycles / F_CPU, real,
+		(double)sim_cycles / F_CPU / real);
+	printf("ShutdownOS(%u), %u Fehler der Dienste, %llu Ticks, %u Taskwechsel (%u verdraengt)\n",
+		os_host_stat.shutdown_status, os_host_stat.errors, (unsigned long long)os_host_stat.ticks,
+		os_host_stat.switches, os_host_stat.preemptions);
+	printf("Leerlauf %.1f %%, ISR %.1f %%, USART %u Byte\n", 100.0 * sim_sleep_cycles / sim_cycles,
+		100.0 * sim_isr_cycles / sim_cycles, usart_bytes);
+	printf("Taster %u/%u gesendet, Status-LED %u (%u falsch), Antwortzeit mittel %.2f ms, max %.2f ms\n",
+		peer.press_next, peer.presses, peer.led_frames, peer.led_errors,
+		peer.led_frames ? peer.led_latency_sum * 1000.0 / F_CPU / (peer.led_frames - peer.led_errors) : 0.0,
+		peer.led_latency_max * 1000.0 / F_CPU);
+	printf("Temperatur %u Nachrichten (%u falsch, %u beim Stoppen), Abstand min %.2f mittel %.2f max %.2f ms\n",
+		peer.temp_frames, peer.temp_errors, peer.temp_zero, peer.temp_gap_min * 1000.0 / F_CPU,
+		peer.temp_gaps ? peer.temp_gap_sum * 1000.0 / F_CPU / peer.temp_gaps : 0.0,
+		peer.temp_gap_max * 1000.0 / F_CPU);
+	printf("LM75 %u Mal gelesen, Bus %llu Nachrichten, %llu Fehler\n", lm75.reads,
+		(unsigned long long)bus.frames, (unsigned long long)bus.errors);
+	can_sched_get_stats(&sched);
+	printf("Zyklisch %u gesendet, %u verworfen, %u verspaetet\n", sched.sent, sched.dropped, sched.late);
+	mcp2515_get_error_status(&can_error);
+	printf("CAN %s, TEC %u REC %u (max %u/%u), Wechsel Warnung %u Passiv %u Bus-Off %u Aktiv %u,"
+		" wieder gesendet %u\n", can_state[can_error.state], can_error.tec, can_error.rec,
+		can_error.tec_max, can_error.rec_max, can_error.transitions[MCP2515_ERROR_WARNING],
+		can_error.transitions[MCP2515_ERROR_PASSIVE], can_error.transitions[MCP2515_BUS_OFF],
+		can_error.transitions[MCP2515_ERROR_ACTIVE], can_error.recoveries);
+	printf("    Abfragen mit Error-Frames %u, abgebrochen %u, Ueberlauf MCP2515 %u, Ringpuffer %u,"
+		" TX verworfen %u\n", can_error.error_periods, can_error.tx_aborted, can_error.rx_hw_overflow,
+		mcp2515_get_rx_overflow_count(), mcp2515_get_tx_dropped_count());
+	if (fault_settled) {
+		printf("    Temperatur waehrend Stoerung und Sperrzeit %u, danach %u\n", peer.temp_fault,
+			peer.temp_after_fault);
+	}
+
+	printf("\nTask Prio     Akt. verloren   CPU %% | Antwort [ms] mittel    max | Abschnitt max | READY max"
+		" | Stack Host\n");
+	for (TaskType i = 0; i < OsCfg.numberOfTasks; i++) {
+		const os_host_task_stats *stat = &os_host_stat.task[i];
+
+		printf("%4u %4u %8u %8u %7.2f |              %6.3f %6.3f | %13.3f | %9.3f | %10u\n", i,
+			OsTaskIB[i].priority, stat->activations, stat->lost, 100.0 * stat->run_cycles / sim_cycles,
+			stat->jobs ? stat->response_sum * 1000.0 / F_CPU / stat->jobs : 0.0,
+			stat->response_max * 1000.0 / F_CPU, stat->segment_max * 1000.0 / F_CPU,
+			stat->ready_max * 1000.0 / F_CPU, os_host_stack_used(i));
+		if (stat->lost) {
+			errors++;
+		}
+	}
+
+	if (os_host_stat.shutdown_status != E_OK || os_host_stat.errors) {
+		errors++;
+	}
+	if (peer.led_errors || (!fault_settled && peer.led_frames != peer.press_next) || peer.temp_errors
+		|| !peer.temp_frames) {
+		errors++;
+	}
+	if (fault_settled && (can_error.state != MCP2515_ERROR_ACTIVE || !peer.temp_after_fault)) {
+		errors++;
+	}
+	printf("%s\n", errors ? "FEHLER" : "ok");
+	return errors != 0;
+}
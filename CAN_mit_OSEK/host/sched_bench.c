@@ -0,0 +1,212 @@
+/*
+ * sched_bench.c
+ *
+ * Benchmark der Task-Auswahl: Suche ueber alle Task-Kontrollbloecke wie
+ * Os_Schedule() in libOsekAvr.a (hoechste Prioritaet im Zustand READY, bei
+ * gleicher Prioritaet kleinste activationOrder, 32 Bit) gegen die Ready-Queue
+ * mit Prioritaets-Bitmap aus os_ready.c.
+ *
+ * Beide bekommen denselben Ablauf: eine Task wird ausgewaehlt, aktiviert
+ * waehrend ihres Laufs 0 bis 2 zufaellige Tasks (nur suspendierte, maxAct 1)
+ * und beendet sich; ist keine Task bereit, werden zwei aktiviert. Die
+ * Prioritaeten sind zufaellig mit vielen gleichen, damit die Reihenfolge
+ * innerhalb einer Prioritaet zaehlt. Die Reihenfolge der Tasks muss in beiden
+ * Varianten gleich sein. Ausgegeben wird die Zeit je Durchlauf (Aktivieren,
+ * Auswahl, Beenden) fuer 4, 16 und 64 Tasks.
+ *
+ * Auf dem ATmega88PA kostet die Suche in Os_Schedule() etwa 15 Takte je Task,
+ * die nicht bereit ist, und bis zu etwa 50 je bereiter Task gleicher
+ * Prioritaet (32-Bit-Vergleich, Listing 0xa3e-0xaa8).
+ *
+ * Uebersetzen und starten (aus CAN_mit_OSEK):
+ *
+ *   gcc -std=gnu99 -O2 -Wall -funsigned-char -Ihost -I. -Ilib \
+ *       -o sched_bench host/sched_bench.c host/os_ready.c
+ *   ./sched_bench [-d durchlaeufe] [-s seed]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "Os.h"
+#include "os_ready.h"
+
+#define MAX_TASKS	64
+
+static uint64_t seed = 1;
+
+// ----------------------------------------------------------------------------
+static uint64_t random64(void)
+{
+	// xorshift64
+	seed ^= seed << 13;
+	seed ^= seed >> 7;
+	seed ^= seed << 17;
+	return seed;
+}
+
+static double seconds(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static uint8_t priority[MAX_TASKS];
+static uint8_t tasks;
+
+/* Zufallsfolge fuer den Ablauf, beide Varianten lesen sie gleich */
+static uint8_t *script;
+static size_t script_len;
+
+// ----------------------------------------------------------------------------
+/* Kontrollbloecke und Suche wie in libOsekAvr.a */
+static struct
+{
+	uint32_t activationOrder;
+	uint8_t state;
+} lib_tcb[MAX_TASKS];
+
+static uint32_t lib_order;
+
+static void lib_activate(TaskType task)
+{
+	if (lib_tcb[task].state == SUSPENDED) {
+		lib_tcb[task].state = READY;
+		lib_tcb[task].activationOrder = ++lib_order;
+	}
+}
+
+static TaskType lib_schedule(void)
+{
+	TaskType best = INVALID_TASK;
+
+	for (TaskType i = 0; i < tasks; i++) {
+		if (lib_tcb[i].state == READY) {
+			if (best == INVALID_TASK || priority[i] > priority[best] ||
+				(priority[i] == priority[best] && lib_tcb[i].activationOrder < lib_tcb[best].activationOrder)) {
+				best = i;
+			}
+		}
+	}
+	if (best != INVALID_TASK) {
+		lib_tcb[best].state = RUNNING;
+	}
+	return best;
+}
+
+static void lib_terminate(TaskType task)
+{
+	lib_tcb[task].state = SUSPENDED;
+}
+
+// ----------------------------------------------------------------------------
+/* Ready-Queue mit Bitmap */
+static os_ready_queue queue;
+static uint8_t ready_state[MAX_TASKS];
+
+static void rq_activate(TaskType task)
+{
+	if (ready_state[task] == SUSPENDED) {
+		ready_state[task] = READY;
+		os_ready_push(&queue, task, priority[task]);
+	}
+}
+
+static TaskType rq_schedule(void)
+{
+	TaskType task = os_ready_pop(&queue);
+
+	if (task != INVALID_TASK) {
+		ready_state[task] = RUNNING;
+	}
+	return task;
+}
+
+static void rq_terminate(TaskType task)
+{
+	ready_state[task] = SUSPENDED;
+}
+
+// ----------------------------------------------------------------------------
+/* Ablauf mit einer der beiden Varianten, liefert eine Pruefsumme der Reihenfolge */
+#define RUN(name, activate, schedule, terminate) \
+static uint64_t name(uint32_t runs, double *ns) \
+{ \
+	uint64_t sum = 0; \
+	size_t pos = 0; \
+	double t = seconds(); \
+	\
+	for (uint32_t n = 0; n < runs; n++) { \
+		TaskType task = schedule(); \
+		\
+		if (task == INVALID_TASK) { \
+			activate(script[pos++ % script_len] % tasks); \
+			activate(script[pos++ % script_len] % tasks); \
+			task = schedule(); \
+		} \
+		for (uint8_t k = script[pos++ % script_len] % 3; k; k--) { \
+			activate(script[pos++ % script_len] % tasks); \
+		} \
+		terminate(task); \
+		sum = sum * 31 + task; \
+	} \
+	*ns = (seconds() - t) * 1e9 / runs; \
+	return sum; \
+}
+
+RUN(run_lib, lib_activate, lib_schedule, lib_terminate)
+RUN(run_queue, rq_activate, rq_schedule, rq_terminate)
+
+int main(int argc, char **argv)
+{
+	static const uint8_t counts[] = { 4, 16, 64 };
+	uint32_t runs = 2000000;
+	int opt, errors = 0;
+
+	while ((opt = getopt(argc, argv, "d:s:")) != -1) {
+		switch (opt) {
+		case 'd': runs = strtoul(optarg, 0, 0); break;
+		case 's': seed = strtoull(optarg, 0, 0); break;
+		default:
+			fprintf(stderr, "Aufruf: %s [-d durchlaeufe] [-s seed]\n", argv[0]);
+			return 2;
+		}
+	}
+	script_len = 1 << 16;
+	script = malloc(script_len);
+	for (size_t i = 0; i < script_len; i++) {
+		script[i] = random64();
+	}
+
+	printf("%u Durchlaeufe (Aktivieren, Auswahl, Beenden)\n\n", runs);
+	printf("Tasks  Prioritaeten | Suche ns/Durchlauf | Bitmap ns/Durchlauf\n");
+	for (unsigned c = 0; c < sizeof(counts); c++) {
+		uint64_t sum_lib, sum_queue;
+		double ns_lib, ns_queue;
+
+		tasks = counts[c];
+		for (TaskType i = 0; i < tasks; i++) {
+			priority[i] = 1 + random64() % (tasks / 2 + 1);
+			lib_tcb[i].state = SUSPENDED;
+			ready_state[i] = SUSPENDED;
+		}
+		lib_order = 0;
+		os_ready_init(&queue);
+
+		sum_lib = run_lib(runs, &ns_lib);
+		sum_queue = run_queue(runs, &ns_queue);
+		if (sum_lib != sum_queue) {
+			printf("FEHLER: Reihenfolge verschieden bei %u Tasks\n", tasks);
+			errors++;
+		}
+		printf("%5u  %12u | %18.1f | %19.1f\n", tasks, tasks / 2 + 1, ns_lib, ns_queue);
+	}
+	printf("\n%d Fehler\n", errors);
+	free(script);
+	return errors != 0;
+}
@@ -0,0 +1,628 @@
+/*
+ * sim_avr.c
+ *
+ * Nachbildung des ATmega88PA fuer den Host-Build, siehe sim_avr.h.
+ */
+
+#include <string.h>
+
+#include <avr/io.h>
+#include <avr/interrupt.h>
+
+#include "sim_avr.h"
+
+#define SIM_MAX_CLOCKS		4
+
+/* Schritt in Takten, in dem Warteschleifen die Peripherie abfragen */
+#define SIM_DELAY_STEP		16
+
+/* Bit 1 von TWCR ist reserviert und wird sonst immer 0 gelesen */
+#define SIM_TWCR_MARK		0x02
+
+uint64_t sim_cycles;
+uint64_t sim_isr_cycles;
+uint32_t sim_isr_count[SIM_IRQ_COUNT];
+uint64_t sim_sleep_cycles;
+
+/* Interrupt-Service-Routinen der Firmware, falls sie gelinkt sind */
+void INT0_vect(void) __attribute__((weak));
+void TIMER1_OVF_vect(void) __attribute__((weak));
+void TIMER0_OVF_vect(void) __attribute__((weak));
+void USART_UDRE_vect(void) __attribute__((weak));
+void TWI_vect(void) __attribute__((weak));
+
+static union
+{
+	uint8_t b[SIM_IO_SIZE];
+	uint16_t w[SIM_IO_SIZE / 2];
+} io;
+
+/* Interrupt-Flags (EIFR), werden durch Schreiben einer 1 geloescht und deshalb
+ * neben dem Registerabbild gehalten */
+static uint8_t eifr;
+
+static sim_spi_slave spi;
+static uint8_t spi_pending;
+static uint8_t cs_level = 1;
+static uint8_t int_level = 1;
+static uint8_t in_isr;
+static uint32_t isr_total;
+static void (*isr_exit)(void);
+static uint64_t (*next_event)(void *context);
+static void *next_event_context;
+
+/* Timer/Counter 0 und 1: Zeitpunkt des letzten Abgleichs, Takte im Vorteiler */
+static struct
+{
+	uint64_t last;
+	uint16_t rest;
+} timer[2];
+
+/* USART: Schieberegister bis tx_shift_end, UDR0 voll, Empfangsbyte */
+static void (*usart_tx)(void *context, uint8_t data);
+static void *usart_context;
+static uint8_t udr_accessed;
+static uint8_t udr_full;
+static uint8_t udr_data;
+static uint8_t tx_shift_busy;
+static uint8_t tx_shift_data;
+static uint64_t tx_shift_end;
+static uint8_t rx_full;
+
+/* TWI: Phase des Masters, laufende Aktion bis twi_done_at */
+enum { TWI_IDLE, TWI_ADDRESS, TWI_TRANSMIT, TWI_RECEIVE };
+static sim_twi_slave twi;
+static uint8_t twcr_accessed;
+static uint8_t twi_phase;
+static uint8_t twi_busy;
+static uint8_t twi_status;
+static uint64_t twi_done_at;
+
+static struct
+{
+	void (*advance)(void *context, uint64_t now);
+	void *context;
+} clocks[SIM_MAX_CLOCKS];
+static uint8_t clock_count;
+
+// ----------------------------------------------------------------------------
+void sim_attach_spi(const sim_spi_slave *slave)
+{
+	spi = *slave;
+	cs_level = 1;
+	int_level = 1;
+}
+
+// ----------------------------------------------------------------------------
+void sim_attach_twi(const sim_twi_slave *slave)
+{
+	twi = *slave;
+	twi_phase = TWI_IDLE;
+}
+
+// ----------------------------------------------------------------------------
+void sim_attach_usart(void (*tx)(void *context, uint8_t data), void *context)
+{
+	usart_tx = tx;
+	usart_context = context;
+}
+
+// ----------------------------------------------------------------------------
+void sim_attach_clock(void (*advance)(void *context, uint64_t now), void *context)
+{
+	clocks[clock_count].advance = advance;
+	clocks[clock_count].context = context;
+	clock_count++;
+}
+
+// ----------------------------------------------------------------------------
+void sim_attach_next_event(uint64_t (*next)(void *context), void *context)
+{
+	next_event = next;
+	next_event_context = context;
+}
+
+// ----------------------------------------------------------------------------
+void sim_attach_isr_exit(void (*exit_hook)(void))
+{
+	isr_exit = exit_hook;
+}
+
+// ----------------------------------------------------------------------------
+/* Takte eines SPI-Bytes aus SPR1..0 und SPI2X */
+static uint16_t spi_byte_cycles(void)
+{
+	static const uint8_t divider[4] = { 4, 16, 64, 128 };
+	uint16_t cycles = 8 * divider[io.b[SIM_SPCR] & 0x03];
+
+	if (io.b[SIM_SPSR] & (1<<SPI2X)) {
+		cycles /= 2;
+	}
+	return cycles;
+}
+
+// ----------------------------------------------------------------------------
+/* Ein nach SPDR geschriebenes Byte wird uebertragen, sobald das Programm auf
+ * SPIF wartet. */
+static void spi_transfer(void)
+{
+	uint8_t miso = 0xff;
+
+	if (spi.exchange) {
+		miso = spi.exchange(spi.context, io.b[SIM_SPDR]);
+	}
+	io.b[SIM_SPDR] = miso;
+	io.b[SIM_SPSR] |= (1<<SPIF);
+	spi_pending = 0;
+	sim_cycles += spi_byte_cycles();
+}
+
+// ----------------------------------------------------------------------------
+/* Takte je Zaehlschritt aus CSn2..0, 0 = Timer steht */
+static uint16_t timer_prescaler(uint8_t tccrb)
+{
+	static const uint16_t prescaler[8] = { 0, 1, 8, 64, 256, 1024, 0, 0 };
+
+	return prescaler[tccrb & 0x07];
+}
+
+/* Zaehlerstand nachziehen und Ueberlauf in TIFRn melden */
+static void timer_advance(uint8_t n)
+{
+	uint16_t prescaler = timer_prescaler(io.b[n ? SIM_TCCR1B : SIM_TCCR0B]);
+	uint64_t elapsed = sim_cycles - timer[n].last;
+	uint64_t steps, count;
+
+	timer[n].last = sim_cycles;
+	if (prescaler == 0) {
+		timer[n].rest = 0;
+		return;
+	}
+	steps = (timer[n].rest + elapsed) / prescaler;
+	timer[n].rest = (timer[n].rest + elapsed) % prescaler;
+	if (n) {
+		count = io.w[SIM_TCNT1 / 2] + steps;
+		if (count > 0xffff) {
+			io.b[SIM_TIFR1] |= (1<<TOV1);
+		}
+		io.w[SIM_TCNT1 / 2] = (uint16_t)count;
+	}
+	else {
+		count = io.b[SIM_TCNT0] + steps;
+		if (count > 0xff) {
+			io.b[SIM_TIFR0] |= (1<<TOV0);
+		}
+		io.b[SIM_TCNT0] = (uint8_t)count;
+	}
+}
+
+/* Takte bis zum naechsten Ueberlauf oder UINT64_MAX */
+static uint64_t timer_next_overflow(uint8_t n)
+{
+	uint16_t prescaler = timer_prescaler(io.b[n ? SIM_TCCR1B : SIM_TCCR0B]);
+	uint32_t steps;
+
+	if (prescaler == 0) {
+		return UINT64_MAX;
+	}
+	steps = n ? 0x10000 - io.w[SIM_TCNT1 / 2] : 0x100 - io.b[SIM_TCNT0];
+	return (uint64_t)steps * prescaler - timer[n].rest;
+}
+
+// ----------------------------------------------------------------------------
+/* Takte eines Zeichens (Start, 8 Daten, Stopp) aus UBRR0 und U2X0 */
+static uint32_t usart_byte_cycles(void)
+{
+	uint32_t ubrr = ((io.b[SIM_UBRR0H] & 0x0f) << 8) | io.b[SIM_UBRR0L];
+
+	return 10 * ((io.b[SIM_UCSR0A] & (1<<U2X0)) ? 8 : 16) * (ubrr + 1);
+}
+
+static void usart_advance(void)
+{
+	if (tx_shift_busy && sim_cycles >= tx_shift_end) {
+		tx_shift_busy = 0;
+		if (usart_tx) {
+			usart_tx(usart_context, tx_shift_data);
+		}
+	}
+	if (!tx_shift_busy && udr_full) {
+		tx_shift_busy = 1;
+		tx_shift_data = udr_data;
+		tx_shift_end = sim_cycles + usart_byte_cycles();
+		udr_full = 0;
+	}
+	io.b[SIM_UCSR0A] = (io.b[SIM_UCSR0A] & ~((1<<UDRE0) | (1<<RXC0)))
+		| (udr_full ? 0 : (1<<UDRE0)) | (rx_full ? (1<<RXC0) : 0);
+}
+
+void sim_usart_receive(uint8_t data)
+{
+	io.b[SIM_UDR0] = data;
+	rx_full = 1;
+	io.b[SIM_UCSR0A] |= (1<<RXC0);
+}
+
+// ----------------------------------------------------------------------------
+/* Takte eines SCL-Bits aus TWBR und TWPS */
+static uint32_t twi_bit_cycles(void)
+{
+	return 16 + 2 * io.b[SIM_TWBR] * (1 << (2 * (io.b[SIM_TWSR] & 0x03)));
+}
+
+/* Geschriebenes TWCR ausfuehren: TWINT = 1 startet die naechste Aktion */
+static void twi_write(uint8_t twcr)
+{
+	uint8_t data = io.b[SIM_TWDR];
+	uint32_t bit = twi_bit_cycles();
+
+	if (!(twcr & (1<<TWEN)) || !(twcr & (1<<TWINT))) {
+		return;
+	}
+	io.b[SIM_TWCR] = twcr & ~(1<<TWINT);
+	twi_busy = 1;
+	if (twcr & (1<<TWSTA)) {
+		twi_status = (twi_phase == TWI_IDLE) ? 0x08 : 0x10;		/* TW_START, TW_REP_START */
+		twi_phase = TWI_ADDRESS;
+		twi_done_at = sim_cycles + bit;
+	}
+	else if (twcr & (1<<TWSTO)) {
+		if (twi_phase != TWI_IDLE && twi.stop) {
+			twi.stop(twi.context);
+		}
+		twi_phase = TWI_IDLE;
+		twi_status = 0xf8;
+		twi_done_at = sim_cycles + bit;
+	}
+	else if (twi_phase == TWI_ADDRESS) {
+		int read = data & 1;
+		int ack = twi.address && (data & 0xfe) == twi.address;
+
+		if (ack && twi.start) {
+			twi.start(twi.context, read);
+		}
+		twi_status = read ? (ack ? 0x40 : 0x48) : (ack ? 0x18 : 0x20);
+		twi_phase = ack ? (read ? TWI_RECEIVE : TWI_TRANSMIT) : TWI_ADDRESS;
+		twi_done_at = sim_cycles + 9 * bit;
+	}
+	else if (twi_phase == TWI_TRANSMIT) {
+		int ack = twi.write ? twi.write(twi.context, data) : 0;
+
+		twi_status = ack ? 0x28 : 0x30;
+		twi_done_at = sim_cycles + 9 * bit;
+	}
+	else if (twi_phase == TWI_RECEIVE) {
+		int ack = (twcr & (1<<TWEA)) != 0;
+
+		io.b[SIM_TWDR] = twi.read ? twi.read(twi.context, ack) : 0xff;
+		twi_status = ack ? 0x50 : 0x58;
+		twi_done_at = sim_cycles + 9 * bit;
+	}
+	else {
+		twi_busy = 0;
+	}
+}
+
+static void twi_advance(void)
+{
+	if (twi_busy && sim_cycles >= twi_done_at) {
+		twi_busy = 0;
+		io.b[SIM_TWSR] = twi_status | (io.b[SIM_TWSR] & 0x03);
+		if (io.b[SIM_TWCR] & (1<<TWSTO)) {
+			io.b[SIM_TWCR] &= ~(1<<TWSTO);
+		}
+		else {
+			io.b[SIM_TWCR] |= (1<<TWINT);
+		}
+	}
+}
+
+// ----------------------------------------------------------------------------
+/* Seit dem letzten Zugriff geschriebene Register auswerten */
+static void sync_registers(void)
+{
+	// EIFR: beim vorherigen Zugriff geschriebene Einsen loeschen die Flags
+	if (io.b[SIM_EIFR]) {
+		eifr &= ~io.b[SIM_EIFR];
+		io.b[SIM_EIFR] = 0;
+	}
+	if (udr_accessed) {
+		udr_accessed = 0;
+		udr_full = 1;
+		udr_data = io.b[SIM_UDR0];
+	}
+	if (twcr_accessed && !(io.b[SIM_TWCR] & SIM_TWCR_MARK)) {
+		twcr_accessed = 0;
+		twi_write(io.b[SIM_TWCR]);
+	}
+}
+
+// ----------------------------------------------------------------------------
+/* Pegel an den Ports abgleichen: Chip-Select (B,2) und INT-Leitung (D,2) */
+static void sync_pins(void)
+{
+	uint8_t cs = (io.b[SIM_PORTB] >> PB2) & 1;
+	uint8_t level = 1;
+
+	if (cs != cs_level) {
+		cs_level = cs;
+		if (spi.select) {
+			spi.select(spi.context, cs == 0);
+		}
+	}
+
+	if (spi.int_pin) {
+		level = spi.int_pin(spi.context) ? 1 : 0;
+	}
+	io.b[SIM_PIND] = (io.b[SIM_PIND] & ~(1<<PD2)) | (level << PD2);
+
+	// Flankenerkennung fuer INT0 gemaess ISC01..ISC00
+	if (level != int_level) {
+		switch (io.b[SIM_EICRA] & ((1<<ISC01)|(1<<ISC00))) {
+			case (1<<ISC00):
+				eifr |= (1<<INTF0);
+				break;
+			case (1<<ISC01):
+				if (level == 0) {
+					eifr |= (1<<INTF0);
+				}
+				break;
+			case (1<<ISC01)|(1<<ISC00):
+				if (level == 1) {
+					eifr |= (1<<INTF0);
+				}
+				break;
+		}
+		int_level = level;
+	}
+}
+
+// ----------------------------------------------------------------------------
+/* Hoechste anstehende und freigegebene Quelle mit ISR oder SIM_IRQ_COUNT */
+static uint8_t pending_interrupt(void)
+{
+	if ((io.b[SIM_EIMSK] & (1<<INT0)) && INT0_vect) {
+		if ((io.b[SIM_EICRA] & ((1<<ISC01)|(1<<ISC00))) == 0) {
+			// Low-Level-Interrupt, solange die Leitung LOW ist
+			if (int_level == 0) {
+				return SIM_IRQ_INT0;
+			}
+		}
+		else if (eifr & (1<<INTF0)) {
+			return SIM_IRQ_INT0;
+		}
+	}
+	if ((io.b[SIM_TIMSK1] & (1<<TOIE1)) && (io.b[SIM_TIFR1] & (1<<TOV1)) && TIMER1_OVF_vect) {
+		return SIM_IRQ_TIMER1_OVF;
+	}
+	if ((io.b[SIM_TIMSK0] & (1<<TOIE0)) && (io.b[SIM_TIFR0] & (1<<TOV0)) && TIMER0_OVF_vect) {
+		return SIM_IRQ_TIMER0_OVF;
+	}
+	if ((io.b[SIM_UCSR0B] & (1<<UDRIE0)) && (io.b[SIM_UCSR0A] & (1<<UDRE0)) && USART_UDRE_vect) {
+		return SIM_IRQ_USART_UDRE;
+	}
+	if ((io.b[SIM_TWCR] & ((1<<TWIE)|(1<<TWINT)|(1<<TWEN))) == ((1<<TWIE)|(1<<TWINT)|(1<<TWEN)) && TWI_vect) {
+		return SIM_IRQ_TWI;
+	}
+	return SIM_IRQ_COUNT;
+}
+
+/* Anstehende und freigegebene Interrupts ausfuehren */
+static void deliver_interrupts(void)
+{
+	uint8_t irq;
+
+	while (!in_isr && (io.b[SIM_SREG] & 0x80) && (irq = pending_interrupt()) != SIM_IRQ_COUNT) {
+		uint64_t start = sim_cycles;
+
+		in_isr = 1;
+		io.b[SIM_SREG] &= ~0x80;
+		sim_cycles += SIM_CYCLES_PER_ISR;
+		switch (irq) {
+			case SIM_IRQ_INT0:
+				eifr &= ~(1<<INTF0);
+				INT0_vect();
+				break;
+			case SIM_IRQ_TIMER1_OVF:
+				io.b[SIM_TIFR1] &= ~(1<<TOV1);
+				TIMER1_OVF_vect();
+				break;
+			case SIM_IRQ_TIMER0_OVF:
+				io.b[SIM_TIFR0] &= ~(1<<TOV0);
+				TIMER0_OVF_vect();
+				break;
+			case SIM_IRQ_USART_UDRE:
+				USART_UDRE_vect();
+				break;
+			case SIM_IRQ_TWI:
+				TWI_vect();
+				break;
+		}
+		sync_registers();
+		usart_advance();
+		io.b[SIM_SREG] |= 0x80;
+		in_isr = 0;
+
+		sim_isr_count[irq]++;
+		isr_total++;
+		sim_isr_cycles += sim_cycles - start;
+		sync_pins();
+		if (isr_exit) {
+			// der Hook kann die Task gewechselt haben: Schreibzugriffe der
+			// zuletzt gelaufenen Task vor der naechsten Pruefung auswerten
+			isr_exit();
+			sync_registers();
+			usart_advance();
+		}
+	}
+}
+
+// ----------------------------------------------------------------------------
+/* Zeit und Peripherie bis sim_cycles nachziehen */
+static void sync(void)
+{
+	sync_registers();
+	for (uint8_t i = 0; i < clock_count; i++) {
+		clocks[i].advance(clocks[i].context, sim_cycles);
+	}
+	timer_advance(0);
+	timer_advance(1);
+	usart_advance();
+	twi_advance();
+	sync_pins();
+	deliver_interrupts();
+}
+
+// ----------------------------------------------------------------------------
+volatile uint8_t *sim_io(uint8_t adress)
+{
+	sim_cycles += SIM_CYCLES_PER_IO;
+
+	if (adress == SIM_SPSR && spi_pending && !(io.b[SIM_SPSR] & (1<<SPIF))) {
+		spi_transfer();
+	}
+	sync();
+
+	if (adress == SIM_SPDR) {
+		// SPIF wird durch den Zugriff auf SPDR geloescht, ein geschriebenes Byte
+		// wird beim naechsten Lesen von SPSR uebertragen
+		io.b[SIM_SPSR] &= ~(1<<SPIF);
+		spi_pending = 1;
+	}
+	else if (adress == SIM_UDR0) {
+		// mit anstehendem Empfang ein Lesen, sonst ein Schreiben in den Sendepuffer
+		if (rx_full) {
+			rx_full = 0;
+			io.b[SIM_UCSR0A] &= ~(1<<RXC0);
+		}
+		else {
+			udr_accessed = 1;
+		}
+	}
+	else if (adress == SIM_TWCR) {
+		io.b[SIM_TWCR] |= SIM_TWCR_MARK;
+		twcr_accessed = 1;
+	}
+	return &io.b[adress];
+}
+
+// ----------------------------------------------------------------------------
+volatile uint16_t *sim_io16(uint8_t adress)
+{
+	sim_cycles += 2 * SIM_CYCLES_PER_IO;
+	sync();
+	return &io.w[adress / 2];
+}
+
+// ----------------------------------------------------------------------------
+void sim_delay_cycles(uint64_t cycles)
+{
+	while (cycles) {
+		uint64_t step = (cycles > SIM_DELAY_STEP) ? SIM_DELAY_STEP : cycles;
+
+		sim_cycles += step;
+		cycles -= step;
+		sync();
+	}
+}
+
+// ----------------------------------------------------------------------------
+void sim_sleep(void)
+{
+	uint32_t before = isr_total;
+
+	if (!(io.b[SIM_SMCR] & (1<<SE)) || !(io.b[SIM_SREG] & 0x80)) {
+		return;
+	}
+	sync();
+	while (isr_total == before) {
+		uint64_t step = next_event ? UINT64_MAX : SIM_SLEEP_STEP;
+		uint64_t next = timer_next_overflow(0);
+
+		if (timer_next_overflow(1) < next) {
+			next = timer_next_overflow(1);
+		}
+		if (tx_shift_busy && tx_shift_end - sim_cycles < next) {
+			next = tx_shift_end - sim_cycles;
+		}
+		if (twi_busy && twi_done_at - sim_cycles < next) {
+			next = twi_done_at - sim_cycles;
+		}
+		if (next_event) {
+			uint64_t at = next_event(next_event_context);
+
+			if (at != UINT64_MAX && (at <= sim_cycles ? 0 : at - sim_cycles) < next) {
+				next = at <= sim_cycles ? 0 : at - sim_cycles;
+			}
+		}
+		if (next == UINT64_MAX && step == UINT64_MAX) {
+			// nichts kann die CPU mehr wecken
+			return;
+		}
+		if (next < step) {
+			step = next ? next : 1;
+		}
+		sim_cycles += step;
+		sim_sleep_cycles += step;
+		sync();
+	}
+}
+
+// ----------------------------------------------------------------------------
+void sim_sei(void)
+{
+	io.b[SIM_SREG] |= 0x80;
+	sync();
+}
+
+// ----------------------------------------------------------------------------
+void sim_cli(void)
+{
+	io.b[SIM_SREG] &= ~0x80;
+}
+
+// ----------------------------------------------------------------------------
+int sim_in_isr(void)
+{
+	return in_isr;
+}
+
+uint8_t sim_get_sreg(void)
+{
+	return io.b[SIM_SREG];
+}
+
+void sim_set_sreg(uint8_t sreg)
+{
+	io.b[SIM_SREG] = sreg;
+}
+
+// ----------------------------------------------------------------------------
+void sim_reset(void)
+{
+	memset(&io, 0, sizeof(io));
+	memset(&spi, 0, sizeof(spi));
+	memset(&twi, 0, sizeof(twi));
+	memset(timer, 0, sizeof(timer));
+	memset(sim_isr_count, 0, sizeof(sim_isr_count));
+	eifr = 0;
+	spi_pending = 0;
+	cs_level = 1;
+	int_level = 1;
+	in_isr = 0;
+	isr_total = 0;
+	isr_exit = 0;
+	next_event = 0;
+	usart_tx = 0;
+	udr_accessed = 0;
+	udr_full = 0;
+	tx_shift_busy = 0;
+	rx_full = 0;
+	twcr_accessed = 0;
+	twi_phase = TWI_IDLE;
+	twi_busy = 0;
+	clock_count = 0;
+	sim_cycles = 0;
+	sim_isr_cycles = 0;
+	sim_sleep_cycles = 0;
+}
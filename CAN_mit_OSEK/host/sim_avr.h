@@ -0,0 +1,190 @@
+/*
+ * sim_avr.h
+ *
+ * Nachbildung des ATmega88PA fuer den Host-Build (Linux). Die I/O-Register aus
+ * <avr/io.h> liegen in einem simulierten Datenspeicher; jeder Zugriff laeuft ueber
+ * sim_io(), das die Zeit weiterzaehlt, SPI-Transfers an den angeschlossenen
+ * Baustein weitergibt, Pegelwechsel an den Ports erkennt und anstehende
+ * Interrupts ausloest.
+ *
+ * Die Zeit wird in CPU-Takten (F_CPU) gezaehlt und ist nur zyklusgenau
+ * angenaehert: jeder Registerzugriff kostet SIM_CYCLES_PER_IO Takte fuer die
+ * umgebenden Befehle, ein SPI-Byte 8 SCK-Perioden.
+ *
+ * Weitere Peripherie (fuer die ganze Firmware mit dem Host-OS, os_host.h):
+ * Timer/Counter 0 und 1 im Normalbetrieb mit Ueberlauf-Interrupt, die USART
+ * (Senden mit UDR0-Puffer und Schieberegister, Empfang ueber
+ * sim_usart_receive()), der TWI-Master mit einem angeschlossenen Baustein und
+ * sleep_cpu() (sim_sleep()), das die Zeit bis zum naechsten Interrupt vorrueckt.
+ *
+ * Da die Register nur ueber Zeiger erreichbar sind, erkennt die Simulation
+ * Schreibzugriffe erst beim naechsten Zugriff: UDR0 gilt als geschrieben, wenn
+ * kein empfangenes Byte ansteht (RXC0 = 0); TWCR wird mit dem sonst immer 0
+ * gelesenen Bit 1 gesetzt herausgegeben, ein Schreiben ueberschreibt es.
+ * TWCR |= ... und das Loeschen von TOVn durch Schreiben einer 1 werden nicht
+ * erkannt; die Flags loescht der Interrupt.
+ */
+
+#ifndef SIM_AVR_H
+#define SIM_AVR_H
+
+#include <stdint.h>
+
+#ifndef F_CPU
+#define F_CPU 3686400UL
+#endif
+
+/* Angenommene Takte pro I/O-Zugriff inkl. umgebender Befehle. */
+#define SIM_CYCLES_PER_IO		3
+
+/* Takte fuer Interrupt-Eintritt und -Austritt inkl. Register sichern. */
+#define SIM_CYCLES_PER_ISR		40
+
+/* Adressen im Datenspeicher wie beim ATmega88PA. */
+#define SIM_PINB	0x23
+#define SIM_DDRB	0x24
+#define SIM_PORTB	0x25
+#define SIM_PINC	0x26
+#define SIM_DDRC	0x27
+#define SIM_PORTC	0x28
+#define SIM_PIND	0x29
+#define SIM_DDRD	0x2A
+#define SIM_PORTD	0x2B
+#define SIM_TIFR0	0x35
+#define SIM_TIFR1	0x36
+#define SIM_TIFR2	0x37
+#define SIM_EIFR	0x3C
+#define SIM_EIMSK	0x3D
+#define SIM_TCCR0A	0x44
+#define SIM_TCCR0B	0x45
+#define SIM_TCNT0	0x46
+#define SIM_SPCR	0x4C
+#define SIM_SPSR	0x4D
+#define SIM_SPDR	0x4E
+#define SIM_SMCR	0x53
+#define SIM_SREG	0x5F
+#define SIM_EICRA	0x69
+#define SIM_TIMSK0	0x6E
+#define SIM_TIMSK1	0x6F
+#define SIM_TIMSK2	0x70
+#define SIM_TCCR1A	0x80
+#define SIM_TCCR1B	0x81
+#define SIM_TCNT1	0x84
+#define SIM_TCCR2A	0xB0
+#define SIM_TCCR2B	0xB1
+#define SIM_TCNT2	0xB2
+#define SIM_TWBR	0xB8
+#define SIM_TWSR	0xB9
+#define SIM_TWAR	0xBA
+#define SIM_TWDR	0xBB
+#define SIM_TWCR	0xBC
+#define SIM_UCSR0A	0xC0
+#define SIM_UCSR0B	0xC1
+#define SIM_UCSR0C	0xC2
+#define SIM_UBRR0L	0xC4
+#define SIM_UBRR0H	0xC5
+#define SIM_UDR0	0xC6
+
+#define SIM_IO_SIZE	0x100
+
+/* Interruptquellen, die der Host-Build kennt, in der Rangfolge der Vektoren. */
+enum
+{
+	SIM_IRQ_INT0,			/* Vektor 1 */
+	SIM_IRQ_TIMER1_OVF,		/* Vektor 13, Tick des OS */
+	SIM_IRQ_TIMER0_OVF,		/* Vektor 16 */
+	SIM_IRQ_USART_UDRE,		/* Vektor 19 */
+	SIM_IRQ_TWI,			/* Vektor 24 */
+	SIM_IRQ_COUNT
+};
+
+/* Laengster Schritt in Takten, um den sim_sleep() die Zeit auf einmal vorrueckt
+ * (Bus und INT-Leitung werden in diesem Abstand abgefragt) */
+#define SIM_SLEEP_STEP		256
+
+/* Baustein am SPI-Bus (z.B. MCP2515): Chip-Select an B,2, INT-Leitung an D,2. */
+typedef struct
+{
+	void *context;
+	void (*select)(void *context, int active);			/* CS-Flanke: active = 1 bei LOW */
+	uint8_t (*exchange)(void *context, uint8_t mosi);	/* ein Byte tauschen */
+	int (*int_pin)(void *context);						/* Pegel der INT-Leitung (0 = aktiv) */
+} sim_spi_slave;
+
+/* Baustein am TWI (z.B. LM75), address wie in der Firmware: 7-Bit-Adresse << 1. */
+typedef struct
+{
+	void *context;
+	uint8_t address;
+	void (*start)(void *context, int read);				/* SLA+R/W mit ACK */
+	int (*write)(void *context, uint8_t data);			/* Byte vom Master, 1 = ACK */
+	uint8_t (*read)(void *context, int ack);			/* Byte an den Master, ack = Master quittiert */
+	void (*stop)(void *context);
+} sim_twi_slave;
+
+/* Simulierte Zeit in CPU-Takten seit Start. */
+extern uint64_t sim_cycles;
+
+/* Takte, die in Interrupt-Service-Routinen verbracht wurden. */
+extern uint64_t sim_isr_cycles;
+
+/* Anzahl ausgefuehrter Interrupts je Quelle. */
+extern uint32_t sim_isr_count[SIM_IRQ_COUNT];
+
+/* Takte, die die CPU in sim_sleep() geschlafen hat. */
+extern uint64_t sim_sleep_cycles;
+
+/* Zugriff auf ein 8-Bit- bzw. 16-Bit-I/O-Register (fuer die Makros aus <avr/io.h>). */
+volatile uint8_t *sim_io(uint8_t adress);
+volatile uint16_t *sim_io16(uint8_t adress);
+
+/* SPI-Baustein anschliessen. */
+void sim_attach_spi(const sim_spi_slave *slave);
+
+/* TWI-Baustein anschliessen. */
+void sim_attach_twi(const sim_twi_slave *slave);
+
+/* Empfaenger fuer die von der USART gesendeten Bytes (Zeitpunkt: Ende des Stoppbits). */
+void sim_attach_usart(void (*tx)(void *context, uint8_t data), void *context);
+
+/* Byte an den Empfaenger der USART legen (RXC0, UDR0). */
+void sim_usart_receive(uint8_t data);
+
+/* Zeitgeber, der bei jedem Vorruecken der Zeit aufgerufen wird (z.B. Busmodell). */
+void sim_attach_clock(void (*advance)(void *context, uint64_t now), void *context);
+
+/* Naechstes Ereignis ausserhalb der CPU (z.B. Ende einer Nachricht auf dem Bus,
+ * Gegenstelle) in Takten oder UINT64_MAX. Mit einer solchen Quelle springt
+ * sim_sleep() direkt zum naechsten Ereignis (Timer-Ueberlauf, USART, TWI oder
+ * next()) statt in Schritten von SIM_SLEEP_STEP (virtuelle Zeit). */
+void sim_attach_next_event(uint64_t (*next)(void *context), void *context);
+
+/* Wird nach jeder Interrupt-Service-Routine mit wieder gesetztem I-Bit aufgerufen
+ * (Taskwechsel des Host-OS am Ende des ISR). */
+void sim_attach_isr_exit(void (*isr_exit)(void));
+
+/* 1 waehrend einer Interrupt-Service-Routine. */
+int sim_in_isr(void);
+
+/* SREG ohne Zeit und Interrupts lesen und setzen (Kontextwechsel des Host-OS). */
+uint8_t sim_get_sreg(void);
+void sim_set_sreg(uint8_t sreg);
+
+/* sleep_cpu(): bei gesetztem SE in SMCR die Zeit bis zum naechsten Interrupt vorruecken. */
+void sim_sleep(void);
+
+/* Zeit um cycles Takte vorruecken, ohne dass die CPU Register anspricht (Warteschleifen). */
+void sim_delay_cycles(uint64_t cycles);
+
+/* Simulation in den Zustand nach Power-On versetzen (Register, Zeit, Bausteine). */
+void sim_reset(void);
+
+/* Globale Interruptfreigabe (sei/cli). */
+void sim_sei(void);
+void sim_cli(void);
+
+/* Zeitumrechnung. */
+#define SIM_CYCLES_TO_NS(c)		((uint64_t)(c) * 1000000000ULL / F_CPU)
+#define SIM_NS_TO_CYCLES(ns)	((uint64_t)(ns) * F_CPU / 1000000000ULL)
+
+#endif /* SIM_AVR_H */
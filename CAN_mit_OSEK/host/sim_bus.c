@@ -0,0 +1,198 @@
+/*
+ * sim_bus.c
+ *
+ * CAN-Bus der Host-Simulation, siehe sim_bus.h.
+ */
+
+#include <string.h>
+
+#include "sim_bus.h"
+
+// ----------------------------------------------------------------------------
+void sim_bus_init(sim_bus *bus, uint32_t bitrate)
+{
+	memset(bus, 0, sizeof(*bus));
+	bus->bit_ns = 1000000000UL / bitrate;
+}
+
+// ----------------------------------------------------------------------------
+uint16_t sim_bus_attach(sim_bus *bus, const sim_bus_port *port)
+{
+	bus->port[bus->ports] = *port;
+	return bus->ports++;
+}
+
+// ----------------------------------------------------------------------------
+void sim_bus_set_fault(sim_bus *bus, uint64_t from, uint64_t to)
+{
+	bus->fault_from = from;
+	bus->fault_to = to;
+}
+
+// ----------------------------------------------------------------------------
+uint64_t sim_bus_frame_ns(const sim_bus *bus, const sim_can_frame *frame)
+{
+	return (uint64_t)sim_can_frame_bits(frame) * bus->bit_ns;
+}
+
+// ----------------------------------------------------------------------------
+uint64_t sim_bus_next_event(const sim_bus *bus)
+{
+	return bus->busy ? bus->free_at : UINT64_MAX;
+}
+
+// ----------------------------------------------------------------------------
+/* Alle Teilnehmer nach ihrer naechsten Nachricht fragen und die Arbitrierung
+ * Bit fuer Bit durchfuehren. Rueckgabe: 1, wenn der Bus belegt wurde. */
+static int sim_bus_arbitrate(sim_bus *bus, uint64_t start)
+{
+	static sim_can_frame frame[SIM_BUS_MAX_PORTS];
+	static uint8_t bits[SIM_BUS_MAX_PORTS][SIM_CAN_MAX_BITS];
+	uint16_t length[SIM_BUS_MAX_PORTS];
+	uint16_t arbitration_end[SIM_BUS_MAX_PORTS];
+	uint8_t active[SIM_BUS_MAX_PORTS];
+	uint16_t count = 0;
+	uint16_t pos;
+
+	for (uint16_t i = 0; i < bus->ports; i++) {
+		if (bus->port[i].tx_next(bus->port[i].context, &frame[count])) {
+			active[count] = i;
+			length[count] = sim_can_wire_bits(&frame[count], bits[count], &arbitration_end[count]);
+			count++;
+		}
+	}
+	if (count == 0) {
+		return 0;
+	}
+
+	// SOF ist fuer alle dominant, ab Bit 1 wird arbitriert
+	for (pos = 1; count > 1; pos++) {
+		uint8_t level = 1;
+		uint8_t in_arbitration = 0;
+		uint16_t n = 0;
+
+		for (uint16_t i = 0; i < count; i++) {
+			level &= bits[i][pos];
+			if (pos <= arbitration_end[i]) {
+				in_arbitration = 1;
+			}
+		}
+
+		if (!in_arbitration) {
+			// Arbitrierungsfeld gleich: jede Abweichung ist ein Bitfehler
+			uint16_t crc_delimiter = SIM_CAN_CRC_DELIMITER(length[0]);
+
+			if (pos >= crc_delimiter) {
+				break;
+			}
+			for (uint16_t i = 1; i < count; i++) {
+				if (bits[i][pos] != bits[0][pos]) {
+					bus->busy = 1;
+					bus->error = 1;
+					bus->senders = count;
+					for (uint16_t j = 0; j < count; j++) {
+						bus->sender[j] = active[j];
+					}
+					bus->free_at = start + (uint64_t)(pos + 1 + SIM_BUS_ERROR_FRAME_BITS) * bus->bit_ns;
+					return 1;
+				}
+			}
+			continue;
+		}
+
+		// wer rezessiv sendet und dominant liest, verliert
+		for (uint16_t i = 0; i < count; i++) {
+			if (bits[i][pos] == 1 && level == 0) {
+				bus->port[active[i]].tx_done(bus->port[active[i]].context, SIM_BUS_LOST,
+					start + (uint64_t)(pos + 1) * bus->bit_ns);
+				bus->arbitration_lost++;
+				continue;
+			}
+			if (n != i) {
+				active[n] = active[i];
+				frame[n] = frame[i];
+				length[n] = length[i];
+				arbitration_end[n] = arbitration_end[i];
+				memcpy(bits[n], bits[i], length[i]);
+			}
+			n++;
+		}
+		count = n;
+	}
+
+	bus->busy = 1;
+	bus->error = 0;
+	bus->frame = frame[0];
+	bus->senders = count;
+	for (uint16_t j = 0; j < count; j++) {
+		bus->sender[j] = active[j];
+	}
+	bus->free_at = start + (uint64_t)length[0] * bus->bit_ns;
+	if (start >= bus->fault_from && start < bus->fault_to) {
+		bus->error = 1;
+		bus->free_at = start + (uint64_t)(arbitration_end[0] + 1 + SIM_BUS_ERROR_FRAME_BITS) * bus->bit_ns;
+	}
+	return 1;
+}
+
+// ----------------------------------------------------------------------------
+static int is_sender(const sim_bus *bus, uint16_t port)
+{
+	for (uint16_t j = 0; j < bus->senders; j++) {
+		if (bus->sender[j] == port) {
+			return 1;
+		}
+	}
+	return 0;
+}
+
+// ----------------------------------------------------------------------------
+void sim_bus_advance(sim_bus *bus, uint64_t now)
+{
+	for (;;) {
+		if (bus->busy) {
+			if (bus->free_at > now) {
+				break;
+			}
+
+			bus->busy = 0;
+			if (bus->error) {
+				// Error-Frame: alle beteiligten Sender wiederholen spaeter
+				bus->errors++;
+				for (uint16_t j = 0; j < bus->senders; j++) {
+					bus->port[bus->sender[j]].tx_done(bus->port[bus->sender[j]].context,
+						SIM_BUS_ERROR, bus->free_at);
+				}
+				for (uint16_t i = 0; i < bus->ports; i++) {
+					if (!is_sender(bus, i) && bus->port[i].rx_error) {
+						bus->port[i].rx_error(bus->port[i].context, bus->free_at);
+					}
+				}
+				continue;
+			}
+
+			// Nachricht vollstaendig: Sender bestaetigen, alle anderen empfangen
+			bus->frames++;
+			bus->busy_ns += sim_bus_frame_ns(bus, &bus->frame);
+			for (uint16_t j = 0; j < bus->senders; j++) {
+				bus->port[bus->sender[j]].tx_done(bus->port[bus->sender[j]].context,
+					SIM_BUS_WON, bus->free_at);
+			}
+			for (uint16_t i = 0; i < bus->ports; i++) {
+				if (!is_sender(bus, i)) {
+					bus->port[i].rx(bus->port[i].context, &bus->frame, bus->free_at);
+				}
+			}
+			continue;
+		}
+
+		// Bus frei: eine seit dem letzten Aufruf angeforderte Nachricht startet
+		// fruehestens mit dem Ende der vorherigen
+		uint64_t start = (bus->free_at > bus->now) ? bus->free_at : bus->now;
+
+		if (start > now || !sim_bus_arbitrate(bus, start)) {
+			break;
+		}
+	}
+	bus->now = now;
+}
@@ -0,0 +1,107 @@
+/*
+ * sim_bus.h
+ *
+ * CAN-Bus der Host-Simulation. An den Bus werden Teilnehmer (Ports) gehaengt,
+ * die Nachrichten zum Senden anbieten und empfangene Nachrichten erhalten.
+ *
+ * Die Arbitrierung ist bitgenau: ab SOF werden die gestopften Bitstroeme aller
+ * sendebereiten Teilnehmer Bit fuer Bit verUNDet (dominant = 0), wer rezessiv
+ * sendet und dominant liest, verliert an dieser Bitposition. Senden nach der
+ * Arbitrierung noch mehrere Teilnehmer (gleiches Arbitrierungsfeld), erkennt der
+ * erste, der ein abweichendes rezessives Bit sendet, einen Bitfehler und es folgt
+ * ein Error-Frame; sind die Nachrichten identisch, gelten alle als gesendet.
+ * Der Bus ist fuer die Laenge des Bitstroms (inkl. Stopfbits und Intermission)
+ * belegt. Die Zeit wird in Nanosekunden gezaehlt.
+ *
+ * Mit sim_bus_set_fault() wird der Bus fuer eine Zeit gestoert (z.B. Wackler
+ * im Kabel): jede Nachricht, die darin beginnt, endet nach dem
+ * Arbitrierungsfeld mit einem Error-Frame.
+ */
+
+#ifndef SIM_BUS_H
+#define SIM_BUS_H
+
+#include <stdint.h>
+
+#include "sim_can.h"
+
+#define SIM_BUS_MAX_PORTS	128
+
+/* Error-Flag (6), Error-Delimiter (8) und Intermission (3) */
+#define SIM_BUS_ERROR_FRAME_BITS	17
+
+/* Ergebnis einer angebotenen Nachricht fuer tx_done() */
+enum
+{
+	SIM_BUS_LOST,			/* Arbitrierung verloren */
+	SIM_BUS_WON,			/* Nachricht fehlerfrei gesendet */
+	SIM_BUS_ERROR			/* Bitfehler, Error-Frame gesendet */
+};
+
+typedef struct
+{
+	void *context;
+
+	/* Naechste Nachricht zum Senden liefern (1) oder 0, wenn nichts ansteht. */
+	int (*tx_next)(void *context, sim_can_frame *frame);
+
+	/* Ergebnis der angebotenen Nachricht (SIM_BUS_LOST, _WON, _ERROR), now ist
+	 * der Zeitpunkt, zu dem der Sender es erkennt. */
+	void (*tx_done)(void *context, int result, uint64_t now);
+
+	/* Nachricht eines anderen Teilnehmers empfangen. */
+	void (*rx)(void *context, const sim_can_frame *frame, uint64_t now);
+
+	/* Optional: Error-Frame in einer Nachricht eines anderen Teilnehmers. */
+	void (*rx_error)(void *context, uint64_t now);
+} sim_bus_port;
+
+typedef struct
+{
+	sim_bus_port port[SIM_BUS_MAX_PORTS];
+	uint16_t ports;
+
+	uint32_t bit_ns;			/* Bitzeit */
+	uint64_t now;				/* letzter Zeitpunkt von sim_bus_advance() */
+	uint64_t free_at;			/* Ende der laufenden Nachricht bzw. des Error-Frames */
+
+	/* laufende Nachricht: Sender mit gleichem Bitstrom bis zum Ende */
+	uint8_t busy;
+	uint8_t error;
+	uint8_t sender[SIM_BUS_MAX_PORTS];
+	uint16_t senders;
+	sim_can_frame frame;
+
+	/* Stoerung: Nachrichten mit Beginn in [fault_from, fault_to) */
+	uint64_t fault_from;
+	uint64_t fault_to;
+
+	/* Statistik */
+	uint64_t frames;
+	uint64_t errors;
+	uint64_t busy_ns;
+	uint64_t arbitration_lost;
+} sim_bus;
+
+void sim_bus_init(sim_bus *bus, uint32_t bitrate);
+
+/* Teilnehmer anhaengen, Rueckgabe: Portnummer. */
+uint16_t sim_bus_attach(sim_bus *bus, const sim_bus_port *port);
+
+/* Bus bis zum Zeitpunkt now (ns) laufen lassen. Nachrichten, die seit dem
+ * letzten Aufruf angeboten werden, starten fruehestens zum Zeitpunkt des letzten
+ * Aufrufs: wer den Bus ereignisgesteuert betreibt, ruft sim_bus_advance() vor
+ * und nach dem Bearbeiten der Ereignisse eines Zeitpunkts auf. */
+void sim_bus_advance(sim_bus *bus, uint64_t now);
+
+/* Zeitpunkt, zu dem der Bus das naechste Mal etwas zu tun hat (Ende der
+ * laufenden Nachricht), oder UINT64_MAX, wenn er frei ist. */
+uint64_t sim_bus_next_event(const sim_bus *bus);
+
+/* Bus von from bis to (ns) stoeren. */
+void sim_bus_set_fault(sim_bus *bus, uint64_t from, uint64_t to);
+
+/* Dauer einer Nachricht auf dem Bus in ns. */
+uint64_t sim_bus_frame_ns(const sim_bus *bus, const sim_can_frame *frame);
+
+#endif /* SIM_BUS_H */
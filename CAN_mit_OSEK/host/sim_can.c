@@ -0,0 +1,180 @@
+/*
+ * sim_can.c
+ *
+ * Bitstrom einer CAN-Nachricht (ISO 11898-1, klassisches CAN) fuer die
+ * Host-Simulation.
+ */
+
+#include <string.h>
+
+#include "sim_can.h"
+
+// ----------------------------------------------------------------------------
+uint16_t sim_can_crc15(const uint8_t *bits, uint16_t n)
+{
+	uint16_t crc = 0;
+
+	for (uint16_t i = 0; i < n; i++) {
+		uint8_t next = bits[i] ^ ((crc >> 14) & 1);
+
+		crc = (crc << 1) & 0x7fff;
+		if (next) {
+			crc ^= 0x4599;
+		}
+	}
+	return crc;
+}
+
+// ----------------------------------------------------------------------------
+static uint16_t put_bits(uint8_t *bits, uint16_t pos, uint32_t value, uint8_t count)
+{
+	while (count--) {
+		bits[pos++] = (value >> count) & 1;
+	}
+	return pos;
+}
+
+// ----------------------------------------------------------------------------
+uint16_t sim_can_raw_bits(const sim_can_frame *frame, uint8_t *bits)
+{
+	uint16_t n = 0;
+	uint8_t length = frame->length & 0x0f;
+	uint8_t bytes = (frame->rtr) ? 0 : ((length > 8) ? 8 : length);
+
+	// SOF
+	bits[n++] = 0;
+
+	if (frame->id & CAN_ID_EXT) {
+		uint32_t id = frame->id & CAN_ID_EXT_MASK;
+
+		n = put_bits(bits, n, id >> 18, 11);	// Basis-ID
+		bits[n++] = 1;							// SRR
+		bits[n++] = 1;							// IDE
+		n = put_bits(bits, n, id, 18);			// ID-Erweiterung
+		bits[n++] = frame->rtr ? 1 : 0;			// RTR
+		bits[n++] = 0;							// r1
+		bits[n++] = 0;							// r0
+	}
+	else {
+		n = put_bits(bits, n, frame->id, 11);
+		bits[n++] = frame->rtr ? 1 : 0;			// RTR
+		bits[n++] = 0;							// IDE
+		bits[n++] = 0;							// r0
+	}
+
+	n = put_bits(bits, n, length, 4);
+	for (uint8_t i = 0; i < bytes; i++) {
+		n = put_bits(bits, n, frame->data[i], 8);
+	}
+
+	return put_bits(bits, n, sim_can_crc15(bits, n), 15);
+}
+
+// ----------------------------------------------------------------------------
+uint16_t sim_can_wire_bits(const sim_can_frame *frame, uint8_t *bits, uint16_t *arbitration_end)
+{
+	uint8_t raw[SIM_CAN_MAX_BITS];
+	uint16_t count = sim_can_raw_bits(frame, raw);
+	uint16_t n = 0;
+	uint8_t run = 0;
+	uint8_t last = 2;
+
+	// Stopfbits: nach 5 gleichen Bits folgt ein inverses Bit, das selbst mitzaehlt
+	for (uint16_t i = 0; i < count; i++) {
+		if (arbitration_end && i == sim_can_arbitration_bits(frame)) {
+			*arbitration_end = n;
+		}
+		bits[n++] = raw[i];
+		if (raw[i] == last) {
+			run++;
+		}
+		else {
+			last = raw[i];
+			run = 1;
+		}
+		if (run == 5) {
+			last = !last;
+			bits[n++] = last;
+			run = 1;
+		}
+	}
+
+	bits[n++] = 1;		// CRC-Delimiter
+	bits[n++] = 0;		// ACK-Slot (von den Empfaengern dominant ueberschrieben)
+	for (uint8_t i = 0; i < SIM_CAN_TAIL_BITS - 2; i++) {
+		bits[n++] = 1;	// ACK-Delimiter, EOF, Intermission
+	}
+	return n;
+}
+
+// ----------------------------------------------------------------------------
+uint16_t sim_can_frame_bits(const sim_can_frame *frame)
+{
+	uint8_t bits[SIM_CAN_MAX_BITS];
+
+	return sim_can_wire_bits(frame, bits, NULL);
+}
+
+// ----------------------------------------------------------------------------
+uint8_t sim_can_arbitration_bits(const sim_can_frame *frame)
+{
+	return (frame->id & CAN_ID_EXT) ? 32 : 13;
+}
+
+// ----------------------------------------------------------------------------
+int sim_can_arbitration_compare(const sim_can_frame *a, const sim_can_frame *b)
+{
+	uint8_t bits_a[SIM_CAN_MAX_BITS];
+	uint8_t bits_b[SIM_CAN_MAX_BITS];
+	uint8_t n_a = sim_can_arbitration_bits(a);
+	uint8_t n_b = sim_can_arbitration_bits(b);
+
+	sim_can_raw_bits(a, bits_a);
+	sim_can_raw_bits(b, bits_b);
+
+	// das erste abweichende Bit entscheidet, dominant (0) gewinnt
+	for (uint8_t i = 1; i <= n_a && i <= n_b; i++) {
+		if (bits_a[i] != bits_b[i]) {
+			return (bits_a[i] == 0) ? -1 : 1;
+		}
+	}
+	return 0;
+}
+
+// ----------------------------------------------------------------------------
+void sim_can_from_tcanframe(sim_can_frame *frame, const tCANFrame *message)
+{
+	memset(frame, 0, sizeof(*frame));
+	frame->id = message->id;
+	frame->rtr = (message->flags & CAN_FRAME_RTR) ? 1 : 0;
+	frame->length = message->length;
+	if (!frame->rtr) {
+		memcpy(frame->data, message->data, (frame->length > 8) ? 8 : frame->length);
+	}
+}
+
+// ----------------------------------------------------------------------------
+void sim_can_to_tcanframe(tCANFrame *message, const sim_can_frame *frame)
+{
+	memset(message, 0, sizeof(*message));
+	message->id = frame->id;
+	message->flags = frame->rtr ? CAN_FRAME_RTR : 0;
+	message->length = frame->length;
+	if (!frame->rtr) {
+		memcpy(message->data, frame->data, (frame->length > 8) ? 8 : frame->length);
+	}
+}
+
+// ----------------------------------------------------------------------------
+int sim_can_frame_compare(const sim_can_frame *a, const sim_can_frame *b)
+{
+	uint8_t length = (a->length > 8) ? 8 : a->length;
+
+	if (a->id != b->id || a->rtr != b->rtr || a->length != b->length) {
+		return 1;
+	}
+	if (a->rtr) {
+		return 0;
+	}
+	return memcmp(a->data, b->data, length) != 0;
+}
@@ -0,0 +1,65 @@
+/*
+ * sim_can.h
+ *
+ * CAN-Nachricht auf Bitebene fuer die Host-Simulation: Aufbau des Bitstroms
+ * (SOF bis EOF inkl. Stopfbits und CRC-15) und Vergleich zweier Nachrichten in
+ * der Arbitrierung. IDs wie in tCANFrame, Extended IDs mit gesetztem CAN_ID_EXT.
+ * Nur klassisches CAN, CAN FD bildet die Simulation nicht nach.
+ */
+
+#ifndef SIM_CAN_H
+#define SIM_CAN_H
+
+#include <stdint.h>
+
+#include "mcp2515.h"
+
+/* Laengster moeglicher Bitstrom (Extended, 8 Byte, alle Stopfbits) inkl. Zwischenraum. */
+#define SIM_CAN_MAX_BITS	160
+
+/* Bits nach dem CRC-Feld: CRC-Delimiter, ACK, ACK-Delimiter, EOF (7) und Intermission (3). */
+#define SIM_CAN_TAIL_BITS	13
+
+typedef struct
+{
+	uint32_t id;
+	uint8_t rtr;
+	uint8_t length;
+	uint8_t data[8];
+} sim_can_frame;
+
+/* CRC-15 ueber n Bits (Polynom 0x4599), bits[i] = 0 (dominant) oder 1 (rezessiv). */
+uint16_t sim_can_crc15(const uint8_t *bits, uint16_t n);
+
+/* Bitstrom der Nachricht ohne Stopfbits von SOF bis einschliesslich CRC.
+ * Rueckgabe: Anzahl der Bits. */
+uint16_t sim_can_raw_bits(const sim_can_frame *frame, uint8_t *bits);
+
+/* Bitstrom wie auf dem Bus: mit Stopfbits, ACK-Slot dominant, EOF und
+ * Intermission. Rueckgabe: Anzahl der Bits (= Belegung des Busses in Bitzeiten).
+ * arbitration_end (darf NULL sein) erhaelt die Position des letzten Bits des
+ * Arbitrierungsfeldes im Bitstrom. */
+uint16_t sim_can_wire_bits(const sim_can_frame *frame, uint8_t *bits, uint16_t *arbitration_end);
+
+/* Position des CRC-Delimiters im Bitstrom (Ende des gestopften Bereichs). */
+#define SIM_CAN_CRC_DELIMITER(wire_bits)	((wire_bits) - SIM_CAN_TAIL_BITS)
+
+/* Nur die Laenge von sim_can_wire_bits(). */
+uint16_t sim_can_frame_bits(const sim_can_frame *frame);
+
+/* Bits ohne SOF, in denen die Arbitrierung entschieden wird (ID, RTR, IDE bzw.
+ * ID, SRR, IDE, ID-Erweiterung, RTR): 13 bzw. 32 Bit. */
+uint8_t sim_can_arbitration_bits(const sim_can_frame *frame);
+
+/* Arbitrierung: < 0 wenn a gewinnt, > 0 wenn b gewinnt, 0 bei gleichem
+ * Arbitrierungsfeld (auf einem echten Bus ein Bitfehler im Steuerfeld). */
+int sim_can_arbitration_compare(const sim_can_frame *a, const sim_can_frame *b);
+
+/* Umwandlung zwischen tCANFrame (can.h) und sim_can_frame. */
+void sim_can_from_tcanframe(sim_can_frame *frame, const tCANFrame *message);
+void sim_can_to_tcanframe(tCANFrame *message, const sim_can_frame *frame);
+
+/* Vergleich zweier Nachrichten (ID, RTR, DLC und Nutzdaten). 0 = gleich. */
+int sim_can_frame_compare(const sim_can_frame *a, const sim_can_frame *b);
+
+#endif /* SIM_CAN_H */
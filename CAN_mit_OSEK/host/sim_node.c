@@ -0,0 +1,483 @@
+/*
+ * sim_node.c
+ *
+ * Verhaltensmodelle der Teilnehmer am virtuellen CAN-Bus, siehe sim_node.h.
+ */
+
+#include <string.h>
+
+#include "sim_node.h"
+
+// ----------------------------------------------------------------------------
+void sim_node_init(sim_node *node, uint16_t index, uint64_t phase_ns, int32_t ppm, uint64_t deadline_ns)
+{
+	memset(node, 0, sizeof(*node));
+	node->index = index;
+	node->temperatur_id = SIM_NODE_TEMPERATUR_ID + index;
+	node->status_led_id = SIM_NODE_STATUS_LED_ID + index;
+	node->tick_ns = (uint32_t)(SIM_NODE_TICK_NS + (int64_t)SIM_NODE_TICK_NS * ppm / 1000000);
+	node->tick_at = phase_ns;
+	node->offered = -1;
+	node->deadline_ns = deadline_ns;
+
+	// LM75: 0,125 Grad je Bit, Startwert je Knoten verschieden
+	node->temperatur = 8 * 21 + (index % 16);
+}
+
+// ----------------------------------------------------------------------------
+/* mcp2515_send_message(): freien Sendepuffer laden, sonst nach Prioritaet in
+ * die Warteschlange einreihen. Rueckgabe: Rechenzeit. */
+static uint64_t node_send(sim_node *node, const sim_can_frame *frame, uint64_t now, uint64_t activated_at)
+{
+	uint8_t i;
+
+	for (uint8_t b = 0; b < 3; b++) {
+		if (node->hw[b].state == SIM_NODE_HW_FREE && node->queued == 0) {
+			node->hw[b].state = SIM_NODE_HW_LOADING;
+			node->hw[b].at = now + SIM_NODE_SEND_NS;
+			node->hw[b].frame = *frame;
+			node->hw[b].activated_at = activated_at;
+			return SIM_NODE_SEND_NS;
+		}
+	}
+
+	if (node->queued == SIM_NODE_TX_QUEUE) {
+		node->tx_dropped++;
+		return SIM_NODE_SEND_NS;
+	}
+	for (i = node->queued; i > 0 && node->queue[i - 1].id > frame->id; i--) {
+		node->queue[i] = node->queue[i - 1];
+		node->queue_activated_at[i] = node->queue_activated_at[i - 1];
+	}
+	node->queue[i] = *frame;
+	node->queue_activated_at[i] = activated_at;
+	node->queued++;
+	return SIM_NODE_SEND_NS;
+}
+
+// ----------------------------------------------------------------------------
+static void node_temperatur(const sim_node *node, sim_can_frame *frame)
+{
+	memset(frame, 0, sizeof(*frame));
+	frame->id = node->temperatur_id;
+	frame->length = CAN_DB_TEMPERATUR_DLC;
+	can_db_pack_temperatur_signal(frame->data, node->temperatur);
+}
+
+static void node_status_led(const sim_node *node, sim_can_frame *frame, uint8_t on)
+{
+	memset(frame, 0, sizeof(*frame));
+	frame->id = node->status_led_id;
+	frame->length = CAN_DB_STATUS_LED_DLC;
+	can_db_pack_status_led_signal(frame->data, on ? CAN_DB_STATUS_LED_SIGNAL_AN : CAN_DB_STATUS_LED_SIGNAL_AUS);
+}
+
+// ----------------------------------------------------------------------------
+/* Task1: Ringpuffer abarbeiten, Nachrichten ab ready_at <= cpu. Rueckgabe:
+ * Ende der Bearbeitung. */
+static uint64_t node_task1(sim_node *node, uint64_t cpu, uint64_t now)
+{
+	sim_can_frame frame;
+
+	while (node->rx_count && node->rx_ready_at[node->rx_head] <= cpu) {
+		const sim_can_frame *message = &node->rx[node->rx_head];
+		uint64_t latency = cpu - (node->rx_ready_at[node->rx_head] - SIM_NODE_RX_ISR_NS);
+
+		node->rx_head = (node->rx_head + 1) % SIM_NODE_RX_RING;
+		node->rx_count--;
+		cpu += SIM_NODE_GET_NS;
+
+		node->rx_latency_sum += latency;
+		node->rx_latency_count++;
+		if (latency > node->rx_latency_max) {
+			node->rx_latency_max = latency;
+		}
+
+		if (message->id != SIM_NODE_TASTER_ID) {
+			continue;
+		}
+		uint8_t taster = can_db_unpack_taster_signal(message->data);
+
+		if (taster == CAN_DB_TASTER_SIGNAL_MESSUNG_STARTEN && node->zustand_messung == 0) {
+			node->task2_tick = node->ticks + 1;
+			node_status_led(node, &frame, 1);
+			cpu += node_send(node, &frame, cpu, now);
+			node->zustand_messung = 1;
+		}
+		if (taster == CAN_DB_TASTER_SIGNAL_MESSUNG_STOPPEN && node->zustand_messung == 1) {
+			node->task2_tick = 0;
+			node_temperatur(node, &frame);
+			cpu += node_send(node, &frame, cpu, now);
+			node_status_led(node, &frame, 0);
+			cpu += node_send(node, &frame, cpu, now);
+			node->zustand_messung = 0;
+		}
+	}
+	return cpu + SIM_NODE_POLL_NS;
+}
+
+// ----------------------------------------------------------------------------
+/* OS-Tick: Task2 (hoehere Prioritaet) startet die TWI-Uebertragung und wartet,
+ * Task1 laeuft, danach sendet Task2 die Temperatur */
+static void node_tick(sim_node *node, uint64_t now)
+{
+	uint64_t cpu = now + SIM_NODE_TICK_ISR_NS;
+	uint64_t twi_done = 0;
+	uint8_t task1;
+	sim_can_frame frame;
+
+	node->ticks++;
+	task1 = node->rx_event ? node->ticks % SIM_NODE_HOUSEKEEPING_TICKS == 0
+		: node->ticks % SIM_NODE_POLL_TICKS == 0;
+
+
+	if (node->task2_tick && node->ticks == node->task2_tick) {
+		node->task2_tick += SIM_NODE_TASK2_TICKS;
+
+		// Task2: LM75_start_read(), dann WaitEvent() bis zum Ende der TWI-Uebertragung
+		cpu += SIM_NODE_SWITCH_NS + SIM_NODE_TWI_START_NS;
+		twi_done = cpu + SIM_NODE_READTEMP_NS;
+		if ((node->ticks / SIM_NODE_TASK2_TICKS) % 8 == 0) {
+			node->temperatur ^= 1;
+		}
+	}
+
+	// Task1: Alarm1 alle 10 ms bzw. mit rx_event nur fuer OS_STAT_POLL()
+	if (task1) {
+		cpu = node_task1(node, cpu + SIM_NODE_SWITCH_NS, now);
+	}
+	node->busy_ns += cpu - now;
+
+	// Task2 laeuft nach EV_TEMP_READY weiter, aber erst wenn Task1 fertig ist
+	if (twi_done) {
+		if (twi_done > cpu) {
+			cpu = twi_done;
+		}
+		node->busy_ns += SIM_NODE_SWITCH_NS + SIM_NODE_SEND_NS;
+		cpu += SIM_NODE_SWITCH_NS;
+		node_temperatur(node, &frame);
+		cpu += node_send(node, &frame, cpu, now);
+	}
+
+	node->cpu_free_at = cpu;
+	node->tick_at += node->tick_ns;
+}
+
+// ----------------------------------------------------------------------------
+/* rx_event: SetEvent() im Empfangs-ISR, Task1 laeuft, sobald die CPU frei ist */
+static uint64_t node_rx_event_at(const sim_node *node)
+{
+	uint64_t at;
+
+	if (!node->rx_event || node->rx_count == 0) {
+		return UINT64_MAX;
+	}
+	at = node->rx_ready_at[node->rx_head];
+	return (at > node->cpu_free_at) ? at : node->cpu_free_at;
+}
+
+static void node_rx_event(sim_node *node, uint64_t now)
+{
+	uint64_t cpu = node_task1(node, now + SIM_NODE_SWITCH_NS, now);
+
+	node->busy_ns += cpu - now;
+	node->cpu_free_at = cpu;
+}
+
+// ----------------------------------------------------------------------------
+uint64_t sim_node_next_event(const sim_node *node)
+{
+	uint64_t next = node->tick_at;
+
+	if (node_rx_event_at(node) < next) {
+		next = node_rx_event_at(node);
+	}
+	for (uint8_t b = 0; b < 3; b++) {
+		if ((node->hw[b].state == SIM_NODE_HW_LOADING || node->hw[b].state == SIM_NODE_HW_SENT)
+			&& node->hw[b].at < next) {
+			next = node->hw[b].at;
+		}
+	}
+	return next;
+}
+
+// ----------------------------------------------------------------------------
+void sim_node_run(sim_node *node, uint64_t now)
+{
+	uint64_t next;
+
+	while ((next = sim_node_next_event(node)) <= now) {
+		uint8_t b;
+
+		for (b = 0; b < 3; b++) {
+			if ((node->hw[b].state == SIM_NODE_HW_LOADING || node->hw[b].state == SIM_NODE_HW_SENT)
+				&& node->hw[b].at == next) {
+				break;
+			}
+		}
+		if (b == 3) {
+			if (node_rx_event_at(node) == next) {
+				node_rx_event(node, next);
+			}
+			else {
+				node_tick(node, next);
+			}
+			continue;
+		}
+
+		if (node->hw[b].state == SIM_NODE_HW_LOADING) {
+			node->hw[b].state = SIM_NODE_HW_PENDING;
+		}
+		else if (node->queued) {
+			// Sende-ISR laedt die Nachricht mit der hoechsten Prioritaet nach
+			node->hw[b].state = SIM_NODE_HW_PENDING;
+			node->hw[b].frame = node->queue[0];
+			node->hw[b].activated_at = node->queue_activated_at[0];
+			node->queued--;
+			memmove(&node->queue[0], &node->queue[1], node->queued * sizeof(node->queue[0]));
+			memmove(&node->queue_activated_at[0], &node->queue_activated_at[1],
+				node->queued * sizeof(node->queue_activated_at[0]));
+		}
+		else {
+			node->hw[b].state = SIM_NODE_HW_FREE;
+		}
+	}
+}
+
+// ----------------------------------------------------------------------------
+static int node_tx_next(void *context, sim_can_frame *frame)
+{
+	sim_node *node = context;
+	int8_t best = -1;
+
+	// mcp2515.c vergibt TXP nach der ID: die kleinste ID geht zuerst
+	for (uint8_t b = 0; b < 3; b++) {
+		if (node->hw[b].state == SIM_NODE_HW_PENDING
+			&& (best < 0 || node->hw[b].frame.id < node->hw[best].frame.id)) {
+			best = b;
+		}
+	}
+	if (best < 0) {
+		return 0;
+	}
+	*frame = node->hw[best].frame;
+	node->offered = best;
+	return 1;
+}
+
+static void node_tx_done(void *context, int result, uint64_t now)
+{
+	sim_node *node = context;
+	uint8_t b = node->offered;
+
+	node->offered = -1;
+	if (result == SIM_BUS_ERROR) {
+		node->tx_errors++;
+	}
+	if (result != SIM_BUS_WON) {
+		return;
+	}
+
+	node->tx_frames++;
+	node->busy_ns += SIM_NODE_TX_ISR_NS;
+	if (node->hw[b].frame.id == node->temperatur_id) {
+		uint64_t response = now - node->hw[b].activated_at;
+
+		node->temperatur_sent++;
+		if (response > node->temperatur_response_max) {
+			node->temperatur_response_max = response;
+		}
+		if (response > node->deadline_ns) {
+			node->temperatur_missed++;
+		}
+	}
+	node->hw[b].state = SIM_NODE_HW_SENT;
+	node->hw[b].at = now + SIM_NODE_TX_ISR_NS;
+}
+
+static void node_rx(void *context, const sim_can_frame *frame, uint64_t now)
+{
+	sim_node *node = context;
+
+	// Akzeptanzfilter laut CAN_DB_RX_FILTER_IDS
+	if (frame->id != SIM_NODE_TASTER_ID) {
+		return;
+	}
+	node->busy_ns += SIM_NODE_RX_ISR_NS;
+	if (node->rx_count == SIM_NODE_RX_RING) {
+		node->rx_dropped++;
+		return;
+	}
+
+	uint8_t i = (node->rx_head + node->rx_count) % SIM_NODE_RX_RING;
+
+	node->rx[i] = *frame;
+	node->rx_ready_at[i] = now + SIM_NODE_RX_ISR_NS;
+	node->rx_count++;
+}
+
+// ----------------------------------------------------------------------------
+void sim_node_attach(sim_node *node, sim_bus *bus)
+{
+	sim_bus_port port = { node, node_tx_next, node_tx_done, node_rx, 0 };
+
+	sim_bus_attach(bus, &port);
+}
+
+// ----------------------------------------------------------------------------
+void sim_panel_init(sim_panel *panel, uint16_t nodes, uint64_t start_at, uint64_t measure_ns,
+	uint32_t cycles, uint64_t jitter_ns, uint64_t led_deadline_ns)
+{
+	memset(panel, 0, sizeof(*panel));
+	panel->nodes = nodes;
+	panel->start_at = start_at;
+	panel->stop_at = start_at + measure_ns;
+	panel->cycle_ns = measure_ns + measure_ns / 2;
+	panel->cycles = cycles;
+	panel->jitter_ns = jitter_ns;
+	panel->led_deadline_ns = led_deadline_ns;
+	for (uint16_t i = 0; i < nodes; i++) {
+		panel->node[i].period_min = UINT64_MAX;
+	}
+}
+
+// ----------------------------------------------------------------------------
+uint64_t sim_panel_next_event(const sim_panel *panel)
+{
+	if (panel->cycles == 0) {
+		return UINT64_MAX;
+	}
+	return panel->measuring ? panel->stop_at : panel->start_at;
+}
+
+// ----------------------------------------------------------------------------
+/* Knoepfe "Messung starten" und "Messung stoppen" im Wechsel druecken */
+void sim_panel_run(sim_panel *panel, uint64_t now)
+{
+	while (sim_panel_next_event(panel) <= now) {
+		if (!panel->measuring) {
+			panel->tx_signal = 1;
+			panel->tx_requested = panel->start_at;
+			panel->measuring = 1;
+			for (uint16_t i = 0; i < panel->nodes; i++) {
+				panel->node[i].waiting_led = 1;
+				panel->node[i].waiting_temp = 1;
+				panel->node[i].last_temp = 0;
+			}
+		}
+		else {
+			panel->tx_signal = 0;
+			panel->tx_requested = panel->stop_at;
+			panel->measuring = 0;
+			panel->start_at += panel->cycle_ns;
+			panel->stop_at += panel->cycle_ns;
+			panel->cycles--;
+			for (uint16_t i = 0; i < panel->nodes; i++) {
+				panel->node[i].waiting_led = 1;
+			}
+		}
+		panel->tx_pending = 1;
+	}
+}
+
+// ----------------------------------------------------------------------------
+static int panel_tx_next(void *context, sim_can_frame *frame)
+{
+	sim_panel *panel = context;
+
+	if (!panel->tx_pending) {
+		return 0;
+	}
+	memset(frame, 0, sizeof(*frame));
+	frame->id = SIM_NODE_TASTER_ID;
+	frame->length = CAN_DB_TASTER_DLC;
+	can_db_pack_taster_signal(frame->data, panel->tx_signal ? CAN_DB_TASTER_SIGNAL_MESSUNG_STARTEN
+		: CAN_DB_TASTER_SIGNAL_MESSUNG_STOPPEN);
+	return 1;
+}
+
+static void panel_tx_done(void *context, int result, uint64_t now)
+{
+	sim_panel *panel = context;
+
+	(void)now;
+	if (result == SIM_BUS_WON) {
+		panel->tx_pending = 0;
+	}
+}
+
+static void panel_rx(void *context, const sim_can_frame *frame, uint64_t now)
+{
+	sim_panel *panel = context;
+	uint64_t latency = now - panel->tx_requested;
+	sim_panel_node *node;
+
+	if (frame->id >= SIM_NODE_TEMPERATUR_ID && frame->id < SIM_NODE_TEMPERATUR_ID + (uint32_t)panel->nodes) {
+		node = &panel->node[frame->id - SIM_NODE_TEMPERATUR_ID];
+
+		if (!panel->measuring) {
+			// letzte Temperatur beim Stoppen
+			return;
+		}
+		if (node->waiting_temp) {
+			node->waiting_temp = 0;
+			node->first_temp_sum += latency;
+			node->first_temp_count++;
+			if (latency > node->first_temp_max) {
+				node->first_temp_max = latency;
+			}
+		}
+		if (node->last_temp) {
+			uint64_t period = now - node->last_temp;
+			uint64_t nominal = SIM_NODE_TASK2_TICKS * SIM_NODE_TICK_NS;
+			uint64_t deviation = (period > nominal) ? period - nominal : nominal - period;
+
+			node->periods++;
+			if (period < node->period_min) {
+				node->period_min = period;
+			}
+			if (period > node->period_max) {
+				node->period_max = period;
+			}
+			if (deviation > panel->jitter_ns) {
+				node->period_missed++;
+			}
+		}
+		node->last_temp = now;
+	}
+	else if (frame->id >= SIM_NODE_STATUS_LED_ID && frame->id < SIM_NODE_STATUS_LED_ID + (uint32_t)panel->nodes) {
+		node = &panel->node[frame->id - SIM_NODE_STATUS_LED_ID];
+
+		uint8_t led = can_db_unpack_status_led_signal(frame->data);
+
+		if (!node->waiting_led || (led == CAN_DB_STATUS_LED_SIGNAL_AN) != panel->measuring) {
+			return;
+		}
+		node->waiting_led = 0;
+		if (latency > panel->led_deadline_ns) {
+			panel->led_missed++;
+		}
+		if (led == CAN_DB_STATUS_LED_SIGNAL_AN) {
+			node->led_on_sum += latency;
+			node->led_on_count++;
+			if (latency > node->led_on_max) {
+				node->led_on_max = latency;
+			}
+		}
+		else {
+			node->led_off_sum += latency;
+			node->led_off_count++;
+			if (latency > node->led_off_max) {
+				node->led_off_max = latency;
+			}
+		}
+	}
+}
+
+// ----------------------------------------------------------------------------
+void sim_panel_attach(sim_panel *panel, sim_bus *bus)
+{
+	sim_bus_port port = { panel, panel_tx_next, panel_tx_done, panel_rx, 0 };
+
+	sim_bus_attach(bus, &port);
+}
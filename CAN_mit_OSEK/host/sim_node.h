@@ -0,0 +1,193 @@
+/*
+ * sim_node.h
+ *
+ * Verhaltensmodelle der Teilnehmer am virtuellen CAN-Bus (vbus.c):
+ *
+ * - Temperaturknoten: bildet main.c auf Ebene der Tasks nach. Alarm1 aktiviert
+ *   Task1 alle 10 ms, die den Empfangsringpuffer abarbeitet und
+ *   auf die Taster-Nachricht wie main.c reagiert; Alarm2 aktiviert Task2 alle
+ *   100 ms, die das LM75 im TWI-ISR auslesen laesst, mit WaitEvent() wartet
+ *   und die Temperatur sendet. Beide Tasks sind NON_PREEMPTIVE, Task2 hat die
+ *   hoehere Prioritaet; Task1 laeuft, waehrend Task2 wartet. Gesendet wird
+ *   wie in mcp2515.c ueber drei Sendepuffer (Bus-Prioritaet nach ID) und eine
+ *   Warteschlange, die die Sende-ISR nachlaedt.
+ *   Mit rx_event (CAN_RX_POLLING 0 in Os_Cfg.h) wartet Task1 stattdessen auf
+ *   EV_CAN_RX aus dem Empfangs-ISR und laeuft, sobald die CPU frei ist (im
+ *   Modell erst nach dem Ende von Task2); der Tick weckt sie nur alle
+ *   SIM_NODE_HOUSEKEEPING_TICKS. Gezaehlt werden die Rechenzeit (Tasks und
+ *   ISRs) und die Zeit vom Empfang bis zur Bearbeitung in Task1. Der OS-Tick
+ *   (1 ms) kostet in jedem Tick die Zeit des Tick-ISR.
+ *
+ * - Bedienpanel: Ersatz fuer das CANoe-Panel aus Temperaturmessung.can, sendet
+ *   die Taster-Nachricht (Messung starten/stoppen) und misst die Antworten
+ *   aller Knoten.
+ *
+ * Die Rechenzeiten der Knoten stammen aus mcp2515_bench (Treiber gegen das
+ * Registermodell) und der TWI-Taktrate; Interrupts verlaengern die laufende
+ * Task nicht. Damit mehrere Knoten am selben Bus betrieben werden koennen,
+ * sendet Knoten i temperatur mit ID 0x90 + i und status_led mit ID 0x100 + i
+ * (Knoten 0 entspricht main.c). Alle Zeiten in ns.
+ */
+
+#ifndef SIM_NODE_H
+#define SIM_NODE_H
+
+#include <stdint.h>
+
+#include "can_db.h"
+#include "sim_bus.h"
+
+/* IDs laut Temperaturmessung.dbc (can_db.h) */
+#define SIM_NODE_TASTER_ID		CAN_DB_TASTER_ID
+#define SIM_NODE_TEMPERATUR_ID	CAN_DB_TEMPERATUR_ID
+#define SIM_NODE_STATUS_LED_ID	CAN_DB_STATUS_LED_ID
+
+/* Knoten, bevor sich temperatur und status_led ueberschneiden */
+#define SIM_NODE_MAX			((uint16_t)(SIM_NODE_STATUS_LED_ID - SIM_NODE_TEMPERATUR_ID))
+
+/* Betriebssystem laut Os_Cfg.h und main.c */
+#define SIM_NODE_TICK_NS		1000000ULL		/* OSTICKDURATION */
+#define SIM_NODE_POLL_TICKS		10				/* Alarm1 mit CAN_RX_POLLING */
+#define SIM_NODE_TASK2_TICKS	100				/* SetRelAlarm(Alarm2, 0, OS_MS_TO_TICKS(100)) */
+
+
+#define SIM_NODE_HOUSEKEEPING_TICKS	100		/* CAN_RX_HOUSEKEEPING_MS */
+
+/* Rechenzeiten */
+#define SIM_NODE_TICK_ISR_NS	8000		/* Tick-ISR (Systemzaehler, Alarme) */
+#define SIM_NODE_SWITCH_NS		7000		/* ActivateTask()/SetEvent() und Task-Wechsel */
+#define SIM_NODE_POLL_NS		4000		/* mcp2515_get_message() ohne Nachricht, Ende der Task */
+#define SIM_NODE_RX_ISR_NS		127000		/* Nachricht von RXBn in den Ringpuffer */
+#define SIM_NODE_TX_ISR_NS		60000		/* Sende-ISR bis zum Nachladen eines Puffers */
+#define SIM_NODE_SEND_NS		20000		/* mcp2515_send_message() */
+#define SIM_NODE_GET_NS			12000		/* mcp2515_get_message() */
+#define SIM_NODE_TWI_START_NS	10000		/* LM75_start_read() und WaitEvent() */
+#define SIM_NODE_READTEMP_NS	480000		/* TWI-Uebertragung im ISR: 48 SCL-Takte bei 100 kHz */
+
+#define SIM_NODE_RX_RING		4			/* MCP2515_RX_BUFFER_SIZE */
+#define SIM_NODE_TX_QUEUE		4			/* MCP2515_TX_QUEUE_SIZE */
+
+enum
+{
+	SIM_NODE_HW_FREE,
+	SIM_NODE_HW_LOADING,			/* mcp2515_send_message() laeuft */
+	SIM_NODE_HW_PENDING,			/* TXREQ gesetzt */
+	SIM_NODE_HW_SENT				/* gesendet, Sende-ISR laeuft */
+};
+
+typedef struct
+{
+	uint16_t index;
+	uint16_t temperatur_id;
+	uint16_t status_led_id;
+
+	/* OS-Tick mit Phase und Quarzabweichung */
+	uint64_t tick_at;
+	uint32_t tick_ns;
+	uint32_t ticks;
+
+	uint32_t task2_tick;			/* naechste Aktivierung von Task2, 0 = Alarm2 aus */
+	uint8_t zustand_messung;
+	uint16_t temperatur;
+
+	/* Task1 wartet auf EV_CAN_RX statt jeden Tick zu laufen; cpu_free_at: Ende
+	 * der zuletzt gelaufenen Task */
+	uint8_t rx_event;
+	uint64_t cpu_free_at;
+
+	/* Empfangsringpuffer, Eintraege sind ab ready_at fuer Task1 sichtbar */
+	sim_can_frame rx[SIM_NODE_RX_RING];
+	uint64_t rx_ready_at[SIM_NODE_RX_RING];
+	uint8_t rx_head;
+	uint8_t rx_count;
+
+	/* Sendepuffer des MCP2515 (SIM_NODE_HW_...), at: Ende des Ladens bzw. der
+	 * Sende-ISR */
+	struct
+	{
+		uint8_t state;
+		uint64_t at;
+		sim_can_frame frame;
+		uint64_t activated_at;
+	} hw[3];
+	int8_t offered;
+
+	/* Warteschlange des Treibers, nach Prioritaet sortiert */
+	sim_can_frame queue[SIM_NODE_TX_QUEUE];
+	uint64_t queue_activated_at[SIM_NODE_TX_QUEUE];
+	uint8_t queued;
+
+	/* Statistik */
+	uint32_t rx_dropped;
+	uint32_t tx_dropped;
+	uint32_t tx_frames;
+	uint32_t tx_errors;
+	uint32_t temperatur_sent;
+	uint32_t temperatur_missed;		/* nicht innerhalb von deadline_ns nach Aktivierung von Task2 */
+	uint64_t temperatur_response_max;
+	uint64_t deadline_ns;
+	uint64_t busy_ns;				/* Rechenzeit von Tasks und ISRs */
+	uint64_t rx_latency_sum;		/* Ende der Nachricht auf dem Bus bis Task1 */
+	uint64_t rx_latency_max;
+	uint32_t rx_latency_count;
+} sim_node;
+
+/* Knoten i mit OS-Tick-Phase phase_ns und Quarzabweichung ppm anlegen. Danach
+ * kann rx_event gesetzt werden. */
+void sim_node_init(sim_node *node, uint16_t index, uint64_t phase_ns, int32_t ppm, uint64_t deadline_ns);
+void sim_node_attach(sim_node *node, sim_bus *bus);
+
+/* Naechster Zeitpunkt, zu dem der Knoten etwas tut, und Ereignisse bis now bearbeiten. */
+uint64_t sim_node_next_event(const sim_node *node);
+void sim_node_run(sim_node *node, uint64_t now);
+
+// ----------------------------------------------------------------------------
+/* Messwerte des Bedienpanels je Knoten */
+typedef struct
+{
+	uint64_t led_on_sum, led_on_max;		/* taster (starten) bis status_led {1} */
+	uint32_t led_on_count;
+	uint64_t first_temp_sum, first_temp_max;	/* taster (starten) bis erste temperatur */
+	uint32_t first_temp_count;
+	uint64_t led_off_sum, led_off_max;		/* taster (stoppen) bis status_led {0} */
+	uint32_t led_off_count;
+
+	uint64_t last_temp;						/* Periode von temperatur */
+	uint64_t period_min, period_max;
+	uint32_t periods;
+	uint32_t period_missed;					/* Abweichung groesser als jitter_ns */
+
+	uint8_t waiting_led;
+	uint8_t waiting_temp;
+} sim_panel_node;
+
+typedef struct
+{
+	uint16_t nodes;
+	sim_panel_node node[SIM_NODE_MAX];
+
+	/* Ablauf: Messung starten bei start_at, stoppen bei stop_at, dann naechster
+	 * Zyklus nach cycle_ns */
+	uint64_t start_at;
+	uint64_t stop_at;
+	uint64_t cycle_ns;
+	uint32_t cycles;
+	uint8_t measuring;
+
+	uint64_t jitter_ns;
+	uint64_t led_deadline_ns;
+	uint32_t led_missed;
+
+	/* Taster-Nachricht, die gesendet werden soll */
+	uint8_t tx_pending;
+	uint8_t tx_signal;
+	uint64_t tx_requested;					/* Tastendruck, Bezug der Latenzen */
+} sim_panel;
+
+void sim_panel_init(sim_panel *panel, uint16_t nodes, uint64_t start_at, uint64_t measure_ns,
+	uint32_t cycles, uint64_t jitter_ns, uint64_t led_deadline_ns);
+void sim_panel_attach(sim_panel *panel, sim_bus *bus);
+uint64_t sim_panel_next_event(const sim_panel *panel);
+void sim_panel_run(sim_panel *panel, uint64_t now);
+
+#endif /* SIM_NODE_H */
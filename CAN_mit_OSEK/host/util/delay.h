@@ -0,0 +1,16 @@
+/*
+ * util/delay.h (Host-Build)
+ *
+ * Warteschleifen ruecken die simulierte Zeit vor, waehrenddessen laufen Bus und
+ * Interrupts weiter.
+ */
+
+#ifndef SIM_UTIL_DELAY_H
+#define SIM_UTIL_DELAY_H
+
+#include "sim_avr.h"
+
+#define _delay_us(us)	sim_delay_cycles((uint64_t)((double)(us) * F_CPU / 1e6))
+#define _delay_ms(ms)	sim_delay_cycles((uint64_t)((double)(ms) * F_CPU / 1e3))
+
+#endif /* SIM_UTIL_DELAY_H */
@@ -0,0 +1,341 @@
+/*
+ * vbus.c
+ *
+ * Virtueller CAN-Bus mit mehreren Temperaturknoten und einem Ersatz fuer das
+ * CANoe-Bedienpanel (sim_node.h). Gemessen wird die Latenz vom Tastendruck bis
+ * zu den Antworten status_led und temperatur, die Periode von temperatur und
+ * die Buslast. Im Modus sweep wird die Zahl der Knoten erhoeht, bis Fristen
+ * verletzt werden. Mit -e wartet Task1 auf EV_CAN_RX (CAN_RX_POLLING 0), statt
+ * alle 10 ms den Ringpuffer abzufragen; der Modus compare rechnet beide
+ * Varianten mit derselben Phase der Knoten und vergleicht Latenz und
+ * Rechenzeit.
+ *
+ * Uebersetzen und starten (aus CAN_mit_OSEK):
+ *
+ *   gcc -std=gnu99 -O2 -Wall -funsigned-char -DF_CPU=3686400UL -Ihost -I. \
+ *       -o vbus host/vbus.c host/sim_node.c host/sim_bus.c host/sim_can.c mcp2515_timing.c
+ *   ./vbus [run|sweep|compare] [-b kbps] [-n nodes] [-c cycles] [-m measure_ms]
+ *          [-d temp_deadline_ms] [-l led_deadline_ms] [-j jitter_ms] [-s seed] [-e] [-v]
+ *
+ * Fristen (Voreinstellung): temperatur spaetestens 10 ms nach Aktivierung von
+ * Task2 auf dem Bus (vor der naechsten Abfrage durch Task1), status_led spaetestens 20 ms
+ * nach dem Tastendruck, Periode von temperatur 100 ms +- 5 ms.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "sim_bus.h"
+#include "sim_node.h"
+#include "mcp2515_timing.h"
+
+#define MS		1000000ULL
+
+typedef struct
+{
+	uint16_t kbps;
+	uint16_t nodes;
+	uint32_t cycles;
+	uint64_t measure_ns;
+	uint64_t temp_deadline_ns;
+	uint64_t led_deadline_ns;
+	uint64_t jitter_ns;
+	uint8_t rx_event;
+	uint8_t verbose;
+} vbus_config;
+
+typedef struct
+{
+	double load;
+	uint64_t frames;
+	uint64_t errors;
+	uint64_t arbitration_lost;
+	double led_on_mean, led_off_mean, first_temp_mean;
+	uint64_t led_on_max, led_off_max, first_temp_max;
+	uint64_t response_max;
+	uint64_t period_min, period_max;
+	uint32_t missed;
+	uint32_t led_missed, period_missed, temp_missed, dropped;
+	double rx_latency_mean;
+	uint64_t rx_latency_max;
+	double cpu_load, cpu_load_max;
+} vbus_result;
+
+static sim_bus bus;
+static sim_node node[SIM_NODE_MAX];
+static sim_panel panel;
+
+static uint32_t seed = 1;
+
+// ----------------------------------------------------------------------------
+static uint32_t random32(void)
+{
+	// xorshift32
+	seed ^= seed << 13;
+	seed ^= seed >> 17;
+	seed ^= seed << 5;
+	return seed;
+}
+
+// ----------------------------------------------------------------------------
+/* Nur Bitraten, fuer die mcp2515_init() CNF-Werte findet (mcp2515_timing.h) */
+static int valid_kbps(uint16_t kbps)
+{
+	uint8_t cnf[3];
+
+	return mcp2515_bit_timing(MCP2515_OSC, kbps * 1000UL, MCP2515_SAMPLE_POINT, cnf);
+}
+
+// ----------------------------------------------------------------------------
+static void simulate(const vbus_config *config, vbus_result *result)
+{
+	uint64_t end;
+	uint64_t t;
+	uint64_t led_on_sum = 0, led_off_sum = 0, first_temp_sum = 0, rx_latency_sum = 0, busy_sum = 0;
+	uint32_t led_on_count = 0, led_off_count = 0, first_temp_count = 0, rx_latency_count = 0;
+
+	sim_bus_init(&bus, config->kbps * 1000UL);
+	sim_panel_init(&panel, config->nodes, 50 * MS, config->measure_ns, config->cycles,
+		config->jitter_ns, config->led_deadline_ns);
+	sim_panel_attach(&panel, &bus);
+	for (uint16_t i = 0; i < config->nodes; i++) {
+		// Alarm1 mit zufaelliger Phase, Quarz +-100 ppm
+		sim_node_init(&node[i], i, random32() % (SIM_NODE_POLL_TICKS * SIM_NODE_TICK_NS),
+			(int32_t)(random32() % 201) - 100, config->temp_deadline_ns);
+		node[i].rx_event = config->rx_event;
+		sim_node_attach(&node[i], &bus);
+	}
+	end = panel.start_at + config->cycles * panel.cycle_ns;
+
+	// ereignisgesteuert: der Bus laeuft vor und nach den Ereignissen eines
+	// Zeitpunkts, damit dabei angebotene Nachrichten zu diesem Zeitpunkt starten
+	for (;;) {
+		t = sim_bus_next_event(&bus);
+		if (sim_panel_next_event(&panel) < t) {
+			t = sim_panel_next_event(&panel);
+		}
+		for (uint16_t i = 0; i < config->nodes; i++) {
+			if (sim_node_next_event(&node[i]) < t) {
+				t = sim_node_next_event(&node[i]);
+			}
+		}
+		if (t > end) {
+			break;
+		}
+
+		sim_bus_advance(&bus, t);
+		sim_panel_run(&panel, t);
+		for (uint16_t i = 0; i < config->nodes; i++) {
+			sim_node_run(&node[i], t);
+		}
+		sim_bus_advance(&bus, t);
+	}
+
+	memset(result, 0, sizeof(*result));
+	result->load = (double)bus.busy_ns / end;
+	result->frames = bus.frames;
+	result->errors = bus.errors;
+	result->arbitration_lost = bus.arbitration_lost;
+	result->period_min = UINT64_MAX;
+	result->led_missed = panel.led_missed;
+
+	for (uint16_t i = 0; i < config->nodes; i++) {
+		const sim_panel_node *p = &panel.node[i];
+		const sim_node *n = &node[i];
+
+		led_on_sum += p->led_on_sum;
+		led_on_count += p->led_on_count;
+		led_off_sum += p->led_off_sum;
+		led_off_count += p->led_off_count;
+		first_temp_sum += p->first_temp_sum;
+		first_temp_count += p->first_temp_count;
+		if (p->led_on_max > result->led_on_max) {
+			result->led_on_max = p->led_on_max;
+		}
+		if (p->led_off_max > result->led_off_max) {
+			result->led_off_max = p->led_off_max;
+		}
+		if (p->first_temp_max > result->first_temp_max) {
+			result->first_temp_max = p->first_temp_max;
+		}
+		if (p->periods && p->period_min < result->period_min) {
+			result->period_min = p->period_min;
+		}
+		if (p->period_max > result->period_max) {
+			result->period_max = p->period_max;
+		}
+		if (n->temperatur_response_max > result->response_max) {
+			result->response_max = n->temperatur_response_max;
+		}
+		result->period_missed += p->period_missed;
+		result->temp_missed += n->temperatur_missed;
+		result->dropped += n->rx_dropped + n->tx_dropped;
+		rx_latency_sum += n->rx_latency_sum;
+		rx_latency_count += n->rx_latency_count;
+		if (n->rx_latency_max > result->rx_latency_max) {
+			result->rx_latency_max = n->rx_latency_max;
+		}
+		busy_sum += n->busy_ns;
+		if ((double)n->busy_ns / end > result->cpu_load_max) {
+			result->cpu_load_max = (double)n->busy_ns / end;
+		}
+
+		// Antworten, die gar nicht gekommen sind, zaehlen als verpasste Frist
+		result->led_missed += config->cycles - p->led_on_count;
+		result->led_missed += config->cycles - p->led_off_count;
+
+		if (config->verbose) {
+			printf("Knoten %3u  status_led %7.2f ms max  temperatur %7.2f ms max, Periode %7.2f..%7.2f ms"
+				"  Fristen verpasst %u/%u\n", i, p->led_on_max / 1e6,
+				n->temperatur_response_max / 1e6, p->periods ? p->period_min / 1e6 : 0.0,
+				p->period_max / 1e6, n->temperatur_missed, p->period_missed);
+		}
+	}
+	if (result->period_min == UINT64_MAX) {
+		result->period_min = 0;
+	}
+	result->led_on_mean = led_on_count ? (double)led_on_sum / led_on_count : 0;
+	result->led_off_mean = led_off_count ? (double)led_off_sum / led_off_count : 0;
+	result->first_temp_mean = first_temp_count ? (double)first_temp_sum / first_temp_count : 0;
+	result->rx_latency_mean = rx_latency_count ? (double)rx_latency_sum / rx_latency_count : 0;
+	result->cpu_load = (double)busy_sum / end / config->nodes;
+	result->missed = result->led_missed + result->period_missed + result->temp_missed + result->dropped;
+}
+
+// ----------------------------------------------------------------------------
+static void report(const vbus_config *config, const vbus_result *result)
+{
+	printf("%u Knoten, %u kbit/s, %u Messzyklen zu %llu ms, Task1 %s\n", config->nodes, config->kbps,
+		config->cycles, (unsigned long long)(config->measure_ns / MS),
+		config->rx_event ? "wartet auf EV_CAN_RX" : "fragt alle 10 ms ab");
+	printf("Buslast                       %8.1f %%\n", 100.0 * result->load);
+	printf("Nachrichten                   %8llu (%llu Arbitrierungen verloren, %llu Error-Frames)\n",
+		(unsigned long long)result->frames, (unsigned long long)result->arbitration_lost,
+		(unsigned long long)result->errors);
+	printf("Empfang bis Task1             %8.2f ms Mittel, %8.2f ms max\n",
+		result->rx_latency_mean / 1e6, result->rx_latency_max / 1e6);
+	printf("Taster bis status_led {1}     %8.2f ms Mittel, %8.2f ms max\n",
+		result->led_on_mean / 1e6, result->led_on_max / 1e6);
+	printf("Taster bis erste temperatur   %8.2f ms Mittel, %8.2f ms max\n",
+		result->first_temp_mean / 1e6, result->first_temp_max / 1e6);
+	printf("Taster bis status_led {0}     %8.2f ms Mittel, %8.2f ms max\n",
+		result->led_off_mean / 1e6, result->led_off_max / 1e6);
+	printf("Task2 bis temperatur gesendet %8.2f ms max (Frist %.1f ms)\n",
+		result->response_max / 1e6, config->temp_deadline_ns / 1e6);
+	printf("Periode temperatur            %8.2f .. %.2f ms\n",
+		result->period_min / 1e6, result->period_max / 1e6);
+	printf("Rechenzeit je Knoten          %8.3f %% Mittel, %8.3f %% max\n",
+		100.0 * result->cpu_load, 100.0 * result->cpu_load_max);
+	printf("Fristen verpasst              %8u (status_led %u, temperatur %u, Periode %u, verworfen %u)\n",
+		result->missed, result->led_missed, result->temp_missed, result->period_missed, result->dropped);
+}
+
+// ----------------------------------------------------------------------------
+/* Knoten hinzufuegen, bis Fristen verpasst werden */
+static int sweep(vbus_config *config)
+{
+	vbus_result result;
+	uint16_t max_ok = 0;
+	uint8_t failed = 0;
+	uint32_t base_seed = seed;
+
+	printf("Knoten  Buslast  status_led max  temperatur max  Periode min..max     verpasst\n");
+	for (uint16_t n = 1; n <= SIM_NODE_MAX && failed < 3; n++) {
+		config->nodes = n;
+		seed = base_seed;
+		simulate(config, &result);
+		printf("%6u  %6.1f%%  %11.2f ms  %11.2f ms  %6.2f..%6.2f ms  %8u\n", n, 100.0 * result.load,
+			result.led_on_max / 1e6, result.response_max / 1e6, result.period_min / 1e6,
+			result.period_max / 1e6, result.missed);
+		if (result.missed) {
+			failed++;
+		}
+		else if (!failed) {
+			max_ok = n;
+		}
+	}
+	printf("\n%u kbit/s: bis %u Knoten ohne verpasste Fristen\n", config->kbps, max_ok);
+	return 0;
+}
+
+// ----------------------------------------------------------------------------
+/* Gleiche Knoten einmal mit Abfrage alle 10 ms und einmal mit EV_CAN_RX */
+static int compare(vbus_config *config)
+{
+	vbus_result result[2];
+	uint32_t base_seed = seed;
+
+	for (uint8_t e = 0; e < 2; e++) {
+		config->rx_event = e;
+		seed = base_seed;
+		simulate(config, &result[e]);
+	}
+
+	printf("%u Knoten, %u kbit/s, %u Messzyklen      Abfrage alle 10 ms   EV_CAN_RX\n",
+		config->nodes, config->kbps, config->cycles);
+	printf("Empfang bis Task1, Mittel       %12.3f ms  %10.3f ms\n",
+		result[0].rx_latency_mean / 1e6, result[1].rx_latency_mean / 1e6);
+	printf("Empfang bis Task1, max          %12.3f ms  %10.3f ms\n",
+		result[0].rx_latency_max / 1e6, result[1].rx_latency_max / 1e6);
+	printf("Taster bis status_led {1}, Mittel %10.3f ms  %10.3f ms\n",
+		result[0].led_on_mean / 1e6, result[1].led_on_mean / 1e6);
+	printf("Taster bis status_led {0}, Mittel %10.3f ms  %10.3f ms\n",
+		result[0].led_off_mean / 1e6, result[1].led_off_mean / 1e6);
+	printf("Rechenzeit je Knoten            %12.3f %%   %10.3f %%\n",
+		100.0 * result[0].cpu_load, 100.0 * result[1].cpu_load);
+	printf("Leerlauf je Knoten              %12.3f %%   %10.3f %%\n",
+		100.0 * (1 - result[0].cpu_load), 100.0 * (1 - result[1].cpu_load));
+	printf("Fristen verpasst                %12u     %10u\n", result[0].missed, result[1].missed);
+	return (result[0].missed || result[1].missed) ? 1 : 0;
+}
+
+// ----------------------------------------------------------------------------
+int main(int argc, char **argv)
+{
+	vbus_config config = { 125, 4, 3, 2000 * MS, 10 * MS, 20 * MS, 5 * MS, 0, 0 };
+	const char *mode = "run";
+	vbus_result result;
+
+	for (int i = 1; i < argc; i++) {
+		if (argv[i][0] != '-') {
+			mode = argv[i];
+		}
+		else if (argv[i][1] == 'v') {
+			config.verbose = 1;
+		}
+		else if (argv[i][1] == 'e') {
+			config.rx_event = 1;
+		}
+		else if (i + 1 < argc) {
+			unsigned long value = strtoul(argv[++i], NULL, 0);
+
+			switch (argv[i - 1][1]) {
+				case 'b':	config.kbps = value;				break;
+				case 'n':	config.nodes = value;				break;
+				case 'c':	config.cycles = value;				break;
+				case 'm':	config.measure_ns = value * MS;		break;
+				case 'd':	config.temp_deadline_ns = value * MS;	break;
+				case 'l':	config.led_deadline_ns = value * MS;	break;
+				case 'j':	config.jitter_ns = value * MS;		break;
+				case 's':	seed = value ? value : 1;			break;
+			}
+		}
+	}
+
+	if (!valid_kbps(config.kbps) || config.nodes < 1 || config.nodes > SIM_NODE_MAX || config.cycles < 1) {
+		printf("Bitrate mit %lu Hz am MCP2515 erreichbar, 1..%u Knoten, mindestens ein Zyklus\n",
+			(unsigned long)MCP2515_OSC, SIM_NODE_MAX);
+		return 1;
+	}
+
+	if (strcmp(mode, "sweep") == 0) {
+		return sweep(&config);
+	}
+	if (strcmp(mode, "compare") == 0) {
+		return compare(&config);
+	}
+	simulate(&config, &result);
+	report(&config, &result);
+	return result.missed ? 1 : 0;
+}
@@ -13,12 +13,15 @@
 #include "Usart.h"
 
 #include <avr/interrupt.h>
+#include <avr/pgmspace.h>
 #include <util/delay.h>
 #include <inttypes.h>
 #include <compat/twi.h>  // Hier stehen Definitionen der Register
 #include <ctype.h>
 #include <stddef.h>
 
+#include "can.h"
+#include "can_sched.h"
 #include "mcp2515.h"
 #include "global.h"
 #include "defaults.h"
@@ -26,19 +29,34 @@
 
 #include "LM75.h"
 #include "TWI.h"
+#include "can_db.h"
+#include "Trace.h"
+#include "OsStat.h"
+#include "OsStack.h"
+#include "OsTick.h"
+#include "SwTimer.h"
+
+#if OS_STAT_ENABLE && NUMBER_OF_TASKS > OS_STAT_TASKS
+#error OS_STAT_TASKS (OsStat.h) muss mindestens NUMBER_OF_TASKS sein
+#endif
+
+#if CAN_DB_SCHED_COUNT > CAN_SCHED_MAX
+#error CAN_SCHED_MAX (can_sched.h) muss mindestens CAN_DB_SCHED_COUNT sein
+#endif
 
 /*------------------------------------------------------------------------------------------------*/
 /* DEFINES                                                                                        */
 /*------------------------------------------------------------------------------------------------*/
 
-#define CANSPEED_125 	7		/* CAN speed at 125 kbps  */
-#define CANSPEED_250  	3		/* CAN speed at 250 kbps  */
-#define CANSPEED_500	1		/* CAN speed at 500 kbps  */
-#define CANSPEED_1000	0		/* CAN speed at 1000 kbps */
-
-#define MESSAGE_TASTER_ID 0x80
-#define MESSAGE_TEMPERATUR_ID 0x90
-#define MESSAGE_STATUS_LED_ID 0x100
+#define CANSPEED_125 	125000UL	/* CAN speed at 125 kbps  */
+#define CANSPEED_250  	250000UL	/* CAN speed at 250 kbps  */
+#define CANSPEED_500	500000UL	/* CAN speed at 500 kbps  */
+#define CANSPEED_1000	1000000UL	/* CAN speed at 1000 kbps */
+
+/* IDs, Laengen und Signale der Nachrichten stehen in can_db.h (aus der DBC erzeugt) */
+
+/* Treiber hinter can.h, die Tasks kennen nur can_...() */
+#define CAN_CONTROLLER	mcp2515_can_ops
 
 /*------------------------------------------------------------------------------------------------*/
 /* TASK FUNCTIONS                                                                                 */
@@ -48,25 +66,100 @@
 TASK(IdleTask)
 {
     /* Idle-Task sollte sich nicht beenden sonst wird das OS beendet, gleichbedeutend mit ShutdownOS().  */
-    for (;;);
+    for (;;)
+    {
+        SwTimer_Idle();                           /* im Tick der IdleTask faellige Software-Timer (SwTimer.h) */
+        OS_STAT_IDLE();                           /* Aufwachen je Sekunde (OsStat.h) */
+        OsTick_Idle();                            /* schlafen bis zum naechsten Interrupt (OsTick.h) */
+    }
     TerminateTask();
 }
 
+/* Empfangs-ISR des Treibers: mindestens eine neue Nachricht im Ringpuffer */
+static void can_rx_notify(void)
+{
+	OS_STAT_ACTIVATE(Task1);					  /* Antwortzeit von Task1 ab dem Empfang */
+#if !CAN_RX_POLLING
+	SetEvent(Task1, EV_CAN_RX);
+#endif
+}
+
+static uint8_t zustand_messung = 0;
+static uint16_t temperatur_wert;							  /* letzte Messung, zyklisch gesendet */
+static SwTimerT timer_temperatur = SW_TIMER_TASK(Task2);
+#if !CAN_RX_POLLING
+static SwTimerT timer_can_tx = SW_TIMER_EVENT(Task1, EV_CAN_TX);	  /* einmalig, zur naechsten faelligen Nachricht */
+#endif
+
+/* Vorlagen der gesendeten Nachrichten im Flash: can_tx_alloc_P() legt sie direkt
+   in der Sendewarteschlange an, auf dem Task-Stack liegt keine Nachricht */
+static const tCANFrame can_tx_status_led PROGMEM = CAN_DB_STATUS_LED_INIT;
+static const tCANFrame can_tx_temperatur PROGMEM = CAN_DB_TEMPERATUR_INIT;
+
+/* Signale der zyklischen Nachrichten eintragen (can_sched_run() in Task1) */
+static void can_fill_temperatur(uint8_t *data)
+{
+	can_db_pack_temperatur_signal(data, temperatur_wert);		  /* LM75: 0,125 Grad je Bit wie in der DBC */
+}
+
+/* Zyklische Nachrichten laut DBC (GenMsgCycleTime), Versatz von tools/dbc2c.py */
+static const tCANSchedEntry can_sched_table[] PROGMEM = CAN_DB_SCHED_TABLE;
+
 TASK(StartUpTask)
-{
+{
+	static const uint32_t rx_ids[] = CAN_DB_RX_FILTER_IDS;		  /* Empfangene Nachrichten laut DBC */
+
     USART_Init(115200);
 	USART_PutString("StartupTask aufgerufen.\n");
+	if(!OsStack_Check())						  /* Aufteilung von OsTaskSB wie in OsStack.h? */
+	{
+		USART_PutString("OsTaskSB: Schutzbytes nicht wie erwartet, Stack-Messung ungueltig.\n");
+	}
+	TRACE_INIT();								  /* ab hier binaerer Trace (tools/trace_decode.py) */
+	OS_STAT_INIT();								  /* Laufzeitmessung der Tasks (OsStat.h) */
 
 	TWI_init();                                   /* TWI initialisieren */
 	LM75_init();								  /* LM75 initialisieren */
-	mcp2515_init(CANSPEED_125);					  /* MCP2515 initialisieren */
+	can_init(&CAN_CONTROLLER, CANSPEED_125);	  /* CAN-Controller initialisieren */
+	can_set_filters(rx_ids, CAN_DB_RX_FILTER_COUNT);	  /* Nur die benoetigten Nachrichten empfangen */
+	SwTimer_Init(Alarm2, IdleTask);				  /* Software-Timer (SwTimer.h) */
+	can_sched_init(can_sched_table, CAN_DB_SCHED_COUNT, OS_MS_TO_TICKS(CAN_DB_SCHED_TICK_MS));	/* zyklisch senden (can_sched.h) */
 
-    SetAbsAlarm(Alarm1, 1, 1);                    /* Alarm fuer Task 1 initialisieren. */
+#if CAN_RX_POLLING
+    SetRelAlarm(Alarm1, 1, OS_MS_TO_TICKS(10));   /* Alarm fuer Task 1 initialisieren (relativ: die Initialisierung dauert laenger als ein Tick). */
+#else
+    ActivateTask(Task1);                          /* vor can_set_rx_notify(): SetEvent() auf eine suspendierte Task ist ein Fehler */
+    SetRelAlarm(Alarm1, OS_MS_TO_TICKS(CAN_RX_HOUSEKEEPING_MS), OS_MS_TO_TICKS(CAN_RX_HOUSEKEEPING_MS));
+    SwTimer_Start(&timer_can_tx, 0, 0);           /* erster can_sched_run() im naechsten Tick */
+#endif
+	can_set_rx_notify(can_rx_notify);			  /* Empfang an Task1 melden */
 	
-    TerminateTask();
-}
-
-TASK(Task1)
+    TerminateTask();
+}
+
+static void send_status_led(uint8_t signal)
+{
+	tCANFrame *message = can_tx_alloc_P(&can_tx_status_led);
+
+	if(message)
+	{
+		can_db_pack_status_led_signal(message->data, signal);
+		can_tx_commit(message);
+	}
+}
+
+static void send_temperatur(uint16_t temp)
+{
+	tCANFrame *message = can_tx_alloc_P(&can_tx_temperatur);
+
+	if(message)
+	{
+		can_db_pack_temperatur_signal(message->data, temp);				/* LM75: 0,125 Grad je Bit wie in der DBC */
+		can_tx_commit(message);
+	}
+}
+
+static void Task1_ProcessMessages(void)
 {
 	/*====================== Todo ========================*/
 	/* 
@@ -76,42 +169,101 @@ TASK(Task1)
 	   - und die entsprechende Botschaft fr den LED-Status versenden. 
 	*/
 	
-	static uint8_t zustand_messung = 0;
-	tCAN message_received;
-		
-	//USART_PutString("1.Task aufgerufen.\n");
-	if(mcp2515_check_message())													/* auf Empfang eine Nachricht prfen */
-	{
-		mcp2515_get_message(&message_received);									/* Nachricht zwischenspeichern */
-		if(message_received.id == MESSAGE_TASTER_ID)							/* Taster-Nachricht gesendet? */
-		{	
-			if(message_received.data[0] == 1 && zustand_messung == 0)			/* Messung gestartet */
-			{
-				tCAN message_status_led = { MESSAGE_STATUS_LED_ID, {0, 1}, {1} };
+	const tCANFrame *message_received;
+		
+	//USART_PutString("1.Task aufgerufen.\n");
+	while((message_received = can_rx_peek()) != 0)										/* alle empfangenen Nachrichten im Ringpuffer abarbeiten */
+	{
+		if(message_received->id == CAN_DB_TASTER_ID)								/* Taster-Nachricht gesendet? */
+		{	
+			uint8_t taster = can_db_unpack_taster_signal(message_received->data);
+
+			can_rx_release();
+			if(taster == CAN_DB_TASTER_SIGNAL_MESSUNG_STARTEN && zustand_messung == 0)	/* Messung gestartet */
+			{
+				SwTimer_Start(&timer_temperatur, 0, OS_MS_TO_TICKS(100));		/* Temperatur alle 100 ms messen, Task2 schaltet das Senden ein */
+				TRACE_ALARM_SET(Alarm2, OS_MS_TO_TICKS(100));
+
+				send_status_led(CAN_DB_STATUS_LED_SIGNAL_AN);					/* Status LED umschalten*/
+				zustand_messung = 1;											/* den Zustand 'Messung gestartet' merken */
+			}
+			if(taster == CAN_DB_TASTER_SIGNAL_MESSUNG_STOPPEN && zustand_messung == 1)
+			{
+				SwTimer_Stop(&timer_temperatur);
+				TRACE_ALARM_CANCEL(Alarm2);
+				can_sched_enable(CAN_DB_SCHED_TEMPERATUR, 0);
+
+				send_temperatur(0);
+				send_status_led(CAN_DB_STATUS_LED_SIGNAL_AUS);					/* Status LED umschalten*/
+				zustand_messung = 0;											/* den Zustand 'Messung beendet' merken */
+			}
+		}
+		else
+		{
+			can_rx_release();
+		}
+	}
+	/*====================================================*/
+}
 
-				SetRelAlarm(Alarm2, 0, 10);
+#if CAN_RX_POLLING
 
-				mcp2515_send_message(&message_status_led);						/* Status LED umschalten*/
-				zustand_messung = 1;											/* den Zustand 'Messung gestartet' merken */
-			}
-			if(message_received.data[0] == 0 && zustand_messung == 1)
-			{
-				tCAN message_status_led = { MESSAGE_STATUS_LED_ID, {0, 1}, {0} };
-				tCAN message_temperatur = { MESSAGE_TEMPERATUR_ID, {0, 2}, {0, 0} };
+TASK(Task1)
+{
+	OS_STAT_ALARM(Task1, Alarm1, OS_MS_TO_TICKS(10));									/* Antwortzeit ab dem Ablauf von Alarm1 */
+	OS_STAT_TASK_BEGIN(Task1);
+	TRACE_TASK_START(Task1);
+	Task1_ProcessMessages();
+	can_sched_run();																	/* zyklische Nachrichten, Tick 10 ms wie Alarm1 */
+	can_error_poll(10);																	/* Fehlerzaehler, Senden nach Bus-Off (alle 10 ms) */
+	OS_STAT_POLL();																		/* 's' auf der USART: Laufzeiten ausgeben */
+	TRACE_TASK_END(Task1);
+	OS_STAT_TASK_END(Task1);
+	TerminateTask();
+}
+
+#else
+
+TASK(Task1)
+{
+	EventMaskType events;
+
+	/* Extended Task: endet nie, schlaeft in WaitEvent() bis zum naechsten Empfang */
+	for (;;)
+	{
+		WaitEvent(EV_CAN_RX | EV_HOUSEKEEPING | EV_CAN_TX);
+		GetEvent(Task1, &events);
+		ClearEvent(events);
 
-				CancelAlarm(Alarm2);
+		if(events & EV_HOUSEKEEPING)
+		{
+			OS_STAT_ALARM(Task1, Alarm1, OS_MS_TO_TICKS(CAN_RX_HOUSEKEEPING_MS));		/* Antwortzeit ab dem Ablauf von Alarm1 */
+		}
+		OS_STAT_TASK_BEGIN(Task1);
+		TRACE_TASK_START(Task1);
+		Task1_ProcessMessages();														/* auch bei EV_HOUSEKEEPING: Nachrichten vor can_set_rx_notify() */
+		if(events & EV_CAN_TX)
+		{
+			TickType wait = can_sched_run();											/* zyklische Nachrichten senden */
 
-				mcp2515_send_message(&message_temperatur);
-				mcp2515_send_message(&message_status_led);						/* Status LED umschalten*/
-				zustand_messung = 0;											/* den Zustand 'Messung beendet' merken */
+			if(wait)
+			{
+				SwTimer_Start(&timer_can_tx, wait, 0);									/* erst zur naechsten faelligen Nachricht wecken */
 			}
-		}
+		}
+		if(events & EV_HOUSEKEEPING)
+		{
+			can_error_poll(CAN_RX_HOUSEKEEPING_MS);											/* Fehlerzaehler, Senden nach Bus-Off */
+			OS_STAT_POLL();																/* 's' auf der USART: Laufzeiten ausgeben */
+		}
+		TRACE_TASK_END(Task1);
+		OS_STAT_TASK_END(Task1);
 	}
-	/*====================================================*/
-	
 	TerminateTask();
 }
 
+#endif /* CAN_RX_POLLING */
+
 TASK(Task2)
 {
 	/*====================== Todo ========================*/
@@ -119,17 +271,34 @@ TASK(Task2)
 	- Temperatur per TWI auslesen 
 	- und auf dem CAN-Bus passend versenden
 	*/
-	tCAN message_temperatur = { MESSAGE_TEMPERATUR_ID, {0, 2}, {0, 0} };
+	uint16_t temp;
 	
 	//USART_PutString("2.Task wird aufgerufen.\n");
+	OS_STAT_TASK_BEGIN(Task2);
+	TRACE_TASK_START(Task2);
 
-	uint16_t temperatur = ReadTemp();
-	message_temperatur.data[0] = temperatur % 256;								/* Intel-Byte-Order: Erst Low-Byte, dann */
-	message_temperatur.data[1] = temperatur / 256;								/* High-Byte mit 3 Bits. */
-	
-	mcp2515_send_message(&message_temperatur);
+	/* LM75 im TWI-ISR auslesen; bis EV_TEMP_READY laufen Task1 und die CAN-ISRs */
+	if(LM75_start_read(Task2, EV_TEMP_READY) == TWI_OK)
+	{
+		OS_STAT_WAIT_BEGIN(Task2);
+		WaitEvent(EV_TEMP_READY);
+		OS_STAT_WAIT_END(Task2);
+		ClearEvent(EV_TEMP_READY);
+
+		if(LM75_result(&temp))
+		{
+			TRACE_VALUE(TRACE_VALUE_TEMPERATUR, temp);
+			temperatur_wert = temp;
+			if(zustand_messung)															/* nicht, wenn Task1 waehrend WaitEvent() gestoppt hat */
+			{
+				can_sched_enable(CAN_DB_SCHED_TEMPERATUR, 1);							/* ab der ersten Messung zyklisch senden (can_sched.h) */
+			}
+		}
+	}
 	/*====================================================*/
 	
+	TRACE_TASK_END(Task2);
+	OS_STAT_TASK_END(Task2);
     TerminateTask();
 }
 
@@ -139,5 +308,6 @@ TASK(Task2)
 
 int main(void)
 {
+    OsStack_Paint();                              /* fuer OsStack_HighWater() */
     StartOS(OSDEFAULTAPPMODE);
 }
@@ -34,18 +34,71 @@
 
 
 #include <avr/io.h>
+#include <avr/interrupt.h>
 #include <util/delay.h>
 
 #include <stdint.h>
-//#include <avr/pgmspace.h>
+#include <stddef.h>
+#include <string.h>
+#include <avr/pgmspace.h>
 #include <avr/sfr_defs.h>	// fr bit_is_clear(...) und bit_is_set(...) notwendig
 
 #include "global.h"
 #include "mcp2515.h"
 #include "mcp2515_defs.h"
+#include "mcp2515_timing.h"
 #include "defaults.h"
+#include "Trace.h"
 
 
+// -------------------------------------------------------------------------
+/* The INT line of the MCP2515 (D,2) is wired to the external interrupt INT0.
+ * An SPI transaction from a task must not be interrupted by the ISR, so
+ * INT0 is disabled for the duration of the transaction. An edge during
+ * that time stays latched in INTF0 and is serviced afterwards. */
+#define MCP2515_LOCK()		uint8_t int_mask = EIMSK & (1<<INT0); EIMSK &= ~(1<<INT0)
+#define MCP2515_UNLOCK()	EIMSK |= int_mask
+
+#define RX_BUFFER_MASK		(MCP2515_RX_BUFFER_SIZE - 1)
+
+/* Receive ring buffer: only the ISR writes (rx_head), only the task reads (rx_tail).
+ * Both indices wrap freely, the number of used slots is rx_head - rx_tail. */
+static tCANFrame rx_buffer[MCP2515_RX_BUFFER_SIZE];
+static volatile uint8_t rx_head;
+static volatile uint8_t rx_tail;
+static volatile uint16_t rx_overflow;
+static void (* volatile rx_notify)(void);
+
+/* Transmit queue: messages stay in their slot in tx_pool, tx_order holds
+ * the numbers of the queued slots sorted by descending priority (next
+ * message at the end), tx_free the free ones. A slot lent out by
+ * mcp2515_tx_alloc() is in neither list. The lists are only accessed from
+ * the ISR or with INT0 disabled. */
+static tCANFrame tx_pool[MCP2515_TX_QUEUE_SIZE];
+static uint8_t tx_order[MCP2515_TX_QUEUE_SIZE];
+static uint8_t tx_count;
+static uint8_t tx_free[MCP2515_TX_QUEUE_SIZE];
+static uint8_t tx_free_count;
+static uint16_t tx_dropped;
+static uint16_t tx_delayed;
+
+/* State of the three transmit buffers TXB0..TXB2: sort key of the ID
+ * (computed when loading, so the ISR needs no stack space for it), age
+ * (0 = loaded last, the used buffers always have distinct values 0..2)
+ * and TXP */
+static uint32_t tx_hw_key[3];
+static uint8_t tx_hw_age[3];
+static uint8_t tx_hw_txp[3];
+
+/* Error monitoring: only accessed from the ISR or with INT0 disabled. After
+ * a bus-off, bus_off stays set until mcp2515_error_poll() resumes
+ * transmission; no transmit buffer is loaded until then. */
+static tCANErrorStatus error_status;
+static void (*error_notify)(uint8_t old_state, uint8_t new_state);
+static uint8_t bus_off;
+static uint16_t bus_off_wait;			// remaining hold-off time in ms
+static uint16_t bus_off_holdoff;		// hold-off time for the next bus-off
+static uint16_t bus_off_stable;			// ms without bus-off since resuming
 
 // -------------------------------------------------------------------------
 /* Senden oder Empfangen der Daten ber SPI-Bus */
@@ -58,15 +111,75 @@ uint8_t spi_putc( uint8_t data )
 	return SPDR;
 }
 
+// -------------------------------------------------------------------------
+/* Send header and data without a gap within one chip select window. The
+ * next byte is fetched while the current one is still being shifted out,
+ * also at the change from header to data; between two bytes there is only
+ * the wait for SPIF. header_length >= 1. */
+static void spi_write_frame(const uint8_t *header, uint8_t header_length,
+	const uint8_t *data, uint8_t length)
+{
+	const uint8_t *end = header + header_length;
+	uint8_t count = header_length + length;
+	uint8_t next;
+	
+	next = *header++;
+	while (--count) {
+		SPDR = next;
+		if (header == end) {
+			header = data;
+		}
+		next = *header++;
+		while( !( SPSR & (1<<SPIF) ) );
+	}
+	SPDR = next;
+	while( !( SPSR & (1<<SPIF) ) );
+}
+
+// -------------------------------------------------------------------------
+/* Send several bytes within one chip select window */
+void spi_write_block(const uint8_t *data, uint8_t length)
+{
+	if (length) {
+		spi_write_frame(data, length, NULL, 0);
+	}
+}
+
+// -------------------------------------------------------------------------
+/* Receive several bytes within one chip select window (dummy byte 0xff). */
+void spi_read_block(uint8_t *data, uint8_t length)
+{
+	while (length--) {
+		SPDR = 0xff;
+		while( !( SPSR & (1<<SPIF) ) );
+		*data++ = SPDR;
+	}
+}
+
 // -------------------------------------------------------------------------
 /*Funktion zum Schreiben von Registerwertenen */
 void mcp2515_write_register( uint8_t adress, uint8_t data )
 {
+	MCP2515_LOCK();
 	RESET(MCP2515_CS);			// CS - Leitung auf LOW-Pegel legen
 	spi_putc(SPI_WRITE);        // SPI-Kommando SPI_WRITE senden
 	spi_putc(adress);           // Registeradresse senden
 	spi_putc(data);				// Daten senden
 	SET(MCP2515_CS);			// CS - Leitung wieder auf HIGH-Pegel ziehen
+	MCP2515_UNLOCK();
+}
+
+// -------------------------------------------------------------------------
+/* Write several consecutive registers in one access */
+void mcp2515_write_registers( uint8_t adress, const uint8_t *data, uint8_t length )
+{
+	MCP2515_LOCK();
+	RESET(MCP2515_CS);
+	spi_putc(SPI_WRITE);
+	spi_putc(adress);
+	spi_write_block(data, length);
+	SET(MCP2515_CS);
+	MCP2515_UNLOCK();
 }
 
 // -------------------------------------------------------------------------
@@ -74,11 +187,13 @@ void mcp2515_write_register( uint8_t adress, uint8_t data )
 uint8_t mcp2515_read_register(uint8_t adress)
 {
 	uint8_t data;
+	MCP2515_LOCK();
 	RESET(MCP2515_CS);			// CS - Leitung auf LOW-Pegel legen
 	spi_putc(SPI_READ);			// SPI-Kommando SPI_READ senden
 	spi_putc(adress);			// Registeradresse senden
 	data = spi_putc(0xff);		// Daten empfangen, hierbei wird ein Dummy-Byte als Parameter bergeben
 	SET(MCP2515_CS);			// CS - Leitung wieder auf HIGH-Pegel ziehen
+	MCP2515_UNLOCK();
 	return data;				// Empfangene Daten zurckgeben
 }
 
@@ -94,12 +209,14 @@ des MCP2515 gel
 */
 void mcp2515_bit_modify(uint8_t adress, uint8_t mask, uint8_t data)
 {
+	MCP2515_LOCK();
 	RESET(MCP2515_CS);
 	spi_putc(SPI_BIT_MODIFY);
 	spi_putc(adress);
 	spi_putc(mask);
 	spi_putc(data);
 	SET(MCP2515_CS);
+	MCP2515_UNLOCK();
 }
 
 
@@ -108,10 +225,12 @@ void mcp2515_bit_modify(uint8_t adress, uint8_t mask, uint8_t data)
 uint8_t mcp2515_read_status(uint8_t type)
 {
 	uint8_t data;
+	MCP2515_LOCK();
 	RESET(MCP2515_CS);
 	spi_putc(type);
 	data = spi_putc(0xff);
 	SET(MCP2515_CS);
+	MCP2515_UNLOCK();
 	return data;
 }
 
@@ -120,8 +239,30 @@ uint8_t mcp2515_read_status(uint8_t type)
 
 // Den SPI-Interface des ATmegas und den CAN-Controller einstellen (Initialisation) 
 // Das einzig Schwierige bei der Initialisierung ist das Einstellen des Bit-Timings bzw. der Bit Rate des CAN Buses.
-uint8_t mcp2515_init(uint8_t speed)
+// CNF1..3 are computed by mcp2515_bit_timing() from MCP2515_OSC and MCP2515_SAMPLE_POINT (mcp2515_timing.h).
+uint8_t mcp2515_init(uint32_t bitrate)
 {
+	uint8_t cnf[3];
+	
+	if (!mcp2515_bit_timing(MCP2515_OSC, bitrate, MCP2515_SAMPLE_POINT, cnf)) {
+		return false;
+	}
+	
+	// disable INT0 during initialisation and empty the ring buffer
+	EIMSK &= ~(1<<INT0);
+	rx_head = 0;
+	rx_tail = 0;
+	rx_overflow = 0;
+	tx_count = 0;
+	for (tx_free_count = 0; tx_free_count < MCP2515_TX_QUEUE_SIZE; tx_free_count++) {
+		tx_free[tx_free_count] = tx_free_count;
+	}
+	tx_dropped = 0;
+	tx_delayed = 0;
+	for (uint8_t b = 0; b < 3; b++) {
+		tx_hw_txp[b] = 0;					// TXBnCTRL after reset
+	}
+	
 	SET(MCP2515_CS);			// Ilya: Hier ganz am Anfang macht es keinen Sinn?
 	SET_OUTPUT(MCP2515_CS);     // PB2 auf Ausgang fr Chip Slect (CS) Pin setzen alternativ DDRB |= 1 << PB2
 	
@@ -136,9 +277,9 @@ uint8_t mcp2515_init(uint8_t speed)
 	SET_INPUT(MCP2515_INT);
 	SET(MCP2515_INT);
 	
-	// active SPI master interface
-	SPCR = (1<<SPE)|(1<<MSTR)|(0<<SPR1)|(1<<SPR0);
-	SPSR = 0;
+	// active SPI master interface, SCK = F_CPU/2 (the MCP2515 allows up to 10 MHz)
+	SPCR = (1<<SPE)|(1<<MSTR)|(0<<SPR1)|(0<<SPR0);
+	SPSR = (1<<SPI2X);
 	
 	// reset MCP2515 by software reset.
 	// After this he is in configuration mode.
@@ -149,45 +290,24 @@ uint8_t mcp2515_init(uint8_t speed)
 	// wait a little bit until the MCP2515 has restarted
 	_delay_us(10);
 	
-	// load CNF1..3 Register
-	RESET(MCP2515_CS);
-	spi_putc(SPI_WRITE);
-	spi_putc(CNF3);
-
-    /*Auswahl der CAN-Baudrate*/
-	switch(speed)
-	{
-		// Bitrate 1000 kbps at 16 MHz
-		case 0:	spi_putc((1<<PHSEG21));
-				spi_putc((1<<BTLMODE)|(1<<PHSEG11));
-				spi_putc(0);
-				break;
-		
-		// Bitrate 500 kbps at 16 MHz	
-		case 1:	spi_putc((1<<PHSEG21));		
-				spi_putc((1<<BTLMODE)|(1<<PHSEG11));
-				spi_putc(1<<BRP0);
-				break;
-			
-		// Bitrate 250 kbps at 16 MHz
-		case 3: spi_putc((1<<PHSEG21));
-		        spi_putc((1<<BTLMODE)|(1<<PHSEG11)); 
-				spi_putc((1<<BRP1)|(1<<BRP0));
-			    break;
-				
-		// Bitrate 125 kbps at 16 MHz		
-		case 7:	spi_putc((1<<PHSEG21));		
-				spi_putc((1<<BTLMODE)|(1<<PHSEG11));
-				spi_putc((1<<BRP2)|(1<<BRP1)|(1<<BRP0));
-				break;
-	}
-	
-	// activate interrupts
-	spi_putc((1<<RX1IE)|(1<<RX0IE));
+	// load CNF3, CNF2, CNF1
+	RESET(MCP2515_CS);
+	spi_putc(SPI_WRITE);
+	spi_putc(CNF3);
+	spi_write_block(cnf, 3);
+	
+	// activate interrupts (ERRIF: change in EFLG). MERRE stays off, otherwise
+	// a disturbed bus would raise an interrupt with every error frame;
+	// mcp2515_error_poll() polls MERRF.
+	spi_putc((1<<ERRIE)|(1<<TX2IE)|(1<<TX1IE)|(1<<TX0IE)|(1<<RX1IE)|(1<<RX0IE));
 	SET(MCP2515_CS);
 	
+	error_status = (tCANErrorStatus){ 0 };
+	bus_off = 0;
+	bus_off_holdoff = MCP2515_BUS_OFF_HOLDOFF_MS;
+	
 	// test if we could read back the value => is the chip accessible?
-	if (mcp2515_read_register(CNF1) != speed) 
+	if (mcp2515_read_register(CNF1) != cnf[2]) 
 	{
 		return false;
 	}
@@ -202,150 +322,835 @@ uint8_t mcp2515_init(uint8_t speed)
 	mcp2515_write_register(RXB0CTRL, (1<<RXM1)|(1<<RXM0));
 	mcp2515_write_register(RXB1CTRL, (1<<RXM1)|(1<<RXM0));
 	
+	// INT0 on the falling edge of the INT line. From here on every edge is
+	// latched in INTF0, even while INT0 is still disabled.
+	EICRA = (EICRA & ~((1<<ISC01)|(1<<ISC00))) | (1<<ISC01);
+	EIFR = (1<<INTF0);
+	
 	// reset device to normal mode
 	mcp2515_write_register(CANCTRL, 0);
+	
+	// enable the receive interrupt
+	EIMSK |= (1<<INT0);
 
 	return true;
 }
 
 // ----------------------------------------------------------------------------
-// check if there are any new messages waiting
+// check if there are any new messages waiting in the receive ring buffer
 
 uint8_t mcp2515_check_message(void) {
-	return (!IS_SET(MCP2515_INT));
+	return (rx_head != rx_tail);
 }
 
 // ----------------------------------------------------------------------------
-// check if there is a free buffer to send messages
+// request an operation mode via CANCTRL.REQOP and wait until CANSTAT.OPMOD reports it
 
-uint8_t mcp2515_check_free_buffer(void)
+static uint8_t mcp2515_set_mode(uint8_t mode)
 {
-	uint8_t status = mcp2515_read_status(SPI_READ_STATUS);
+	uint8_t retry = 255;
 	
-	if ((status & 0x54) == 0x54) {
-		// all buffers used
+	mcp2515_bit_modify(CANCTRL, (1<<REQOP2)|(1<<REQOP1)|(1<<REQOP0), mode);
+	while ((mcp2515_read_register(CANSTAT) & ((1<<OPMOD2)|(1<<OPMOD1)|(1<<OPMOD0))) != mode) {
+		if (--retry == 0) {
+			return false;
+		}
+	}
+	return true;
+}
+
+// ----------------------------------------------------------------------------
+// convert an id (11 or 29 bit, CAN_ID_EXT set) into the register image SIDH,
+// SIDL, EID8 and EID0 of a buffer, filter or mask. Only single bytes are
+// shifted, no 32-bit shift loops.
+//
+// Deliberately at runtime, also for the constant ids of the PROGMEM
+// templates: tCANFrame (can.h) holds the id independent of the controller,
+// and every message goes through the queue, which stores only the id. A
+// precomputed register image would need 4 more bytes per slot in tx_pool.
+// Packing costs about 30 cycles, loading the buffer over SPI for 8 data
+// bytes about 280.
+
+static void mcp2515_pack_id(uint8_t *regs, uint32_t id)
+{
+	if (id & CAN_ID_EXT) {
+		uint8_t b2 = (uint8_t)(id >> 16);
+		
+		regs[0] = ((uint8_t)(id >> 24) << 3) | (b2 >> 5);
+		regs[1] = ((b2 << 3) & 0xe0) | (1<<EXIDE) | (b2 & 0x03);
+		regs[2] = (uint8_t)(id >> 8);
+		regs[3] = (uint8_t)id;
+	}
+	else {
+		uint16_t sid = (uint16_t)id;
+		
+		regs[0] = sid >> 3;
+		regs[1] = sid << 5;
+		regs[2] = 0;
+		regs[3] = 0;
+	}
+}
+
+// ----------------------------------------------------------------------------
+// convert the register image SIDH, SIDL, EID8, EID0 of a receive buffer into an id
+
+static uint32_t mcp2515_unpack_id(const uint8_t *regs)
+{
+	if (regs[1] & (1<<IDE)) {
+		uint8_t b2 = (regs[0] << 5) | ((regs[1] >> 3) & 0x1c) | (regs[1] & 0x03);
+		
+		return CAN_ID_EXT
+			| ((uint32_t)(regs[0] >> 3) << 24)
+			| ((uint32_t)b2 << 16)
+			| ((uint16_t)regs[2] << 8)
+			| regs[3];
+	}
+	return ((uint16_t)regs[0] << 3) | (regs[1] >> 5);
+}
+
+// ----------------------------------------------------------------------------
+/* Program the acceptance filters RXF0..RXF5 and masks RXM0/RXM1 from a table
+ * of wanted ids, so that unwanted messages are already dropped in the
+ * MCP2515 and cause neither INT nor SPI traffic.
+ * Extended ids are given with CAN_ID_EXT set.
+ *
+ * - count == 0:  filters off, all messages are received
+ * - count <= 6:  every id gets a filter of its own with an exact mask
+ * - count  > 6:  ids[0] and ids[1] exact in RXB0, for all further ids RXM1
+ *                is set to the bits they have in common. Some unwanted
+ *                ids may then pass as well, so the application still has
+ *                to check the id.
+ *
+ * For standard messages the MCP2515 compares the EID bits of the mask with
+ * the first two data bytes. If a filter group holds a standard id, the EID
+ * bits of its mask are therefore masked out; extended ids in that group
+ * are then only told apart by their upper 11 bits.
+ *
+ * The order of the table sets the priority: the first two ids go to RXB0,
+ * which rolls over into RXB1 when full (BUKT). */
+uint8_t mcp2515_set_filters(const uint32_t *ids, uint8_t count)
+{
+	static const uint8_t filter_adress[6] PROGMEM = { RXF0SIDH, RXF1SIDH, RXF2SIDH, RXF3SIDH, RXF4SIDH, RXF5SIDH };
+	uint8_t filter[6][4];
+	uint8_t mask[2][4];
+	uint8_t i, j;
+	
+	if (!mcp2515_set_mode(1<<REQOP2)) {
 		return false;
 	}
 	
-	return true;
+	if (count == 0) {
+		// turn off filters => receive any message
+		mcp2515_write_register(RXB0CTRL, (1<<RXM1)|(1<<RXM0));
+		mcp2515_write_register(RXB1CTRL, (1<<RXM1)|(1<<RXM0));
+	}
+	else {
+		// unused filters repeat the table instead of letting everything pass
+		for (i = 0; i < 6; i++) {
+			mcp2515_pack_id(filter[i], ids[i < count ? i : i % count]);
+		}
+		
+		// exact masks (all implemented bits), group 0 = RXF0..1, group 1 = RXF2..5
+		for (j = 0; j < 2; j++) {
+			mask[j][0] = 0xff;
+			mask[j][1] = 0xe3;
+			mask[j][2] = 0xff;
+			mask[j][3] = 0xff;
+		}
+		
+		if (count > 6) {
+			// compare only the bits in which all ids from ids[2] on agree
+			uint8_t regs[4];
+			
+			for (i = 3; i < count; i++) {
+				mcp2515_pack_id(regs, ids[i]);
+				for (j = 0; j < 4; j++) {
+					mask[1][j] &= ~(regs[j] ^ filter[2][j]);
+				}
+			}
+			
+			// EXIDE is compared regardless of the mask: if one kind (standard/
+			// extended) only occurs in ids[6..], it needs RXF5
+			for (i = 6; i < count; i++) {
+				uint8_t exide = (ids[i] & CAN_ID_EXT) ? (1<<EXIDE) : 0;
+				
+				for (j = 2; j < 6; j++) {
+					if ((filter[j][1] & (1<<EXIDE)) == exide) {
+						break;
+					}
+				}
+				if (j == 6) {
+					mcp2515_pack_id(filter[5], ids[i]);
+				}
+			}
+		}
+		
+		// compare groups with standard ids on the 11 bit SID only
+		for (i = 0; i < count; i++) {
+			if (!(ids[i] & CAN_ID_EXT)) {
+				j = (i < 2) ? 0 : 1;
+				mask[j][1] &= 0xe0;
+				mask[j][2] = 0;
+				mask[j][3] = 0;
+			}
+		}
+		
+		mcp2515_write_registers(RXM0SIDH, mask[0], 4);
+		mcp2515_write_registers(RXM1SIDH, mask[1], 4);
+		for (i = 0; i < 6; i++) {
+			mcp2515_write_registers(pgm_read_byte(&filter_adress[i]), filter[i], 4);
+		}
+		
+		// only valid messages matching the filters, RXB0 rolls over into RXB1
+		mcp2515_write_register(RXB0CTRL, (1<<BUKT));
+		mcp2515_write_register(RXB1CTRL, 0);
+	}
+	
+	return mcp2515_set_mode(0);
 }
 
 // ----------------------------------------------------------------------------
-void mcp2515_get_message(tCAN *message)
+// check if there is a free place in the transmit queue
+
+uint8_t mcp2515_check_free_buffer(void)
+{
+	return (tx_free_count != 0);
+}
+
+// ----------------------------------------------------------------------------
+// read a message from RXB0 or RXB1 of the MCP2515 (called from the ISR only).
+// status is the result of SPI_READ_STATUS, bit 0 = RX0IF, bit 1 = RX1IF.
+static void mcp2515_read_rx_buffer(tCANFrame *message, uint8_t status)
 {
-	// read status
-	uint8_t status = mcp2515_read_status(SPI_RX_STATUS);
 	uint8_t addr;
-	uint8_t t;
-	if (bit_is_set(status,6)) {
+	
+	if (bit_is_set(status,0)) {
 		// message in buffer 0
 		addr = SPI_READ_RX;
 	}
-	else if (bit_is_set(status,7)) {
+	else {
 		// message in buffer 1
 		addr = SPI_READ_RX | 0x04;
 	}
-	else {
-		// Error: no message available
-		return;
-	}
 
+	// read SIDH, SIDL, EID8, EID0 and DLC in one block
+	uint8_t header[5];
+	
 	RESET(MCP2515_CS);
 	spi_putc(addr);
+	spi_read_block(header, sizeof(header));
 	
-	// read id
-	message->id  = (uint16_t) spi_putc(0xff) << 3;
-	message->id |=            spi_putc(0xff) >> 5;
-	
-	spi_putc(0xff);
-	spi_putc(0xff);
+	// read id (11 or 29 bit)
+	message->id = mcp2515_unpack_id(header);
 	
 	// read DLC
-	uint8_t length = spi_putc(0xff) & 0x0f;
+	uint8_t length = header[4] & 0x0f;
+	if (length > 8) {
+		length = 8;
+	}
 	
-	message->header.length = length;
-	message->header.rtr = (bit_is_set(status, 3)) ? 1 : 0;
+	message->length = length;
 	
-	// read data
-	for (t=0;t<length;t++) {
-		message->data[t] = spi_putc(0xff);
+	// remote frame: SRR in SIDL for standard ids, RTR in DLC for extended ids
+	if (bit_is_set(header[1], IDE)) {
+		message->flags = (bit_is_set(header[4], RTR)) ? CAN_FRAME_RTR : 0;
+	}
+	else {
+		message->flags = (bit_is_set(header[1], SRR)) ? CAN_FRAME_RTR : 0;
 	}
+	
+	// read data
+	spi_read_block(message->data, length);
+	
+	// SPI_READ_RX clears RXnIF itself as soon as CS is HIGH again, so no
+	// separate bit modify on CANINTF is needed.
 	SET(MCP2515_CS);
+}
+
+// ----------------------------------------------------------------------------
+/* Sort key for arbitration: a smaller key means a higher priority.
+ * As on the bus the 11 bit base id is compared first; with equal base ids
+ * the standard message wins over the extended one. */
+static uint32_t mcp2515_tx_key(uint32_t id)
+{
+	if (id & CAN_ID_EXT) {
+		return ((id & 0x1ffc0000UL) << 1) | 0x00040000UL | (id & 0x0003ffffUL);
+	}
+	return id << 19;
+}
+
+#if TRACE_ENABLE
+// ----------------------------------------------------------------------------
+/* Recover the id from the sort key (bit 18 marks extended ids) */
+static uint32_t mcp2515_tx_key_id(uint32_t key)
+{
+	if (key & 0x00040000UL) {
+		return ((key >> 1) & 0x1ffc0000UL) | (key & 0x0003ffffUL) | CAN_ID_EXT;
+	}
+	return key >> 19;
+}
+#endif
+
+// ----------------------------------------------------------------------------
+/* Load transmit buffer TXBn with a message and priority txp and send it.
+ * If txp is already in TXBnCTRL, LOAD TX BUFFER from SIDH is enough,
+ * otherwise a WRITE from TXBnCTRL writes the priority in the same access. */
+static void mcp2515_load_tx_buffer(uint8_t buffer, const tCANFrame *message, uint8_t txp)
+{
+	/* command, SIDH..DLC and the data straight from the queue without a gap
+	 * in one chip select window */
+	uint8_t header[8];			// SPI_WRITE, address TXBnCTRL, TXBnCTRL, SIDH..DLC
+	uint8_t *start;
+	uint8_t length = message->length & 0x0f;
+	
+	mcp2515_pack_id(&header[3], message->id);
+	
+	if (message->flags & CAN_FRAME_RTR) {
+		// a rtr-frame has a length, but contains no data
+		header[7] = (1<<RTR) | length;
+		length = 0;
+	}
+	else {
+		// set message length
+		header[7] = length;
+		if (length > 8) {
+			length = 8;
+		}
+	}
 	
-	// clear interrupt flag
-	if (bit_is_set(status, 6)) {
-		mcp2515_bit_modify(CANINTF, (1<<RX0IF), 0);
+	if (tx_hw_txp[buffer] != txp) {
+		header[0] = SPI_WRITE;
+		header[1] = TXB0CTRL + (buffer << 4);
+		header[2] = txp;					// TXREQ stays 0 until the RTS
+		start = &header[0];
+		tx_hw_txp[buffer] = txp;
 	}
 	else {
-		mcp2515_bit_modify(CANINTF, (1<<RX1IF), 0);
+		header[2] = SPI_WRITE_TX | (buffer << 1);
+		start = &header[2];
 	}
 	
-	//return (status & 0x07) + 1;
+	RESET(MCP2515_CS);
+	spi_write_frame(start, &header[sizeof(header)] - start, message->data, length);
+	SET(MCP2515_CS);
+	
+	// send message: RTS right afterwards, the minimum CS high time of the
+	// MCP2515 (50 ns) is already met by one instruction cycle
+	RESET(MCP2515_CS);
+	spi_putc(SPI_RTS | (1 << buffer));
+	SET(MCP2515_CS);
 }
 
 // ----------------------------------------------------------------------------
-
-uint8_t mcp2515_send_message(tCAN *message)
+/* Refill free transmit buffers from the queue (ISR, or task with INT0
+ * disabled). status is the result of SPI_READ_STATUS:
+ *
+ * Bit	Function
+ *  2	TXB0CNTRL.TXREQ
+ *  4	TXB1CNTRL.TXREQ
+ *  6	TXB2CNTRL.TXREQ
+ *
+ * Before the RTS the TXP bits of all used buffers and the new one are
+ * assigned by id (highest priority = TXP 3), so that the MCP2515 always
+ * sends the most important message into arbitration first. With equal ids
+ * the message loaded first is preferred. Only a changed TXP is written;
+ * TXP stays in TXBnCTRL beyond the transmission. */
+static void mcp2515_tx_refill(uint8_t status)
 {
-	uint8_t status = mcp2515_read_status(SPI_READ_STATUS);
+	uint8_t age[3];
+	uint8_t buffer, b, other, rank, txp, load_txp = 0, slot;
 	
-	/* Statusbyte:
-	 *
-	 * Bit	Function
-	 *  2	TXB0CNTRL.TXREQ
-	 *  4	TXB1CNTRL.TXREQ
-	 *  6	TXB2CNTRL.TXREQ
-	 */
-	uint8_t address;
-	uint8_t t;
+	if (bus_off) {
+		return;
+	}
 	
-	if (bit_is_clear(status, 2)) {
-		address = 0x00;
+	while (tx_count != 0) {
+		if (bit_is_clear(status, 2)) {
+			buffer = 0;
+		}
+		else if (bit_is_clear(status, 4)) {
+			buffer = 1;
+		}
+		else if (bit_is_clear(status, 6)) {
+			buffer = 2;
+		}
+		else {
+			// all buffer used
+			return;
+		}
+		status |= (1 << (2 + 2*buffer));
+		
+		// the message with the highest priority is at the end of the queue
+		tx_count--;
+		slot = tx_order[tx_count];
+		tx_hw_key[buffer] = mcp2515_tx_key(tx_pool[slot].id);
+		
+		// renumber the age of the other used buffers: a message that has waited
+		// long thus always stays older than a newly loaded one, without any
+		// counter overflowing
+		for (b = 0; b < 3; b++) {
+			age[b] = 0;
+			if (b == buffer || bit_is_clear(status, 2 + 2*b)) {
+				continue;
+			}
+			age[b] = 1;
+			for (other = 0; other < 3; other++) {
+				if (other != buffer && other != b && bit_is_set(status, 2 + 2*other)
+					&& tx_hw_age[other] < tx_hw_age[b]) {
+					age[b]++;
+				}
+			}
+		}
+		for (b = 0; b < 3; b++) {
+			tx_hw_age[b] = age[b];
+		}
+		
+		for (b = 0; b < 3; b++) {
+			if (bit_is_clear(status, 2 + 2*b)) {
+				continue;
+			}
+			rank = 0;
+			for (other = 0; other < 3; other++) {
+				if (other == b || bit_is_clear(status, 2 + 2*other)) {
+					continue;
+				}
+				if (tx_hw_key[other] < tx_hw_key[b]
+					|| (tx_hw_key[other] == tx_hw_key[b] && tx_hw_age[other] > tx_hw_age[b])) {
+					rank++;
+				}
+			}
+			txp = 3 - rank;
+			if (b == buffer) {
+				load_txp = txp;					// TXP of the new buffer when loading
+			}
+			else if (tx_hw_txp[b] != txp) {
+				mcp2515_bit_modify(TXB0CTRL + (b << 4), (1<<TXP1)|(1<<TXP0), txp);
+				tx_hw_txp[b] = txp;
+			}
+		}
+		mcp2515_load_tx_buffer(buffer, &tx_pool[slot], load_txp);
+		tx_free[tx_free_count++] = slot;
+	}
+}
+
+// ----------------------------------------------------------------------------
+/* Error state from EFLG */
+static uint8_t mcp2515_error_state(uint8_t eflg)
+{
+	if (eflg & (1<<TXBO)) {
+		return MCP2515_BUS_OFF;
 	}
-	else if (bit_is_clear(status, 4)) {
-		address = 0x02;
-	} 
-	else if (bit_is_clear(status, 6)) {
-		address = 0x04;
+	if (eflg & ((1<<TXEP)|(1<<RXEP))) {
+		return MCP2515_ERROR_PASSIVE;
 	}
-	else {
-		// all buffer used => could not send message
-		return 0;
+	if (eflg & (1<<EWARN)) {
+		return MCP2515_ERROR_WARNING;
 	}
+	return MCP2515_ERROR_ACTIVE;
+}
+
+// ----------------------------------------------------------------------------
+/* Read TEC, REC and EFLG, acknowledge the overflow bits and report state
+ * changes (ISR, or task with INT0 disabled). On the change to bus-off the
+ * used transmit buffers are aborted with ABAT: otherwise the MCP2515 repeats
+ * them right after recovery (128 x 11 recessive bits) and, with a
+ * persistent fault, runs straight back into bus-off. */
+static void mcp2515_error_update(void)
+{
+	uint8_t counters[2];
+	uint8_t eflg, state, old_state;
 	
 	RESET(MCP2515_CS);
-	spi_putc(SPI_WRITE_TX | address);
+	spi_putc(SPI_READ);
+	spi_putc(TEC);
+	spi_read_block(counters, 2);
+	SET(MCP2515_CS);
+	eflg = mcp2515_read_register(EFLG);
 	
-	spi_putc(message->id >> 3);
-    spi_putc(message->id << 5);
+	if (eflg & ((1<<RX1OVR)|(1<<RX0OVR))) {
+		// message lost in the MCP2515 (RXBn not yet read)
+		error_status.rx_hw_overflow += ((eflg >> RX1OVR) & 1) + ((eflg >> RX0OVR) & 1);
+		mcp2515_bit_modify(EFLG, (1<<RX1OVR)|(1<<RX0OVR), 0);
+	}
 	
-	spi_putc(0);
-	spi_putc(0);
+	error_status.eflg = eflg;
+	error_status.tec = counters[0];
+	error_status.rec = counters[1];
+	if (counters[0] > error_status.tec_max) {
+		error_status.tec_max = counters[0];
+	}
+	if (counters[1] > error_status.rec_max) {
+		error_status.rec_max = counters[1];
+	}
 	
-	uint8_t length = message->header.length & 0x0f;
+	state = mcp2515_error_state(eflg);
+	old_state = error_status.state;
+	if (state == old_state) {
+		return;
+	}
+	error_status.state = state;
+	error_status.transitions[state]++;
+	TRACE_CAN_ERROR(state, counters[0], counters[1]);
 	
-	if (message->header.rtr) {
-		// a rtr-frame has a length, but contains no data
-		spi_putc((1<<RTR) | length);
+	if (state == MCP2515_BUS_OFF && !bus_off) {
+		uint8_t status = mcp2515_read_status(SPI_READ_STATUS);
+		
+		// TXREQ of the three transmit buffers: bit 2, 4, 6
+		error_status.tx_aborted += ((status >> 2) & 1) + ((status >> 4) & 1) + ((status >> 6) & 1);
+		mcp2515_bit_modify(CANCTRL, (1<<ABAT), (1<<ABAT));
+		bus_off = 1;
+		bus_off_wait = bus_off_holdoff;
 	}
-	else {
-		// set message length
-		spi_putc(length);
+	if (error_notify) {
+		error_notify(old_state, state);
+	}
+}
+
+// ----------------------------------------------------------------------------
+/* Interrupt of the INT line: as long as the MCP2515 holds the INT line LOW,
+ * empty both receive buffers into the ring buffer and refill freed transmit
+ * buffers from the queue. If SPI_READ_STATUS shows neither reception nor
+ * transmission, only ERRIF can be pending; CANINTF is read in addition
+ * only in that case.
+ *
+ * SPI_READ_STATUS:	Bit 0 = RX0IF, Bit 1 = RX1IF, Bit 3 = TX0IF, Bit 5 = TX1IF, Bit 7 = TX2IF */
+
+ISR(INT0_vect)
+{
+	uint8_t received = 0;
+	
+	while (!IS_SET(MCP2515_INT))
+	{
+		uint8_t status = mcp2515_read_status(SPI_READ_STATUS);
 		
-		// data
-		for (t=0;t<length;t++) {
-			spi_putc(message->data[t]);
+		if (status & 0x03) {
+			if ((uint8_t)(rx_head - rx_tail) < MCP2515_RX_BUFFER_SIZE) {
+				mcp2515_read_rx_buffer(&rx_buffer[rx_head & RX_BUFFER_MASK], status);
+				TRACE_CAN_RX(rx_buffer[rx_head & RX_BUFFER_MASK].id,
+					rx_buffer[rx_head & RX_BUFFER_MASK].length);
+				rx_head++;
+				received = 1;
+			}
+			else {
+				// ring buffer full: drop the message unread so that the MCP2515
+				// can keep receiving, and count the loss. Only clear RXnIF, the
+				// data need not go over SPI.
+				mcp2515_bit_modify(CANINTF, bit_is_set(status,0) ? (1<<RX0IF) : (1<<RX1IF), 0);
+				rx_overflow++;
+			}
+		}
+		else if (status & 0xa8) {
+			// acknowledge TXnIF (CANINTF bit 2..4) and refill transmit buffers
+			uint8_t flags = ((status >> 1) & (1<<TX0IF))
+						  | ((status >> 2) & (1<<TX1IF))
+						  | ((status >> 3) & (1<<TX2IF));
+			mcp2515_bit_modify(CANINTF, flags, 0);
+#if TRACE_ENABLE
+			for (uint8_t b = 0; b < 3; b++) {
+				if (bit_is_set(status, 3 + 2*b)) {
+					TRACE_CAN_TX_DONE(mcp2515_tx_key_id(tx_hw_key[b]), b);
+				}
+			}
+#endif
+			mcp2515_tx_refill(status);
+		}
+		else {
+			if (!(mcp2515_read_register(CANINTF) & (1<<ERRIF))) {
+				break;
+			}
+			mcp2515_bit_modify(CANINTF, (1<<ERRIF), 0);
+			mcp2515_error_update();
 		}
 	}
-	SET(MCP2515_CS);
 	
-	_delay_us(1);
+	// once per interrupt, not per message. SetEvent() enables interrupts
+	// again; INT0 stays disabled meanwhile so that the ISR does not
+	// interrupt itself on the same task stack. An edge in that time is
+	// latched in INTF0 and only triggers the ISR again after the reti.
+	if (received && rx_notify) {
+		EIMSK &= ~(1<<INT0);
+		rx_notify();
+		cli();
+		EIMSK |= (1<<INT0);
+	}
+}
+
+// ----------------------------------------------------------------------------
+void mcp2515_set_rx_notify(void (*notify)(void))
+{
+	MCP2515_LOCK();
+	rx_notify = notify;
+	MCP2515_UNLOCK();
+}
+
+// ----------------------------------------------------------------------------
+uint8_t mcp2515_get_message(tCANFrame *frame)
+{
+	const tCANFrame *message = mcp2515_rx_peek();
 	
-	// send message
-	RESET(MCP2515_CS);
-	address = (address == 0) ? 1 : address;
-	spi_putc(SPI_RTS | address);
-	SET(MCP2515_CS);
+	if (!message) {
+		// no message available
+		return 0;
+	}
+	
+	memcpy(frame, message, offsetof(tCANFrame, data) + message->length);
+	mcp2515_rx_release();
 	
 	return 1;
 }
+
+// ----------------------------------------------------------------------------
+/* The slot at the tail of the ring buffer belongs to the task until rx_tail
+ * advances: the ISR only writes at rx_head while rx_head - rx_tail is
+ * less than the size. */
+const tCANFrame *mcp2515_rx_peek(void)
+{
+	uint8_t tail = rx_tail;
+	
+	if (tail == rx_head) {
+		return 0;
+	}
+	return &rx_buffer[tail & RX_BUFFER_MASK];
+}
+
+// ----------------------------------------------------------------------------
+void mcp2515_rx_release(void)
+{
+	uint8_t tail = rx_tail;
+	
+	if (tail != rx_head) {
+		rx_tail = tail + 1;
+	}
+}
+
+// ----------------------------------------------------------------------------
+uint16_t mcp2515_get_rx_overflow_count(void)
+{
+	uint16_t count;
+	
+	MCP2515_LOCK();
+	count = rx_overflow;
+	MCP2515_UNLOCK();
+	
+	return count;
+}
+
+// ----------------------------------------------------------------------------
+/* Lend a slot in tx_pool for a message with id id, with id, flags and
+ * length entered. If no slot is free, the queued message with the lowest
+ * priority is dropped; if the new one has no higher priority, it is
+ * dropped itself (NULL). A message the MCP2515 cannot send is dropped
+ * before it can evict another one. */
+tCANFrame *mcp2515_tx_alloc(uint32_t id, uint8_t flags, uint8_t length)
+{
+	uint32_t key = mcp2515_tx_key(id);
+	uint8_t i, slot;
+	
+	if ((flags & CAN_FRAME_FDF) || length > 8) {
+		// the MCP2515 only handles classic CAN
+		return 0;
+	}
+	
+	MCP2515_LOCK();
+	
+	if (bus_off) {
+		// during bus-off keep only the newest value per id, otherwise cyclic
+		// messages arrive stale after resuming: the slot of the waiting
+		// message is written again
+		for (i = 0; i < tx_count; i++) {
+			if (tx_pool[tx_order[i]].id == id) {
+				slot = tx_order[i];
+				goto unlink;
+			}
+		}
+	}
+	
+	if (tx_free_count != 0) {
+		slot = tx_free[--tx_free_count];
+		goto lend;
+	}
+	
+	tx_dropped++;
+	if (tx_count == 0 || mcp2515_tx_key(tx_pool[tx_order[0]].id) <= key) {
+		// all buffer used => could not send message
+		MCP2515_UNLOCK();
+		return 0;
+	}
+	// drop the lowest priority (index 0)
+	i = 0;
+	slot = tx_order[0];
+	
+unlink:
+	tx_count--;
+	for (; i < tx_count; i++) {
+		tx_order[i] = tx_order[i + 1];
+	}
+	
+lend:
+	MCP2515_UNLOCK();
+	
+	tx_pool[slot].id = id;
+	tx_pool[slot].flags = flags;
+	tx_pool[slot].length = length;
+	return &tx_pool[slot];
+}
+
+// ----------------------------------------------------------------------------
+/* Queue a message by priority (CAN id) and, if a transmit buffer is free,
+ * hand it to the MCP2515 right away. Only the slot numbers are sorted,
+ * the message stays where it is. */
+uint8_t mcp2515_tx_commit(tCANFrame *frame)
+{
+	uint8_t slot = frame - tx_pool;
+	uint32_t key = mcp2515_tx_key(frame->id);
+	uint8_t i;
+	
+	MCP2515_LOCK();
+	
+	if ((frame->flags & CAN_FRAME_FDF) || frame->length > 8) {
+		// changed after mcp2515_tx_alloc() to a format the MCP2515
+		// cannot send
+		tx_free[tx_free_count++] = slot;
+		MCP2515_UNLOCK();
+		return 0;
+	}
+	
+	/* tx_order is sorted by descending key, the next message to send is
+	 * at the end. The new message goes before all messages with equal or
+	 * higher priority. */
+	i = tx_count;
+	while (i > 0 && mcp2515_tx_key(tx_pool[tx_order[i - 1]].id) <= key) {
+		tx_order[i] = tx_order[i - 1];
+		i--;
+	}
+	tx_order[i] = slot;
+	tx_count++;
+	TRACE_CAN_TX_QUEUE(frame->id, frame->length);
+	
+	mcp2515_tx_refill(mcp2515_read_status(SPI_READ_STATUS));
+	
+	// message had to wait for a free transmit buffer
+	if (i < tx_count) {
+		tx_delayed++;
+	}
+	
+	MCP2515_UNLOCK();
+	
+	return 1;
+}
+
+// ----------------------------------------------------------------------------
+/* Like mcp2515_tx_alloc() and mcp2515_tx_commit() with a copy of the
+ * message. Returns 0 if it was dropped. */
+uint8_t mcp2515_send_message(const tCANFrame *frame)
+{
+	tCANFrame *slot = mcp2515_tx_alloc(frame->id, frame->flags, frame->length);
+	
+	if (!slot) {
+		return 0;
+	}
+	memcpy(slot, frame, offsetof(tCANFrame, data) + frame->length);
+	
+	return mcp2515_tx_commit(slot);
+}
+
+// ----------------------------------------------------------------------------
+uint16_t mcp2515_get_tx_dropped_count(void)
+{
+	uint16_t count;
+	
+	MCP2515_LOCK();
+	count = tx_dropped;
+	MCP2515_UNLOCK();
+	
+	return count;
+}
+
+// ----------------------------------------------------------------------------
+uint16_t mcp2515_get_tx_delayed_count(void)
+{
+	uint16_t count;
+	
+	MCP2515_LOCK();
+	count = tx_delayed;
+	MCP2515_UNLOCK();
+	
+	return count;
+}
+
+// ----------------------------------------------------------------------------
+void mcp2515_get_error_status(tCANErrorStatus *status)
+{
+	MCP2515_LOCK();
+	*status = error_status;
+	MCP2515_UNLOCK();
+}
+
+// ----------------------------------------------------------------------------
+void mcp2515_set_error_notify(void (*notify)(uint8_t old_state, uint8_t new_state))
+{
+	MCP2515_LOCK();
+	error_notify = notify;
+	MCP2515_UNLOCK();
+}
+
+// ----------------------------------------------------------------------------
+/* Refresh counters and state and resume transmission after a bus-off.
+ * The MCP2515 leaves bus-off by itself after 128 x 11 recessive bits;
+ * transmission only starts once the hold-off time has passed as well.
+ * If the node keeps running into bus-off with a persistent fault (e.g.
+ * missing termination), the hold-off time doubles and it only rarely
+ * occupies the bus with error frames. */
+void mcp2515_error_poll(uint16_t elapsed_ms)
+{
+	MCP2515_LOCK();
+	
+	if (mcp2515_read_register(CANINTF) & (1<<MERRF)) {
+		error_status.error_periods++;
+		mcp2515_bit_modify(CANINTF, (1<<MERRF), 0);
+	}
+	mcp2515_error_update();
+	
+	if (bus_off) {
+		if (bus_off_wait > elapsed_ms) {
+			bus_off_wait -= elapsed_ms;
+		}
+		else {
+			bus_off_wait = 0;
+			if (error_status.state != MCP2515_BUS_OFF) {
+				bus_off = 0;
+				bus_off_stable = 0;
+				error_status.recoveries++;
+				bus_off_holdoff = (bus_off_holdoff < MCP2515_BUS_OFF_HOLDOFF_MAX_MS / 2)
+					? bus_off_holdoff * 2 : MCP2515_BUS_OFF_HOLDOFF_MAX_MS;
+				mcp2515_bit_modify(CANCTRL, (1<<ABAT), 0);
+				mcp2515_tx_refill(mcp2515_read_status(SPI_READ_STATUS));
+			}
+		}
+	}
+	else if (bus_off_holdoff != MCP2515_BUS_OFF_HOLDOFF_MS) {
+		bus_off_stable += elapsed_ms;
+		if (bus_off_stable >= MCP2515_BUS_OFF_HOLDOFF_MAX_MS) {
+			bus_off_holdoff = MCP2515_BUS_OFF_HOLDOFF_MS;
+		}
+	}
+	
+	MCP2515_UNLOCK();
+}
+
+// ----------------------------------------------------------------------------
+const tCANOps mcp2515_can_ops PROGMEM = {
+	mcp2515_init,
+	mcp2515_set_filters,
+	mcp2515_send_message,
+	mcp2515_get_message,
+	mcp2515_rx_peek,
+	mcp2515_rx_release,
+	mcp2515_tx_alloc,
+	mcp2515_tx_commit,
+	mcp2515_set_rx_notify,
+	mcp2515_get_error_status,
+	mcp2515_set_error_notify,
+	mcp2515_error_poll,
+	8
+};
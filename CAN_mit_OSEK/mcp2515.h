@@ -41,25 +41,77 @@
 
 #include "mcp2515_defs.h"
 #include "global.h"
+#include "can.h"
 
-	typedef struct
-	{
-		uint16_t id;
-		struct 
-		{
-			int8_t rtr : 1;
-			uint8_t length : 4;
-		} header;
-		
-		uint8_t data[8];
-	} tCAN;
+	// ----------------------------------------------------------------------------
+	// number of messages in the receive ring buffer (must be a power of two <= 128),
+	// 14 bytes of RAM per message
+	#ifndef MCP2515_RX_BUFFER_SIZE
+	#define MCP2515_RX_BUFFER_SIZE	4
+	#endif
+
+	#if (MCP2515_RX_BUFFER_SIZE & (MCP2515_RX_BUFFER_SIZE - 1)) != 0 || MCP2515_RX_BUFFER_SIZE > 128
+	#error "MCP2515_RX_BUFFER_SIZE must be a power of two <= 128"
+	#endif
+
+	// ----------------------------------------------------------------------------
+	// receive load ceiling at 100 % bus load (holds from MCP2515_RX_BUFFER_SIZE 4,
+	// checked by host/mcp2515_bench rx): no message is lost up to
+	// MCP2515_RX_MAX_KBPS for any message length if rx_notify wakes the
+	// receiving task (CAN_RX_POLLING 0) and it empties the ring buffer within
+	// MCP2515_RX_MAX_LATENCY_US. If the task only polls periodically
+	// (CAN_RX_POLLING 1), at most MCP2515_RX_BUFFER_SIZE - 1 messages may
+	// arrive per period.
+	// Beyond that the ring buffer overflows (mcp2515_get_rx_overflow_count()),
+	// from about 800 kbit/s RXB0/RXB1 as well (RXnOVR): the INT0 interrupt
+	// takes about 130 us for a message with 8 data bytes.
+	#define MCP2515_RX_MAX_KBPS			250
+	#define MCP2515_RX_MAX_LATENCY_US	200
+
+	// ----------------------------------------------------------------------------
+	// number of messages in the transmit queue (in addition to TXB0..TXB2),
+	// 16 bytes of RAM per message
+	#ifndef MCP2515_TX_QUEUE_SIZE
+	#define MCP2515_TX_QUEUE_SIZE	4
+	#endif
+
+	// ----------------------------------------------------------------------------
+	// hold-off time in ms after a bus-off before transmitting again. It doubles
+	// with every further bus-off up to MCP2515_BUS_OFF_HOLDOFF_MAX_MS and drops
+	// back to the initial value once no bus-off occurred for that long.
+	#ifndef MCP2515_BUS_OFF_HOLDOFF_MS
+	#define MCP2515_BUS_OFF_HOLDOFF_MS		100
+	#endif
+	#ifndef MCP2515_BUS_OFF_HOLDOFF_MAX_MS
+	#define MCP2515_BUS_OFF_HOLDOFF_MAX_MS	3200
+	#endif
+
+	// ----------------------------------------------------------------------------
+	// error states of the MCP2515 (EFLG), same as CAN_ERROR_... in can.h
+	#define MCP2515_ERROR_ACTIVE	CAN_ERROR_ACTIVE	// TEC and REC < 96
+	#define MCP2515_ERROR_WARNING	CAN_ERROR_WARNING	// EWARN: TEC or REC >= 96
+	#define MCP2515_ERROR_PASSIVE	CAN_ERROR_PASSIVE	// TXEP/RXEP: TEC or REC >= 128
+	#define MCP2515_BUS_OFF			CAN_BUS_OFF			// TXBO: TEC > 255
+
+	// ----------------------------------------------------------------------------
+	// function table in flash for can_init() (can.h): the MCP2515 only handles classic
+	// CAN, mcp2515_send_message() rejects FD messages and lengths > 8
+	extern const tCANOps mcp2515_can_ops;
 
 	// ----------------------------------------------------------------------------
 	uint8_t spi_putc( uint8_t data );
 
+	// ----------------------------------------------------------------------------
+	// burst transfers of several bytes within one chip select window
+	void spi_write_block(const uint8_t *data, uint8_t length);
+	void spi_read_block(uint8_t *data, uint8_t length);
+
 	// ----------------------------------------------------------------------------
 	void mcp2515_write_register( uint8_t adress, uint8_t data );
 
+	// ----------------------------------------------------------------------------
+	void mcp2515_write_registers( uint8_t adress, const uint8_t *data, uint8_t length );
+
 	// ----------------------------------------------------------------------------
 	uint8_t mcp2515_read_register(uint8_t adress);
 
@@ -70,22 +122,88 @@
 	uint8_t mcp2515_read_status(uint8_t type);
 
 	// ----------------------------------------------------------------------------
-
-	uint8_t mcp2515_init(uint8_t speed);
+	// reset and configure the MCP2515 for bitrate in bit/s (CNF1..3 from
+	// mcp2515_timing.h), returns 0 if the bitrate cannot be reached or the chip
+	// does not answer
+	uint8_t mcp2515_init(uint32_t bitrate);
 
 	// ----------------------------------------------------------------------------
-	// check if there are any new messages waiting
+	// check if there are any new messages waiting in the receive ring buffer
 	uint8_t mcp2515_check_message(void);
 
 	// ----------------------------------------------------------------------------
-	// check if there is a free buffer to send messages
+	// program the acceptance filters RXF0..RXF5 and masks RXM0/RXM1 from a table
+	// of wanted ids (extended ids with CAN_ID_EXT), count == 0 turns the filters
+	// off (receive any message)
+	uint8_t mcp2515_set_filters(const uint32_t *ids, uint8_t count);
+
+	// ----------------------------------------------------------------------------
+	// check if there is a free place in the transmit queue
 	uint8_t mcp2515_check_free_buffer(void);
 
 	// ----------------------------------------------------------------------------
-	void mcp2515_get_message(tCAN *message);
+	// take the oldest message out of the receive ring buffer (non-blocking),
+	// returns 0 if no message is available
+	uint8_t mcp2515_get_message(tCANFrame *frame);
+
+	// ----------------------------------------------------------------------------
+	// oldest message in the receive ring buffer without copying it, NULL if none
+	// is available; the slot stays valid until mcp2515_rx_release()
+	const tCANFrame *mcp2515_rx_peek(void);
+	void mcp2515_rx_release(void);
+
+	// ----------------------------------------------------------------------------
+	// number of received messages dropped because the ring buffer was full
+	uint16_t mcp2515_get_rx_overflow_count(void);
+
+	// ----------------------------------------------------------------------------
+	// function called at the end of the INT0 interrupt if at least one message was
+	// put into the receive ring buffer (e.g. SetEvent() for the receiving task),
+	// NULL turns it off
+	void mcp2515_set_rx_notify(void (*notify)(void));
+
+	// ----------------------------------------------------------------------------
+	// queue a message by CAN id priority, it is handed to TXB0..TXB2 as soon as one
+	// is free. Returns 0 if the message was dropped because the queue was full
+	// or it is no classic CAN message (CAN_FRAME_FDF or length > 8).
+	uint8_t mcp2515_send_message(const tCANFrame *frame);
+
+	// ----------------------------------------------------------------------------
+	// lend a slot of the transmit queue for a message with this id, flags and
+	// length (already entered) to be filled in place, NULL if it was dropped like
+	// in mcp2515_send_message(). A message that is no classic CAN message is
+	// dropped before it can evict a queued one. During bus-off a queued message
+	// with the same id is handed out again. Every slot goes back with
+	// mcp2515_tx_commit(), which queues it (same return value as
+	// mcp2515_send_message()).
+	tCANFrame *mcp2515_tx_alloc(uint32_t id, uint8_t flags, uint8_t length);
+	uint8_t mcp2515_tx_commit(tCANFrame *frame);
+
+	// ----------------------------------------------------------------------------
+	// number of messages dropped because the transmit queue was full
+	uint16_t mcp2515_get_tx_dropped_count(void);
+
+	// ----------------------------------------------------------------------------
+	// number of messages that had to wait in the queue for a free transmit buffer
+	uint16_t mcp2515_get_tx_delayed_count(void);
+
+	// ----------------------------------------------------------------------------
+	// copy of the error counters, flags and statistics (ERRIF/MERRF interrupt and
+	// mcp2515_error_poll()): eflg is EFLG, error_periods counts MERRF,
+	// rx_hw_overflow RX0OVR/RX1OVR and tx_aborted the messages in TXB0..TXB2
+	void mcp2515_get_error_status(tCANErrorStatus *status);
+
+	// ----------------------------------------------------------------------------
+	// function called on every change of the error state, from the INT0 interrupt
+	// or from mcp2515_error_poll(), NULL turns it off
+	void mcp2515_set_error_notify(void (*notify)(uint8_t old_state, uint8_t new_state));
 
 	// ----------------------------------------------------------------------------
-	uint8_t mcp2515_send_message(tCAN *message);
+	// call periodically from a task, elapsed_ms since the last call: reads TEC, REC
+	// and EFLG (the return to error active raises no interrupt) and resumes
+	// transmission after bus-off once the MCP2515 has recovered and the hold-off
+	// time has passed
+	void mcp2515_error_poll(uint16_t elapsed_ms);
 
 
 #endif	// MCP2515_H
@@ -239,7 +239,7 @@
 /** \brief	Bitdefinition von EFLG */
 #define RX1OVR		7
 #define RX0OVR		6
-#define TXB0		5
+#define TXBO		5
 #define TXEP		4
 #define RXEP		3
 #define TXWAR		2
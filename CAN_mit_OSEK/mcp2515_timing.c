@@ -0,0 +1,83 @@
+/*
+ * mcp2515_timing.c
+ *
+ * Bit-Timing des MCP2515 berechnen, siehe mcp2515_timing.h.
+ */
+
+#include "mcp2515_timing.h"
+#include "mcp2515_defs.h"
+
+//---------------------------------------------------------------------------------------------
+uint8_t mcp2515_bit_timing(uint32_t osc, uint32_t bitrate, uint16_t sample_point, uint8_t cnf[3])
+{
+	uint32_t best_error = 0xffffffffUL;
+	uint16_t best_sp_error = 0xffff;
+	uint8_t best_n = 0, best_brp = 0, best_ps2 = 0;
+	uint8_t n, ps2, tseg1, ps1, prop, sjw;
+
+	if (bitrate == 0) {
+		return 0;
+	}
+
+	for (n = 25; n >= 8; n--) {
+		uint32_t div = 2 * bitrate * n;
+		uint32_t brp = (osc + div / 2) / div;
+		uint32_t rate, error;
+		uint16_t sp, sp_error;
+
+		if (brp < 1) {
+			brp = 1;
+		}
+		else if (brp > 64) {
+			continue;
+		}
+		rate = osc / (2 * brp * n);
+		error = (rate > bitrate) ? rate - bitrate : bitrate - rate;
+
+		// PS2 aus dem Abtastpunkt, gerundet auf ganze Quanten
+		ps2 = n - (uint8_t)((n * (uint32_t)sample_point + 500) / 1000);
+		if (ps2 < 2) {
+			ps2 = 2;
+		}
+		else if (ps2 > 8) {
+			ps2 = 8;
+		}
+		if (n - 1 - ps2 > 16) {
+			ps2 = n - 17;
+		}
+		if (n - 1 - ps2 < ps2) {
+			ps2 = (n - 1) / 2;
+		}
+		sp = (uint16_t)(1000UL * (n - ps2) / n);
+		sp_error = (sp > sample_point) ? sp - sample_point : sample_point - sp;
+
+		if (error < best_error || (error == best_error && sp_error < best_sp_error)) {
+			best_error = error;
+			best_sp_error = sp_error;
+			best_n = n;
+			best_brp = brp;
+			best_ps2 = ps2;
+		}
+	}
+
+	if (best_n == 0 || best_error * 1000 > bitrate * MCP2515_BITRATE_TOLERANCE) {
+		return 0;
+	}
+
+	// PropSeg bekommt bei ungerader Summe das Quant mehr (tseg1 <= 16)
+	tseg1 = best_n - 1 - best_ps2;
+	ps1 = tseg1 / 2;
+	prop = tseg1 - ps1;
+	sjw = 4;
+	if (sjw > ps1) {
+		sjw = ps1;
+	}
+	if (sjw > best_ps2) {
+		sjw = best_ps2;
+	}
+
+	cnf[0] = best_ps2 - 1;
+	cnf[1] = (1<<BTLMODE) | ((ps1 - 1) << 3) | (prop - 1);
+	cnf[2] = ((sjw - 1) << 6) | (best_brp - 1);
+	return 1;
+}
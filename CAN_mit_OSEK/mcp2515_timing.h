@@ -0,0 +1,50 @@
+/*
+ * mcp2515_timing.h
+ *
+ * Bit-Timing des MCP2515 aus Oszillator, Bitrate und gewuenschtem Abtastpunkt
+ * berechnen, statt CNF1..CNF3 je Bitrate und Quarz als Tabelle zu pflegen.
+ *
+ * Eine Bitzeit besteht aus N Zeitquanten TQ = 2 * (BRP + 1) / Fosc:
+ *
+ *   Sync (1) | PropSeg (1..8) | PS1 (1..8) | PS2 (2..8)      N = 8..25
+ *                                         ^ Abtastpunkt
+ *
+ * Gesucht wird ueber alle N: zuerst die kleinste Abweichung der Bitrate, dann
+ * der Abtastpunkt am naechsten zum gewuenschten, bei Gleichstand das groessere
+ * N (feinere Aufloesung fuer die Nachsynchronisation). Der Abschnitt vor dem
+ * Abtastpunkt wird zu gleichen Teilen auf PropSeg und PS1 verteilt, SJW ist
+ * so gross wie moeglich (hoechstens 4, PS1 und PS2). Es gelten die Regeln des
+ * Datenblatts: PropSeg + PS1 >= PS2, PS2 >= 2 (IPT), SJW <= PS2.
+ *
+ * Eine Berechnung sind 18 Durchlaeufe mit je vier 32-Bit-Divisionen, auf dem
+ * ATmega88PA gut 40000 Takte (etwa 12 ms); sie laeuft nur in mcp2515_init().
+ * Die Tabelle fuer beliebige Bitraten gibt host/bittiming.c aus.
+ */
+
+#ifndef MCP2515_TIMING_H_
+#define MCP2515_TIMING_H_
+
+#include <inttypes.h>
+
+/* Oszillator des MCP2515 auf der Platine in Hz */
+#ifndef MCP2515_OSC
+#define MCP2515_OSC				16000000UL
+#endif
+
+/* Gewuenschter Abtastpunkt in Promille der Bitzeit (CiA 301: 87,5 %) */
+#ifndef MCP2515_SAMPLE_POINT
+#define MCP2515_SAMPLE_POINT	875
+#endif
+
+/* Groesste zulaessige Abweichung der Bitrate in Promille */
+#ifndef MCP2515_BITRATE_TOLERANCE
+#define MCP2515_BITRATE_TOLERANCE	5
+#endif
+
+//---------------------------------------------------------------------------------------------
+/* CNF3, CNF2, CNF1 (Reihenfolge der Registeradressen ab CNF3) fuer bitrate in
+   bit/s und sample_point in Promille berechnen. Rueckgabe 0, wenn die Bitrate
+   mit osc nicht innerhalb MCP2515_BITRATE_TOLERANCE erreichbar ist. */
+uint8_t mcp2515_bit_timing(uint32_t osc, uint32_t bitrate, uint16_t sample_point, uint8_t cnf[3]);
+
+#endif /* MCP2515_TIMING_H_ */
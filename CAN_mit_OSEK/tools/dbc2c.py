@@ -0,0 +1,463 @@
+#!/usr/bin/env python3
+"""
+dbc2c.py - Erzeugt aus der CAN-Datenbasis (DBC) einen C-Header fuer die Firmware.
+
+Aufruf (aus CAN_mit_OSEK):
+
+    python3 tools/dbc2c.py ../Grosse_Aufgabe_Temperaturmessung/Datenbasis/Temperaturmessung.dbc \
+        --node Temperaturknoten -o can_db.h
+
+Erzeugt werden:
+
+- je Botschaft die ID (CAN_DB_<BOTSCHAFT>_ID), die Laenge in Byte (_DLC) und
+  ein Initialisierer fuer tCANFrame aus can.h (_INIT). Botschaften mit dem
+  Attribut VFrameFormat StandardCAN_FD oder ExtendedCAN_FD bekommen
+  CAN_FRAME_FDF (und CAN_FRAME_BRS bei CANFD_BRS 1) und bis zu 64 Byte
+- je Signal die Rohwerte aus VAL_ (CAN_DB_<SIGNAL>_<WERT>), Faktor und Offset
+  sowie die Funktionen can_db_pack_<signal>() und can_db_unpack_<signal>(). Sie
+  werden fuer jedes Signal aus Startbit, Laenge und Byte-Reihenfolge als feste
+  Folge von Schiebe- und Maskenoperationen je Byte erzeugt (ohne Schleifen und
+  Verzweigungen) und arbeiten auf dem Datenfeld (uint8_t[], 8 bzw. bei CAN FD
+  bis 64 Byte) der Nachricht, damit Firmware und Host-Werkzeuge sie
+  gleichermassen benutzen koennen
+- die Tabelle aller Signale (CAN_DB_SIGNAL_TABLE) als Initialisierer fuer
+  can_decode_signal aus host/can_decode.h, fuer die Auswertung auf dem Host
+- die Tabelle der Nachrichten, die der Knoten empfaengt (alle Botschaften mit
+  mindestens einem Signal, das an den Knoten geht). Sie wird von
+  can_set_filters() benutzt, um die Akzeptanzfilter zu programmieren.
+- der Zeitplan der zyklischen Nachrichten des Knotens (CAN_DB_SCHED_TABLE fuer
+  can_sched.h): alle Botschaften, die er sendet und die das Attribut
+  GenMsgCycleTime (ms) > 0 haben. Periode und Versatz sind in Ticks von
+  --tick-ms (Standard 10 ms). Den Versatz gibt GenMsgStartDelayTime vor; fehlt
+  es, wird er so gewaehlt, dass ueber die Hyperperiode (kgV aller Perioden) in
+  keinem Tick mehr Nachrichten als noetig faellig werden: zuerst die kurzen
+  Perioden, jeweils der Versatz mit der kleinsten Hoechstlast. Werden in einem
+  Tick mehr Nachrichten faellig, als der MCP2515 Sendepuffer hat (3), gibt es
+  eine Warnung. Die Tabelle verweist auf die Vorlage can_tx_<botschaft>
+  (PROGMEM) und die Funktion can_fill_<botschaft>(uint8_t *data), beide stellt
+  die Firmware.
+
+Die Funktionen rechnen mit Rohwerten; physikalischer Wert = Rohwert * FACTOR +
+OFFSET.
+"""
+
+import argparse
+import math
+import re
+import sys
+
+
+class Signal:
+    def __init__(self, name, start, length, little_endian, signed, factor, offset,
+                 minimum, maximum, unit, receivers):
+        self.name = name
+        self.start = start
+        self.length = length
+        self.little_endian = little_endian
+        self.signed = signed
+        self.factor = factor
+        self.offset = offset
+        self.minimum = minimum
+        self.maximum = maximum
+        self.unit = unit
+        self.receivers = receivers
+        self.values = []
+
+
+class Message:
+    def __init__(self, frame_id, name, dlc, transmitter):
+        self.frame_id = frame_id
+        self.name = name
+        self.dlc = dlc
+        self.transmitter = transmitter
+        self.signals = []
+        self.fd = False
+        self.brs = False
+        self.attributes = {}
+
+
+class Database:
+    def __init__(self):
+        self.nodes = []
+        self.messages = []
+        self.defaults = {}
+
+    def attribute(self, msg, name):
+        """Zahlenwert eines Attributs der Botschaft, sonst BA_DEF_DEF_ oder 0."""
+        return msg.attributes.get(name, self.defaults.get(name, 0))
+
+
+RE_BU = re.compile(r'^BU_\s*:(.*)$')
+RE_BO = re.compile(r'^BO_\s+(\d+)\s+(\w+)\s*:\s*(\d+)\s+(\w+)')
+RE_SG = re.compile(r'^SG_\s+(\w+)\s*:\s*(\d+)\|(\d+)@([01])([+-])\s*'
+                   r'\(([^,]+),([^)]+)\)\s*\[([^|]*)\|([^\]]*)\]\s*"([^"]*)"\s*(.*)$')
+RE_VAL = re.compile(r'^VAL_\s+(\d+)\s+(\w+)\s+(.*);$')
+RE_VAL_ENTRY = re.compile(r'(-?\d+)\s+"([^"]*)"')
+RE_BA_BO = re.compile(r'^BA_\s+"(\w+)"\s+BO_\s+(\d+)\s+(-?\d+)\s*;')
+RE_BA_DEF_DEF = re.compile(r'^BA_DEF_DEF_\s+"(\w+)"\s+(-?\d+)\s*;')
+
+# Sendepuffer des MCP2515: mehr gleichzeitig faellige Nachrichten warten in der
+# Warteschlange von mcp2515.c
+TX_BUFFERS = 3
+
+# VFrameFormat: 14 = StandardCAN_FD, 15 = ExtendedCAN_FD
+FRAME_FORMAT_FD = (14, 15)
+
+# Laengen, die ein DLC bei CAN FD darstellen kann (can_dlc_to_length())
+FD_LENGTHS = (0, 1, 2, 3, 4, 5, 6, 7, 8, 12, 16, 20, 24, 32, 48, 64)
+
+
+def parse_dbc(path):
+    db = Database()
+    message = None
+    with open(path, encoding='latin-1') as f:
+        for line in f:
+            line = line.strip()
+            m = RE_BU.match(line)
+            if m:
+                db.nodes = m.group(1).split()
+                continue
+            m = RE_BO.match(line)
+            if m:
+                message = Message(int(m.group(1)), m.group(2), int(m.group(3)), m.group(4))
+                db.messages.append(message)
+                continue
+            m = RE_SG.match(line)
+            if m and message is not None:
+                receivers = [r for r in re.split(r'[\s,]+', m.group(11)) if r]
+                message.signals.append(Signal(
+                    m.group(1), int(m.group(2)), int(m.group(3)),
+                    m.group(4) == '1', m.group(5) == '-',
+                    float(m.group(6)), float(m.group(7)),
+                    float(m.group(8)), float(m.group(9)), m.group(10), receivers))
+                continue
+            m = RE_VAL.match(line)
+            if m:
+                signal = find_signal(db, int(m.group(1)), m.group(2))
+                if signal is not None:
+                    signal.values = [(int(v), text) for v, text in RE_VAL_ENTRY.findall(m.group(3))]
+                continue
+            m = RE_BA_DEF_DEF.match(line)
+            if m:
+                db.defaults[m.group(1)] = int(m.group(2))
+                continue
+            m = RE_BA_BO.match(line)
+            if m:
+                msg = find_message(db, int(m.group(2)))
+                if msg is not None:
+                    msg.attributes[m.group(1)] = int(m.group(3))
+                if msg is not None and m.group(1) == 'VFrameFormat':
+                    msg.fd = int(m.group(3)) in FRAME_FORMAT_FD
+                elif msg is not None and m.group(1) == 'CANFD_BRS':
+                    msg.brs = int(m.group(3)) == 1
+                continue
+            if not line:
+                message = None
+    return db
+
+
+def find_message(db, frame_id):
+    for msg in db.messages:
+        if msg.frame_id == frame_id:
+            return msg
+    return None
+
+
+def find_signal(db, frame_id, name):
+    for msg in db.messages:
+        if msg.frame_id == frame_id:
+            for sig in msg.signals:
+                if sig.name == name:
+                    return sig
+    return None
+
+
+def c_id(frame_id):
+    """ID als C-Konstante, Extended IDs behalten wie in der DBC Bit 31 (CAN_ID_EXT)."""
+    if frame_id & 0x80000000:
+        return '0x%08XUL' % frame_id
+    return '0x%03XUL' % frame_id
+
+
+def c_name(text):
+    """Beliebigen Text (z.B. Wertbeschreibung aus VAL_) als Teil eines C-Namens."""
+    name = re.sub(r'[^0-9A-Za-z]+', '_', text).strip('_').upper()
+    return name if name and not name[0].isdigit() else '_' + name
+
+
+def c_number(value):
+    """Faktor bzw. Offset als C-Konstante (double)."""
+    text = repr(float(value))
+    return text if 'e' in text or '.' in text else text + '.0'
+
+
+def signal_type(sig):
+    """Kleinster C-Typ fuer den Rohwert."""
+    for bits in (8, 16, 32, 64):
+        if sig.length <= bits:
+            return ('int%d_t' if sig.signed else 'uint%d_t') % bits, bits
+    raise ValueError('Signal %s ist laenger als 64 Bit' % sig.name)
+
+
+def signal_bytes(sig, size):
+    """Lage des Signals im Datenfeld als Liste (Byte, erstes Bit, Anzahl Bits,
+    Bitposition im Rohwert). Intel (@1): Startbit ist das LSB, die Bits steigen
+    ueber die Bytegrenzen. Motorola (@0): Startbit ist das MSB, nach Bit 0 eines
+    Bytes geht es bei Bit 7 des naechsten Bytes weiter."""
+    positions = []
+    if sig.little_endian:
+        positions = [sig.start + i for i in range(sig.length)]
+    else:
+        pos = sig.start
+        msb_first = []
+        for _ in range(sig.length):
+            msb_first.append(pos)
+            pos = pos + 15 if pos % 8 == 0 else pos - 1
+        positions = list(reversed(msb_first))
+
+    runs = []
+    for raw_bit, pos in enumerate(positions):
+        byte, bit = divmod(pos, 8)
+        if byte >= size:
+            raise ValueError('Signal %s liegt ausserhalb von %d Datenbytes' % (sig.name, size))
+        if runs and runs[-1][0] == byte and runs[-1][1] + runs[-1][2] == bit:
+            runs[-1][2] += 1
+        else:
+            runs.append([byte, bit, 1, raw_bit])
+    return runs
+
+
+def generate_signal(sig, message):
+    out = []
+    ctype, bits = signal_type(sig)
+    utype = ctype.lstrip('u').replace('int', 'uint')
+    prefix = 'CAN_DB_%s' % sig.name.upper()
+    func = sig.name.lower()
+    runs = signal_bytes(sig, message.dlc)
+
+    out.append('/* %s.%s: Startbit %d, %d Bit, %s, %s, Faktor %g, Offset %g%s */'
+               % (message.name, sig.name, sig.start, sig.length,
+                  'Intel' if sig.little_endian else 'Motorola',
+                  'signed' if sig.signed else 'unsigned', sig.factor, sig.offset,
+                  ', Einheit ' + sig.unit if sig.unit else ''))
+    out.append('#define %s_FACTOR %s' % (prefix, c_number(sig.factor)))
+    out.append('#define %s_OFFSET %s' % (prefix, c_number(sig.offset)))
+    for value, text in sig.values:
+        out.append('#define %s_%s %d' % (prefix, c_name(text), value))
+    out.append('')
+
+    out.append('static inline void can_db_pack_%s(uint8_t *data, %s value)' % (func, ctype))
+    out.append('{')
+    if sig.signed:
+        out.append('\t%s raw = (%s)value;' % (utype, utype))
+    else:
+        out.append('\t%s raw = value;' % utype)
+    out.append('')
+    for byte, bit, count, raw_bit in runs:
+        mask = ((1 << count) - 1) << bit
+        shifted = '(raw >> %d)' % raw_bit if raw_bit else 'raw'
+        if count == 8:
+            out.append('\tdata[%d] = (uint8_t)%s;' % (byte, shifted))
+        else:
+            out.append('\tdata[%d] = (data[%d] & 0x%02X) | ((uint8_t)(%s << %d) & 0x%02X);'
+                       % (byte, byte, ~mask & 0xff, shifted, bit, mask))
+    out.append('}')
+    out.append('')
+
+    out.append('static inline %s can_db_unpack_%s(const uint8_t *data)' % (ctype, func))
+    out.append('{')
+    terms = []
+    for byte, bit, count, raw_bit in runs:
+        term = 'data[%d]' % byte
+        if bit:
+            term = '(%s >> %d)' % (term, bit)
+        if count < 8 and bit + count < 8:
+            term = '(%s & 0x%02X)' % (term, (1 << count) - 1)
+        if term != 'data[%d]' % byte or utype != 'uint8_t':
+            term = '(%s)%s' % (utype, term)
+        if raw_bit:
+            term = '(%s << %d)' % (term, raw_bit)
+        terms.append(term)
+    out.append('\t%s raw = %s' % (utype, terms[0]) + (';' if len(terms) == 1 else ''))
+    for i, term in enumerate(terms[1:], 2):
+        out.append('\t\t| %s%s' % (term, ';' if i == len(terms) else ''))
+    out.append('')
+    if sig.signed and sig.length < bits:
+        # Vorzeichen erweitern: Vorzeichenbit an die oberste Stelle schieben und
+        # arithmetisch zurueckschieben
+        out.append('\treturn (%s)((%s)(raw << %d) >> %d);' % (ctype, ctype, bits - sig.length, bits - sig.length))
+    elif sig.signed:
+        out.append('\treturn (%s)raw;' % ctype)
+    else:
+        out.append('\treturn raw;')
+    out.append('}')
+    out.append('')
+    return out
+
+
+def rx_messages(db, node):
+    return [msg for msg in db.messages
+            if any(node in sig.receivers for sig in msg.signals)]
+
+
+class Cyclic:
+    def __init__(self, msg, period, offset):
+        self.msg = msg
+        self.period = period
+        self.offset = offset
+
+
+def cyclic_messages(db, node, tick_ms):
+    """Zyklische Botschaften des Knotens mit Periode und Versatz in Ticks."""
+    cyclic = []
+    for msg in db.messages:
+        cycle_ms = db.attribute(msg, 'GenMsgCycleTime')
+        if msg.transmitter != node or cycle_ms <= 0:
+            continue
+        delay_ms = msg.attributes.get('GenMsgStartDelayTime')
+        for what, ms in (('GenMsgCycleTime', cycle_ms), ('GenMsgStartDelayTime', delay_ms or 0)):
+            if ms % tick_ms:
+                raise ValueError('Botschaft %s: %s %d ms ist kein Vielfaches von %d ms (--tick-ms)'
+                                 % (msg.name, what, ms, tick_ms))
+        if cycle_ms // tick_ms > 0xffff:
+            raise ValueError('Botschaft %s: GenMsgCycleTime %d ms ist zu lang' % (msg.name, cycle_ms))
+        period = cycle_ms // tick_ms
+        offset = None if delay_ms is None else (delay_ms // tick_ms) % period
+        cyclic.append(Cyclic(msg, period, offset))
+    return cyclic
+
+
+def spread_offsets(cyclic):
+    """Fehlende Versaetze waehlen, Rueckgabe: hoechste Zahl gleichzeitig
+    faelliger Nachrichten in einem Tick."""
+    if not cyclic:
+        return 0
+    hyper = 1
+    for c in cyclic:
+        hyper = hyper * c.period // math.gcd(hyper, c.period)
+    load = [0] * hyper
+    # vorgegebene Versaetze zuerst, dann die kurzen Perioden: sie treffen die
+    # meisten Ticks und haben die wenigsten Versaetze zur Auswahl
+    for c in sorted(cyclic, key=lambda c: (c.offset is None, c.period)):
+        if c.offset is None:
+            c.offset = min(range(c.period),
+                           key=lambda o: (max(load[o::c.period]), sum(load[o::c.period]), o))
+        for t in range(c.offset, hyper, c.period):
+            load[t] += 1
+    return max(load)
+
+
+def generate(db, node, dbc_name, tick_ms):
+    out = []
+    guard = 'CAN_DB_H'
+    out.append('/*')
+    out.append(' * can_db.h')
+    out.append(' *')
+    out.append(' * Automatisch erzeugt aus %s mit tools/dbc2c.py - nicht von Hand aendern!' % dbc_name)
+    out.append(' */')
+    out.append('')
+    out.append('#ifndef %s' % guard)
+    out.append('#define %s' % guard)
+    out.append('')
+    out.append('#include <stdint.h>')
+    out.append('')
+
+    for msg in db.messages:
+        if msg.dlc > 8 and not msg.fd:
+            raise ValueError('Botschaft %s: %d Byte nur mit CAN FD (VFrameFormat)' % (msg.name, msg.dlc))
+        if msg.dlc not in FD_LENGTHS:
+            raise ValueError('Botschaft %s: %d Byte ist keine CAN-FD-Laenge' % (msg.name, msg.dlc))
+
+    longest = max([msg.dlc for msg in db.messages] + [8])
+    if longest > 8:
+        out.append('#include "can.h"')
+        out.append('')
+        out.append('#if CAN_MAX_DLEN < %d' % longest)
+        out.append('#error "Botschaften mit CAN FD: CAN_FD_ENABLE 1 setzen (can.h)"')
+        out.append('#endif')
+        out.append('')
+
+    for msg in db.messages:
+        prefix = 'CAN_DB_%s' % msg.name.upper()
+        flags = '0'
+        if msg.fd:
+            flags = 'CAN_FRAME_FDF | CAN_FRAME_BRS' if msg.brs else 'CAN_FRAME_FDF'
+        out.append('/* Botschaft %s, gesendet von %s%s */'
+                   % (msg.name, msg.transmitter, ', CAN FD' if msg.fd else ''))
+        out.append('#define %s_ID %s' % (prefix, c_id(msg.frame_id)))
+        out.append('#define %s_DLC %d' % (prefix, msg.dlc))
+        out.append('#define %s_INIT { %s_ID, %s, %s_DLC, { 0 } }' % (prefix, prefix, flags, prefix))
+        out.append('')
+        for sig in msg.signals:
+            out.extend(generate_signal(sig, msg))
+
+    out.append('/* Alle Signale: Name, ID, Startbit, Laenge, Intel, signed, Faktor, Offset */')
+    out.append('#define CAN_DB_SIGNAL_COUNT %d' % sum(len(msg.signals) for msg in db.messages))
+    out.append('#define CAN_DB_SIGNAL_TABLE { \\')
+    for msg in db.messages:
+        for sig in msg.signals:
+            out.append('\t{ "%s", CAN_DB_%s_ID, %d, %d, %d, %d, %s, %s }, \\'
+                       % (sig.name, msg.name.upper(), sig.start, sig.length, int(sig.little_endian),
+                          int(sig.signed), c_number(sig.factor), c_number(sig.offset)))
+    out.append('}')
+    out.append('')
+
+    rx = rx_messages(db, node)
+    out.append('/* Nachrichten, die der Knoten %s empfaengt (Tabelle fuer can_set_filters()). */' % node)
+    out.append('#define CAN_DB_RX_FILTER_COUNT %d' % len(rx))
+    ids = ', '.join('%s /* %s */' % (c_id(msg.frame_id), msg.name) for msg in rx)
+    out.append('#define CAN_DB_RX_FILTER_IDS { %s }' % ids)
+    out.append('')
+
+    cyclic = cyclic_messages(db, node, tick_ms)
+    burst = spread_offsets(cyclic)
+    if burst > TX_BUFFERS:
+        sys.stderr.write('Warnung: %d zyklische Nachrichten im selben Tick, der MCP2515 hat %d Sendepuffer\n'
+                         % (burst, TX_BUFFERS))
+    out.append('/* Zyklische Nachrichten des Knotens %s (GenMsgCycleTime) fuer can_sched.h: Vorlage'
+               % node)
+    out.append('   can_tx_<botschaft>, Funktion can_fill_<botschaft>(), Periode und Versatz in Ticks.')
+    out.append('   Hoechstens CAN_DB_SCHED_BURST Nachrichten sind im selben Tick faellig. */')
+    out.append('#define CAN_DB_SCHED_TICK_MS %d' % tick_ms)
+    out.append('#define CAN_DB_SCHED_COUNT %d' % len(cyclic))
+    out.append('#define CAN_DB_SCHED_BURST %d' % burst)
+    for i, c in enumerate(cyclic):
+        out.append('#define CAN_DB_SCHED_%s %d' % (c.msg.name.upper(), i))
+    out.append('#define CAN_DB_SCHED_TABLE { \\')
+    for c in cyclic:
+        name = c.msg.name.lower()
+        out.append('\t{ &can_tx_%s, can_fill_%s, %d, %d }, /* %d ms, Versatz %d ms */ \\'
+                   % (name, name, c.period, c.offset, c.period * tick_ms, c.offset * tick_ms))
+    out.append('}')
+    out.append('')
+    out.append('#endif /* %s */' % guard)
+    out.append('')
+    return '\r\n'.join(out)
+
+
+def main():
+    parser = argparse.ArgumentParser(description='C-Header aus einer DBC-Datei erzeugen')
+    parser.add_argument('dbc', help='DBC-Datei')
+    parser.add_argument('--node', required=True, help='Name des Knotens (BU_) der Firmware')
+    parser.add_argument('-o', '--output', help='Ausgabedatei (Standard: stdout)')
+    parser.add_argument('--tick-ms', type=int, default=10,
+                        help='Tick des Zeitplans zyklischer Nachrichten in ms (Standard: 10)')
+    args = parser.parse_args()
+    if args.tick_ms <= 0:
+        sys.exit('--tick-ms muss groesser als 0 sein')
+
+    db = parse_dbc(args.dbc)
+    if args.node not in db.nodes:
+        sys.exit('Knoten %s ist in %s nicht definiert (BU_: %s)'
+                 % (args.node, args.dbc, ' '.join(db.nodes)))
+
+    text = generate(db, args.node, args.dbc.replace('\\', '/').split('/')[-1], args.tick_ms)
+    if args.output:
+        with open(args.output, 'w', newline='') as f:
+            f.write(text)
+    else:
+        sys.stdout.write(text)
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,243 @@
+#!/usr/bin/env python3
+"""
+trace_decode.py - Macht aus dem binaeren Trace der Firmware (Trace.h) eine
+lesbare Zeitleiste.
+
+Aufruf (aus CAN_mit_OSEK):
+
+    python3 tools/trace_decode.py mitschnitt.bin
+    python3 tools/trace_decode.py /dev/ttyUSB0 --baud 115200     (mit pyserial)
+
+Der Datenstrom besteht aus COBS-codierten Datensaetzen, jeder mit 0x00
+abgeschlossen:
+
+    Typ (1 Byte) | Zeitstempel (2 Byte, little-endian) | Nutzdaten
+
+Der Zeitstempel zaehlt in Schritten von 256 / F_CPU und laeuft alle 65536
+Schritte ueber; zwischen zwei Datensaetzen darf hoechstens ein Ueberlauf
+liegen (Task1 zeichnet mindestens alle 100 ms auf). Namen von Tasks und
+Alarmen stammen aus Os_Cfg.h, Namen der CAN-Nachrichten aus can_db.h. Text,
+den die Firmware zwischen den Datensaetzen ausgibt (USART_PutString(),
+Meldungen des OS), wird als solcher angezeigt.
+"""
+
+import argparse
+import os
+import re
+import struct
+import sys
+
+TRACE_EV_LOST = 0x01
+TRACE_EV_TASK_START = 0x02
+TRACE_EV_TASK_END = 0x03
+TRACE_EV_ALARM_SET = 0x04
+TRACE_EV_ALARM_CANCEL = 0x05
+TRACE_EV_CAN_RX = 0x06
+TRACE_EV_CAN_TX_QUEUE = 0x07
+TRACE_EV_CAN_TX_DONE = 0x08
+TRACE_EV_TWI_DONE = 0x09
+TRACE_EV_VALUE = 0x0a
+TRACE_EV_CAN_ERROR = 0x0b
+
+# Laenge der Nutzdaten je Typ
+PAYLOAD = {
+    TRACE_EV_LOST: 2,
+    TRACE_EV_TASK_START: 1,
+    TRACE_EV_TASK_END: 1,
+    TRACE_EV_ALARM_SET: 3,
+    TRACE_EV_ALARM_CANCEL: 1,
+    TRACE_EV_CAN_RX: 5,
+    TRACE_EV_CAN_TX_QUEUE: 5,
+    TRACE_EV_CAN_TX_DONE: 5,
+    TRACE_EV_TWI_DONE: 1,
+    TRACE_EV_VALUE: 3,
+    TRACE_EV_CAN_ERROR: 3,
+}
+
+CAN_ID_EXT = 0x80000000
+TWI_STATUS = {0: 'ok', 2: 'Fehler'}
+VALUE_NAMES = {1: ('temperatur', 0.125, 'Grad')}
+CAN_ERROR_STATES = {0: 'error active', 1: 'warning', 2: 'error passive', 3: 'bus-off'}
+
+HERE = os.path.dirname(os.path.abspath(__file__))
+
+
+def cobs_decode(frame):
+    """COBS-Rahmen ohne die abschliessende 0 decodieren, None bei Fehler."""
+    out = bytearray()
+    i = 0
+    while i < len(frame):
+        code = frame[i]
+        if code == 0 or i + code > len(frame):
+            return None
+        out += frame[i + 1:i + code]
+        i += code
+        if code < 0xff and i < len(frame):
+            out.append(0)
+    return bytes(out)
+
+
+def read_defines(path, pattern):
+    """#define NAME WERT aus einer Datei, als {WERT: NAME} fuer passende Namen."""
+    names = {}
+    if not path or not os.path.exists(path):
+        return names
+    with open(path, encoding='latin-1') as f:
+        for line in f:
+            m = re.match(r'\s*#define\s+(\w+)\s+(0x[0-9a-fA-F]+|\d+)U?L?\b', line)
+            if m and re.fullmatch(pattern, m.group(1)):
+                names[int(m.group(2), 0)] = m.group(1)
+    return names
+
+
+class Decoder:
+    def __init__(self, f_cpu, tasks, alarms, messages):
+        self.tick = 256.0 / f_cpu
+        self.tasks = tasks
+        self.alarms = alarms
+        self.messages = messages
+        self.last = None
+        self.base = 0
+        self.started = {}
+        self.count = {}
+        self.lost = 0
+        self.invalid = 0
+
+    def time(self, stamp):
+        # 16-Bit-Zeitstempel zu einer fortlaufenden Zeit zusammensetzen
+        if self.last is not None and stamp < self.last:
+            self.base += 0x10000
+        self.last = stamp
+        return (self.base + stamp) * self.tick
+
+    def can(self, payload):
+        can_id, value = struct.unpack('<IB', payload)
+        if can_id & CAN_ID_EXT:
+            text = '0x%08X' % (can_id & 0x1fffffff)
+        else:
+            text = '0x%03X' % can_id
+        name = self.messages.get(can_id & ~CAN_ID_EXT)
+        if name:
+            text += ' ' + name
+        return text, value
+
+    def record(self, data):
+        """Einen decodierten Datensatz als Zeile; None, wenn er ungueltig ist."""
+        if len(data) < 3 or data[0] not in PAYLOAD or len(data) != 3 + PAYLOAD[data[0]]:
+            return None
+        kind = data[0]
+        t = self.time(data[1] | data[2] << 8)
+        p = data[3:]
+        self.count[kind] = self.count.get(kind, 0) + 1
+
+        if kind == TRACE_EV_LOST:
+            n = p[0] | p[1] << 8
+            self.lost += n
+            text = '*** %u Datensaetze verworfen (Sendepuffer voll)' % n
+        elif kind == TRACE_EV_TASK_START:
+            self.started[p[0]] = t
+            text = '%s Start' % self.tasks.get(p[0], 'Task %u' % p[0])
+        elif kind == TRACE_EV_TASK_END:
+            text = '%s Ende' % self.tasks.get(p[0], 'Task %u' % p[0])
+            if p[0] in self.started:
+                text += ' (%.3f ms)' % ((t - self.started.pop(p[0])) * 1e3)
+        elif kind == TRACE_EV_ALARM_SET:
+            text = '%s gesetzt, Zyklus %u Ticks' % (self.alarms.get(p[0], 'Alarm %u' % p[0]),
+                                                    p[1] | p[2] << 8)
+        elif kind == TRACE_EV_ALARM_CANCEL:
+            text = '%s geloescht' % self.alarms.get(p[0], 'Alarm %u' % p[0])
+        elif kind == TRACE_EV_CAN_RX:
+            name, dlc = self.can(p)
+            text = 'CAN RX %s DLC %u' % (name, dlc)
+        elif kind == TRACE_EV_CAN_TX_QUEUE:
+            name, dlc = self.can(p)
+            text = 'CAN TX %s DLC %u eingereiht' % (name, dlc)
+        elif kind == TRACE_EV_CAN_TX_DONE:
+            name, buffer = self.can(p)
+            text = 'CAN TX %s gesendet (TXB%u)' % (name, buffer)
+        elif kind == TRACE_EV_TWI_DONE:
+            text = 'TWI fertig: %s' % TWI_STATUS.get(p[0], 'Status %u' % p[0])
+        elif kind == TRACE_EV_CAN_ERROR:
+            text = '*** CAN %s (TEC %u, REC %u)' % (CAN_ERROR_STATES.get(p[0], 'Zustand %u' % p[0]),
+                                                    p[1], p[2])
+        else:
+            value = p[1] | p[2] << 8
+            name, factor, unit = VALUE_NAMES.get(p[0], ('Wert %u' % p[0], 1, ''))
+            text = '%s = %u' % (name, value)
+            if factor != 1:
+                text += ' (%g %s)' % (value * factor, unit)
+        return '%12.6f s  %s' % (t, text)
+
+    def frame(self, frame):
+        """Alles zwischen zwei 0x00: Datensatz oder Text."""
+        if not frame:
+            return None
+        data = cobs_decode(frame)
+        line = self.record(data) if data is not None else None
+        if line is None:
+            self.invalid += 1
+            text = frame.decode('latin-1').strip()
+            printable = ''.join(c if c.isprintable() else '.' for c in text)
+            return '%12s    | %s' % ('', printable)
+        return line
+
+    def summary(self):
+        lines = ['', 'Datensaetze:']
+        names = {v: k for k, v in globals().items() if k.startswith('TRACE_EV_')}
+        for kind in sorted(self.count):
+            lines.append('  %-22s %8u' % (names[kind][9:], self.count[kind]))
+        lines.append('  verworfen              %8u' % self.lost)
+        lines.append('  Text/ungueltig         %8u' % self.invalid)
+        return '\n'.join(lines)
+
+
+def chunks(args):
+    if os.path.exists(args.input) and not args.input.startswith('/dev/'):
+        with open(args.input, 'rb') as f:
+            yield f.read()
+        return
+    if args.input == '-':
+        while True:
+            data = sys.stdin.buffer.read1(4096)
+            if not data:
+                return
+            yield data
+    import serial
+    with serial.Serial(args.input, args.baud) as port:
+        while True:
+            yield port.read(port.in_waiting or 1)
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Binaeren Trace der Firmware als Zeitleiste ausgeben')
+    parser.add_argument('input', help='Mitschnitt, - fuer stdin oder serielle Schnittstelle')
+    parser.add_argument('--baud', type=int, default=115200, help='Baudrate der seriellen Schnittstelle')
+    parser.add_argument('--f-cpu', type=float, default=3686400, help='Takt der Firmware in Hz')
+    parser.add_argument('--cfg', default=os.path.join(HERE, '..', 'Os_Cfg.h'), help='Os_Cfg.h (Task-Namen)')
+    parser.add_argument('--db', default=os.path.join(HERE, '..', 'can_db.h'), help='can_db.h (Nachrichten)')
+    parser.add_argument('--stats', action='store_true', help='am Ende Anzahl je Ereignistyp ausgeben')
+    args = parser.parse_args()
+
+    tasks = read_defines(args.cfg, r'\w*Task\w*')
+    alarms = read_defines(args.cfg, r'Alarm\w*')
+    messages = {k: v[len('CAN_DB_'):-len('_ID')].lower()
+                for k, v in read_defines(args.db, r'CAN_DB_\w+_ID').items()}
+    decoder = Decoder(args.f_cpu, tasks, alarms, messages)
+
+    pending = b''
+    try:
+        for data in chunks(args):
+            pending += data
+            *frames, pending = pending.split(b'\0')
+            for frame in frames:
+                line = decoder.frame(frame)
+                if line:
+                    print(line, flush=True)
+    except KeyboardInterrupt:
+        pass
+    if args.stats:
+        print(decoder.summary())
+
+
+if __name__ == '__main__':
+    main()